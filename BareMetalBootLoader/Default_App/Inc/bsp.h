@@ -2,11 +2,14 @@
 #define BSP_H_
 #include <stdint.h>
 #include <stdbool.h>
+#include "common_apis.h"
 
-void led_init();
-void led_on();
-void led_off();
-void button_init(void);
-bool get_btn_state(void);
+//driver of the bootloader, refer common_apis.h
+static inline void led_init(void){ COMMON_APIS->led_init(); }
+static inline void led_on(void){ COMMON_APIS->led_on(); }
+static inline void led_off(void){ COMMON_APIS->led_off(); }
+static inline void button_init(void){ COMMON_APIS->button_init(); }
+static inline void button_deinit(void){ COMMON_APIS->button_deinit(); }
+static inline bool get_btn_state(void){ return COMMON_APIS->get_btn_state(); }
 
 #endif /* BSP_H_ */
@@ -1,6 +1,9 @@
 #ifndef FPU_H_
 #define FPU_H_
 
-void fpu_enable(void);
+#include "common_apis.h"
+
+//driver of the bootloader, refer common_apis.h
+static inline void fpu_enable(void){ COMMON_APIS->fpu_enable(); }
 
 #endif /* FPU_H_ */
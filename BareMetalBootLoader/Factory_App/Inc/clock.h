@@ -0,0 +1,19 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include<stdint.h>
+#include "common_apis.h"
+
+#define CLOCK_HSI_FREQ 16000000U
+#define CLOCK_HSE_FREQ 8000000U//MCO of the on-board ST-LINK, HSE bypass
+#define CLOCK_SYSCLK_FREQ 100000000U
+
+//driver of the bootloader, refer common_apis.h
+static inline void clock_init(void){ COMMON_APIS->clock_init(); }
+static inline uint32_t clock_get_hclk(void){ return COMMON_APIS->clock_get_hclk(); }
+static inline uint32_t clock_get_pclk1(void){ return COMMON_APIS->clock_get_pclk1(); }
+static inline uint32_t clock_get_pclk2(void){ return COMMON_APIS->clock_get_pclk2(); }
+static inline void flash_art_enable(void){ COMMON_APIS->flash_art_enable(); }
+static inline void flash_art_reset(void){ COMMON_APIS->flash_art_reset(); }
+
+#endif /* CLOCK_H_ */
@@ -2,9 +2,12 @@
 #define TIMEBASE_H_
 
 #include<stdint.h>
+#include "common_apis.h"
 
-uint32_t get_tick(void);
-void delay(uint32_t delay);
-void timebase_init(void);
+//driver of the bootloader, refer common_apis.h. SysTick_Handler (timebase.c) feeds its counter
+static inline uint32_t get_tick(void){ return COMMON_APIS->get_tick(); }
+static inline void delay(uint32_t delay){ COMMON_APIS->delay(delay); }//in ms
+static inline void timebase_init(void){ COMMON_APIS->timebase_init(); }
+static inline void tick_increment(void){ COMMON_APIS->tick_increment(); }
 
 #endif /* TIMEBASE_H_ */
@@ -5,5 +5,19 @@
 
 #include "stm32f4xx.h"
 
-void debug_uart_init(void);
+/*
+ * behaviour of uart_dma_write when the transmit ring is full
+ */
+#define UART_TX_OVERFLOW_DROP 0
+#define UART_TX_OVERFLOW_BLOCK 1
+
+#ifndef UART_TX_RING_SIZE
+#define UART_TX_RING_SIZE 1024
+#endif
+
+void system_uart_init(void);
+void system_uart_dma_init(uint8_t policy);
+uint32_t uart_dma_write(const uint8_t *data, uint32_t len);
+void uart_dma_flush(void);
+uint32_t uart_dma_dropped(void);
 #endif /* UART_H_ */
@@ -2,30 +2,47 @@
 #include "fpu.h"
 #include <stdio.h>
 #include "timebase.h"
+#include "clock.h"
 #include "bsp.h"
+#include "boot_stats.h"
+#include "common_apis.h"
 
 
 #define GPIOAEN (1U<<0)
 #define PIN5 (1U<<5)
 #define LED_PIN PIN5
 
-#define FLASH_BASE_ADRRESS 0x08000000
-#define VECTOR_TABLE_BASE_ADDRESS FLASH_BASE_ADRRESS
-#define VECTOR_TABLE_OFFSET 0xC000
-
 typedef void(*func_ptr)(void);
 
+//filled by the bootloader before the jump, refer boot_stats.h
+volatile boot_stats_t g_boot_stats BOOT_STATS_SECTION;
+volatile boot_ctrl_t g_boot_ctrl BOOT_CTRL_SECTION;
+//reserves the RAM of the shared drivers, refer common_apis.h
+volatile common_apis_ram_t g_common_apis_ram COMMON_APIS_RAM_SECTION;
+
+//vector table of this image, placed by the linker script (startup_stm32f411retx.s)
+extern uint32_t g_pfnVectors[];
+
 //callback of reset handler, Automatically call
+//the bootloader already points VTOR here, this keeps a start from the debugger working
 void SystemInit(void){
-	SCB->VTOR = VECTOR_TABLE_BASE_ADDRESS|VECTOR_TABLE_OFFSET;
+	SCB->VTOR = (uint32_t)g_pfnVectors;
 }
 
 
 int main(){
 
+	//the drivers are in the bootloader: without a compatible table this image never confirms
+	//itself and the bootloader rolls back to the other slot
+	if (!common_apis_ok()) {
+		while(1){}
+	}
+
 	//enable Floating point
 	fpu_enable();
 
+	//run at 100 MHz, no-op when the bootloader already started the PLL
+	clock_init();
 
 	//enable timebase
 	timebase_init();
@@ -36,6 +53,9 @@ int main(){
 	//enable button
 	button_init();
 
+	//everything came up: keep this image, otherwise the bootloader rolls back after a few boots
+	boot_confirm((uint32_t)g_pfnVectors);
+
 	while(1){
 		printf("Factory application is running\n");
 		delay(1000);
@@ -7,6 +7,7 @@ void led_init();
 void led_on();
 void led_off();
 void button_init(void);
+void button_deinit(void);
 bool get_btn_state(void);
 
 #endif /* BSP_H_ */
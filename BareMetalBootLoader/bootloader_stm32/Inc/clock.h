@@ -0,0 +1,17 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include<stdint.h>
+
+#define CLOCK_HSI_FREQ 16000000U
+#define CLOCK_HSE_FREQ 8000000U//MCO of the on-board ST-LINK, HSE bypass
+#define CLOCK_SYSCLK_FREQ 100000000U
+
+void clock_init(void);
+uint32_t clock_get_hclk(void);
+uint32_t clock_get_pclk1(void);
+uint32_t clock_get_pclk2(void);
+void flash_art_enable(void);
+void flash_art_reset(void);
+
+#endif /* CLOCK_H_ */
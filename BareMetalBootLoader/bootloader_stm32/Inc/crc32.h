@@ -0,0 +1,28 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include<stdint.h>
+
+/*
+ * CRC-32/MPEG-2, the algorithm of the STM32 CRC unit: polynomial 0x04C11DB7, init 0xFFFFFFFF,
+ * no reflection, no final xor, data fed as 32-bit words (most significant byte first).
+ * On the target the CRC peripheral is used; building for another architecture (host tests) or
+ * with CRC32_SOFTWARE selects the table driven implementation, both give the same result.
+ */
+#if defined(__arm__) && !defined(CRC32_SOFTWARE)
+#define CRC32_USE_HW 1
+#else
+#define CRC32_USE_HW 0
+#endif
+
+#define CRC32_INIT 0xFFFFFFFFU
+
+void crc32_begin(void);
+void crc32_feed(const uint32_t *data, uint32_t words);
+void crc32_feed_word(uint32_t word);
+uint32_t crc32_end(void);
+#if !CRC32_USE_HW
+uint32_t crc32_sw_update(uint32_t crc, const uint32_t *data, uint32_t words);
+#endif
+
+#endif /* CRC32_H_ */
@@ -0,0 +1,34 @@
+#ifndef FLASH_H_
+#define FLASH_H_
+
+#include<stdint.h>
+
+/*
+ * Flash layout of the STM32F411xE: sectors 0-3 16KB, sector 4 64KB, sectors 5-7 128KB
+ */
+#define FLASH_SECTOR_COUNT 8U
+#define FLASH_SECTOR_NONE 0xFFU
+
+/*
+ * flash driver results
+ */
+#define FLASH_OK 0
+#define FLASH_ERR_PARAM 1
+#define FLASH_ERR_WRP 2//sector write protected
+#define FLASH_ERR_PROG 3//alignment, parallelism or sequence error reported by the controller
+#define FLASH_ERR_VERIFY 4//read back differs, the target was not erased
+
+/*
+ * Erase and program need VDD 2.7-3.6 V: program parallelism is x32 (PSIZE = 10).
+ * The CPU stalls on flash fetches while the controller is busy, DMA keeps running, so a UART
+ * receive into RAM continues during an erase or a program. The waits run from SRAM (ramfunc.h)
+ * so interrupt handlers in SRAM are served meanwhile.
+ */
+void flash_unlock(void);
+void flash_lock(void);
+uint8_t flash_sector_of(uint32_t addr);
+uint32_t flash_sector_base(uint8_t sector);
+uint8_t flash_erase_sector(uint8_t sector);
+uint8_t flash_program(uint32_t addr, const uint32_t *data, uint32_t words);
+
+#endif /* FLASH_H_ */
@@ -0,0 +1,9 @@
+#ifndef HANDOFF_H_
+#define HANDOFF_H_
+
+#include<stdint.h>
+
+void boot_handoff(uint32_t image_base) __attribute__((noreturn));
+void boot_vectors_to_ram(void);
+
+#endif /* HANDOFF_H_ */
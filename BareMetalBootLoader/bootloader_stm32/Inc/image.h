@@ -0,0 +1,43 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include<stdint.h>
+
+/*
+ * Image header, emitted by the .image_header section of the application linker scripts at
+ * IMAGE_HEADER_OFFSET from the image base (right behind the vector table).
+ * length covers the whole image from its base: vector table, header, code, rodata and .data
+ * initialisers. crc is CRC-32/MPEG-2 (crc32.h) over those length bytes with the crc word itself
+ * read as IMAGE_CRC_UNSIGNED; the linker leaves that value and tools/imgtool.py patches it.
+ */
+#define IMAGE_HEADER_OFFSET 0x200U
+#define IMAGE_MAGIC 0x31474D49U//"IMG1"
+#define IMAGE_CRC_UNSIGNED 0xFFFFFFFFU
+
+/*
+ * IMAGE_ALLOW_UNSIGNED 1 accepts an image whose crc was never patched (development builds
+ * flashed straight from the .elf); the rest of the header is still checked.
+ */
+#ifndef IMAGE_ALLOW_UNSIGNED
+#define IMAGE_ALLOW_UNSIGNED 0
+#endif
+
+typedef struct{
+	uint32_t magic;      /* IMAGE_MAGIC */
+	uint32_t length;     /* bytes from the image base, multiple of 4 */
+	uint32_t version;    /* major << 24 | minor << 16 | patch */
+	uint32_t crc;        /* CRC-32/MPEG-2 of the image, refer above */
+}image_header_t;
+
+/*
+ * image_verify results
+ */
+#define IMAGE_OK 0
+#define IMAGE_ERR_MAGIC 1
+#define IMAGE_ERR_LENGTH 2
+#define IMAGE_ERR_CRC 3
+
+uint8_t image_verify(uint32_t image_base, uint32_t slot_size);
+const image_header_t *image_header(uint32_t image_base);
+
+#endif /* IMAGE_H_ */
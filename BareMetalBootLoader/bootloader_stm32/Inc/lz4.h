@@ -0,0 +1,36 @@
+#ifndef LZ4_H_
+#define LZ4_H_
+
+#include<stdint.h>
+
+/*
+ * Streaming decoder for the LZ4 block format (tools/imgtool.py compresses with it).
+ * Input can be fed in pieces of any size, e.g. one update frame at a time; the decoder keeps
+ * only its state, no window: match bytes are read back from the output through get, which
+ * lets the output go straight to flash. Plain C without target headers, builds on the host.
+ */
+#define LZ4_OK 0
+#define LZ4_ERR_OFFSET 1//match offset 0 or before the start of the output
+#define LZ4_ERR_OVERFLOW 2//output larger than out_max
+
+typedef void (*lz4_put_fn)(void *ctx, uint8_t byte);
+typedef uint8_t (*lz4_get_fn)(void *ctx, uint32_t pos);
+
+typedef struct{
+	lz4_put_fn put;      /* appends a byte to the output */
+	lz4_get_fn get;      /* returns an output byte already put */
+	void *ctx;
+	uint32_t out_pos;    /* bytes put so far, plus the dictionary */
+	uint32_t out_max;
+	uint32_t count;      /* literal or match length being decoded */
+	uint16_t offset;
+	uint8_t token;
+	uint8_t state;
+}lz4_stream_t;
+
+void lz4_stream_init(lz4_stream_t *s, lz4_put_fn put, lz4_get_fn get, void *ctx, uint32_t out_max);
+void lz4_stream_dict(lz4_stream_t *s, uint32_t dict_size);
+uint8_t lz4_stream_feed(lz4_stream_t *s, const uint8_t *in, uint32_t len);
+uint8_t lz4_stream_complete(const lz4_stream_t *s);
+
+#endif /* LZ4_H_ */
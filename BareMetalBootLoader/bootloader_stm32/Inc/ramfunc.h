@@ -0,0 +1,16 @@
+#ifndef RAMFUNC_H_
+#define RAMFUNC_H_
+
+/*
+ * Code executed from SRAM: .ramfunc is copied by the startup code like .data (linker script).
+ * No flash wait states, and it keeps running while the flash controller erases or programs,
+ * when any fetch from flash stalls the CPU. long_call because SRAM is out of reach of a bl from
+ * flash. Callees stay in flash unless marked too.
+ */
+#ifdef __arm__
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call))
+#else
+#define RAMFUNC
+#endif
+
+#endif /* RAMFUNC_H_ */
@@ -0,0 +1,37 @@
+#ifndef SLOTS_H_
+#define SLOTS_H_
+
+#include<stdint.h>
+
+/*
+ * A/B image slots: A is the Default App sector, B the App1 sector, the Factory App is the
+ * fallback when neither A nor B can be started. Every slot is one 16KB sector ending with a
+ * trailer of two marker words which the image never covers:
+ *   slot end - 8: SLOT_MARK_CONFIRMED once the application confirmed itself (boot_stats.h)
+ *   slot end - 4: SLOT_MARK_REJECTED once it failed SLOT_MAX_ATTEMPTS boots unconfirmed
+ * Both are erased with the sector by an update, a freshly written image is pending.
+ * Among the A/B images that are valid and not rejected the highest version is started; a pending
+ * one is tried SLOT_MAX_ATTEMPTS times (counter in g_boot_ctrl) before it is rejected and the
+ * other slot runs again.
+ */
+#define SLOT_A_ADDRESS 0x08004000U
+#define SLOT_B_ADDRESS 0x08008000U
+#define SLOT_FACTORY_ADDRESS 0x0800C000U
+#define SLOT_SIZE 0x4000U
+#define SLOT_TRAILER_SIZE 8U
+#define SLOT_IMAGE_MAX (SLOT_SIZE - SLOT_TRAILER_SIZE)//largest image a slot takes
+
+#define SLOT_MARK_CONFIRMED 0x464E4F43U//"CONF"
+#define SLOT_MARK_REJECTED 0x544A4552U//"REJT"
+
+#ifndef SLOT_MAX_ATTEMPTS
+#define SLOT_MAX_ATTEMPTS 3U
+#endif
+
+typedef int (*slot_valid_fn)(uint32_t image_base);
+
+uint32_t slot_select(slot_valid_fn is_valid);
+uint32_t slot_update_target(void);
+void slot_forget(uint32_t image_base);
+
+#endif /* SLOTS_H_ */
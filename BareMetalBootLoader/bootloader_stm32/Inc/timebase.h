@@ -4,7 +4,8 @@
 #include<stdint.h>
 
 uint32_t get_tick(void);
-void delay(uint32_t delay);
+void delay(uint32_t delay);//in ms
 void timebase_init(void);
+void tick_increment(void);
 
 #endif /* TIMEBASE_H_ */
@@ -5,5 +5,33 @@
 
 #include "stm32f4xx.h"
 
+/*
+ * behaviour of uart_dma_write when the transmit ring is full
+ */
+#define UART_TX_OVERFLOW_DROP 0
+#define UART_TX_OVERFLOW_BLOCK 1
+
+#ifndef UART_TX_RING_SIZE
+#define UART_TX_RING_SIZE 1024
+#endif
+
+/* receive ring filled by circular DMA, must hold everything that arrives between two reads */
+#ifndef UART_RX_RING_SIZE
+#define UART_RX_RING_SIZE 1024
+#endif
+
+#define UART_RX_NONE (-1)
+
 void system_uart_init(void);
+void system_uart_dma_init(uint8_t policy);
+uint32_t uart_dma_write(const uint8_t *data, uint32_t len);
+void uart_dma_flush(void);
+uint32_t uart_dma_dropped(void);
+void uart_rx_dma_start(void);
+void uart_rx_dma_stop(void);
+int uart_getc(void);
+void uart_rx_dbm_start(uint8_t *buf0, uint8_t *buf1, uint32_t len);
+int uart_rx_dbm_poll(void);
+uint32_t uart_rx_dbm_pending(void);
+void uart_rx_drain(uint32_t idle_ms);
 #endif /* UART_H_ */
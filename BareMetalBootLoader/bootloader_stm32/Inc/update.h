@@ -0,0 +1,104 @@
+#ifndef UPDATE_H_
+#define UPDATE_H_
+
+#include<stdint.h>
+
+/*
+ * Firmware update over USART2 (115200 8N1), entered with 'u' from the bootloader menu.
+ *
+ * Every frame is UPD_FRAME_SIZE bytes, all fields little endian:
+ *   SOF(1) CMD(1) LEN(2) | payload (LEN valid bytes, multiple of 4, zero padded) | CRC32(4)
+ * CRC32 is CRC-32/MPEG-2 (crc32.h) over everything before it.
+ * Every frame is answered with update_reply_t: UPD_ACK or UPD_NACK, a UPD_x status and the
+ * offset the bootloader expects in the next DATA frame.
+ *
+ *   START  payload: slot address (0: the A/B slot not running, slots.h), image length,
+ *                   optionally @UPD_Flags and the stream length (compressed size),
+ *                   with UPD_FLAG_DELTA the source slot (0: the other A/B slot) and its image CRC
+ *                                                -> erases the slot sector, answered when done
+ *   DATA   payload: offset, data (<= UPD_CHUNK_SIZE) -> answered once the chunk is programmed
+ *   END    no payload                            -> header completed, image verified (image.h)
+ *                   and newer than the valid image in the other A/B slot
+ *   ABORT  no payload
+ *
+ * Frames are received by DMA into a ping-pong pair of buffers: one is programmed while the
+ * other fills. Flow control is an ACK window of UPD_WINDOW frames: the host may send frame n+2
+ * once frame n is acknowledged, so the link never idles while a chunk is programmed and no
+ * buffer is overwritten before it is done. START and END are sent alone.
+ * A bad frame (SOF, length, CRC, or a frame not completed within UPD_FRAME_TIMEOUT_MS) makes the
+ * bootloader wait for the line to go quiet, restart the reception and send a NACK; the host
+ * goes back to the offset of the NACK. DATA below that offset (ACK lost, host retried) is
+ * acknowledged again and not programmed.
+ * With UPD_FLAG_LZ4 the DATA frames carry the image compressed in the LZ4 block format (offsets
+ * count compressed bytes, the last frame is padded). It is decompressed as it arrives into a
+ * UPD_PAGE_SIZE buffer which is programmed when full; matches are read back from the flash.
+ * UPD_FLAG_DELTA (with UPD_FLAG_LZ4) makes the stream a patch against the image in the source
+ * slot: that image is the LZ4 dictionary, so unchanged code is a match into the source slot and
+ * only the changes travel. The source must pass image_verify and carry the announced CRC.
+ * The magic word of the image header is held back and programmed by END, so an interrupted
+ * update, or an image refused with UPD_ERR_VERSION, leaves a slot that fails at the magic
+ * check. The image is sent as signed by tools/imgtool.py.
+ */
+#define UPD_SOF 0x5AU
+
+#define UPD_CMD_START 0x01U
+#define UPD_CMD_DATA 0x02U
+#define UPD_CMD_END 0x03U
+#define UPD_CMD_ABORT 0x04U
+
+#define UPD_ACK 0x79U
+#define UPD_NACK 0x1FU
+
+/*
+ * @UPD_Status
+ */
+#define UPD_OK 0
+#define UPD_ERR_FRAME 1//bad length, incomplete frame
+#define UPD_ERR_CRC 2
+#define UPD_ERR_SEQ 3//unexpected offset or command
+#define UPD_ERR_PARAM 4//slot address or length not accepted
+#define UPD_ERR_FLASH 5//erase/program failed
+#define UPD_ERR_IMAGE 6//written image fails image_verify
+#define UPD_ERR_TIMEOUT 7
+#define UPD_ERR_ABORT 8
+#define UPD_ERR_DECODE 9//compressed stream corrupt or of the wrong size
+#define UPD_ERR_SOURCE 10//delta source slot invalid or not the image the patch was made for
+#define UPD_ERR_VERSION 11//image not newer than the one in the other A/B slot, it would never boot
+
+/*
+ * @UPD_Flags
+ */
+#define UPD_FLAG_LZ4 (1U<<0)
+#define UPD_FLAG_DELTA (1U<<1)
+
+#define UPD_CHUNK_SIZE 256U//data bytes per DATA frame
+#define UPD_MAX_PAYLOAD (4U + UPD_CHUNK_SIZE)
+#define UPD_FRAME_SIZE (4U + UPD_MAX_PAYLOAD + 4U)
+#define UPD_PAGE_SIZE 256U//decompressed bytes programmed at once
+#define UPD_WINDOW 2U//frames the host may send ahead of the last ACK
+#define UPD_IDLE_TIMEOUT_MS 10000U//no frame for that long leaves the update mode
+#define UPD_FRAME_TIMEOUT_MS 100U//rest of a frame once its first byte arrived
+#define UPD_RESYNC_IDLE_MS 20U//quiet line before the reception restarts after a bad frame
+
+typedef struct{
+	uint8_t sof;
+	uint8_t cmd;
+	uint16_t len;
+	uint32_t payload[UPD_MAX_PAYLOAD / 4U];
+	uint32_t crc;
+}update_frame_t;
+
+typedef struct{
+	uint8_t code;        /* UPD_ACK or UPD_NACK */
+	uint8_t status;      /* @UPD_Status */
+	uint16_t reserved;
+	uint32_t next;       /* offset expected in the next DATA frame */
+}update_reply_t;
+
+/* slots which can be written: the application sectors 1-3 */
+#define UPD_SLOT_FIRST_SECTOR 1U
+#define UPD_SLOT_LAST_SECTOR 3U
+
+uint8_t update_run(uint32_t *slot);
+
+#endif /* UPDATE_H_ */
@@ -28,6 +28,11 @@ void button_init(void){
 	GPIOC->MODER &= ~(1<<27); //MODER13 00 = set input mode to PC13 pin
 }
 
+void button_deinit(void){
+	//PC13 is already back in input mode (reset state), only the clock has to go
+	RCC->AHB1ENR &= ~GPIOCEN;
+}
+
 bool get_btn_state(void){
 	//Note: button is active Low
 	return (GPIOC->IDR & BTN_PIN) == 0;
@@ -0,0 +1,150 @@
+#include "clock.h"
+#include "stm32f4xx.h"
+
+/* VCO input 2 MHz (HSE/4 or HSI/8), VCO output 400 MHz, SYSCLK = 400/4 = 100 MHz,
+ * PLLQ = 9 keeps the 48 MHz domain below its limit (USB is not used) */
+#define PLL_N 200U
+#define PLL_P 4U
+#define PLL_Q 9U
+#define PLL_VCO_IN 2000000U
+/* HCLK 90-100 MHz at 2.7-3.6 V needs 3 wait states (refer flash access time in RM) */
+#define FLASH_LATENCY FLASH_ACR_LATENCY_3WS
+/* bounds of the clock start-up waits, the timeouts of the HAL (HSE_STARTUP_TIMEOUT, PLL_TIMEOUT_VALUE,
+ * CLOCKSWITCH_TIMEOUT_VALUE) in DWT cycles of the 16 MHz HSI the core runs from until the switch.
+ * A board without the ST-LINK clock falls back to HSI after 100 ms instead of spinning */
+#define CLOCK_MS_CYCLES (CLOCK_HSI_FREQ / 1000U)
+#define HSE_STARTUP_MS 100U
+#define PLL_LOCK_MS 2U
+#define CLOCK_SWITCH_MS 5000U
+
+static const uint8_t ahb_shift[8] = {1, 2, 3, 4, 6, 7, 8, 9};
+
+/* wait for (*reg & mask) == value for at most ms milliseconds, 1 once it is there */
+static int clock_wait(volatile uint32_t *reg, uint32_t mask, uint32_t value, uint32_t ms){
+	uint32_t start = DWT->CYCCNT;
+
+	while ((*reg & mask) != value) {
+		if ((DWT->CYCCNT - start) >= ms * CLOCK_MS_CYCLES) {
+			return (*reg & mask) == value;
+		}
+	}
+	return 1;
+}
+
+/* SYSCLK = 100 MHz from PLL, HCLK = PCLK2 = 100 MHz, PCLK1 = 50 MHz (max 50 MHz) */
+void clock_init(void){
+	uint32_t pll_src, pll_m;
+
+	/*already running from the PLL: the bootloader did it before jumping to the application*/
+	if ((RCC->CFGR & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL) {
+		flash_art_enable();
+		return;
+	}
+
+	/*try HSE (bypass, 8 MHz from ST-LINK) and fall back to HSI when no clock is present*/
+	RCC->CR |= RCC_CR_HSEBYP;
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	RCC->CR |= RCC_CR_HSEON;
+	if (clock_wait(&RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY, HSE_STARTUP_MS)) {
+		pll_src = RCC_PLLCFGR_PLLSRC_HSE;
+		pll_m = CLOCK_HSE_FREQ / PLL_VCO_IN;
+	} else {
+		RCC->CR &= ~RCC_CR_HSEON;
+		RCC->CR &= ~RCC_CR_HSEBYP;
+		pll_src = RCC_PLLCFGR_PLLSRC_HSI;
+		pll_m = CLOCK_HSI_FREQ / PLL_VCO_IN;
+	}
+
+	/*regulator scale 1, needed above 84 MHz*/
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR |= PWR_CR_VOS;
+
+	/*flash wait states before the clock goes up*/
+	FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | FLASH_LATENCY;
+	while ((FLASH->ACR & FLASH_ACR_LATENCY) != FLASH_LATENCY) {}
+
+	/*configure and lock the PLL, a PLL that does not lock leaves SYSCLK on HSI*/
+	RCC->CR &= ~RCC_CR_PLLON;
+	if (!clock_wait(&RCC->CR, RCC_CR_PLLRDY, 0U, PLL_LOCK_MS)) {
+		flash_art_enable();
+		return;
+	}
+	RCC->PLLCFGR = (RCC->PLLCFGR & ~(RCC_PLLCFGR_PLLM | RCC_PLLCFGR_PLLN | RCC_PLLCFGR_PLLP |
+	                                 RCC_PLLCFGR_PLLSRC | RCC_PLLCFGR_PLLQ)) |
+	               (pll_m << RCC_PLLCFGR_PLLM_Pos) | (PLL_N << RCC_PLLCFGR_PLLN_Pos) |
+	               (((PLL_P / 2U) - 1U) << RCC_PLLCFGR_PLLP_Pos) | pll_src |
+	               (PLL_Q << RCC_PLLCFGR_PLLQ_Pos);
+	RCC->CR |= RCC_CR_PLLON;
+	if (!clock_wait(&RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY, PLL_LOCK_MS)) {
+		RCC->CR &= ~RCC_CR_PLLON;
+		flash_art_enable();
+		return;
+	}
+
+	/*AHB /1, APB1 /2, APB2 /1, set before the switch so APB1 never exceeds 50 MHz*/
+	RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2)) |
+	            RCC_CFGR_HPRE_DIV1 | RCC_CFGR_PPRE1_DIV2 | RCC_CFGR_PPRE2_DIV1;
+
+	/*switch SYSCLK to the PLL*/
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+	if (!clock_wait(&RCC->CFGR, RCC_CFGR_SWS, RCC_CFGR_SWS_PLL, CLOCK_SWITCH_MS)) {
+		RCC->CFGR &= ~RCC_CFGR_SW;
+	}
+
+	/*hide the 3 wait states: prefetch and instruction/data caches*/
+	flash_art_enable();
+}
+
+/* ART accelerator: caches start from a clean state, then prefetch, I-cache and D-cache are turned on */
+void flash_art_enable(void){
+	flash_art_reset();
+	FLASH->ACR |= FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN;
+}
+
+/* drop every cached flash line, e.g. before jumping into another image or after a flash write.
+ * The reset bits only work with the caches disabled, their previous state is restored */
+void flash_art_reset(void){
+	uint32_t acr = FLASH->ACR;
+
+	FLASH->ACR = acr & ~(FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+	FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+	FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+	FLASH->ACR = acr;
+}
+
+/* current HCLK read back from RCC, so it is right whether or not clock_init ran */
+uint32_t clock_get_hclk(void){
+	uint32_t cfgr = RCC->CFGR;
+	uint32_t pllcfgr, sysclk, hpre;
+
+	if ((cfgr & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL) {
+		pllcfgr = RCC->PLLCFGR;
+		sysclk = (pllcfgr & RCC_PLLCFGR_PLLSRC) ? CLOCK_HSE_FREQ : CLOCK_HSI_FREQ;
+		sysclk /= (pllcfgr & RCC_PLLCFGR_PLLM) >> RCC_PLLCFGR_PLLM_Pos;
+		sysclk *= (pllcfgr & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos;
+		sysclk /= ((((pllcfgr & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) + 1U) * 2U);
+	} else if ((cfgr & RCC_CFGR_SWS) == RCC_CFGR_SWS_HSE) {
+		sysclk = CLOCK_HSE_FREQ;
+	} else {
+		sysclk = CLOCK_HSI_FREQ;
+	}
+
+	hpre = (cfgr & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos;
+	if (hpre & 0x8U) {
+		sysclk >>= ahb_shift[hpre & 0x7U];
+	}
+	return sysclk;
+}
+
+uint32_t clock_get_pclk1(void){
+	uint32_t ppre = (RCC->CFGR & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos;
+
+	return (ppre & 0x4U) ? (clock_get_hclk() >> ((ppre & 0x3U) + 1U)) : clock_get_hclk();
+}
+
+uint32_t clock_get_pclk2(void){
+	uint32_t ppre = (RCC->CFGR & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos;
+
+	return (ppre & 0x4U) ? (clock_get_hclk() >> ((ppre & 0x3U) + 1U)) : clock_get_hclk();
+}
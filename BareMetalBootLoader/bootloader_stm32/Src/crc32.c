@@ -0,0 +1,84 @@
+#include "crc32.h"
+
+#if CRC32_USE_HW
+#include "stm32f4xx.h"
+
+void crc32_begin(void){
+	RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+	CRC->CR = CRC_CR_RESET;
+}
+
+/* the unit takes one word per AHB write (4 cycles), unrolled so the loop does not dominate */
+void crc32_feed(const uint32_t *data, uint32_t words){
+	volatile uint32_t *dr = &CRC->DR;
+
+	while (words >= 4U) {
+		*dr = data[0];
+		*dr = data[1];
+		*dr = data[2];
+		*dr = data[3];
+		data += 4;
+		words -= 4U;
+	}
+	while (words--) {
+		*dr = *data++;
+	}
+}
+
+void crc32_feed_word(uint32_t word){
+	CRC->DR = word;
+}
+
+uint32_t crc32_end(void){
+	return CRC->DR;
+}
+#else
+#define CRC32_POLY 0x04C11DB7U
+
+static uint32_t crc_table[256];
+static uint8_t crc_table_ready;
+
+static void crc32_sw_table_init(void){
+	for (uint32_t i = 0; i < 256U; i++) {
+		uint32_t c = i << 24;
+		for (int bit = 0; bit < 8; bit++) {
+			c = (c & 0x80000000U) ? ((c << 1) ^ CRC32_POLY) : (c << 1);
+		}
+		crc_table[i] = c;
+	}
+	crc_table_ready = 1;
+}
+
+/* one table lookup per byte, the word is consumed from its most significant byte like the CRC unit */
+uint32_t crc32_sw_update(uint32_t crc, const uint32_t *data, uint32_t words){
+	if (!crc_table_ready) {
+		crc32_sw_table_init();
+	}
+	while (words--) {
+		uint32_t w = *data++;
+		crc = (crc << 8) ^ crc_table[(crc >> 24) ^ (w >> 24)];
+		crc = (crc << 8) ^ crc_table[(crc >> 24) ^ ((w >> 16) & 0xFFU)];
+		crc = (crc << 8) ^ crc_table[(crc >> 24) ^ ((w >> 8) & 0xFFU)];
+		crc = (crc << 8) ^ crc_table[(crc >> 24) ^ (w & 0xFFU)];
+	}
+	return crc;
+}
+
+static uint32_t crc_state;
+
+void crc32_begin(void){
+	crc_state = CRC32_INIT;
+}
+
+void crc32_feed(const uint32_t *data, uint32_t words){
+	crc_state = crc32_sw_update(crc_state, data, words);
+}
+
+void crc32_feed_word(uint32_t word){
+	crc_state = crc32_sw_update(crc_state, &word, 1);
+}
+
+uint32_t crc32_end(void){
+	return crc_state;
+}
+#endif
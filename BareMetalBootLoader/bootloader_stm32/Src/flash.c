@@ -0,0 +1,126 @@
+#include "flash.h"
+#include "clock.h"
+#include "stm32f4xx.h"
+#include "ramfunc.h"
+
+#define FLASH_KEY1 0x45670123U//unlock sequence, refer flash interface in RM
+#define FLASH_KEY2 0xCDEF89ABU
+#define FLASH_PSIZE_X32 FLASH_CR_PSIZE_1
+#define FLASH_SR_ERRORS (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR | \
+                         FLASH_SR_RDERR | FLASH_SR_SOP)
+#define FLASH_ERASED_WORD 0xFFFFFFFFU
+
+static const uint32_t sector_base[FLASH_SECTOR_COUNT + 1U] = {
+	0x08000000, 0x08004000, 0x08008000, 0x0800C000,
+	0x08010000, 0x08020000, 0x08040000, 0x08060000,
+	0x08080000//end of flash
+};
+
+void flash_unlock(void){
+	if (FLASH->CR & FLASH_CR_LOCK) {
+		FLASH->KEYR = FLASH_KEY1;
+		FLASH->KEYR = FLASH_KEY2;
+	}
+}
+
+void flash_lock(void){
+	FLASH->CR |= FLASH_CR_LOCK;
+}
+
+uint8_t flash_sector_of(uint32_t addr){
+	for (uint8_t i = 0; i < FLASH_SECTOR_COUNT; i++) {
+		if (addr >= sector_base[i] && addr < sector_base[i + 1U]) {
+			return i;
+		}
+	}
+	return FLASH_SECTOR_NONE;
+}
+
+uint32_t flash_sector_base(uint8_t sector){
+	return sector_base[sector < FLASH_SECTOR_COUNT ? sector : FLASH_SECTOR_COUNT];
+}
+
+/* wait for the end of the operation and turn the error flags into a result (flags are cleared) */
+RAMFUNC static uint8_t flash_wait(void){
+	uint32_t sr;
+
+	while (FLASH->SR & FLASH_SR_BSY) {}
+	sr = FLASH->SR;
+	FLASH->SR = sr & (FLASH_SR_ERRORS | FLASH_SR_EOP);
+	if (sr & FLASH_SR_WRPERR) {
+		return FLASH_ERR_WRP;
+	}
+	if (sr & FLASH_SR_ERRORS) {
+		return FLASH_ERR_PROG;
+	}
+	return FLASH_OK;
+}
+
+/*
+ * start an operation and wait for its end from SRAM: the next fetch from flash would stall the
+ * CPU for the whole erase, SRAM interrupt handlers included
+ */
+RAMFUNC static uint8_t flash_start(uint32_t cr){
+	FLASH->CR = cr;
+	FLASH->CR |= FLASH_CR_STRT;
+	return flash_wait();
+}
+
+RAMFUNC static uint8_t flash_write_word(volatile uint32_t *dst, uint32_t word){
+	*dst = word;
+	return flash_wait();
+}
+
+/* typ. 250 ms for a 16KB sector, up to 2 s for a 128KB one. The bootloader sector is refused */
+uint8_t flash_erase_sector(uint8_t sector){
+	uint8_t status;
+
+	if (sector == 0U || sector >= FLASH_SECTOR_COUNT) {
+		return FLASH_ERR_PARAM;
+	}
+	flash_unlock();
+	(void)flash_wait();
+
+	status = flash_start(FLASH_PSIZE_X32 | FLASH_CR_SER | ((uint32_t)sector << FLASH_CR_SNB_Pos));
+	FLASH->CR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+
+	//the caches may hold lines of the old content
+	flash_art_reset();
+	return status;
+}
+
+/*
+ * program words at addr (word aligned, inside sectors 1-7). Erased words (0xFFFFFFFF) are skipped:
+ * they cost a program cycle for nothing and can still be written later (e.g. a header field).
+ * The result is read back with the caches reset, so the target must have been erased.
+ */
+uint8_t flash_program(uint32_t addr, const uint32_t *data, uint32_t words){
+	volatile uint32_t *dst = (volatile uint32_t *)addr;
+	uint8_t status = FLASH_OK;
+
+	if (words == 0U) {
+		return FLASH_OK;
+	}
+	if ((addr & 0x3U) || flash_sector_of(addr) == FLASH_SECTOR_NONE || flash_sector_of(addr) == 0U ||
+	    flash_sector_of(addr + words * 4U - 1U) == FLASH_SECTOR_NONE) {
+		return FLASH_ERR_PARAM;
+	}
+	flash_unlock();
+	(void)flash_wait();
+
+	FLASH->CR = FLASH_PSIZE_X32 | FLASH_CR_PG;
+	for (uint32_t i = 0; i < words && status == FLASH_OK; i++) {
+		if (data[i] != FLASH_ERASED_WORD) {
+			status = flash_write_word(&dst[i], data[i]);
+		}
+	}
+	FLASH->CR &= ~FLASH_CR_PG;
+
+	flash_art_reset();
+	for (uint32_t i = 0; i < words && status == FLASH_OK; i++) {
+		if (dst[i] != data[i]) {
+			status = FLASH_ERR_VERIFY;
+		}
+	}
+	return status;
+}
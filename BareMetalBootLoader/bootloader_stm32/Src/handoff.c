@@ -0,0 +1,100 @@
+#include "handoff.h"
+#include "clock.h"
+#include "stm32f4xx.h"
+
+/*
+ * Peripherals are put back to their reset state before the application starts, except:
+ *  - RCC clock tree (PLL, prescalers) and FLASH->ACR: the application keeps running at 100 MHz
+ *  - PWR: a PWR reset would drop the regulator to scale 2 (max 84 MHz) under the running PLL
+ *  - DWT cycle counter: left running, the boot stats are expressed in its cycles
+ */
+#define APB1_RESET_MASK (0xFFFFFFFFU & ~RCC_APB1RSTR_PWRRST)
+
+#define BOOT_VECTOR_COUNT (16U + 86U)//core exceptions and the 86 interrupts of the STM32F411
+
+/* copy of the vector table in SRAM, aligned on the table size rounded up to a power of two */
+static uint32_t boot_ram_vectors[BOOT_VECTOR_COUNT] __attribute__((aligned(512)));
+
+static void handoff_reset_peripherals(void){
+	/*pulse every peripheral reset, this also stops DMA streams and clears USART/GPIO setup*/
+	RCC->AHB1RSTR = 0xFFFFFFFFU;
+	RCC->AHB1RSTR = 0;
+	RCC->AHB2RSTR = 0xFFFFFFFFU;
+	RCC->AHB2RSTR = 0;
+	RCC->APB1RSTR = APB1_RESET_MASK;
+	RCC->APB1RSTR = 0;
+	RCC->APB2RSTR = 0xFFFFFFFFU;
+	RCC->APB2RSTR = 0;
+
+	/*peripheral clock enables back to their reset values*/
+	RCC->AHB1ENR = 0;
+	RCC->AHB2ENR = 0;
+	RCC->APB1ENR = 0;
+	RCC->APB2ENR = 0;
+}
+
+/*
+ * Take exceptions through a copy of the vector table in SRAM: with the handlers in .ramfunc
+ * nothing is fetched from flash between an interrupt and its return, so SysTick and the UART
+ * DMA keep being served while a sector is erased. boot_handoff points VTOR to the image anyway.
+ */
+void boot_vectors_to_ram(void){
+	const volatile uint32_t *vectors = (const volatile uint32_t *)SCB->VTOR;
+
+	for (uint32_t i = 0; i < BOOT_VECTOR_COUNT; i++) {
+		boot_ram_vectors[i] = vectors[i];
+	}
+	__DSB();
+	SCB->VTOR = (uint32_t)boot_ram_vectors;
+	__DSB();
+	__ISB();
+}
+
+/*
+ * Start the image at image_base: nothing of the bootloader may fire into the application's
+ * vector table, and the application starts with the core state of a reset (MSP, privileged
+ * thread mode, interrupts unmasked, VTOR on its own table).
+ */
+void boot_handoff(uint32_t image_base){
+	uint32_t msp = *(volatile uint32_t *)image_base;
+	uint32_t reset = *(volatile uint32_t *)(image_base + 4);
+
+	__disable_irq();
+
+	/*SysTick stopped and its pending exception dropped*/
+	SysTick->CTRL = 0;
+	SysTick->LOAD = 0;
+	SysTick->VAL = 0;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk | SCB_ICSR_PENDSVCLR_Msk;
+
+	/*every NVIC line disabled, then pending bits cleared (a disabled line can still pend)*/
+	for (uint32_t i = 0; i < (sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0])); i++) {
+		NVIC->ICER[i] = 0xFFFFFFFFU;
+	}
+	handoff_reset_peripherals();
+	for (uint32_t i = 0; i < (sizeof(NVIC->ICPR) / sizeof(NVIC->ICPR[0])); i++) {
+		NVIC->ICPR[i] = 0xFFFFFFFFU;
+	}
+
+	/*no stale flash lines from the bootloader*/
+	flash_art_reset();
+
+	/*vector table of the image, visible before the first exception can be taken*/
+	SCB->VTOR = image_base;
+	__DSB();
+	__ISB();
+
+	/*privileged thread mode on MSP, FP context flag cleared*/
+	__set_CONTROL(0);
+	__ISB();
+
+	/*new stack, unmask and branch: no C code may run on the old stack after the MSP write*/
+	__asm volatile (
+		"msr msp, %0\n"
+		"dsb\n"
+		"isb\n"
+		"cpsie i\n"
+		"bx %1\n"
+		: : "r" (msp), "r" (reset) : "memory");
+	__builtin_unreachable();
+}
@@ -0,0 +1,38 @@
+#include "image.h"
+#include "crc32.h"
+#include <stddef.h>
+
+const image_header_t *image_header(uint32_t image_base){
+	return (const image_header_t *)(uintptr_t)(image_base + IMAGE_HEADER_OFFSET);
+}
+
+/* header sanity first (cheap), then the CRC over the whole image */
+uint8_t image_verify(uint32_t image_base, uint32_t slot_size){
+	const image_header_t *hdr = image_header(image_base);
+	const uint32_t *image = (const uint32_t *)(uintptr_t)image_base;
+	uint32_t crc_index = (IMAGE_HEADER_OFFSET + offsetof(image_header_t, crc)) / 4U;
+	uint32_t words;
+
+	if (hdr->magic != IMAGE_MAGIC) {
+		return IMAGE_ERR_MAGIC;
+	}
+	if ((hdr->length & 0x3U) || hdr->length < (IMAGE_HEADER_OFFSET + sizeof(image_header_t)) ||
+	    hdr->length > slot_size) {
+		return IMAGE_ERR_LENGTH;
+	}
+#if IMAGE_ALLOW_UNSIGNED
+	if (hdr->crc == IMAGE_CRC_UNSIGNED) {
+		return IMAGE_OK;
+	}
+#endif
+
+	words = hdr->length / 4U;
+	crc32_begin();
+	crc32_feed(image, crc_index);
+	crc32_feed_word(IMAGE_CRC_UNSIGNED);
+	crc32_feed(image + crc_index + 1U, words - crc_index - 1U);
+	if (crc32_end() != hdr->crc) {
+		return IMAGE_ERR_CRC;
+	}
+	return IMAGE_OK;
+}
@@ -0,0 +1,116 @@
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4U
+
+/* sequence: token, [literal length bytes], literals, offset (2), [match length bytes] */
+#define LZ4_STATE_TOKEN 0
+#define LZ4_STATE_LIT_LEN 1
+#define LZ4_STATE_LITERALS 2
+#define LZ4_STATE_OFFSET_LO 3
+#define LZ4_STATE_OFFSET_HI 4
+#define LZ4_STATE_MATCH_LEN 5
+
+void lz4_stream_init(lz4_stream_t *s, lz4_put_fn put, lz4_get_fn get, void *ctx, uint32_t out_max){
+	s->put = put;
+	s->get = get;
+	s->ctx = ctx;
+	s->out_pos = 0;
+	s->out_max = out_max;
+	s->count = 0;
+	s->offset = 0;
+	s->token = 0;
+	s->state = LZ4_STATE_TOKEN;
+}
+
+/*
+ * output positions below dict_size are a dictionary served by get, e.g. the installed image for
+ * a delta update: matches may reach into it. Call right after lz4_stream_init
+ */
+void lz4_stream_dict(lz4_stream_t *s, uint32_t dict_size){
+	s->out_pos = dict_size;
+	s->out_max += dict_size;
+}
+
+/* copy count bytes from offset back, byte by byte so an overlapping match repeats a pattern */
+static uint8_t lz4_match(lz4_stream_t *s){
+	if (s->offset == 0U || s->offset > s->out_pos) {
+		return LZ4_ERR_OFFSET;
+	}
+	if (s->count > s->out_max - s->out_pos) {
+		return LZ4_ERR_OVERFLOW;
+	}
+	while (s->count) {
+		s->put(s->ctx, s->get(s->ctx, s->out_pos - s->offset));
+		s->out_pos++;
+		s->count--;
+	}
+	return LZ4_OK;
+}
+
+uint8_t lz4_stream_feed(lz4_stream_t *s, const uint8_t *in, uint32_t len){
+	uint8_t status = LZ4_OK;
+
+	for (uint32_t i = 0; i < len && status == LZ4_OK; i++) {
+		uint8_t c = in[i];
+
+		switch (s->state) {
+		case LZ4_STATE_TOKEN:
+			s->token = c;
+			s->count = c >> 4;
+			if (s->count == 15U) {
+				s->state = LZ4_STATE_LIT_LEN;
+			} else if (s->count) {
+				s->state = LZ4_STATE_LITERALS;
+			} else {
+				s->state = LZ4_STATE_OFFSET_LO;
+			}
+			break;
+		case LZ4_STATE_LIT_LEN:
+			s->count += c;
+			if (c != 255U) {
+				s->state = LZ4_STATE_LITERALS;
+			}
+			break;
+		case LZ4_STATE_LITERALS:
+			if (s->out_pos >= s->out_max) {
+				status = LZ4_ERR_OVERFLOW;
+				break;
+			}
+			s->put(s->ctx, c);
+			s->out_pos++;
+			if (--s->count == 0U) {
+				s->state = LZ4_STATE_OFFSET_LO;
+			}
+			break;
+		case LZ4_STATE_OFFSET_LO:
+			s->offset = c;
+			s->state = LZ4_STATE_OFFSET_HI;
+			break;
+		case LZ4_STATE_OFFSET_HI:
+			s->offset |= (uint16_t)(c << 8);
+			s->count = (s->token & 0x0FU) + LZ4_MIN_MATCH;
+			if ((s->token & 0x0FU) == 15U) {
+				s->state = LZ4_STATE_MATCH_LEN;
+			} else {
+				status = lz4_match(s);
+				s->state = LZ4_STATE_TOKEN;
+			}
+			break;
+		case LZ4_STATE_MATCH_LEN:
+			s->count += c;
+			if (c != 255U) {
+				status = lz4_match(s);
+				s->state = LZ4_STATE_TOKEN;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return status;
+}
+
+/* the last sequence of a block has literals only: the stream ends waiting for its offset */
+uint8_t lz4_stream_complete(const lz4_stream_t *s){
+	return s->state == LZ4_STATE_OFFSET_LO || s->state == LZ4_STATE_TOKEN;
+}
@@ -3,7 +3,14 @@
 #include <stdio.h>
 #include "uart.h"
 #include "timebase.h"
+#include "clock.h"
 #include "bsp.h"
+#include "boot_stats.h"
+#include "handoff.h"
+#include "image.h"
+#include "update.h"
+#include "slots.h"
+#include "common_apis.h"
 #define GPIOAEN (1U<<0)
 #define PIN5 (1U<<5)
 #define LED_PIN PIN5
@@ -22,97 +29,200 @@
 #define MSP_VERIFY_MASK 0x2FFE0000
 #define EMPTY_MEM 0xffffffff
 
+#define SRAM_BASE_ADDRESS 0x20000000
+#define SRAM_END_ADDRESS 0x20020000/*128KB*/
+#define FLASH_END_ADDRESS 0x08080000/*512KB*/
+
+/*
+ * FAST_BOOT 1: without the button only the clock and the button pin are touched, the image is
+ * checked and started with no UART output and no delay. FAST_BOOT 0 keeps the old banner.
+ */
+#ifndef FAST_BOOT
+#define FAST_BOOT 1
+#endif
+
 typedef void(*func_ptr)(void);
 volatile char g_key;
 volatile uint8_t g_un_key;
+static uint8_t g_uart_ready;
+
+volatile boot_stats_t g_boot_stats BOOT_STATS_SECTION;
+volatile boot_ctrl_t g_boot_ctrl BOOT_CTRL_SECTION;
+volatile common_apis_ram_t g_common_apis_ram COMMON_APIS_RAM_SECTION;
+
+//callback of reset handler, first code after reset: start the cycle counter for the boot stats
+void SystemInit(void){
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
 
 
 //0x20020000: value stored at 0x08008000=> reset handler of application
 
-//struct blt_common_apis{
-//	void (*led_init)(void);
-//	void (*led_on)(void);
-//	void (*led_off)(void);
-//	void (system_uart_init)(void);
-//	void (*button_init)(void);
-//	bool (*get_btn_state)(void);
-//	void (*fpu_enable)(void);
-//	void (*timebase_init)(void);
-//};
-//
-//struct blt_common_apis blt_common_apis __attribute__((section(".COMMON_APIS"))) = {
-//	led_init,
-//	led_on,
-//	led_off,
-//	led_init,
-//	system_uart_init,
-//	button_init,
-//	get_btn_state,
-//	fpu_enable,
-//	timebase_init
-//};
+//drivers shared with the applications, refer common_apis.h
+const common_apis_t blt_common_apis __attribute__((section(".COMMON_APIS"))) = {
+	.magic = COMMON_APIS_MAGIC,
+	.version_major = COMMON_APIS_VERSION_MAJOR,
+	.version_minor = COMMON_APIS_VERSION_MINOR,
+	.size = sizeof(common_apis_t),
+	.fpu_enable = fpu_enable,
+	.clock_init = clock_init,
+	.clock_get_hclk = clock_get_hclk,
+	.clock_get_pclk1 = clock_get_pclk1,
+	.clock_get_pclk2 = clock_get_pclk2,
+	.flash_art_enable = flash_art_enable,
+	.flash_art_reset = flash_art_reset,
+	.timebase_init = timebase_init,
+	.get_tick = get_tick,
+	.delay = delay,
+	.tick_increment = tick_increment,
+	.led_init = led_init,
+	.led_on = led_on,
+	.led_off = led_off,
+	.button_init = button_init,
+	.button_deinit = button_deinit,
+	.get_btn_state = get_btn_state
+};
 
 typedef enum{
 	APP1 = 1,
-	FACTORY_APP
+	FACTORY_APP,
+	UPDATE_MODE
 }SYS_APPS;
 
 static void process_btldr_cmds(SYS_APPS curr_app);
+static void uart_callback(char key);
+
+/*
+ * image check: initial MSP inside SRAM and word aligned, reset handler a thumb address inside
+ * flash but outside the bootloader sector (an erased sector fails both), then header and CRC32
+ */
+static uint32_t g_verify_cycles;
+
+static int image_is_valid(uint32_t addr_value){
+	uint32_t msp = *(volatile uint32_t *)addr_value;
+	uint32_t reset = *(volatile uint32_t *)(addr_value + 4);
+	uint32_t start;
+	uint8_t status;
+
+	if (msp <= SRAM_BASE_ADDRESS || msp > SRAM_END_ADDRESS || (msp & 0x3U)) {
+		return 0;
+	}
+	if (!(reset & 1U) || reset < SECTOR1_BASE_ADDRESS || reset >= FLASH_END_ADDRESS) {
+		return 0;
+	}
 
-void jump_to_app(uint32_t addr_value){
-	uint32_t app_start_address;
-	func_ptr jump_to_app_ptr;
+	start = DWT->CYCCNT;
+	status = image_verify(addr_value, SLOT_IMAGE_MAX);
+	g_verify_cycles = DWT->CYCCNT - start;
+	if (status != IMAGE_OK) {
+		if (g_uart_ready) {
+			printf("Bootloader: image at 0x%08lX rejected (error %u)\n", addr_value, status);
+		}
+		return 0;
+	}
+	return 1;
+}
+
+static void boot_stats_record(uint32_t addr_value, uint32_t mode, uint32_t clock_cycles){
+	uint32_t total = DWT->CYCCNT;
+	uint32_t hclk = clock_get_hclk();
+
+	if (g_boot_stats.magic != BOOT_STATS_MAGIC) {
+		g_boot_stats.magic = BOOT_STATS_MAGIC;
+		g_boot_stats.boot_count = 0;
+	}
+	g_boot_stats.boot_count++;
+	g_boot_stats.boot_mode = mode;
+	g_boot_stats.app_address = addr_value;
+	g_boot_stats.clock_cycles = clock_cycles;
+	g_boot_stats.verify_cycles = g_verify_cycles;
+	g_boot_stats.total_cycles = total;
+	g_boot_stats.hclk_hz = hclk;
+	//cycles up to the clock switch ran on HSI, the rest on HCLK
+	g_boot_stats.boot_time_us = clock_cycles / (CLOCK_HSI_FREQ / 1000000U) +
+	                            (total - clock_cycles) / (hclk / 1000000U);
+}
+
+static uint32_t g_clock_cycles;
+
+/* hand over to an image which passed image_is_valid */
+static void start_app(uint32_t addr_value){
+#if !FAST_BOOT
 	printf("Boot loader started. \n");
 	delay(300);
-
-    // --- Application Validity Check ---
-#ifdef MEM_CHECK_V1
-    // Kiểm tra Stack Pointer có nằm trong vùng SRAM hợp lệ
-    if (((*(uint32_t *)addr_value) & 0x2FFE0000U) == 0x20000000U)
-#elif MEM_CHECK_V2
-    // Kiểm tra vùng nhớ không trống
-    if (*(uint32_t *)addr_value != EMPTY_MEM)
-#else
-    if (1)
 #endif
-    {
+
+    if (g_uart_ready) {
         printf("Bootloader: Valid application found. Jumping...\n");
+        // log phải được gửi xong trước khi tắt DMA/ngắt
+        uart_dma_flush();
+    }
 
-        // Lấy địa chỉ hàm reset handler (tại addr_value + 4)
-        app_start_address = *(volatile uint32_t *)(addr_value + 4);
-        jump_to_app_ptr = (func_ptr)app_start_address;
+    boot_stats_record(addr_value, g_uart_ready ? BOOT_MODE_MENU : BOOT_MODE_FAST, g_clock_cycles);
 
-        // Set lại MSP (Main Stack Pointer)
-        __disable_irq();                         // Ngăn ngắt trước khi chuyển
-        __set_MSP(*(volatile uint32_t *)addr_value);
-        __enable_irq();                          // (optional) bật lại nếu app cần ngắt
+    // tắt SysTick/NVIC/ngoại vi, VTOR + MSP của app rồi nhảy vào reset handler (tại addr_value + 4)
+    boot_handoff(addr_value);
+}
 
-        jump_to_app_ptr();                       // Nhảy vào ứng dụng
+void jump_to_app(uint32_t addr_value){
+    // --- Application Validity Check ---
+    if (image_is_valid(addr_value))
+    {
+        start_app(addr_value);
     }
-    else
+    else if (g_uart_ready)
     {
         printf("Bootloader: No valid application at 0x%08lX\n", addr_value);
     }
 }
+
+/* A/B slot selection with rollback and the factory image as last resort, refer slots.h */
+static void boot_selected_app(void){
+	uint32_t addr_value = slot_select(image_is_valid);
+
+	if (addr_value != 0U) {
+		start_app(addr_value);
+	} else if (g_uart_ready) {
+		printf("Bootloader: No bootable image\n");
+	}
+}
+
 int main(){
 
 	//enable Floating point
 	fpu_enable();
 
-	//enable Floating point
-	system_uart_init();
+	//PLL at 100 MHz before anything derives a baud rate or tick from the clock
+	clock_init();
+	g_clock_cycles = DWT->CYCCNT;
 
-	//enable Floating point
-	timebase_init();
+	//the button decides between fast boot and the menu, nothing else is needed for that
+	button_init();
 
-	//enable Floating point
-	led_init();
+#if FAST_BOOT
+	if( !get_btn_state()){
+		//no UART, no SysTick: validate and jump, only the button GPIO has to be undone
+		button_deinit();
+		boot_selected_app();
+		button_init();
+	}
+#endif
 
-	//enable Floating point
-	button_init();
+	//exceptions through SRAM from here on, they keep running during the erases of an update
+	boot_vectors_to_ram();
 
-	//enable Floating point
-//	jump_to_default_app();
+	//enable debug uart, printf is queued and sent by DMA, keys are received by DMA too
+	system_uart_dma_init(UART_TX_OVERFLOW_BLOCK);
+	uart_rx_dma_start();
+	g_uart_ready = 1;
+
+	//enable timebase
+	timebase_init();
+
+	//enable led
+	led_init();
 
 	if( get_btn_state()){
 		//button is pressed
@@ -134,14 +244,19 @@ int main(){
 		printf("Available commands: \n");
 		printf("1 ==> run app 1");
 		printf("f ==> Factory App");
+		printf("u ==> firmware update over UART");
 		printf("Any Key ==> run Default App");
 
 		while(1){
+			int key = uart_getc();
+			if (key >= 0) {
+				uart_callback((char)key);
+			}
 			process_btldr_cmds(g_un_key);
 		}
 	}else{
 		//button is not pressed
-		jump_to_app(DEFAULT_APP_ADDRESS);
+		boot_selected_app();
 	}
 
 	while(1){
@@ -151,6 +266,9 @@ int main(){
 
 }
 static void process_btldr_cmds(SYS_APPS curr_app){
+	uint32_t slot;
+	uint8_t status;
+
 	switch(curr_app){
 		case APP1:
 			printf("App 1 selected\n");
@@ -160,27 +278,36 @@ static void process_btldr_cmds(SYS_APPS curr_app){
 			printf("Factory App selected\n");
 			jump_to_app(FACTORY_APP_ADDRESS);
 			break;
+		case UPDATE_MODE:
+			//last text before the binary protocol, the host waits for this line
+			printf("Bootloader: update mode\n");
+			uart_dma_flush();
+			status = update_run(&slot);
+			if (status == UPD_OK) {
+				printf("Bootloader: update of 0x%08lX done\n", slot);
+			} else {
+				printf("Bootloader: update failed (error %u)\n", status);
+			}
+			break;
 		default:
 			break;
 	}
+	//command handled (a failed jump returns here), wait for the next key
+	g_un_key = 0;
 }
 
-static void uart_callback(){
-	g_key = USART2->DR;
+static void uart_callback(char key){
+	g_key = key;
 
 	if(g_key == '1') {
 		printf("Key press: 1\n");
-		g_un_key = 1;
+		g_un_key = APP1;
 	}
 	else if((g_key == 'f')||(g_key == 'F')){
-		g_un_key = 2;
+		g_un_key = FACTORY_APP;
 		printf("Key press: f\n");
 	}
-}
-
-void USART2_IRQHandler(void){
-	/* check if RXNE is set*/
-	if(USART2->SR & (1 << 5)){
-		uart_callback();
+	else if((g_key == 'u')||(g_key == 'U')){
+		g_un_key = UPDATE_MODE;
 	}
 }
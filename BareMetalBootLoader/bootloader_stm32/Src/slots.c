@@ -0,0 +1,125 @@
+#include "slots.h"
+#include "image.h"
+#include "flash.h"
+#include "boot_stats.h"
+
+#define SLOT_STATE_INVALID 0
+#define SLOT_STATE_PENDING 1
+#define SLOT_STATE_CONFIRMED 2
+#define SLOT_STATE_REJECTED 3
+
+static const uint32_t ab_slot[2] = {SLOT_A_ADDRESS, SLOT_B_ADDRESS};
+
+static volatile uint32_t *slot_marker(uint32_t image_base, uint32_t offset){
+	return (volatile uint32_t *)(image_base + SLOT_SIZE - SLOT_TRAILER_SIZE + offset);
+}
+
+/* from the trailer and the header magic only, the image itself is checked by the caller */
+static uint8_t slot_state(uint32_t image_base){
+	if (*slot_marker(image_base, 4) == SLOT_MARK_REJECTED) {
+		return SLOT_STATE_REJECTED;
+	}
+	if (image_header(image_base)->magic != IMAGE_MAGIC) {
+		return SLOT_STATE_INVALID;
+	}
+	if (*slot_marker(image_base, 0) == SLOT_MARK_CONFIRMED) {
+		return SLOT_STATE_CONFIRMED;
+	}
+	return SLOT_STATE_PENDING;
+}
+
+static void slot_mark(uint32_t image_base, uint32_t offset, uint32_t mark){
+	if (*slot_marker(image_base, offset) != mark) {
+		(void)flash_program((uint32_t)slot_marker(image_base, offset), &mark, 1);
+		flash_lock();
+	}
+}
+
+/* A/B slot whose header says it is the newer one, among the slots that may still be started */
+static uint32_t slot_newest(uint8_t skip){
+	uint32_t best = 0;
+
+	for (uint8_t i = 0; i < 2U; i++) {
+		uint8_t state = slot_state(ab_slot[i]);
+
+		if ((skip & (1U << i)) || state == SLOT_STATE_INVALID || state == SLOT_STATE_REJECTED) {
+			continue;
+		}
+		if (best == 0U || image_header(ab_slot[i])->version > image_header(best)->version) {
+			best = ab_slot[i];
+		}
+	}
+	return best;
+}
+
+static void slot_ctrl_init(void){
+	if (g_boot_ctrl.magic != BOOT_CTRL_MAGIC) {
+		g_boot_ctrl.magic = BOOT_CTRL_MAGIC;
+		g_boot_ctrl.slot = 0;
+		g_boot_ctrl.attempts = 0;
+		g_boot_ctrl.confirm = 0;
+	}
+}
+
+/*
+ * image to start, 0 when there is none. is_valid does the full check (vector table, CRC) and
+ * only runs on the candidate, the newest one first. The slot marks are written here: a
+ * confirmation left by the application before this reset, and the rejection of a pending image
+ * which used up its attempts.
+ */
+uint32_t slot_select(slot_valid_fn is_valid){
+	uint8_t skip = 0;//bit per A/B slot already ruled out
+	uint32_t slot;
+
+	slot_ctrl_init();
+	if (g_boot_ctrl.confirm == SLOT_A_ADDRESS || g_boot_ctrl.confirm == SLOT_B_ADDRESS) {
+		slot_mark(g_boot_ctrl.confirm, 0, SLOT_MARK_CONFIRMED);
+		if (g_boot_ctrl.slot == g_boot_ctrl.confirm) {
+			g_boot_ctrl.attempts = 0;
+		}
+	}
+	g_boot_ctrl.confirm = 0;
+
+	while ((slot = slot_newest(skip)) != 0U) {
+		if (!is_valid(slot)) {
+			//corrupted image, the other slot may still be good
+			skip |= (slot == SLOT_A_ADDRESS) ? 1U : 2U;
+			continue;
+		}
+		if (g_boot_ctrl.slot != slot) {
+			g_boot_ctrl.slot = slot;
+			g_boot_ctrl.attempts = 0;
+		}
+		if (slot_state(slot) == SLOT_STATE_CONFIRMED) {
+			g_boot_ctrl.attempts = 0;
+			return slot;
+		}
+		if (++g_boot_ctrl.attempts <= SLOT_MAX_ATTEMPTS) {
+			return slot;
+		}
+		//pending image never confirmed itself: reject it and roll back
+		slot_mark(slot, 4, SLOT_MARK_REJECTED);
+		g_boot_ctrl.attempts = 0;
+		skip |= (slot == SLOT_A_ADDRESS) ? 1U : 2U;
+	}
+
+	g_boot_ctrl.slot = 0;
+	return is_valid(SLOT_FACTORY_ADDRESS) ? SLOT_FACTORY_ADDRESS : 0U;
+}
+
+/* slot an update should write: the A/B slot that would not be started */
+uint32_t slot_update_target(void){
+	return (slot_newest(0) == SLOT_A_ADDRESS) ? SLOT_B_ADDRESS : SLOT_A_ADDRESS;
+}
+
+/* the slot is about to be rewritten, its attempts and confirmation do not apply to the new image */
+void slot_forget(uint32_t image_base){
+	slot_ctrl_init();
+	if (g_boot_ctrl.slot == image_base) {
+		g_boot_ctrl.slot = 0;
+		g_boot_ctrl.attempts = 0;
+	}
+	if (g_boot_ctrl.confirm == image_base) {
+		g_boot_ctrl.confirm = 0;
+	}
+}
@@ -1,5 +1,8 @@
 #include "timebase.h"
+#include "clock.h"
 #include "stm32f4xx.h"
+#include "common_apis.h"
+#include "ramfunc.h"
 
 
 #define CTRL_ENABLE 	(1U<<0)
@@ -7,14 +10,15 @@
 #define CTRL_CLKSOURCE  (1U<<2)
 #define CTRL_COUNTFLAG  (1U<<12)
 
-#define ONE_SEC_LOAD 	16000000//16MHz
+#define TICK_RATE_HZ 	1000U//1 ms tick
 /*systick is a 24bit countdown counter used for creating a period timer
- * => delay, time of system or tick for RTOS*/
+ * => delay, time of system or tick for RTOS.
+ * One second at 100 MHz does not fit in 24 bits, so the tick is 1 ms and delay() counts ms*/
 #define TICK_FREQ 1;
 #define MAX_DELAY 0xffffffff
 
-volatile uint32_t g_cur_tick;
-volatile uint32_t g_cur_tick_p;
+/*the applications run this code too (common_apis.h): no state in the RAM of the bootloader,
+ * the counter lives in the shared block*/
 
 void delay(uint32_t delay){
 	uint32_t tickstart = get_tick();
@@ -28,22 +32,26 @@ void delay(uint32_t delay){
 }
 
 uint32_t get_tick(){
+	uint32_t tick;
+
 	__disable_irq();
-	g_cur_tick_p = g_cur_tick;
+	tick = g_common_apis_ram.tick;
 	__enable_irq();
 
-	return g_cur_tick_p;
+	return tick;
 }
 void tick_increment(){
-	g_cur_tick += TICK_FREQ;
+	g_common_apis_ram.tick += TICK_FREQ;
 }
 
 void timebase_init(void){
 
 	/*Disable global Interrupts*/
 	__disable_irq();
-	/*Load the timer with the number of clock cycle per second */
-    SysTick->LOAD = ONE_SEC_LOAD - 1;
+	/*the shared block is not zeroed by the startup code*/
+	g_common_apis_ram.tick = 0;
+	/*Load the timer with the number of clock cycle per tick, from the current HCLK */
+    SysTick->LOAD = (clock_get_hclk() / TICK_RATE_HZ) - 1;
 	/*clear systick current value register */
     SysTick->VAL = 0;
 	/*select internal clock source */
@@ -57,6 +65,8 @@ void timebase_init(void){
 
 }
 
-void SysTick_Handler(void){
-	tick_increment();
+/* from SRAM so the tick goes on during a flash erase; tick_increment stays in flash, the
+ * applications call it (common_apis.h) and the SRAM of the bootloader is theirs by then */
+RAMFUNC void SysTick_Handler(void){
+	g_common_apis_ram.tick += TICK_FREQ;
 }
@@ -1,25 +1,77 @@
 #include "uart.h"
+#include "clock.h"
+#include "timebase.h"
+#include "ramfunc.h"
 #include<stdint.h>
 
 #define GPIOAEN (1U<<0)
 #define USART2EN (1U<<17)
+#define DMA1EN (1U<<21)
 #define DBG_UART_BAUDRATE 115200//popular baudrate, refer online
-#define SYS_FREQ 16000000
-/*refer clocks and startup in datasheet
- = FREQ of HSI(FREQ of internal clock)*/
-#define APB1_CLK SYS_FREQ
 #define CR1_TE (1U<<3)
 #define CR1_RE (1U<<2)
 #define CR1_UE (1U<<13)
+#define CR3_DMAT (1U<<7)
+#define CR3_DMAR (1U<<6)
 #define SR_TXE (1U<<7)
+#define SR_TC (1U<<6)
+#define SR_RXNE (1U<<5)
+
+/*USART2_TX: DMA1 stream 6 channel 4 (refer DMA1 request mapping in RM)*/
+#define TX_DMA_STREAM DMA1_Stream6
+#define TX_DMA_CHANNEL (4U<<DMA_SxCR_CHSEL_Pos)
+#define TX_DMA_TCIF DMA_HISR_TCIF6
+#define TX_DMA_TEIF DMA_HISR_TEIF6
+#define TX_DMA_CLEAR_ALL (DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6)
+
+/*USART2_RX: DMA1 stream 5 channel 4*/
+#define RX_DMA_STREAM DMA1_Stream5
+#define RX_DMA_CHANNEL (4U<<DMA_SxCR_CHSEL_Pos)
+#define RX_DMA_CLEAR_ALL (DMA_HIFCR_CTCIF5 | DMA_HIFCR_CHTIF5 | DMA_HIFCR_CTEIF5 | DMA_HIFCR_CDMEIF5 | DMA_HIFCR_CFEIF5)
 
 static void usart_set_baudrate(uint32_t periph_clk, uint32_t baudrate);
 static void uart_write(int ch);
+RAMFUNC static void uart_tx_dma_kick(void);
+RAMFUNC static void uart_tx_dma_complete(void);
+
+/* Transmit ring: head is written only by the producer (_write/__io_putchar),
+ * tail and inflight only by the DMA completion. Indexes are free running. */
+static uint8_t tx_ring[UART_TX_RING_SIZE];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+static volatile uint32_t tx_inflight;
+static volatile uint32_t tx_dropped;
+static uint8_t tx_policy;
+static uint8_t tx_dma_ready;
+
+/* Receive ring: written by the DMA stream in circular mode, the write position is
+ * UART_RX_RING_SIZE - NDTR. rx_tail is the free running read index. */
+static uint8_t rx_ring[UART_RX_RING_SIZE];
+static uint32_t rx_tail;
+static uint32_t rx_dbm_len;
+
 int __io_putchar(int ch) {
-	uart_write(ch);
+	uint8_t c = (uint8_t)ch;
+
+	if (tx_dma_ready) {
+		uart_dma_write(&c, 1);
+	} else {
+		uart_write(ch);
+	}
 	return ch;
 }
 
+/* called by _write in syscalls.c with the whole printf buffer */
+int __io_write(char *ptr, int len) {
+	if (!tx_dma_ready) {
+		for (int i = 0; i < len; i++) {
+			uart_write(ptr[i]);
+		}
+		return len;
+	}
+	return (int)uart_dma_write((const uint8_t *)ptr, (uint32_t)len);
+}
+
 void system_uart_init(void) {
 	/* Enable clock access to GPIOA */
 	RCC->AHB1ENR |= GPIOAEN;
@@ -41,8 +93,8 @@ void system_uart_init(void) {
 	GPIOA->AFR[0] &= ~(1U << 12);
 	/* Enable clock access to UsART2 */
 	RCC->APB1ENR |= USART2EN;
-	/* setting baudrate */
-	usart_set_baudrate(APB1_CLK, DBG_UART_BAUDRATE);
+	/* setting baudrate from the current APB1 clock (16 MHz HSI, 50 MHz after clock_init) */
+	usart_set_baudrate(clock_get_pclk1(), DBG_UART_BAUDRATE);
 	/* config transfer direction */
 	USART2->CR1 |= CR1_TE;
 	USART2->CR1 |= CR1_RE;
@@ -55,8 +107,251 @@ static void uart_write(int ch) {
 	while (!(USART2->SR & SR_TXE)) {
 	}
 	/* write to transmit data register */
-	USART2->DR |= ch & 0xff;
+	USART2->DR = ch & 0xff;
 }
+
+/* Debug UART with DMA transmit: printf returns as soon as the text is in the ring.
+ * policy: UART_TX_OVERFLOW_DROP or UART_TX_OVERFLOW_BLOCK when the ring is full */
+void system_uart_dma_init(uint8_t policy) {
+	system_uart_init();
+
+	tx_head = 0;
+	tx_tail = 0;
+	tx_inflight = 0;
+	tx_dropped = 0;
+	tx_policy = policy;
+
+	/* Enable clock access to DMA1 */
+	RCC->AHB1ENR |= DMA1EN;
+	TX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+	while (TX_DMA_STREAM->CR & DMA_SxCR_EN) {
+	}
+	/* channel 4, memory to peripheral, memory increment, byte size, TC and TE interrupt */
+	TX_DMA_STREAM->CR = TX_DMA_CHANNEL | DMA_SxCR_DIR_0 | DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+	/* direct mode */
+	TX_DMA_STREAM->FCR = 0;
+	TX_DMA_STREAM->PAR = (uint32_t)&USART2->DR;
+	DMA1->HIFCR = TX_DMA_CLEAR_ALL;
+
+	/* let USART2 raise DMA requests on TXE */
+	USART2->CR3 |= CR3_DMAT;
+
+	NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+	tx_dma_ready = 1;
+}
+
+/* copy data into the ring and start DMA if idle, returns number of bytes accepted */
+uint32_t uart_dma_write(const uint8_t *data, uint32_t len) {
+	uint32_t copied = 0;
+
+	while (copied < len) {
+		uint32_t head = tx_head;
+		uint32_t space = UART_TX_RING_SIZE - (head - tx_tail);
+
+		if (space == 0) {
+			if (tx_policy == UART_TX_OVERFLOW_DROP) {
+				tx_dropped += len - copied;
+				break;
+			}
+			/* block: keep the ring draining, poll the flag in case interrupts are masked */
+			uart_tx_dma_kick();
+			if (DMA1->HISR & (TX_DMA_TCIF | TX_DMA_TEIF)) {
+				uint32_t primask = __get_PRIMASK();
+				__disable_irq();
+				uart_tx_dma_complete();
+				__set_PRIMASK(primask);
+			}
+			continue;
+		}
+
+		/* copy up to the end of the buffer, the wrap is done in the next iteration */
+		uint32_t idx = head % UART_TX_RING_SIZE;
+		uint32_t chunk = UART_TX_RING_SIZE - idx;
+		if (chunk > space) {
+			chunk = space;
+		}
+		if (chunk > len - copied) {
+			chunk = len - copied;
+		}
+		for (uint32_t i = 0; i < chunk; i++) {
+			tx_ring[idx + i] = data[copied + i];
+		}
+		copied += chunk;
+
+		/* data must be visible before the head is published */
+		__DMB();
+		tx_head = head + chunk;
+	}
+
+	uart_tx_dma_kick();
+	return copied;
+}
+
+/* wait until every queued byte has left the shift register (before reset or jump) */
+void uart_dma_flush(void) {
+	if (tx_dma_ready) {
+		while (tx_head != tx_tail) {
+			uart_tx_dma_kick();
+			if (DMA1->HISR & (TX_DMA_TCIF | TX_DMA_TEIF)) {
+				uint32_t primask = __get_PRIMASK();
+				__disable_irq();
+				uart_tx_dma_complete();
+				__set_PRIMASK(primask);
+			}
+		}
+	}
+	while (!(USART2->SR & SR_TC)) {
+	}
+}
+
+uint32_t uart_dma_dropped(void) {
+	return tx_dropped;
+}
+
+/* start DMA on the contiguous part of the ring if nothing is in flight */
+RAMFUNC static void uart_tx_dma_kick(void) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (tx_inflight == 0 && tx_head != tx_tail) {
+		uint32_t idx = tx_tail % UART_TX_RING_SIZE;
+		uint32_t len = tx_head - tx_tail;
+
+		/* DMA does not wrap, send up to the end of the buffer first */
+		if (len > UART_TX_RING_SIZE - idx) {
+			len = UART_TX_RING_SIZE - idx;
+		}
+		tx_inflight = len;
+		DMA1->HIFCR = TX_DMA_CLEAR_ALL;
+		TX_DMA_STREAM->M0AR = (uint32_t)&tx_ring[idx];
+		TX_DMA_STREAM->NDTR = len;
+		/* TC must be cleared before the transfer, refer USART DMA transmission in RM */
+		USART2->SR &= ~SR_TC;
+		TX_DMA_STREAM->CR |= DMA_SxCR_EN;
+	}
+	__set_PRIMASK(primask);
+}
+
+/* release the finished segment (an errored one is dropped) and continue with the rest */
+RAMFUNC static void uart_tx_dma_complete(void) {
+	if (DMA1->HISR & (TX_DMA_TCIF | TX_DMA_TEIF)) {
+		DMA1->HIFCR = TX_DMA_CLEAR_ALL;
+		tx_tail += tx_inflight;
+		tx_inflight = 0;
+		uart_tx_dma_kick();
+	}
+}
+
+/* handler and the restart of the transmission in SRAM: printf output keeps flowing during an erase */
+RAMFUNC void DMA1_Stream6_IRQHandler(void) {
+	uart_tx_dma_complete();
+}
+
+/* Receive with DMA in circular mode: no interrupt per byte, bytes keep arriving while the CPU
+ * is stalled by a flash erase/program. The reader must keep up with the ring (no overrun check) */
+void uart_rx_dma_start(void) {
+	RCC->AHB1ENR |= DMA1EN;
+	RX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+	while (RX_DMA_STREAM->CR & DMA_SxCR_EN) {
+	}
+	/* channel 4, peripheral to memory, memory increment, byte size, circular */
+	RX_DMA_STREAM->CR = RX_DMA_CHANNEL | DMA_SxCR_MINC | DMA_SxCR_CIRC;
+	RX_DMA_STREAM->FCR = 0;
+	RX_DMA_STREAM->PAR = (uint32_t)&USART2->DR;
+	RX_DMA_STREAM->M0AR = (uint32_t)rx_ring;
+	RX_DMA_STREAM->NDTR = UART_RX_RING_SIZE;
+	DMA1->HIFCR = RX_DMA_CLEAR_ALL;
+	rx_tail = 0;
+
+	/* drop a byte (and an overrun) left in the data register before the stream takes over */
+	(void)USART2->SR;
+	(void)USART2->DR;
+	RX_DMA_STREAM->CR |= DMA_SxCR_EN;
+	USART2->CR3 |= CR3_DMAR;
+}
+
+void uart_rx_dma_stop(void) {
+	USART2->CR3 &= ~CR3_DMAR;
+	RX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+	while (RX_DMA_STREAM->CR & DMA_SxCR_EN) {
+	}
+	DMA1->HIFCR = RX_DMA_CLEAR_ALL;
+}
+
+static uint32_t uart_rx_available(void) {
+	uint32_t head = UART_RX_RING_SIZE - RX_DMA_STREAM->NDTR;
+
+	return (head + UART_RX_RING_SIZE - (rx_tail % UART_RX_RING_SIZE)) % UART_RX_RING_SIZE;
+}
+
+/* next received byte, -1 when the ring is empty */
+int uart_getc(void) {
+	uint8_t c;
+
+	if (uart_rx_available() == 0) {
+		return -1;
+	}
+	c = rx_ring[rx_tail % UART_RX_RING_SIZE];
+	rx_tail++;
+	return c;
+}
+
+/*
+ * Receive with DMA in double buffer mode: the stream fills buf0, then buf1, then buf0 again...
+ * A completed buffer can be processed while the stream fills the other one; the sender must
+ * not get more than one buffer ahead (flow control of the protocol on top).
+ */
+void uart_rx_dbm_start(uint8_t *buf0, uint8_t *buf1, uint32_t len) {
+	RCC->AHB1ENR |= DMA1EN;
+	RX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+	while (RX_DMA_STREAM->CR & DMA_SxCR_EN) {
+	}
+	/* channel 4, peripheral to memory, memory increment, byte size, double buffer (implies circular) */
+	RX_DMA_STREAM->CR = RX_DMA_CHANNEL | DMA_SxCR_MINC | DMA_SxCR_DBM;
+	RX_DMA_STREAM->FCR = 0;
+	RX_DMA_STREAM->PAR = (uint32_t)&USART2->DR;
+	RX_DMA_STREAM->M0AR = (uint32_t)buf0;
+	RX_DMA_STREAM->M1AR = (uint32_t)buf1;
+	RX_DMA_STREAM->NDTR = len;
+	DMA1->HIFCR = RX_DMA_CLEAR_ALL;
+	rx_dbm_len = len;
+
+	(void)USART2->SR;
+	(void)USART2->DR;
+	RX_DMA_STREAM->CR |= DMA_SxCR_EN;
+	USART2->CR3 |= CR3_DMAR;
+}
+
+/* buffer (0 or 1) completed since the last call, UART_RX_NONE while the stream is still filling */
+int uart_rx_dbm_poll(void) {
+	if (!(DMA1->HISR & DMA_HISR_TCIF5)) {
+		return UART_RX_NONE;
+	}
+	DMA1->HIFCR = DMA_HIFCR_CTCIF5;
+	/* CT already points to the buffer being filled */
+	return (RX_DMA_STREAM->CR & DMA_SxCR_CT) ? 0 : 1;
+}
+
+/* bytes already received in the buffer being filled */
+uint32_t uart_rx_dbm_pending(void) {
+	return rx_dbm_len - RX_DMA_STREAM->NDTR;
+}
+
+/* discard received bytes until the line stayed idle for idle_ms (stream must be stopped) */
+void uart_rx_drain(uint32_t idle_ms) {
+	uint32_t start = get_tick();
+
+	while (get_tick() - start < idle_ms) {
+		if (USART2->SR & SR_RXNE) {
+			(void)USART2->DR;
+			start = get_tick();
+		}
+	}
+	/* clear an overrun left by the bytes nobody read */
+	(void)USART2->SR;
+	(void)USART2->DR;
+}
+
 //Note: this code applied only when dont use Oversampling
 static uint16_t compute_usart_baudrate(uint32_t periph_clk, uint32_t baudrate) {
 	return ((periph_clk + (baudrate / 2U)) / baudrate);
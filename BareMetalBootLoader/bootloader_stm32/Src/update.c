@@ -0,0 +1,343 @@
+#include "update.h"
+#include "uart.h"
+#include "flash.h"
+#include "crc32.h"
+#include "image.h"
+#include "timebase.h"
+#include "slots.h"
+#include "lz4.h"
+#include <stddef.h>
+
+#define UPD_MAGIC_OFFSET (IMAGE_HEADER_OFFSET + offsetof(image_header_t, magic))
+
+/* ping-pong pair filled by the RX DMA stream, a frame is handled in place */
+static update_frame_t rx_buf[2];
+
+typedef struct{
+	uint32_t slot;       /* base address of the slot, 0 until START succeeded */
+	uint32_t slot_size;
+	uint32_t length;     /* announced image length */
+	uint32_t stream_length; /* bytes sent in DATA frames, the compressed size with UPD_FLAG_LZ4 */
+	uint32_t next;       /* stream offset expected in the next DATA frame */
+	uint32_t written;    /* image bytes programmed */
+	uint32_t magic;      /* held back header magic */
+	uint32_t flags;      /* @UPD_Flags */
+	uint32_t source;     /* slot the delta is applied to, 0 without UPD_FLAG_DELTA */
+	uint32_t dict;       /* length of the source image, decoder positions below it are read from there */
+	uint32_t page_fill;  /* decompressed bytes waiting in page */
+	uint8_t error;       /* program error while decompressing */
+	lz4_stream_t lz4;
+}update_state_t;
+
+/* decompressed output is collected here and programmed a page at a time */
+static uint32_t page[UPD_PAGE_SIZE / 4U];
+
+static void update_reply(const update_state_t *st, uint8_t code, uint8_t status){
+	update_reply_t reply = {code, status, 0, st->next};
+
+	uart_dma_write((const uint8_t *)&reply, sizeof(reply));
+}
+
+static uint8_t update_check(const update_frame_t *frame){
+	if (frame->sof != UPD_SOF || (frame->len & 0x3U) || frame->len > UPD_MAX_PAYLOAD) {
+		return UPD_ERR_FRAME;
+	}
+	crc32_begin();
+	crc32_feed((const uint32_t *)frame, (sizeof(update_frame_t) - 4U) / 4U);
+	if (crc32_end() != frame->crc) {
+		return UPD_ERR_CRC;
+	}
+	return UPD_OK;
+}
+
+/* lost sync: let the host stop sending, restart both buffers from the beginning and NACK */
+static void update_resync(const update_state_t *st, uint8_t status){
+	uart_rx_dma_stop();
+	uart_rx_drain(UPD_RESYNC_IDLE_MS);
+	uart_rx_dbm_start((uint8_t *)&rx_buf[0], (uint8_t *)&rx_buf[1], UPD_FRAME_SIZE);
+	update_reply(st, UPD_NACK, status);
+}
+
+/* program image words at offset, the header magic is kept back for update_end */
+static uint8_t update_program(update_state_t *st, uint32_t offset, uint32_t *data, uint32_t words){
+	if (UPD_MAGIC_OFFSET >= offset && UPD_MAGIC_OFFSET < offset + words * 4U) {
+		st->magic = data[(UPD_MAGIC_OFFSET - offset) / 4U];
+		data[(UPD_MAGIC_OFFSET - offset) / 4U] = 0xFFFFFFFFU;
+	}
+	if (flash_program(st->slot + offset, data, words) != FLASH_OK) {
+		return UPD_ERR_FLASH;
+	}
+	st->written = offset + words * 4U;
+	return UPD_OK;
+}
+
+/* decoder output: fill the page, program it when full */
+static void update_put(void *ctx, uint8_t byte){
+	update_state_t *st = ctx;
+
+	((uint8_t *)page)[st->page_fill++] = byte;
+	if (st->page_fill == UPD_PAGE_SIZE) {
+		if (update_program(st, st->written, page, UPD_PAGE_SIZE / 4U) != UPD_OK) {
+			st->error = UPD_ERR_FLASH;
+		}
+		st->page_fill = 0;
+	}
+}
+
+/*
+ * decoder back reference: from the source image of a delta, the page, the held back magic, or the
+ * flash already written
+ */
+static uint8_t update_get(void *ctx, uint32_t pos){
+	update_state_t *st = ctx;
+
+	if (pos < st->dict) {
+		return *(volatile uint8_t *)(uintptr_t)(st->source + pos);
+	}
+	pos -= st->dict;
+	if (pos >= st->written) {
+		return ((uint8_t *)page)[pos - st->written];
+	}
+	if (pos >= UPD_MAGIC_OFFSET && pos < UPD_MAGIC_OFFSET + 4U) {
+		return (uint8_t)(st->magic >> ((pos - UPD_MAGIC_OFFSET) * 8U));
+	}
+	return *(volatile uint8_t *)(uintptr_t)(st->slot + pos);
+}
+
+/*
+ * delta source: a valid image in another slot (by default the other A/B slot) whose CRC is the one
+ * the patch was made against. Its length becomes the decoder dictionary
+ */
+static uint8_t update_source(update_state_t *st, uint32_t source, uint32_t source_crc){
+	if (source == 0U) {
+		source = (st->slot == SLOT_A_ADDRESS) ? SLOT_B_ADDRESS : SLOT_A_ADDRESS;
+	}
+	if (source == st->slot || flash_sector_of(source) < UPD_SLOT_FIRST_SECTOR ||
+	    flash_sector_of(source) > UPD_SLOT_LAST_SECTOR || source != flash_sector_base(flash_sector_of(source))) {
+		return UPD_ERR_PARAM;
+	}
+	if (image_verify(source, SLOT_IMAGE_MAX) != IMAGE_OK || image_header(source)->crc != source_crc) {
+		return UPD_ERR_SOURCE;
+	}
+	st->source = source;
+	st->dict = image_header(source)->length;
+	return UPD_OK;
+}
+
+static uint8_t update_start(update_state_t *st, const uint32_t *payload, uint32_t len){
+	uint32_t addr = payload[0];
+	uint32_t length = payload[1];
+	uint8_t sector;
+	uint8_t status;
+
+	//no address: the A/B slot which is not running
+	if (addr == 0U) {
+		addr = slot_update_target();
+	}
+	sector = flash_sector_of(addr);
+	st->slot = 0;
+	st->flags = (len >= 16U) ? payload[2] : 0U;
+	st->stream_length = (len >= 16U) ? payload[3] : length;
+	if ((len != 8U && len != 16U && len != 24U) || sector < UPD_SLOT_FIRST_SECTOR ||
+	    sector > UPD_SLOT_LAST_SECTOR || addr != flash_sector_base(sector)) {
+		return UPD_ERR_PARAM;
+	}
+	//a delta is an LZ4 stream with the source image as dictionary
+	if ((st->flags & ~(UPD_FLAG_LZ4 | UPD_FLAG_DELTA)) || ((st->flags & UPD_FLAG_DELTA) && len != 24U) ||
+	    ((st->flags & UPD_FLAG_DELTA) && !(st->flags & UPD_FLAG_LZ4)) ||
+	    (!(st->flags & UPD_FLAG_LZ4) && st->stream_length != length)) {
+		return UPD_ERR_PARAM;
+	}
+	//the slot trailer (slots.h) stays outside the image
+	st->slot_size = flash_sector_base(sector + 1U) - addr - SLOT_TRAILER_SIZE;
+	if ((length & 0x3U) || length < (IMAGE_HEADER_OFFSET + sizeof(image_header_t)) ||
+	    length > st->slot_size) {
+		return UPD_ERR_PARAM;
+	}
+	st->slot = addr;
+	st->source = 0;
+	st->dict = 0;
+	if (st->flags & UPD_FLAG_DELTA) {
+		status = update_source(st, payload[4], payload[5]);
+		if (status != UPD_OK) {
+			st->slot = 0;
+			return status;
+		}
+	}
+
+	slot_forget(addr);
+	if (flash_erase_sector(sector) != FLASH_OK) {
+		st->slot = 0;
+		return UPD_ERR_FLASH;
+	}
+	st->length = length;
+	st->next = 0;
+	st->written = 0;
+	st->magic = 0xFFFFFFFFU;
+	st->page_fill = 0;
+	st->error = UPD_OK;
+	lz4_stream_init(&st->lz4, update_put, update_get, st, length);
+	lz4_stream_dict(&st->lz4, st->dict);
+	return UPD_OK;
+}
+
+/*
+ * program the chunk in place, or decompress it through the page buffer.
+ * The ACK frees the buffer (the other one is filling meanwhile)
+ */
+static uint8_t update_data(update_state_t *st, uint32_t *payload, uint32_t len){
+	uint32_t offset = payload[0];
+	uint32_t *data = &payload[1];
+	uint32_t bytes;
+
+	if (st->slot == 0U || len < 4U) {
+		return UPD_ERR_SEQ;
+	}
+	if (st->error != UPD_OK) {
+		return st->error;
+	}
+	bytes = len - 4U;
+	if (offset + bytes <= st->next) {
+		//retransmission of a chunk already written
+		return UPD_OK;
+	}
+	if (offset != st->next || offset >= st->stream_length) {
+		return UPD_ERR_SEQ;
+	}
+	//the compressed stream is not a multiple of 4, its last frame is padded
+	if (bytes > st->stream_length - offset) {
+		bytes = st->stream_length - offset;
+	}
+
+	if (st->flags & UPD_FLAG_LZ4) {
+		if (lz4_stream_feed(&st->lz4, (const uint8_t *)data, bytes) != LZ4_OK) {
+			return UPD_ERR_DECODE;
+		}
+		if (st->error != UPD_OK) {
+			return st->error;
+		}
+	} else if (update_program(st, offset, data, bytes / 4U) != UPD_OK) {
+		return UPD_ERR_FLASH;
+	}
+	st->next += bytes;
+	return UPD_OK;
+}
+
+/*
+ * slot_select starts the newer of the A/B images, a tie goes to A: an image which is not newer
+ * than the valid one in the other A/B slot would be reported written and never start. Checked
+ * before the magic goes in, so a refused image stays invalid
+ */
+static uint8_t update_version(const update_state_t *st){
+	uint32_t other;
+
+	if (st->slot != SLOT_A_ADDRESS && st->slot != SLOT_B_ADDRESS) {
+		return UPD_OK;
+	}
+	other = (st->slot == SLOT_A_ADDRESS) ? SLOT_B_ADDRESS : SLOT_A_ADDRESS;
+	if (*(volatile uint32_t *)(other + SLOT_SIZE - SLOT_TRAILER_SIZE + 4U) == SLOT_MARK_REJECTED ||
+	    image_verify(other, SLOT_IMAGE_MAX) != IMAGE_OK) {
+		return UPD_OK;
+	}
+	return (image_header(st->slot)->version > image_header(other)->version) ? UPD_OK : UPD_ERR_VERSION;
+}
+
+/* complete the header with the held back magic and check the whole image */
+static uint8_t update_end(update_state_t *st){
+	if (st->slot == 0U || st->next != st->stream_length) {
+		return UPD_ERR_SEQ;
+	}
+	if (st->flags & UPD_FLAG_LZ4) {
+		//the image length is a multiple of 4, so is the last partial page
+		if (!lz4_stream_complete(&st->lz4) || st->lz4.out_pos != st->dict + st->length) {
+			return UPD_ERR_DECODE;
+		}
+		if (st->page_fill && update_program(st, st->written, page, st->page_fill / 4U) != UPD_OK) {
+			return UPD_ERR_FLASH;
+		}
+	}
+	if (update_version(st) != UPD_OK) {
+		return UPD_ERR_VERSION;
+	}
+	if (flash_program(st->slot + UPD_MAGIC_OFFSET, &st->magic, 1) != FLASH_OK) {
+		return UPD_ERR_FLASH;
+	}
+	if (image_verify(st->slot, st->slot_size) != IMAGE_OK) {
+		return UPD_ERR_IMAGE;
+	}
+	return UPD_OK;
+}
+
+/*
+ * run the update protocol until END, ABORT or UPD_IDLE_TIMEOUT_MS without a frame.
+ * USART2 must be running with DMA (system_uart_dma_init), nothing else may print meanwhile.
+ * The receive ring of the menu (uart_rx_dma_start) is replaced by the ping-pong pair and
+ * restarted on return.
+ * Returns @UPD_Status, *slot is the written slot on UPD_OK
+ */
+uint8_t update_run(uint32_t *slot){
+	update_state_t st = {0};
+	uint32_t idle_start = get_tick();
+	uint32_t frame_start = 0;
+	uint8_t receiving = 0;
+	uint8_t status;
+
+	uart_rx_dma_stop();
+	uart_rx_dbm_start((uint8_t *)&rx_buf[0], (uint8_t *)&rx_buf[1], UPD_FRAME_SIZE);
+	while (1) {
+		int idx = uart_rx_dbm_poll();
+		update_frame_t *frame;
+
+		if (idx == UART_RX_NONE) {
+			if (uart_rx_dbm_pending() == 0U) {
+				if (get_tick() - idle_start >= UPD_IDLE_TIMEOUT_MS) {
+					status = UPD_ERR_TIMEOUT;
+					break;
+				}
+			} else if (!receiving) {
+				receiving = 1;
+				frame_start = get_tick();
+			} else if (get_tick() - frame_start >= UPD_FRAME_TIMEOUT_MS) {
+				//bytes lost: the frame boundaries no longer match the buffers
+				update_resync(&st, UPD_ERR_FRAME);
+				receiving = 0;
+				idle_start = get_tick();
+			}
+			continue;
+		}
+		receiving = 0;
+		idle_start = get_tick();
+
+		frame = &rx_buf[idx];
+		status = update_check(frame);
+		if (status != UPD_OK) {
+			update_resync(&st, status);
+			continue;
+		}
+
+		if (frame->cmd == UPD_CMD_START) {
+			status = update_start(&st, frame->payload, frame->len);
+		} else if (frame->cmd == UPD_CMD_DATA) {
+			status = update_data(&st, frame->payload, frame->len);
+		} else if (frame->cmd == UPD_CMD_END) {
+			status = update_end(&st);
+		} else if (frame->cmd == UPD_CMD_ABORT) {
+			update_reply(&st, UPD_ACK, UPD_OK);
+			status = UPD_ERR_ABORT;
+			break;
+		} else {
+			status = UPD_ERR_SEQ;
+		}
+		update_reply(&st, status == UPD_OK ? UPD_ACK : UPD_NACK, status);
+		if (frame->cmd == UPD_CMD_END && status == UPD_OK) {
+			*slot = st.slot;
+			break;
+		}
+	}
+
+	flash_lock();
+	uart_dma_flush();
+	uart_rx_dma_stop();
+	uart_rx_dma_start();
+	return status;
+}
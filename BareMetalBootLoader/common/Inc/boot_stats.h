@@ -0,0 +1,55 @@
+#ifndef BOOT_STATS_H_
+#define BOOT_STATS_H_
+
+#include<stdint.h>
+
+/*
+ * Boot statistics written by the bootloader just before the jump and read by the application.
+ * The block lives in .custom_ram_block (0x20000100, NOLOAD) which every linker script reserves,
+ * so the startup code of the application neither copies nor zeroes it.
+ */
+#define BOOT_STATS_MAGIC 0xB0075747U
+
+#define BOOT_MODE_FAST 1U//no UART/SysTick, straight validate and jump
+#define BOOT_MODE_MENU 2U//button pressed, image selected from the UART menu
+
+typedef struct{
+	uint32_t magic;          /* BOOT_STATS_MAGIC once the bootloader has written the block */
+	uint32_t boot_count;     /* boots since power-up (RAM keeps its content over a reset) */
+	uint32_t boot_mode;      /* BOOT_MODE_x */
+	uint32_t app_address;    /* image the bootloader jumped to */
+	uint32_t clock_cycles;   /* core cycles from reset to the end of clock_init (mostly 16 MHz HSI) */
+	uint32_t total_cycles;   /* core cycles from reset to the jump */
+	uint32_t boot_time_us;   /* reset to jump, both clock domains converted to us */
+	uint32_t hclk_hz;        /* HCLK handed over to the application */
+	uint32_t verify_cycles;  /* core cycles spent in the header/CRC32 check of the image */
+}boot_stats_t;
+
+extern volatile boot_stats_t g_boot_stats;
+
+#define BOOT_STATS_SECTION __attribute__((section(".custom_ram_block")))
+
+/*
+ * A/B boot control, next to the statistics in the same NOLOAD block (own input section so the
+ * linker keeps the order). The bootloader counts the boots of an unconfirmed image in attempts;
+ * the application confirms itself with boot_confirm() once it is healthy, the bootloader then
+ * marks the slot confirmed in flash at the next reset.
+ */
+#define BOOT_CTRL_MAGIC 0xB007C791U
+
+typedef struct{
+	uint32_t magic;          /* BOOT_CTRL_MAGIC once the bootloader has written the block */
+	uint32_t slot;           /* image base of the slot being tried */
+	uint32_t attempts;       /* boots of that slot without a confirmation */
+	uint32_t confirm;        /* image base confirmed by the running application, 0 if none */
+}boot_ctrl_t;
+
+extern volatile boot_ctrl_t g_boot_ctrl;
+
+#define BOOT_CTRL_SECTION __attribute__((section(".custom_ram_block.ctrl")))
+
+static inline void boot_confirm(uint32_t image_base){
+	g_boot_ctrl.confirm = image_base;
+}
+
+#endif /* BOOT_STATS_H_ */
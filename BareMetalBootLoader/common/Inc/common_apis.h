@@ -0,0 +1,70 @@
+#ifndef COMMON_APIS_H_
+#define COMMON_APIS_H_
+
+#include<stdint.h>
+#include<stdbool.h>
+
+/*
+ * Services of the bootloader used by the applications instead of their own copy of the drivers.
+ * This header and boot_stats.h are shared by all four projects: BareMetalBootLoader/common/Inc is
+ * on the include path of each, so the bootloader and the applications cannot drift apart.
+ * The bootloader links blt_common_apis into .COMMON_APIS at COMMON_APIS_ADDRESS (its linker
+ * script), an application only includes this header: bsp.h, clock.h, fpu.h and timebase.h of the
+ * applications call through the table.
+ *
+ * ABI rules: entries are only ever appended, with COMMON_APIS_VERSION_MINOR raised; an entry that
+ * changes meaning raises COMMON_APIS_VERSION_MAJOR. An application runs on a bootloader with the
+ * same major and at least the minor it was built with (common_apis_ok).
+ *
+ * The entries keep no state in the RAM of the bootloader, which belongs to the application once
+ * it runs. What they need lives in common_apis_ram_t, in the NOLOAD block next to the boot
+ * statistics (boot_stats.h) which every image defines so the linker scripts reserve it.
+ */
+#define COMMON_APIS_ADDRESS 0x08000200U//after the vector table of the bootloader
+#define COMMON_APIS_MAGIC 0x41504943U//"CIPA"
+#define COMMON_APIS_VERSION_MAJOR 1U
+#define COMMON_APIS_VERSION_MINOR 0U
+
+typedef struct{
+	uint32_t magic;              /* COMMON_APIS_MAGIC */
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t size;               /* sizeof(common_apis_t) in the bootloader */
+	void (*fpu_enable)(void);
+	void (*clock_init)(void);
+	uint32_t (*clock_get_hclk)(void);
+	uint32_t (*clock_get_pclk1)(void);
+	uint32_t (*clock_get_pclk2)(void);
+	void (*flash_art_enable)(void);
+	void (*flash_art_reset)(void);
+	void (*timebase_init)(void);
+	uint32_t (*get_tick)(void);
+	void (*delay)(uint32_t delay);
+	void (*tick_increment)(void);   /* from the SysTick_Handler of the running image */
+	void (*led_init)(void);
+	void (*led_on)(void);
+	void (*led_off)(void);
+	void (*button_init)(void);
+	void (*button_deinit)(void);
+	bool (*get_btn_state)(void);
+}common_apis_t;
+
+#define COMMON_APIS ((const common_apis_t *)COMMON_APIS_ADDRESS)
+
+typedef struct{
+	uint32_t tick;               /* ms since timebase_init */
+}common_apis_ram_t;
+
+extern volatile common_apis_ram_t g_common_apis_ram;
+
+#define COMMON_APIS_RAM_SECTION __attribute__((section(".custom_ram_block.apis")))
+
+/* the table is there and provides everything this image was built against */
+static inline bool common_apis_ok(void){
+	return COMMON_APIS->magic == COMMON_APIS_MAGIC &&
+	       COMMON_APIS->version_major == COMMON_APIS_VERSION_MAJOR &&
+	       COMMON_APIS->version_minor >= COMMON_APIS_VERSION_MINOR &&
+	       COMMON_APIS->size >= sizeof(common_apis_t);
+}
+
+#endif /* COMMON_APIS_H_ */
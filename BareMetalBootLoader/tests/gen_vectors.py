@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Test vectors for test_update.c, made with tools/imgtool.py.
+
+Two signed images v1 (installed) and v2 (the update), the LZ4 stream of
+v2 and the delta v1 -> v2, and for every way of sending v2 the frames
+imgtool.py puts on the UART (START, DATA..., END):
+
+    python3 gen_vectors.py <output directory>
+"""
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools"))
+import imgtool  # noqa: E402
+
+SLOT_B_ADDRESS = 0x08008000
+
+
+def make_image(rng, words, version):
+    # code-like content: a small instruction set repeated with varying operands compresses
+    # like a real image, some constants and a string table do not
+    ops = [rng.getrandbits(32) for _ in range(48)]
+    body = bytearray()
+    for i in range(words):
+        if i % 97 < 7:
+            body += struct.pack("<I", rng.getrandbits(32))
+        else:
+            body += struct.pack("<I", ops[rng.randrange(len(ops))] ^ (i & 0x7))
+    struct.pack_into("<IIII", body, imgtool.HEADER_OFFSET, imgtool.MAGIC, len(body), version,
+                     imgtool.CRC_UNSIGNED)
+    # the magic again in a constant table: a match back into the header, whose magic the
+    # bootloader holds back until END
+    struct.pack_into("<I", body, 0x1000, imgtool.MAGIC)
+    return body
+
+
+def patch_image(rng, image, version):
+    # v2: a few functions changed and some code inserted, as a rebuild does
+    new = bytearray(image)
+    for _ in range(6):
+        at = rng.randrange(imgtool.HEADER_OFFSET + 16, len(new) - 64) & ~3
+        new[at:at + 32] = bytes(rng.getrandbits(8) for _ in range(32))
+    at = (len(new) // 2) & ~3
+    new[at:at] = new[at + 512:at + 768]
+    struct.pack_into("<II", new, imgtool.HEADER_OFFSET + 4, len(new), version)
+    return new
+
+
+def write(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def frames(request, stream):
+    # the frames of imgtool.update: START, DATA with the offset first and padded chunks, END
+    out = imgtool.update_frame(imgtool.UPD_CMD_START, request)
+    for sent in range(0, len(stream), imgtool.UPD_CHUNK_SIZE):
+        chunk = stream[sent:sent + imgtool.UPD_CHUNK_SIZE]
+        out += imgtool.update_frame(imgtool.UPD_CMD_DATA, struct.pack("<I", sent) + chunk
+                                    + bytes(-len(chunk) % 4))
+    return out + imgtool.update_frame(imgtool.UPD_CMD_END, b"")
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: gen_vectors.py <output directory>")
+    out = sys.argv[1]
+    rng = random.Random(411)
+
+    v1_path = os.path.join(out, "v1.bin")
+    v2_path = os.path.join(out, "v2.bin")
+    v1 = make_image(rng, 0xA00, 0x01000000)
+    write(v1_path, v1)
+    write(v2_path, patch_image(rng, v1, 0x01010000))
+    imgtool.sign(v1_path)
+    imgtool.sign(v2_path)
+    v1, v1_crc = imgtool.load_image(v1_path)
+    v2, _ = imgtool.load_image(v2_path)
+
+    lz4 = imgtool.lz4_compress(v2)
+    delta = imgtool.make_delta(v1, v2)
+    write(os.path.join(out, "v2.lz4"), lz4)
+    write(os.path.join(out, "v2.delta"), delta)
+
+    request = struct.pack("<II", SLOT_B_ADDRESS, len(v2))
+    write(os.path.join(out, "raw.frames"), frames(request, v2))
+    write(os.path.join(out, "lz4.frames"),
+          frames(request + struct.pack("<II", imgtool.UPD_FLAG_LZ4, len(lz4)), lz4))
+    # source 0: the other A/B slot, slot A, which the test loads with v1
+    write(os.path.join(out, "delta.frames"),
+          frames(request + struct.pack("<IIII", imgtool.UPD_FLAG_LZ4 | imgtool.UPD_FLAG_DELTA, len(delta),
+                                       0, v1_crc), delta))
+    print("v2 %u bytes, lz4 %u, delta %u" % (len(v2), len(lz4), len(delta)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
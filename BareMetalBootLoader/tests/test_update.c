@@ -0,0 +1,371 @@
+/*
+ * Host test of the update path, vectors made by gen_vectors.py with tools/imgtool.py:
+ *  - lz4.c decodes the LZ4 stream and the delta (installed image as dictionary) fed in small
+ *    pieces, byte exact;
+ *  - update_run (update.c) replays the frames imgtool.py sends, raw, LZ4 and delta, against a
+ *    flash kept in RAM at the addresses of sectors 0-3, with a retransmission, a bad frame, a
+ *    wrong delta source, an update without END and one not newer than the other slot.
+ * The UART, the tick and the slot bookkeeping are stubbed here, image.c, crc32.c (software),
+ * lz4.c and update.c are the bootloader sources. Build and run: make -C tests
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "update.h"
+#include "uart.h"
+#include "flash.h"
+#include "crc32.h"
+#include "image.h"
+#include "slots.h"
+#include "lz4.h"
+#include "timebase.h"
+
+#define FLASH_BASE_ADDR 0x08000000U
+#define FLASH_TEST_SIZE 0x10000U//sectors 0-3, the slots
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static int failures;
+
+typedef struct{
+	uint8_t *data;
+	uint32_t len;
+}blob_t;
+
+static blob_t load(const char *dir, const char *name){
+	char path[512];
+	blob_t b = {NULL, 0};
+	FILE *f;
+	long len;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0) {
+		printf("cannot read %s, run gen_vectors.py first\n", path);
+		exit(2);
+	}
+	rewind(f);
+	b.data = malloc((size_t)len);
+	b.len = (uint32_t)len;
+	if (fread(b.data, 1, b.len, f) != b.len) {
+		exit(2);
+	}
+	fclose(f);
+	return b;
+}
+
+/**********************************************************************************
+*  					    flash in RAM
+* *****************************************************************************/
+static const uint32_t sector_base[FLASH_SECTOR_COUNT + 1U] = {
+	0x08000000U, 0x08004000U, 0x08008000U, 0x0800C000U,
+	0x08010000U, 0x08020000U, 0x08040000U, 0x08060000U, 0x08080000U
+};
+static uint32_t erases;
+
+void flash_unlock(void){
+}
+
+void flash_lock(void){
+}
+
+uint8_t flash_sector_of(uint32_t addr){
+	for (uint8_t i = 0; i < FLASH_SECTOR_COUNT; i++) {
+		if (addr >= sector_base[i] && addr < sector_base[i + 1U]) {
+			return i;
+		}
+	}
+	return FLASH_SECTOR_NONE;
+}
+
+uint32_t flash_sector_base(uint8_t sector){
+	return sector_base[sector < FLASH_SECTOR_COUNT ? sector : FLASH_SECTOR_COUNT];
+}
+
+uint8_t flash_erase_sector(uint8_t sector){
+	if (sector == 0U || sector_base[sector + 1U] > FLASH_BASE_ADDR + FLASH_TEST_SIZE) {
+		return FLASH_ERR_PARAM;
+	}
+	memset((void *)(uintptr_t)sector_base[sector], 0xFF, sector_base[sector + 1U] - sector_base[sector]);
+	erases++;
+	return FLASH_OK;
+}
+
+/* programming only clears bits, like the real cells: a word programmed twice reads back wrong */
+uint8_t flash_program(uint32_t addr, const uint32_t *data, uint32_t words){
+	volatile uint32_t *dst = (volatile uint32_t *)(uintptr_t)addr;
+
+	if (words == 0U) {
+		return FLASH_OK;
+	}
+	if ((addr & 0x3U) || flash_sector_of(addr) == 0U || addr + words * 4U > FLASH_BASE_ADDR + FLASH_TEST_SIZE) {
+		return FLASH_ERR_PARAM;
+	}
+	for (uint32_t i = 0; i < words; i++) {
+		dst[i] &= data[i];
+		if (dst[i] != data[i]) {
+			return FLASH_ERR_VERIFY;
+		}
+	}
+	return FLASH_OK;
+}
+
+/**********************************************************************************
+*  					    UART, tick and slot stubs
+* *****************************************************************************/
+static const uint8_t *frames;
+static uint32_t frame_count;
+static uint32_t frame_next;
+static uint8_t *rx_buf[2];
+static int rx_idx;
+static update_reply_t replies[256];
+static uint32_t reply_count;
+static uint32_t tick;
+
+void uart_rx_dbm_start(uint8_t *buf0, uint8_t *buf1, uint32_t len){
+	(void)len;
+	rx_buf[0] = buf0;
+	rx_buf[1] = buf1;
+	rx_idx = 0;
+}
+
+/* the next frame lands in the buffer the DMA fills next */
+int uart_rx_dbm_poll(void){
+	int idx = rx_idx;
+
+	if (frame_next == frame_count) {
+		return UART_RX_NONE;
+	}
+	memcpy(rx_buf[idx], frames + frame_next * UPD_FRAME_SIZE, UPD_FRAME_SIZE);
+	frame_next++;
+	rx_idx ^= 1;
+	return idx;
+}
+
+uint32_t uart_rx_dbm_pending(void){
+	return 0;
+}
+
+void uart_rx_drain(uint32_t idle_ms){
+	(void)idle_ms;
+}
+
+void uart_rx_dma_stop(void){
+}
+
+void uart_rx_dma_start(void){
+}
+
+void uart_dma_flush(void){
+}
+
+uint32_t uart_dma_write(const uint8_t *data, uint32_t len){
+	if (len == sizeof(update_reply_t) && reply_count < sizeof(replies) / sizeof(replies[0])) {
+		memcpy(&replies[reply_count++], data, len);
+	}
+	return len;
+}
+
+//every call is a millisecond: an update without frames left times out after UPD_IDLE_TIMEOUT_MS calls
+uint32_t get_tick(void){
+	return tick++;
+}
+
+uint32_t slot_update_target(void){
+	return SLOT_B_ADDRESS;
+}
+
+void slot_forget(uint32_t image_base){
+	(void)image_base;
+}
+
+/**********************************************************************************
+*  					    LZ4
+* *****************************************************************************/
+typedef struct{
+	uint8_t *buf;
+	uint32_t pos;
+}lz4_out_t;
+
+static void out_put(void *ctx, uint8_t byte){
+	lz4_out_t *o = ctx;
+
+	o->buf[o->pos++] = byte;
+}
+
+static uint8_t out_get(void *ctx, uint32_t pos){
+	return ((lz4_out_t *)ctx)->buf[pos];
+}
+
+/* decode in pieces of piece bytes, dict (may be empty) in front of the output */
+static uint8_t lz4_decode(const blob_t *stream, uint32_t stream_len, const blob_t *dict, uint8_t *buf,
+                          uint32_t out_max, uint32_t piece, lz4_stream_t *s){
+	lz4_out_t o = {buf, dict->len};
+	uint8_t status = LZ4_OK;
+
+	memcpy(buf, dict->data, dict->len);
+	lz4_stream_init(s, out_put, out_get, &o, out_max);
+	lz4_stream_dict(s, dict->len);
+	for (uint32_t i = 0; i < stream_len && status == LZ4_OK; i += piece) {
+		status = lz4_stream_feed(s, stream->data + i, (stream_len - i < piece) ? stream_len - i : piece);
+	}
+	return status;
+}
+
+static void test_lz4(const blob_t *v1, const blob_t *v2, const blob_t *lz4, const blob_t *delta){
+	static const uint32_t pieces[] = {7, 1, 256, 0xFFFFFFFFU};
+	const blob_t none = {NULL, 0};
+	uint8_t *buf = malloc(v1->len + v2->len);
+	lz4_stream_t s;
+
+	for (uint32_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+		CHECK(lz4_decode(lz4, lz4->len, &none, buf, v2->len, pieces[i], &s) == LZ4_OK);
+		CHECK(lz4_stream_complete(&s) && s.out_pos == v2->len && memcmp(buf, v2->data, v2->len) == 0);
+
+		CHECK(lz4_decode(delta, delta->len, v1, buf, v2->len, pieces[i], &s) == LZ4_OK);
+		CHECK(lz4_stream_complete(&s) && s.out_pos == v1->len + v2->len &&
+		      memcmp(buf + v1->len, v2->data, v2->len) == 0);
+	}
+	//a cut stream is not complete, an output larger than announced is refused
+	CHECK(lz4_decode(lz4, lz4->len - 3U, &none, buf, v2->len, 7, &s) == LZ4_OK && !lz4_stream_complete(&s));
+	CHECK(lz4_decode(lz4, lz4->len, &none, buf, v2->len - 4U, 7, &s) == LZ4_ERR_OVERFLOW);
+	//a delta without its dictionary reaches before the start of the output
+	CHECK(lz4_decode(delta, delta->len, &none, buf, v2->len, 7, &s) == LZ4_ERR_OFFSET);
+	printf("lz4: %u -> %u bytes, delta %u bytes, decoded in 7-byte pieces\n", lz4->len, v2->len, delta->len);
+	free(buf);
+}
+
+/**********************************************************************************
+*  					    update
+* *****************************************************************************/
+static uint8_t run(const uint8_t *f, uint32_t count, uint32_t *slot){
+	frames = f;
+	frame_count = count;
+	frame_next = 0;
+	reply_count = 0;
+	erases = 0;
+	*slot = 0;
+	return update_run(slot);
+}
+
+static uint32_t acks(void){
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < reply_count; i++) {
+		n += (replies[i].code == UPD_ACK && replies[i].status == UPD_OK);
+	}
+	return n;
+}
+
+static int slot_holds(const blob_t *image){
+	const uint8_t *slot = (const uint8_t *)(uintptr_t)SLOT_B_ADDRESS;
+
+	for (uint32_t i = image->len; i < SLOT_SIZE; i++) {
+		if (slot[i] != 0xFFU) {
+			return 0;
+		}
+	}
+	return memcmp(slot, image->data, image->len) == 0 && image_verify(SLOT_B_ADDRESS, SLOT_IMAGE_MAX) == IMAGE_OK;
+}
+
+/* a frame of f with its CRC computed again, after the test changed it */
+static void frame_seal(uint8_t *frame){
+	update_frame_t *fr = (update_frame_t *)frame;
+
+	crc32_begin();
+	crc32_feed((const uint32_t *)frame, (sizeof(update_frame_t) - 4U) / 4U);
+	fr->crc = crc32_end();
+}
+
+static void test_update(const char *name, const blob_t *f, const blob_t *v2){
+	uint32_t count = f->len / UPD_FRAME_SIZE;
+	uint8_t *copy = malloc(f->len + 2U * UPD_FRAME_SIZE);
+	uint32_t slot;
+	uint8_t status;
+
+	//as sent: every frame acknowledged, the slot holds exactly the image
+	memset((void *)(uintptr_t)SLOT_B_ADDRESS, 0x00, SLOT_SIZE);
+	status = run(f->data, count, &slot);
+	CHECK(status == UPD_OK && slot == SLOT_B_ADDRESS && erases == 1U);
+	CHECK(reply_count == count && acks() == count);
+	CHECK(slot_holds(v2));
+	printf("update %s: %u frames, status %u, %s\n", name, count, status, slot_holds(v2) ? "image ok" : "image BAD");
+
+	//frame 2 resent after its ACK (ACK lost), then frame 3 with a bad CRC before the good one
+	memcpy(copy, f->data, 3U * UPD_FRAME_SIZE);
+	memcpy(copy + 3U * UPD_FRAME_SIZE, f->data + 2U * UPD_FRAME_SIZE, UPD_FRAME_SIZE);
+	memcpy(copy + 4U * UPD_FRAME_SIZE, f->data + 3U * UPD_FRAME_SIZE, UPD_FRAME_SIZE);
+	copy[4U * UPD_FRAME_SIZE + 40U] ^= 0x01U;
+	memcpy(copy + 5U * UPD_FRAME_SIZE, f->data + 3U * UPD_FRAME_SIZE, f->len - 3U * UPD_FRAME_SIZE);
+	status = run(copy, count + 2U, &slot);
+	CHECK(status == UPD_OK && slot_holds(v2));
+	CHECK(reply_count == count + 2U && replies[4].code == UPD_NACK && replies[4].status == UPD_ERR_CRC &&
+	      replies[4].next == replies[3].next);
+
+	//no END: the magic is held back, the slot fails its check
+	status = run(f->data, count - 1U, &slot);
+	CHECK(status == UPD_ERR_TIMEOUT && acks() == count - 1U);
+	CHECK(image_verify(SLOT_B_ADDRESS, SLOT_IMAGE_MAX) == IMAGE_ERR_MAGIC);
+	free(copy);
+}
+
+static void test_delta_source(const blob_t *f){
+	uint8_t *copy = malloc(f->len);
+	uint32_t slot;
+	update_frame_t *start = (update_frame_t *)copy;
+
+	//a patch made against another image: START refused before anything is erased
+	memcpy(copy, f->data, f->len);
+	start->payload[5] ^= 1U;
+	frame_seal(copy);
+	CHECK(run(copy, f->len / UPD_FRAME_SIZE, &slot) == UPD_ERR_TIMEOUT);
+	CHECK(replies[0].code == UPD_NACK && replies[0].status == UPD_ERR_SOURCE && erases == 0U);
+	free(copy);
+}
+
+/* the running slot A already holds the version sent: END refused, the slot left without magic */
+static void test_version(const blob_t *f, const blob_t *installed, const blob_t *same){
+	uint32_t count = f->len / UPD_FRAME_SIZE;
+	uint32_t slot;
+
+	memset((void *)(uintptr_t)SLOT_A_ADDRESS, 0xFF, SLOT_SIZE);
+	memcpy((void *)(uintptr_t)SLOT_A_ADDRESS, same->data, same->len);
+	CHECK(run(f->data, count, &slot) == UPD_ERR_TIMEOUT && slot == 0U);
+	CHECK(reply_count == count && acks() == count - 1U && replies[count - 1U].code == UPD_NACK &&
+	      replies[count - 1U].status == UPD_ERR_VERSION);
+	CHECK(image_verify(SLOT_B_ADDRESS, SLOT_IMAGE_MAX) == IMAGE_ERR_MAGIC);
+	memset((void *)(uintptr_t)SLOT_A_ADDRESS, 0xFF, SLOT_SIZE);
+	memcpy((void *)(uintptr_t)SLOT_A_ADDRESS, installed->data, installed->len);
+}
+
+int main(int argc, char **argv){
+	const char *dir = (argc > 1) ? argv[1] : ".";
+	blob_t v1 = load(dir, "v1.bin");
+	blob_t v2 = load(dir, "v2.bin");
+	blob_t lz4 = load(dir, "v2.lz4");
+	blob_t delta = load(dir, "v2.delta");
+	blob_t raw_frames = load(dir, "raw.frames");
+	blob_t lz4_frames = load(dir, "lz4.frames");
+	blob_t delta_frames = load(dir, "delta.frames");
+	void *flash = mmap((void *)(uintptr_t)FLASH_BASE_ADDR, FLASH_TEST_SIZE, PROT_READ | PROT_WRITE,
+	                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (flash != (void *)(uintptr_t)FLASH_BASE_ADDR) {
+		printf("cannot map the flash at 0x%08X\n", FLASH_BASE_ADDR);
+		return 2;
+	}
+	memset(flash, 0xFF, FLASH_TEST_SIZE);
+	//the delta source: v1 installed in slot A
+	memcpy((void *)(uintptr_t)SLOT_A_ADDRESS, v1.data, v1.len);
+
+	test_lz4(&v1, &v2, &lz4, &delta);
+	test_update("raw", &raw_frames, &v2);
+	test_update("lz4", &lz4_frames, &v2);
+	test_update("delta", &delta_frames, &v2);
+	test_delta_source(&delta_frames);
+	test_version(&raw_frames, &v1, &v2);
+
+	puts(failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+#!/usr/bin/env python3
+"""Sign and inspect application images for the bootloader.
+
+The application linker scripts place an image header at offset 0x200:
+magic, length, version, crc (bootloader_stm32/Inc/image.h). The crc word is
+left as 0xFFFFFFFF by the linker; "sign" computes CRC-32/MPEG-2 over the
+image the same way the STM32 CRC unit does (32-bit words, MSB first, no
+reflection, init 0xFFFFFFFF, no final xor) with the crc word read as
+0xFFFFFFFF, and patches it into the .bin.
+
+    arm-none-eabi-objcopy -O binary App1.elf App1.bin
+    python3 imgtool.py sign App1.bin
+    python3 imgtool.py info App1.bin
+
+"update" sends a signed image to the bootloader menu over the UART
+(protocol in bootloader_stm32/Inc/update.h, needs pyserial):
+
+    python3 imgtool.py update [--lz4] App1.bin /dev/ttyACM0 [0x08008000]
+
+Without a slot address the bootloader writes the A/B slot that is not
+running. Bump IMAGE_VERSION in the linker script: the newer A/B image
+boots first. --lz4 sends the image compressed (LZ4 block format), the
+bootloader decompresses it straight into flash. --delta sends only a patch
+against the image installed in the other A/B slot:
+
+    python3 imgtool.py update --delta App1_v1.bin App1_v2.bin /dev/ttyACM0
+    python3 imgtool.py diff App1_v1.bin App1_v2.bin App1.patch
+"""
+import struct
+import sys
+import time
+
+HEADER_OFFSET = 0x200
+HEADER_FORMAT = "<IIII"
+MAGIC = 0x31474D49
+CRC_UNSIGNED = 0xFFFFFFFF
+CRC_POLY = 0x04C11DB7
+SLOT_IMAGE_MAX = 0x4000 - 8  # 16KB sector minus the slot trailer (slots.h)
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ CRC_POLY) if crc & 0x80000000 else (crc << 1)
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def crc32_words(data):
+    # the unit consumes each little-endian word from its most significant byte
+    stream = bytearray()
+    for (word,) in struct.iter_unpack("<I", bytes(data)):
+        stream += struct.pack(">I", word)
+    return crc32_mpeg2(stream)
+
+
+def image_crc(image, length):
+    body = bytearray(image[:length])
+    struct.pack_into("<I", body, HEADER_OFFSET + 12, CRC_UNSIGNED)
+    return crc32_words(body)
+
+
+LZ4_MIN_MATCH = 4
+LZ4_LAST_LITERALS = 5  # block format: the last 5 bytes are literals
+LZ4_MATCH_LIMIT = 12  # and no match starts in the last 12 bytes
+LZ4_MAX_OFFSET = 0xFFFF
+LZ4_CHAIN_DEPTH = 64
+
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def lz4_compress(data, dictionary=b""):
+    """LZ4 block format, greedy parse over a hash chain (ratio matters, speed does not).
+
+    With a dictionary the matches may also reach into it: the decoder must see the same
+    bytes in front of its output (delta against the installed image).
+    """
+    out = bytearray()
+    heads = {}
+    data = dictionary + data
+    prev = [-1] * len(data)
+    anchor = len(dictionary)
+    pos = len(dictionary)
+    end = len(data)
+
+    def insert(i):
+        key = data[i:i + 4]
+        prev[i] = heads.get(key, -1)
+        heads[key] = i
+
+    for i in range(max(len(dictionary) - 3, 0)):
+        insert(i)
+
+    while pos + LZ4_MATCH_LIMIT <= end:
+        best_len, best_off = 0, 0
+        cand = heads.get(data[pos:pos + 4], -1)
+        depth = LZ4_CHAIN_DEPTH
+        limit = end - LZ4_LAST_LITERALS
+        while cand >= 0 and pos - cand <= LZ4_MAX_OFFSET and depth:
+            n = 0
+            while pos + n < limit and data[cand + n] == data[pos + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_off = n, pos - cand
+            cand = prev[cand]
+            depth -= 1
+        if best_len < LZ4_MIN_MATCH:
+            insert(pos)
+            pos += 1
+            continue
+        literals = data[anchor:pos]
+        lit, mat = len(literals), best_len - LZ4_MIN_MATCH
+        out.append((min(lit, 15) << 4) | min(mat, 15))
+        if lit >= 15:
+            lz4_length(out, lit - 15)
+        out += literals
+        out += struct.pack("<H", best_off)
+        if mat >= 15:
+            lz4_length(out, mat - 15)
+        for i in range(pos, min(pos + best_len, end - 3)):
+            insert(i)
+        pos += best_len
+        anchor = pos
+    literals = data[anchor:]
+    out.append(min(len(literals), 15) << 4)
+    if len(literals) >= 15:
+        lz4_length(out, len(literals) - 15)
+    out += literals
+    return bytes(out)
+
+
+def lz4_decompress(data, dictionary=b""):
+    out = bytearray(dictionary)
+    i = 0
+    while i < len(data):
+        token = data[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                lit += data[i]
+                i += 1
+                if data[i - 1] != 255:
+                    break
+        out += data[i:i + lit]
+        i += lit
+        if i >= len(data):
+            break
+        off = data[i] | (data[i + 1] << 8)
+        i += 2
+        mat = token & 15
+        if mat == 15:
+            while True:
+                mat += data[i]
+                i += 1
+                if data[i - 1] != 255:
+                    break
+        for _ in range(mat + LZ4_MIN_MATCH):
+            out.append(out[-off])
+    return bytes(out[len(dictionary):])
+
+
+def read_header(image):
+    if len(image) < HEADER_OFFSET + struct.calcsize(HEADER_FORMAT):
+        sys.exit("image too small for a header")
+    magic, length, version, crc = struct.unpack_from(HEADER_FORMAT, image, HEADER_OFFSET)
+    if magic != MAGIC:
+        sys.exit("no image header (magic 0x%08X)" % magic)
+    if length % 4 or length > len(image):
+        sys.exit("bad image length %u (file is %u bytes)" % (length, len(image)))
+    return length, version, crc
+
+
+def sign(path):
+    with open(path, "rb") as f:
+        image = bytearray(f.read())
+    length, _, _ = read_header(image)
+    if length > SLOT_IMAGE_MAX:
+        sys.exit("image of %u bytes does not fit a slot (%u bytes)" % (length, SLOT_IMAGE_MAX))
+    crc = image_crc(image, length)
+    struct.pack_into("<I", image, HEADER_OFFSET + 12, crc)
+    with open(path, "wb") as f:
+        f.write(image)
+    print("%s: %u bytes, crc 0x%08X" % (path, length, crc))
+
+
+def info(path):
+    with open(path, "rb") as f:
+        image = f.read()
+    length, version, crc = read_header(image)
+    expected = image_crc(image, length)
+    print("length  %u" % length)
+    print("version %u.%u.%u" % (version >> 24, (version >> 16) & 0xFF, version & 0xFFFF))
+    if crc == CRC_UNSIGNED:
+        print("crc     unsigned (expected 0x%08X)" % expected)
+        return 1
+    print("crc     0x%08X %s" % (crc, "ok" if crc == expected else "BAD, expected 0x%08X" % expected))
+    return 0 if crc == expected else 1
+
+
+def load_image(path):
+    with open(path, "rb") as f:
+        image = f.read()
+    length, _, crc = read_header(image)
+    if crc == CRC_UNSIGNED or crc != image_crc(image, length):
+        sys.exit("%s not signed, run imgtool.py sign first" % path)
+    return image[:length], crc
+
+
+def make_delta(old, new):
+    # the patch is LZ4 with the old image as dictionary, checked by applying it
+    patch = lz4_compress(new, old)
+    if lz4_decompress(patch, old) != new:
+        sys.exit("delta round trip failed")
+    return patch
+
+
+def diff(old_path, new_path, patch_path):
+    old, _ = load_image(old_path)
+    new, _ = load_image(new_path)
+    patch = make_delta(old, new)
+    with open(patch_path, "wb") as f:
+        f.write(patch)
+    print("%s: %u bytes patch for %u bytes image (lz4 alone: %u)"
+          % (patch_path, len(patch), len(new), len(lz4_compress(new))))
+
+
+UPD_SOF = 0x5A
+UPD_CMD_START, UPD_CMD_DATA, UPD_CMD_END = 1, 2, 3
+UPD_ACK = 0x79
+UPD_ERR_PARAM, UPD_ERR_FLASH, UPD_ERR_IMAGE, UPD_ERR_DECODE = 4, 5, 6, 9
+UPD_FLAG_LZ4 = 1
+UPD_FLAG_DELTA = 2
+UPD_ERR_SOURCE = 10
+UPD_ERR_VERSION = 11
+UPD_CHUNK_SIZE = 256
+UPD_MAX_PAYLOAD = 4 + UPD_CHUNK_SIZE
+UPD_WINDOW = 2
+UPD_RETRIES = 5
+UPD_REPLY = "<BBHI"
+
+
+def update_frame(cmd, payload):
+    frame = struct.pack("<BBH", UPD_SOF, cmd, len(payload)) + payload
+    frame += bytes(4 + UPD_MAX_PAYLOAD - len(frame))
+    return frame + struct.pack("<I", crc32_words(frame))
+
+
+def update_reply(port, timeout):
+    port.timeout = timeout
+    reply = port.read(struct.calcsize(UPD_REPLY))
+    if len(reply) != struct.calcsize(UPD_REPLY):
+        return None
+    return struct.unpack(UPD_REPLY, reply)
+
+
+def update_command(port, cmd, payload, timeout):
+    for _ in range(UPD_RETRIES):
+        port.write(update_frame(cmd, payload))
+        reply = update_reply(port, timeout)
+        if reply and reply[0] == UPD_ACK:
+            return
+        if reply and reply[1] == UPD_ERR_VERSION:
+            sys.exit("image not newer than the one in the other slot, it would never boot")
+        if reply:
+            print("nack, status %u" % reply[1])
+    sys.exit("no ack for command %u" % cmd)
+
+
+def update_data(port, stream):
+    # keep UPD_WINDOW frames on the line: frame n+2 goes out as soon as frame n is acknowledged
+    length = len(stream)
+    acked = 0
+    sent = 0
+    outstanding = 0
+    failures = 0
+    while acked < length:
+        while outstanding < UPD_WINDOW and sent < length:
+            chunk = stream[sent:min(sent + UPD_CHUNK_SIZE, length)]
+            # a compressed stream is not word aligned, the bootloader drops the padding
+            padded = chunk + bytes(-len(chunk) % 4)
+            port.write(update_frame(UPD_CMD_DATA, struct.pack("<I", sent) + padded))
+            sent += len(chunk)
+            outstanding += 1
+        reply = update_reply(port, 1)
+        if reply and reply[0] == UPD_ACK:
+            acked = max(acked, reply[3])
+            outstanding = max(outstanding - 1, 0)
+            failures = 0
+            continue
+        failures += 1
+        if failures > UPD_RETRIES:
+            sys.exit("update failed at offset %u" % acked)
+        if reply is None:
+            # nothing came back: let the line go quiet and resend the oldest chunk
+            time.sleep(0.05)
+            port.reset_input_buffer()
+        elif reply[1] in (UPD_ERR_PARAM, UPD_ERR_FLASH, UPD_ERR_IMAGE, UPD_ERR_DECODE, UPD_ERR_SOURCE):
+            sys.exit("update failed at offset %u, status %u" % (acked, reply[1]))
+        else:
+            print("nack at offset %u, status %u" % (reply[3], reply[1]))
+            acked = reply[3]
+        sent = acked
+        outstanding = 0
+
+
+def update(path, device, slot, compress, base_path):
+    import serial
+
+    image, _ = load_image(path)
+    length = len(image)
+    stream = image
+    request = struct.pack("<II", slot, length)
+    if base_path:
+        # the bootloader checks that the other A/B slot holds exactly this image
+        base, base_crc = load_image(base_path)
+        stream = make_delta(base, image)
+        request += struct.pack("<IIII", UPD_FLAG_LZ4 | UPD_FLAG_DELTA, len(stream), 0, base_crc)
+        print("delta: %u -> %u bytes" % (length, len(stream)))
+    elif compress:
+        stream = lz4_compress(image)
+        if lz4_decompress(stream) != image:
+            sys.exit("lz4 round trip failed")
+        request += struct.pack("<II", UPD_FLAG_LZ4, len(stream))
+        print("lz4: %u -> %u bytes" % (length, len(stream)))
+
+    with serial.Serial(device, 115200, timeout=2) as port:
+        port.reset_input_buffer()
+        port.write(b"u")
+        line = b""
+        deadline = time.time() + 2
+        while b"update mode" not in line and time.time() < deadline:
+            line += port.read(1)
+        if b"update mode" not in line:
+            sys.exit("bootloader menu not answering, hold the button during reset")
+        port.read_until(b"\n")
+
+        start = time.time()
+        # the sector erase is done before the answer
+        update_command(port, UPD_CMD_START, request, 3)
+        update_data(port, stream)
+        update_command(port, UPD_CMD_END, b"", 2)
+        elapsed = time.time() - start
+    print("%s: %u bytes in %.2f s (%.0f B/s)" % (path, length, elapsed, length / elapsed))
+
+
+def main():
+    args = [a for a in sys.argv[1:] if a != "--lz4"]
+    base = None
+    if "--delta" in args:
+        i = args.index("--delta")
+        base = args[i + 1] if i + 1 < len(args) else sys.exit("--delta needs the installed image")
+        del args[i:i + 2]
+    if len(args) in (3, 4) and args[0] == "update":
+        update(args[1], args[2], int(args[3], 0) if len(args) == 4 else 0, "--lz4" in sys.argv, base)
+        return 0
+    if len(args) == 4 and args[0] == "diff":
+        diff(args[1], args[2], args[3])
+        return 0
+    if len(sys.argv) != 3 or sys.argv[1] not in ("sign", "info"):
+        sys.exit("usage: imgtool.py sign|info <image.bin>\n"
+                 "       imgtool.py update [--lz4 | --delta <installed.bin>] <image.bin> <serial port> [slot address]\n"
+                 "       imgtool.py diff <installed.bin> <image.bin> <patch.bin>")
+    if sys.argv[1] == "sign":
+        sign(sys.argv[2])
+        return 0
+    return info(sys.argv[2])
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,116 @@
+#ifndef DMA_H_
+#define DMA_H_
+
+#include <stdint.h>
+#include "stm32f411xx.h"
+
+/*
+ * @DMA_Direction
+ */
+#define DMA_DIR_PERIPH_TO_MEM 0
+#define DMA_DIR_MEM_TO_PERIPH 1
+#define DMA_DIR_MEM_TO_MEM 2
+
+/*
+ * @DMA_DataSize (peripheral and memory side)
+ */
+#define DMA_SIZE_BYTE 0
+#define DMA_SIZE_HALFWORD 1
+#define DMA_SIZE_WORD 2
+
+/*
+ * @DMA_Mode
+ */
+#define DMA_MODE_NORMAL 0
+#define DMA_MODE_CIRCULAR 1
+
+/*
+ * @DMA_Priority
+ */
+#define DMA_PRIORITY_LOW 0
+#define DMA_PRIORITY_MEDIUM 1
+#define DMA_PRIORITY_HIGH 2
+#define DMA_PRIORITY_VERY_HIGH 3
+
+/*
+ * DMA Event (passed to the transfer callback)
+ */
+#define DMA_EVENT_HALF_CMPLT 0
+#define DMA_EVENT_CMPLT 1
+#define DMA_EVENT_ERROR 2                //TE: the hardware disabled the stream
+#define DMA_EVENT_DIRECT_MODE_ERROR 3    //DME: a request was missed, the stream keeps running
+
+/*
+ * DMA stream flags (already shifted into position for the stream by the driver)
+ */
+#define DMA_FLAG_FE (1<<DMA_ISR_FEIF)
+#define DMA_FLAG_DME (1<<DMA_ISR_DMEIF)
+#define DMA_FLAG_TE (1<<DMA_ISR_TEIF)
+#define DMA_FLAG_HT (1<<DMA_ISR_HTIF)
+#define DMA_FLAG_TC (1<<DMA_ISR_TCIF)
+#define DMA_FLAG_ALL (DMA_FLAG_FE | DMA_FLAG_DME | DMA_FLAG_TE | DMA_FLAG_HT | DMA_FLAG_TC)
+
+ /**********************************************************************************
+ *  					config structure of DMA stream
+ * *****************************************************************************/
+typedef struct {
+    uint32_t DMA_Channel;        /* request channel 0..7, refer DMA request mapping in RM */
+    uint32_t DMA_Direction;
+    uint32_t DMA_PeriphInc;      /* ENABLE or DISABLE */
+    uint32_t DMA_MemInc;         /* ENABLE or DISABLE */
+    uint32_t DMA_PeriphDataSize;
+    uint32_t DMA_MemDataSize;
+    uint32_t DMA_Mode;
+    uint32_t DMA_Priority;
+}DMA_Config_t;
+
+ /**********************************************************************************
+ *  					handle structure of DMA stream
+ * *****************************************************************************/
+struct DMA_Handle;
+typedef void (*DMA_Callback_t)(struct DMA_Handle *pDMAHandle, uint8_t Event);
+
+typedef struct DMA_Handle {
+    DMA_RegDef_t *pDMAx;                /* DMA1 or DMA2 */
+    DMA_Stream_RegDef_t *pStream;       /* stream used by this handle */
+    uint8_t StreamNumber;               /* 0..7, used to locate the flags in LISR/HISR */
+    DMA_Config_t DMA_Config;
+    DMA_Callback_t Callback;            /* called from DMA_IRQHandling, may be NULL */
+    void *pParent;                      /* owner of the stream (USART/SPI/I2C handle) */
+}DMA_Handle_t;
+
+ /*******************************************************************************************
+ *                              API supported by DMA driver
+ * ******************************************************************************************/
+
+/*
+ * Clock Setup
+ */
+void DMA_PeriClockControl(DMA_RegDef_t *pDMAx, uint8_t EnorDi);
+
+/*
+ * Init and Deinit
+ */
+void DMA_Init(DMA_Handle_t *pDMAHandle);
+void DMA_DeInit(DMA_Handle_t *pDMAHandle);
+
+/*
+ * Transfer control
+ */
+void DMA_Start(DMA_Handle_t *pDMAHandle, uint32_t PeriphAddr, uint32_t MemAddr, uint32_t len);
+void DMA_StartIT(DMA_Handle_t *pDMAHandle, uint32_t PeriphAddr, uint32_t MemAddr, uint32_t len);
+void DMA_Stop(DMA_Handle_t *pDMAHandle);
+uint32_t DMA_GetRemaining(DMA_Handle_t *pDMAHandle);
+
+uint8_t DMA_GetFlagStatus(DMA_Handle_t *pDMAHandle, uint32_t FlagName);
+void DMA_ClearFlag(DMA_Handle_t *pDMAHandle, uint32_t FlagName);
+
+/*
+ * IRQ Configuration and ISR handling
+ */
+void DMA_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
+void DMA_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
+void DMA_IRQHandling(DMA_Handle_t *pDMAHandle);
+void DMA_IRQRegister(DMA_Handle_t *pDMAHandle, uint8_t IRQNumber);
+
+#endif /* DMA_H_ */
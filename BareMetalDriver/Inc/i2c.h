@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "stm32f411xx.h"
 #include "rcc_driver.h"
+#include "dma.h"
 
 
 /*
@@ -12,6 +13,12 @@
 #define I2C_WRITE 0
 #define I2C_READ 1
 
+/*
+ *@I2C_MemAddSize
+ */
+#define I2C_MEMADD_SIZE_8BIT 1
+#define I2C_MEMADD_SIZE_16BIT 2
+
 /*
  * Application state
  */
@@ -32,6 +39,7 @@
 #define I2C_ERROR_TIMEOUT 7
 #define I2C_EVENT_DATA_REQ 8
 #define I2C_EVENT_DATA_RCV 9
+#define I2C_ERROR_DMA 10
 
 /*
  *@I2C_SckSpeed
@@ -95,7 +103,10 @@ typedef struct {
  /**********************************************************************************
  *  						handle structure of i2c
  * *****************************************************************************/
-typedef struct {
+struct I2C_Handle;
+typedef void (*I2C_Callback_t)(struct I2C_Handle *pHandle, uint8_t AppEv);
+
+typedef struct I2C_Handle {
     I2C_RegDef_t *pI2Cx;        /*this hold the base address of I2Cx peripheral*/
     I2C_Config_t I2C_Config;
     uint8_t* pTxBuffer;          /* Tx buffer Address*/
@@ -106,8 +117,23 @@ typedef struct {
     uint8_t DevAddress;         /* Device/slave address*/
     uint32_t RxSize;
     uint8_t sr;                 /* store repeat start value*/
+    DMA_Handle_t *pTxDMA;       /* streams for transfers of more than 2 bytes, NULL: one interrupt */
+    DMA_Handle_t *pRxDMA;       /* per byte. pDMAx/pStream/StreamNumber/DMA_Channel (@I2C_DMA_Streams) */
+    I2C_Callback_t Callback;    /* master completion and errors, NULL: I2C_ApplicationEventCallback */
+    uint8_t MemAddr[2];         /* register address of I2C_MemReadIT/I2C_MemWriteIT, sent first */
+    uint8_t *pMemData;          /* data phase queued behind the register address */
+    uint32_t MemLen;
+    uint8_t MemDir;             /* @I2C_ReadWrite of the data phase */
+    void *pParent;              /* owner of the handle, e.g. the I2C_Sched_t polling on it */
 }I2C_Handle_t;
 
+/*
+ * @I2C_DMA_Streams (refer DMA request mapping in RM)
+ * I2C1: RX DMA1 stream 0 or 5, TX DMA1 stream 6 or 7, channel 1
+ * I2C2: RX DMA1 stream 2 or 3, TX DMA1 stream 7, channel 7
+ * I2C3: RX DMA1 stream 2, TX DMA1 stream 4, channel 3
+ */
+
 
 
 
@@ -135,6 +161,18 @@ void I2C_MasterReceiveData(I2C_Handle_t *pI2CHandle, uint8_t *pRxBuffer, uint32_
 uint8_t I2C_MasterSendDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pTxBuffer, uint32_t len, uint8_t SlaveAddress, uint8_t sr);
 uint8_t I2C_MasterReceiveDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pRxBuffer, uint32_t len, uint8_t SlaveAddress, uint8_t sr);
 
+/*
+ * register access: register address then data in one transaction (repeated start for reads)
+ */
+void I2C_MemWrite(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                  const uint8_t *pData, uint32_t len);
+void I2C_MemRead(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                 uint8_t *pData, uint32_t len);
+uint8_t I2C_MemWriteIT(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                       uint8_t *pData, uint32_t len);
+uint8_t I2C_MemReadIT(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                      uint8_t *pData, uint32_t len);
+
 
 void I2C_SlaveSendData(I2C_RegDef_t *pI2Cx, uint32_t data);
 uint32_t I2C_SlaveReceiveData(I2C_RegDef_t *pI2Cx);
@@ -144,8 +182,9 @@ uint32_t I2C_SlaveReceiveData(I2C_RegDef_t *pI2Cx);
 void I2C_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
 void I2C_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
 
-void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle);
+RAMFUNC void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle);
 void I2C_ER_IRQHandling(I2C_Handle_t *pI2CHandle);
+void I2C_IRQRegister(I2C_Handle_t *pI2CHandle, uint8_t EvIRQNumber, uint8_t ErIRQNumber);
 
 /*
  * other Peripheral control API
@@ -0,0 +1,55 @@
+#ifndef I2C_SCHED_H_
+#define I2C_SCHED_H_
+
+#include <stdint.h>
+#include "stm32f411xx.h"
+#include "i2c.h"
+
+/*
+ * Periodic register reads of several devices sharing one I2C.
+ * Every job reads Len bytes from a register of a device every Period ticks with I2C_MemReadIT.
+ * I2C_SchedTick, called from the SysTick handler, starts a due job when the bus is idle; the
+ * completion interrupt of a job starts the next due one, so the bus runs back to back while
+ * jobs are late and the application is not involved. Among due jobs the most overdue goes first.
+ * Results are double buffered: a job reads into the copy readers are not using, I2C_SchedGet
+ * returns a copy which is never torn.
+ */
+
+/**********************************************************************************
+*  					    Job
+* *****************************************************************************/
+typedef struct {
+    uint8_t DevAddress;         /* 7-bit address */
+    uint16_t MemAddress;        /* first register */
+    uint8_t MemAddSize;         /* @I2C_MemAddSize */
+    uint8_t Len;                /* bytes per result */
+    uint32_t Period;            /* ticks between two reads */
+    uint8_t *pBuffer;           /* 2 * Len bytes, the two copies of the result */
+    volatile uint32_t Seq;      /* results completed, the latest is copy Seq & 1; 0: none yet */
+    uint32_t Due;               /* tick of the next read, owned by the scheduler */
+    uint32_t Errors;            /* reads which failed (NACK, bus error), retried at the next period */
+    uint32_t Overruns;          /* periods dropped because the bus could not keep up */
+}I2C_Job_t;
+
+/**********************************************************************************
+*  					    Scheduler
+* *****************************************************************************/
+typedef struct {
+    I2C_Handle_t *pI2CHandle;   /* I2C_Init done, interrupts routed to it, pRxDMA optional */
+    I2C_Job_t *pJobs;
+    uint32_t NumJobs;
+    volatile uint32_t Tick;
+    I2C_Job_t *pRunning;        /* job on the bus, NULL: idle */
+}I2C_Sched_t;
+
+/*
+ * @I2C_SchedInit return
+ */
+#define I2C_SCHED_OK            0
+#define I2C_SCHED_ERROR_PARAM   1   /* a job with Period or Len 0, nothing taken over */
+
+uint8_t I2C_SchedInit(I2C_Sched_t *pSched, I2C_Handle_t *pI2CHandle, I2C_Job_t *pJobs, uint32_t NumJobs);
+void I2C_SchedTick(I2C_Sched_t *pSched);
+uint32_t I2C_SchedGet(const I2C_Job_t *pJob, uint8_t *pData);
+
+#endif /* I2C_SCHED_H_ */
@@ -0,0 +1,39 @@
+#ifndef IRQ_H_
+#define IRQ_H_
+
+#include <stdint.h>
+#include "stm32f411xx.h"
+
+/*
+ * RAM vector table with handlers registered at run time.
+ *
+ * IRQ_Init copies the vector table of the image (startup file, weak handlers bound at link time)
+ * into SRAM and points SCB->VTOR at the copy; from then on:
+ *  - IRQ_SetVector puts a plain handler straight into the table (same cost as a linked handler)
+ *  - IRQ_Register binds a handler and a context pointer (e.g. a USART_Handle_t) to an IRQ: the
+ *    vector becomes IRQ_Dispatch, which reads the active exception number from IPSR and calls
+ *    Handler(pContext). The drivers register their *_IRQHandling this way (USART_IRQRegister,
+ *    SPI_IRQRegister, I2C_IRQRegister, DMA_IRQRegister), no per-instance wrapper is needed.
+ *
+ * Dispatch cost over a linked vector: mrs + 2 loads + indirect branch, about 5 cycles on the M4.
+ * This is an estimate from the instruction timings of the Cortex-M4 TRM, not measured on target
+ * (the host sim charges bus accesses and exception entry only, so both cost the same there). The
+ * wrapper a linked vector needs to load its handle and call the driver costs about as much.
+ * The table and IRQ_Dispatch are in SRAM: no flash access between the exception and the driver
+ * handler, also while a flash sector is erased.
+ */
+#define IRQ_VECTOR_COUNT (16 + IRQ_NO_COUNT)//core exceptions and peripheral interrupts
+#define IRQ_VECTOR_ALIGN 512//table size rounded up to a power of two, refer VTOR in PM
+
+typedef void (*IRQ_Handler_t)(void *pContext);
+typedef void (*IRQ_Vector_t)(void);
+
+ /*******************************************************************************************
+ *                              API supported by IRQ layer
+ * ******************************************************************************************/
+void IRQ_Init(void);
+void IRQ_SetVector(int16_t IRQNumber, IRQ_Vector_t pVector);
+void IRQ_Register(int16_t IRQNumber, IRQ_Handler_t Handler, void *pContext);
+RAMFUNC void IRQ_Dispatch(void);
+
+#endif /* IRQ_H_ */
@@ -0,0 +1,73 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include "stm32f411xx.h"
+
+/*
+ * Cycle profiling of driver APIs and ISRs with the DWT cycle counter.
+ * Build with PROF_ENABLE=1 to instrument; otherwise PROF_ENTER/PROF_EXIT expand to nothing and
+ * prof.c is empty, so release images do not change.
+ */
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 0
+#endif
+
+/*
+ * @PROF_Id
+ */
+#define PROF_ID_USART_SEND 0
+#define PROF_ID_USART_RECEIVE 1
+#define PROF_ID_USART_SEND_IT 2
+#define PROF_ID_USART_RECEIVE_IT 3
+#define PROF_ID_USART_IRQ 4
+#define PROF_ID_UART_DMA_WRITE 5
+#define PROF_ID_SPI_SEND 6
+#define PROF_ID_SPI_RECEIVE 7
+#define PROF_ID_SPI_SEND_IT 8
+#define PROF_ID_SPI_RECEIVE_IT 9
+#define PROF_ID_SPI_IRQ 10
+#define PROF_ID_I2C_MASTER_SEND 11
+#define PROF_ID_I2C_MASTER_RECEIVE 12
+#define PROF_ID_I2C_MASTER_SEND_IT 13
+#define PROF_ID_I2C_MASTER_RECEIVE_IT 14
+#define PROF_ID_I2C_EV_IRQ 15
+#define PROF_ID_I2C_ER_IRQ 16
+#define PROF_ID_DMA_IRQ 17
+#define PROF_ID_GPIO_IRQ 18
+#define PROF_ID_SPI_SEND16 19
+#define PROF_ID_SPI_RECEIVE16 20
+#define PROF_ID_COUNT 21
+
+ /**********************************************************************************
+ *  					one profiling slot
+ * *****************************************************************************/
+typedef struct {
+    uint32_t Calls;
+    uint32_t MinCycles;
+    uint32_t MaxCycles;
+    uint64_t TotalCycles;       /* mean = TotalCycles / Calls */
+}PROF_Entry_t;
+
+#if PROF_ENABLE
+/*
+ * PROF_ENTER() opens a measurement at the top of a function, PROF_EXIT(id) closes it and must be
+ * placed before every return of that function.
+ */
+#define PROF_ENTER() uint32_t prof_start = DWT->CYCCNT
+#define PROF_EXIT(id) PROF_Record((id), prof_start)
+
+ /*******************************************************************************************
+ *                              API supported by profiling layer
+ * ******************************************************************************************/
+void PROF_Init(void);
+void PROF_Reset(void);
+void PROF_Record(uint8_t Id, uint32_t StartCycles);
+const PROF_Entry_t *PROF_GetEntry(uint8_t Id);
+void PROF_Dump(void);
+#else
+#define PROF_ENTER() do { } while (0)
+#define PROF_EXIT(id) do { } while (0)
+#endif
+
+#endif /* PROF_H_ */
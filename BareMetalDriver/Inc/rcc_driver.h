@@ -3,9 +3,79 @@
 #include<stdint.h>
 #include "stm32f411xx.h"
 
+/*
+ * Oscillator frequencies. HSE is the 8 MHz MCO of the on-board ST-LINK on Nucleo boards.
+ */
+#ifndef HSI_VALUE
+#define HSI_VALUE 16000000U
+#endif
+#ifndef HSE_VALUE
+#define HSE_VALUE 8000000U
+#endif
+
+/*
+ * @RCC_PLLSource
+ */
+#define RCC_PLL_SRC_HSI 0
+#define RCC_PLL_SRC_HSE 1
+#define RCC_PLL_SRC_HSE_BYPASS 2
+
+/*
+ * @RCC_AHBPrescaler (value of the HPRE field)
+ */
+#define RCC_AHB_DIV1 0
+#define RCC_AHB_DIV2 8
+#define RCC_AHB_DIV4 9
+#define RCC_AHB_DIV8 10
+#define RCC_AHB_DIV16 11
+
+/*
+ * @RCC_APBPrescaler (value of the PPRE1/PPRE2 field)
+ */
+#define RCC_APB_DIV1 0
+#define RCC_APB_DIV2 4
+#define RCC_APB_DIV4 5
+#define RCC_APB_DIV8 6
+#define RCC_APB_DIV16 7
+
+/*
+ * @RCC_Status
+ */
+#define RCC_OK 0
+#define RCC_ERROR_PARAM 1
+#define RCC_ERROR_HSE 2
+#define RCC_ERROR_SWITCH 3
+
+/* polling loops before an oscillator/PLL/clock switch is declared dead */
+#define RCC_TIMEOUT 100000U
+
+/* VOS scale 1 (2.7 - 3.6 V) limits from the datasheet */
+#define RCC_SYSCLK_MAX 100000000U
+#define RCC_PCLK1_MAX 50000000U
+
+ /**********************************************************************************
+ *  					config structure of the system clock
+ * *****************************************************************************/
+typedef struct {
+    uint8_t RCC_PLLSource;      /* @RCC_PLLSource */
+    uint8_t RCC_PLLM;           /* 2..63, VCO input = source / PLLM, keep it 1..2 MHz */
+    uint16_t RCC_PLLN;          /* 50..432, VCO output = VCO input * PLLN, keep it 100..432 MHz */
+    uint8_t RCC_PLLP;           /* 2, 4, 6 or 8, SYSCLK = VCO output / PLLP */
+    uint8_t RCC_PLLQ;           /* 2..15, 48 MHz domain (USB OTG, SDIO) */
+    uint8_t RCC_AHBPrescaler;   /* @RCC_AHBPrescaler */
+    uint8_t RCC_APB1Prescaler;  /* @RCC_APBPrescaler, PCLK1 must stay <= 50 MHz */
+    uint8_t RCC_APB2Prescaler;  /* @RCC_APBPrescaler */
+}RCC_ClkConfig_t;
+
 extern uint16_t AHB_Prescaler[8];
 extern uint16_t APB1_Prescaler[4];
+uint8_t RCC_ConfigSystemClock(RCC_ClkConfig_t *pClkConfig);
+uint8_t RCC_ConfigSystemClock100MHz(uint8_t PLLSource);
+void RCC_FlashARTEnable(void);
+void RCC_FlashARTReset(void);
 uint32_t RCC_GetPLLOutputClock(void);
+uint32_t RCC_GetSysClockValue(void);
+uint32_t RCC_GetHCLKValue(void);
 uint32_t RCC_GetPCLK1Value(void);
 uint32_t RCC_GetPCLK2Value(void);
 #endif /* RCC_DRIVER_H_ */
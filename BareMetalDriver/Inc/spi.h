@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "stm32f411xx.h"
+#include "dma.h"
 
 /*
  * SPI Application State
@@ -10,6 +11,9 @@
 #define SPI_READY 0
 #define SPI_BUSY_IN_TX 1
 #define SPI_BUSY_IN_RX 2
+#define SPI_BUSY_IN_TXRX_DMA 3
+#define SPI_BUSY_IN_SLAVE_DMA 4
+#define SPI_ERROR_PARAM 0xFF       //returned instead of a state: length not accepted, nothing started
 
 /*
  * SPI Application Event
@@ -17,6 +21,10 @@
 #define SPI_EVENT_TX_CMPLT 1
 #define SPI_EVENT_RX_CMPLT 2
 #define SPI_EVENT_OVR_ERROR 3
+#define SPI_EVENT_TXRX_CMPLT 4
+#define SPI_EVENT_DMA_ERROR 5
+#define SPI_EVENT_FRAME 6          //slave: end of a frame (NSS high)
+#define SPI_EVENT_FRAME_PART 7     //slave: part of a frame, the ring filled up to its half or end
 
 
 /*
@@ -97,7 +105,10 @@ typedef struct {
 *  					    Handle structure of USART
 * *****************************************************************************/
 
-typedef struct {
+struct SPI_Handle;
+typedef void (*SPI_Callback_t)(struct SPI_Handle *pHandle, uint8_t AppEv);
+
+typedef struct SPI_Handle {
     SPI_RegDef_t *pSPIx; /*this hold the base address of SPIx peripheral*/
     SPI_Config_t SPI_Config;
     uint8_t* pTxBuffer;
@@ -106,8 +117,22 @@ typedef struct {
     uint32_t RxLen;
     uint8_t TxState;
     uint8_t RxState;
+    DMA_Handle_t *pTxDMA;      /* streams of SPI_TransferDMA, pDMAx/pStream/StreamNumber and */
+    DMA_Handle_t *pRxDMA;      /* DMA_Channel filled in by the application (@SPI_DMA_Streams) */
+    SPI_Callback_t Callback;   /* completion of SPI_TransferDMA, NULL: SPI_ApplicationEventCallback */
+    uint16_t TxFill;           /* item sent when SPI_TransferDMA or the slave has no transmit buffer */
+    uint16_t RxDiscard;        /* sink of the received items when it has no receive buffer */
+    void *pParent;             /* owner of the handle, e.g. the SPI_Bus_t queueing on it */
+    uint32_t RxDMAPos;         /* slave: offset in pRxBuffer up to which data was handed out */
 }SPI_Handle_t;
 
+/*
+ * @SPI_DMA_Streams (refer DMA request mapping in RM)
+ * SPI1: RX DMA2 stream 0 or 2, TX DMA2 stream 3 or 5, channel 3
+ * SPI2: RX DMA1 stream 3, TX DMA1 stream 4, channel 0
+ * SPI3: RX DMA1 stream 0 or 2, TX DMA1 stream 5 or 7, channel 0
+ */
+
 
 /**********************************************************************************
 *  					    API Supported by USART driver
@@ -115,23 +140,39 @@ typedef struct {
 void SPI_PeriClockControl(SPI_RegDef_t *pSPIx, uint8_t EnorDi);
 void SPI_Init(SPI_Handle_t *pSPIx);
 void SPI_DeInit(SPI_Handle_t *pSPIx);
+uint8_t SPI_ApplyConfig(SPI_Handle_t *pSPIHandle, const SPI_Config_t *pConfig);
 
 /*
  * SPI send ànd receive
 */
 void SPI_SendData(SPI_RegDef_t *pSPIx, uint8_t *pTxBuffer, uint32_t len);
 void SPI_ReceiveData(SPI_RegDef_t *pSPIx, uint8_t *pRxBuffer, uint32_t len);
+void SPI_SendData16(SPI_RegDef_t *pSPIx, const uint16_t *pTxBuffer, uint32_t count);
+void SPI_ReceiveData16(SPI_RegDef_t *pSPIx, uint16_t *pRxBuffer, uint32_t count);
 
 uint8_t SPI_SendDataIT(SPI_Handle_t *pPSIHandler, uint8_t *pTxBuffer, uint32_t len);
 
 uint8_t SPI_ReceiveDataIT(SPI_Handle_t *pSPIHandler, uint8_t *pRxBuffer, uint32_t len);
 
+uint8_t SPI_TransferDMA(SPI_Handle_t *pSPIHandle, const uint8_t *pTxBuffer, uint8_t *pRxBuffer, uint32_t len,
+                        SPI_Callback_t Callback);
+
+/*
+ * SPI slave with DMA
+ */
+uint8_t SPI_SlaveStartDMA(SPI_Handle_t *pSPIHandle, uint8_t *pRxBuffer, uint32_t RxLen,
+                          const uint8_t *pTxBuffer, uint32_t TxLen);
+uint8_t SPI_SlaveSetReply(SPI_Handle_t *pSPIHandle, const uint8_t *pTxBuffer, uint32_t TxLen);
+void SPI_SlaveNSSHandling(SPI_Handle_t *pSPIHandle);
+void SPI_SlaveStop(SPI_Handle_t *pSPIHandle);
+
 /*
  * IRQ Configuration and ISR handling
  */
 void SPI_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
 void SPI_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
-void SPI_IRQHandler(SPI_Handle_t *pHandle);
+RAMFUNC void SPI_IRQHandle(SPI_Handle_t *pHandle);
+void SPI_IRQRegister(SPI_Handle_t *pHandle, uint8_t IRQNumber);
 
 void SPI_ClearOVRFlag(SPI_RegDef_t *pSPIx);
 void SPI_CloseTransmission(SPI_Handle_t *pSPIHandler);
@@ -141,6 +182,11 @@ void SPI_CloseReception(SPI_Handle_t *pSPIHandler);
  * Application callbacks
 */
 __attribute((weak)) void SPI_ApplicationEventCallback(SPI_Handle_t *pHandle, uint8_t AppEv);
+/*
+ * Received data of SPI_SlaveStartDMA, pData points into the receive ring.
+ * AppEv is SPI_EVENT_FRAME at the end of a frame (len may be 0), SPI_EVENT_FRAME_PART for a part of a longer frame.
+ */
+__attribute((weak)) void SPI_ApplicationFrameCallback(SPI_Handle_t *pHandle, uint8_t *pData, uint32_t len, uint8_t AppEv);
 //weak to allow application writer to override the default weak implementation
 
 
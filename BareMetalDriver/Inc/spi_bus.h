@@ -0,0 +1,66 @@
+#ifndef SPI_BUS_H_
+#define SPI_BUS_H_
+
+#include <stdint.h>
+#include "stm32f411xx.h"
+#include "spi.h"
+
+/*
+ * Transaction queue for several devices sharing one SPI.
+ * Every device carries its own SPI_Config_t and chip select pin. Transactions are queued by
+ * SPI_BusSubmit from any context and run one after the other with SPI_TransferDMA: the next one
+ * is started from the completion interrupt of the previous one, CR1 is only rewritten when the
+ * device changes configuration. Chip select is driven through BSRR, active low.
+ */
+
+/*
+ * @SPI_TransStatus
+ */
+#define SPI_TRANS_DONE 0
+#define SPI_TRANS_PENDING 1     //queued or running
+#define SPI_TRANS_ERROR 2
+
+/**********************************************************************************
+*  					    Device on the bus
+* *****************************************************************************/
+typedef struct {
+    SPI_Config_t SPI_Config;   /* mode, clock and frame of this device */
+    GPIO_RegDef_t *pCSPort;    /* chip select, NULL when the device has none */
+    uint8_t CSPin;
+}SPI_Device_t;
+
+/**********************************************************************************
+*  					    Transaction
+* *****************************************************************************/
+struct SPI_Transaction;
+typedef void (*SPI_TransCallback_t)(struct SPI_Transaction *pTrans);
+
+typedef struct SPI_Transaction {
+    SPI_Device_t *pDevice;
+    const uint8_t *pTxBuffer;        /* NULL: TxFill of the SPI handle is sent (SPI_TransferDMA) */
+    uint8_t *pRxBuffer;              /* NULL: received data is dropped */
+    uint32_t Len;
+    uint8_t KeepCS;                  /* leave chip select asserted for the next transaction of the
+                                        same device, e.g. command then data */
+    volatile uint8_t Status;         /* @SPI_TransStatus */
+    SPI_TransCallback_t Callback;    /* from the completion interrupt, may be NULL */
+    void *pContext;                  /* for the submitter, not used by the bus */
+    struct SPI_Transaction *pNext;   /* queue link, owned by the bus */
+}SPI_Transaction_t;
+
+/**********************************************************************************
+*  					    Bus
+* *****************************************************************************/
+typedef struct {
+    SPI_Handle_t *pSPIHandle;        /* SPI_Init done, pTxDMA/pRxDMA set */
+    SPI_Transaction_t *pHead;        /* running transaction */
+    SPI_Transaction_t *pTail;
+    const SPI_Device_t *pSelected;   /* device whose chip select is asserted */
+    uint32_t Reconfigs;              /* CR1 rewrites, for tuning the device order */
+}SPI_Bus_t;
+
+void SPI_BusInit(SPI_Bus_t *pBus, SPI_Handle_t *pSPIHandle);
+void SPI_DeviceInit(SPI_Device_t *pDevice);
+uint8_t SPI_BusSubmit(SPI_Bus_t *pBus, SPI_Transaction_t *pTrans);
+
+#endif /* SPI_BUS_H_ */
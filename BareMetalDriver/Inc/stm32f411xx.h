@@ -14,6 +14,10 @@
 /******************************************************************************
 *           				Stm32F411 Memory Map
 *******************************************************************************/
+#ifdef HOST_SIM
+/* Host build: the peripheral and core register blocks live in the simulator's memory (Sim/sim_periph.h) */
+#include "sim_periph.h"
+#else
 #define SPI1_BASE_ADDRESS 0x40013000
 #define SPI2_BASE_ADDRESS 0x40003800
 #define SPI3_BASE_ADDRESS 0x40003C00
@@ -45,6 +49,11 @@
 #define SYSCFG_BASE_ADDRESS 0x40013800
 
 #define RCC_BASE_ADDRESS 0x40023800
+#define FLASH_R_BASE_ADDRESS 0x40023C00
+#define PWR_BASE_ADDRESS 0x40007000
+
+#define DMA1_BASE_ADDRESS 0x40026000
+#define DMA2_BASE_ADDRESS 0x40026400
 
 /******************************************************************************
 *            Arm Cortex M Processor NVIC ISERx Register Address
@@ -78,6 +87,15 @@
 #define NVIC_IPR2 (volatile uint32_t*)0xE000E408
 #define NVIC_IPR3 (volatile uint32_t*)0xE000E40C
 
+/*
+ * Cortex-M4 debug registers (DWT cycle counter and its enable in CoreDebug DEMCR)
+ */
+#define DWT_BASE_ADDRESS 0xE0001000
+#define COREDEBUG_DEMCR (volatile uint32_t*)0xE000EDFC
+
+#define SCB_BASE_ADDRESS 0xE000ED00
+#endif /* HOST_SIM */
+
 
 /*
  * Reg definition structure for exti
@@ -126,6 +144,105 @@ typedef struct{
  #define IRQ_NO_SPI3 51
  #define IRQ_NO_I2C1_EV 31
  #define IRQ_NO_I2C1_ER 32
+ #define IRQ_NO_USART1 37
+ #define IRQ_NO_USART2 38
+ #define IRQ_NO_USART6 71
+ #define IRQ_NO_DMA1_STREAM0 11
+ #define IRQ_NO_DMA1_STREAM1 12
+ #define IRQ_NO_DMA1_STREAM2 13
+ #define IRQ_NO_DMA1_STREAM3 14
+ #define IRQ_NO_DMA1_STREAM4 15
+ #define IRQ_NO_DMA1_STREAM5 16
+ #define IRQ_NO_DMA1_STREAM6 17
+ #define IRQ_NO_DMA1_STREAM7 47
+ #define IRQ_NO_DMA2_STREAM0 56
+ #define IRQ_NO_DMA2_STREAM1 57
+ #define IRQ_NO_DMA2_STREAM2 58
+ #define IRQ_NO_DMA2_STREAM3 59
+ #define IRQ_NO_DMA2_STREAM4 60
+ #define IRQ_NO_DMA2_STREAM5 68
+ #define IRQ_NO_DMA2_STREAM6 69
+ #define IRQ_NO_DMA2_STREAM7 70
+
+ #define IRQ_NO_SYSTICK (-1)
+ #define IRQ_NO_COUNT 86//peripheral interrupts of the STM32F411 (0..85)
+
+/*
+ * Critical section helper: save PRIMASK and mask interrupts, then restore the saved state.
+ * Restoring (instead of blindly enabling) keeps nesting safe when the caller already masked IRQs.
+ */
+#ifdef HOST_SIM
+#define ENTER_CRITICAL(state) ((state) = sim_irq_save())
+#define EXIT_CRITICAL(state)  sim_irq_restore(state)
+#define DMB()                 __sync_synchronize()
+#define DSB()                 __sync_synchronize()
+#define ISB()                 __sync_synchronize()
+#define GET_IPSR(ipsr)        ((ipsr) = sim_ipsr())
+#else
+#define ENTER_CRITICAL(state) __asm volatile ("mrs %0, primask\n\tcpsid i" : "=r" (state) :: "memory")
+#define EXIT_CRITICAL(state)  __asm volatile ("msr primask, %0" :: "r" (state) : "memory")
+#define DMB()                 __asm volatile ("dmb" ::: "memory")
+#define DSB()                 __asm volatile ("dsb" ::: "memory")
+#define ISB()                 __asm volatile ("isb" ::: "memory")
+#define GET_IPSR(ipsr)        __asm volatile ("mrs %0, ipsr" : "=r" (ipsr))//active exception number
+#endif
+
+/*
+ * Code executed from SRAM (.ramfunc, copied by the startup code like .data): no flash wait states
+ * and no stall while a flash sector is erased or programmed. long_call because SRAM is out of
+ * reach of a bl from flash, put it on the prototype too. Callees stay in flash unless marked.
+ */
+#if defined(HOST_SIM) || !defined(__arm__)
+#define RAMFUNC
+#else
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline, long_call))
+#endif
+
+/*
+ * Variables left alone by the startup code (.noinit, neither copied nor zeroed): they keep their
+ * value across a reset, e.g. a reset reason or a crash log. Undefined at power-up, declare them
+ * without an initializer and validate them (magic word) before use.
+ */
+#if defined(HOST_SIM) || !defined(__arm__)
+#define NOINIT
+#else
+#define NOINIT __attribute__((section(".noinit")))
+#endif
+
+/******************************************************************************
+*           		      DWT definition structure
+*******************************************************************************/
+typedef struct{
+    volatile uint32_t CTRL;          /* Address of offset: 0x00*/
+    volatile uint32_t CYCCNT;        /* Address of offset: 0x04*/
+    volatile uint32_t CPICNT;        /* Address of offset: 0x08*/
+    volatile uint32_t EXCCNT;        /* Address of offset: 0x0C*/
+    volatile uint32_t SLEEPCNT;      /* Address of offset: 0x10*/
+    volatile uint32_t LSUCNT;        /* Address of offset: 0x14*/
+    volatile uint32_t FOLDCNT;       /* Address of offset: 0x18*/
+    volatile uint32_t PCSR;          /* Address of offset: 0x1C*/
+}DWT_RegDef_t;
+
+#define DWT ((DWT_RegDef_t*)DWT_BASE_ADDRESS)
+
+#define DWT_CTRL_CYCCNTENA 0
+#define COREDEBUG_DEMCR_TRCENA 24
+
+/******************************************************************************
+*           		      SCB definition structure
+*******************************************************************************/
+typedef struct{
+    volatile uint32_t CPUID;         /* Address of offset: 0x00*/
+    volatile uint32_t ICSR;          /* Address of offset: 0x04*/
+    volatile uint32_t VTOR;          /* Address of offset: 0x08*/
+    volatile uint32_t AIRCR;         /* Address of offset: 0x0C*/
+    volatile uint32_t SCR;           /* Address of offset: 0x10*/
+    volatile uint32_t CCR;           /* Address of offset: 0x14*/
+    volatile uint32_t SHPR[3];       /* Address of offset: 0x18*/
+    volatile uint32_t SHCSR;         /* Address of offset: 0x24*/
+}SCB_RegDef_t;
+
+#define SCB ((SCB_RegDef_t*)SCB_BASE_ADDRESS)
 
 /******************************************************************************
 *           		      RCC definition structure
@@ -169,6 +286,76 @@ typedef struct{
 
 #define RCC ((RCC_Regdef_t*)RCC_BASE_ADDRESS)
 
+/*
+ * bit position definition of RCC_CR
+ */
+#define RCC_CR_HSION 0
+#define RCC_CR_HSIRDY 1
+#define RCC_CR_HSEON 16
+#define RCC_CR_HSERDY 17
+#define RCC_CR_HSEBYP 18
+#define RCC_CR_PLLON 24
+#define RCC_CR_PLLRDY 25
+
+/*
+ * bit position definition of RCC_PLLCFGR
+ */
+#define RCC_PLLCFGR_PLLM 0
+#define RCC_PLLCFGR_PLLN 6
+#define RCC_PLLCFGR_PLLP 16
+#define RCC_PLLCFGR_PLLSRC 22
+#define RCC_PLLCFGR_PLLQ 24
+
+/*
+ * bit position definition of RCC_CFGR
+ */
+#define RCC_CFGR_SW 0
+#define RCC_CFGR_SWS 2
+#define RCC_CFGR_HPRE 4
+#define RCC_CFGR_PPRE1 10
+#define RCC_CFGR_PPRE2 13
+
+/******************************************************************************
+*           		      FLASH interface definition structure
+*******************************************************************************/
+typedef struct{
+    volatile uint32_t ACR;          /* Address of offset: 0x00*/
+    volatile uint32_t KEYR;         /* Address of offset: 0x04*/
+    volatile uint32_t OPTKEYR;      /* Address of offset: 0x08*/
+    volatile uint32_t SR;           /* Address of offset: 0x0C*/
+    volatile uint32_t CR;           /* Address of offset: 0x10*/
+    volatile uint32_t OPTCR;        /* Address of offset: 0x14*/
+}FLASH_RegDef_t;
+
+#define FLASH ((FLASH_RegDef_t*)FLASH_R_BASE_ADDRESS)
+
+/*
+ * bit position definition of FLASH_ACR
+ */
+#define FLASH_ACR_LATENCY 0
+#define FLASH_ACR_PRFTEN 8
+#define FLASH_ACR_ICEN 9
+#define FLASH_ACR_DCEN 10
+#define FLASH_ACR_ICRST 11
+#define FLASH_ACR_DCRST 12
+
+/******************************************************************************
+*           		      PWR definition structure
+*******************************************************************************/
+typedef struct{
+    volatile uint32_t CR;           /* Address of offset: 0x00*/
+    volatile uint32_t CSR;          /* Address of offset: 0x04*/
+}PWR_RegDef_t;
+
+#define PWR ((PWR_RegDef_t*)PWR_BASE_ADDRESS)
+
+/*
+ * bit position definition of PWR_CR
+ */
+#define PWR_CR_VOS 14
+
+#define PWR_CLK_ENABLE() RCC->APB1ENR |= (1<<28)
+
 /******************************************************************************
 *           		      SYSCFG definition structure
 *******************************************************************************/
@@ -367,8 +554,8 @@ typedef struct {
  *  basse address macro
  */
 #define I2C1 ((I2C_RegDef_t*)I2C1_BASE_ADDRESS)
-#define I2C2 ((I2C_RegDef_t*)I2C1_BASE_ADDRESS)
-#define I2C3 ((I2C_RegDef_t*)I2C1_BASE_ADDRESS)
+#define I2C2 ((I2C_RegDef_t*)I2C2_BASE_ADDRESS)
+#define I2C3 ((I2C_RegDef_t*)I2C3_BASE_ADDRESS)
 
 
 /*
@@ -587,4 +774,102 @@ typedef struct{
 #define USART_SR_LBD 8
 #define USART_SR_CTS 9
 
+
+/**********************************************************************************
+*  				DMA register definition structure
+* *****************************************************************************/
+
+/*
+ * DMA controller registers (interrupt status / flag clear)
+ */
+typedef struct{
+    volatile uint32_t LISR;          /* Address of offset: 0x00*/
+    volatile uint32_t HISR;          /* Address of offset: 0x04*/
+    volatile uint32_t LIFCR;         /* Address of offset: 0x08*/
+    volatile uint32_t HIFCR;         /* Address of offset: 0x0C*/
+}DMA_RegDef_t;
+
+/*
+ * DMA stream registers, stream x is located at 0x10 + 0x18 * x from the controller base
+ */
+typedef struct{
+    volatile uint32_t CR;            /* Address of offset: 0x00*/
+    volatile uint32_t NDTR;          /* Address of offset: 0x04*/
+    volatile uint32_t PAR;           /* Address of offset: 0x08*/
+    volatile uint32_t M0AR;          /* Address of offset: 0x0C*/
+    volatile uint32_t M1AR;          /* Address of offset: 0x10*/
+    volatile uint32_t FCR;           /* Address of offset: 0x14*/
+}DMA_Stream_RegDef_t;
+
+#define DMA1 ((DMA_RegDef_t*)DMA1_BASE_ADDRESS)
+#define DMA2 ((DMA_RegDef_t*)DMA2_BASE_ADDRESS)
+
+#define DMA_STREAM(base, x) ((DMA_Stream_RegDef_t*)((base) + 0x10 + (0x18 * (x))))
+
+#define DMA1_Stream0 DMA_STREAM(DMA1_BASE_ADDRESS, 0)
+#define DMA1_Stream1 DMA_STREAM(DMA1_BASE_ADDRESS, 1)
+#define DMA1_Stream2 DMA_STREAM(DMA1_BASE_ADDRESS, 2)
+#define DMA1_Stream3 DMA_STREAM(DMA1_BASE_ADDRESS, 3)
+#define DMA1_Stream4 DMA_STREAM(DMA1_BASE_ADDRESS, 4)
+#define DMA1_Stream5 DMA_STREAM(DMA1_BASE_ADDRESS, 5)
+#define DMA1_Stream6 DMA_STREAM(DMA1_BASE_ADDRESS, 6)
+#define DMA1_Stream7 DMA_STREAM(DMA1_BASE_ADDRESS, 7)
+#define DMA2_Stream0 DMA_STREAM(DMA2_BASE_ADDRESS, 0)
+#define DMA2_Stream1 DMA_STREAM(DMA2_BASE_ADDRESS, 1)
+#define DMA2_Stream2 DMA_STREAM(DMA2_BASE_ADDRESS, 2)
+#define DMA2_Stream3 DMA_STREAM(DMA2_BASE_ADDRESS, 3)
+#define DMA2_Stream4 DMA_STREAM(DMA2_BASE_ADDRESS, 4)
+#define DMA2_Stream5 DMA_STREAM(DMA2_BASE_ADDRESS, 5)
+#define DMA2_Stream6 DMA_STREAM(DMA2_BASE_ADDRESS, 6)
+#define DMA2_Stream7 DMA_STREAM(DMA2_BASE_ADDRESS, 7)
+
+/*
+ * clock enable and disable macro for DMAx peripheral
+ */
+#define DMA1_CLK_ENABLE() RCC->AHB1ENR |= (1<<21)
+#define DMA2_CLK_ENABLE() RCC->AHB1ENR |= (1<<22)
+
+#define DMA1_CLK_DISABLE() RCC->AHB1ENR &= ~(1<<21)
+#define DMA2_CLK_DISABLE() RCC->AHB1ENR &= ~(1<<22)
+
+/*
+ * bit position definition of DMA_SxCR
+ */
+#define DMA_SxCR_EN 0
+#define DMA_SxCR_DMEIE 1
+#define DMA_SxCR_TEIE 2
+#define DMA_SxCR_HTIE 3
+#define DMA_SxCR_TCIE 4
+#define DMA_SxCR_PFCTRL 5
+#define DMA_SxCR_DIR 6
+#define DMA_SxCR_CIRC 8
+#define DMA_SxCR_PINC 9
+#define DMA_SxCR_MINC 10
+#define DMA_SxCR_PSIZE 11
+#define DMA_SxCR_MSIZE 13
+#define DMA_SxCR_PINCOS 15
+#define DMA_SxCR_PL 16
+#define DMA_SxCR_DBM 18
+#define DMA_SxCR_CT 19
+#define DMA_SxCR_PBURST 21
+#define DMA_SxCR_MBURST 23
+#define DMA_SxCR_CHSEL 25
+
+/*
+ * bit position definition of DMA_SxFCR
+ */
+#define DMA_SxFCR_FTH 0
+#define DMA_SxFCR_DMDIS 2
+#define DMA_SxFCR_FS 3
+#define DMA_SxFCR_FEIE 7
+
+/*
+ * bit position of the stream flags inside one 6-bit group of DMA_LISR/HISR (and LIFCR/HIFCR)
+ */
+#define DMA_ISR_FEIF 0
+#define DMA_ISR_DMEIF 2
+#define DMA_ISR_TEIF 3
+#define DMA_ISR_HTIF 4
+#define DMA_ISR_TCIF 5
+
 #endif /* STM32F411XX_H_ */
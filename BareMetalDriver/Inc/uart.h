@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "stm32f411xx.h"
 #include "rcc_driver.h"
+#include "dma.h"
 
 
 
@@ -25,6 +26,7 @@
 #define USART_ERREVENT_FE 5
 #define USART_ERREVENT_NE 5
 #define USART_ERREVENT_ORE 6
+#define USART_ERREVENT_DMA 7    //transfer error of the receive stream, reception stopped
 
 /*
  * @USART_Baud
@@ -87,12 +89,26 @@
 #define USART_FLAG_LBD (1<<USART_SR_LBD)
 #define USART_FLAG_CTS (1<<USART_SR_CTS)
 
+/*
+ * @USART_TxOverflowPolicy
+ */
+#define USART_TX_OVERFLOW_DROP 0
+#define USART_TX_OVERFLOW_BLOCK 1
+
+/*
+ * size of the debug UART transmit ring used by system_uart_dma_init
+ */
+#ifndef UART_TX_RING_SIZE
+#define UART_TX_RING_SIZE 1024
+#endif
+
 /*
  * USART state
  */
 #define USART_READY 0
 #define USART_BUSY_IN_TX 1
 #define USART_BUSY_IN_RX 2
+#define USART_BUSY_IN_RX_DMA 3
 
  /**********************************************************************************
  *  					config structure of USART
@@ -119,6 +135,8 @@ typedef struct {
     uint8_t RxState;
     uint8_t* pTxBuffer;
     uint8_t* pRxBuffer;
+    DMA_Handle_t *pRxDMA;          /* stream used by USART_ReceiveToIdleDMA*/
+    uint32_t RxDMAPos;             /* offset in pRxBuffer up to which data was handed out*/
 }USART_Handle_t;
 
 
@@ -147,13 +165,17 @@ void USART_ReceiveData(USART_Handle_t *pUSARTHandle, uint8_t *pRxBuffer, uint32_
 uint8_t USART_SendDataIT(USART_Handle_t *pUSARTHandle, uint8_t *pTxBuffer, uint32_t len);
 uint8_t USART_ReceiveDataIT(USART_Handle_t *pUSARTHandle, uint8_t *pRxBuffer, uint32_t len);
 
+uint8_t USART_ReceiveToIdleDMA(USART_Handle_t *pUSARTHandle, DMA_Handle_t *pDMAHandle, uint8_t *pRxBuffer, uint32_t len);
+void USART_StopReceiveDMA(USART_Handle_t *pUSARTHandle);
+
 /*
  * IRQ Configuration and ISR handling
  */
 void USART_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
 void USART_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
 
-void USART_IRQHandling(USART_Handle_t *pUSARTHandle);
+RAMFUNC void USART_IRQHandling(USART_Handle_t *pUSARTHandle);
+void USART_IRQRegister(USART_Handle_t *pUSARTHandle, uint8_t IRQNumber);
 
 /*
  * Other Peripheral Control APIs
@@ -161,11 +183,26 @@ void USART_IRQHandling(USART_Handle_t *pUSARTHandle);
 void USART_PeripheralControl(USART_RegDef_t *pUSARTx, uint8_t EnOrDi);
 uint8_t USART_GetFlagStatus(USART_RegDef_t *pUSARTx , uint32_t FlagName);
 void USART_ClearFlag(USART_RegDef_t *pUSARTx, uint16_t StatusFlagName);
+void USART_SetBaudRate(USART_RegDef_t *pUSARTx, uint32_t BaudRate);
+
 
+/*
+ * Debug UART (USART2, printf) with DMA driven transmit
+ */
+void system_uart_init(void);
+void system_uart_dma_init(uint8_t OverflowPolicy);
+uint32_t uart_dma_write(const uint8_t *pData, uint32_t len);
+void uart_dma_flush(void);
+uint32_t uart_dma_dropped(void);
 
 /*
  * Application callbacks
 */
 __attribute((weak)) void USART_ApplicationEventCallback(USART_Handle_t *pHandle, uint8_t AppEv);
+/*
+ * Received data of USART_ReceiveToIdleDMA, pData points into the DMA buffer.
+ * AppEv is USART_EVENT_IDLE at the end of a frame, USART_EVENT_RX_CMPLT for a part of a longer frame.
+ */
+__attribute((weak)) void USART_ApplicationRxDataCallback(USART_Handle_t *pHandle, uint8_t *pData, uint32_t len, uint8_t AppEv);
 //weak to allow application writer to override the default weak implementation
 #endif /* UART_H_ */
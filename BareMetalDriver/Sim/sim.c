@@ -0,0 +1,568 @@
+/*
+ * sim.c
+ *
+ * Access engine of the host simulator: owns the simulated register memory, traps every driver
+ * access (SIGSEGV on the PROT_NONE blocks, then one single-stepped instruction with the blocks
+ * opened, then SIGTRAP), keeps the cycle clock and models the NVIC.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include "sim_internal.h"
+#include "sim_periph.h"
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "the register simulator needs x86_64 Linux (page faults + trap flag single-stepping)"
+#endif
+
+#define EFLAGS_TF (1UL << 8)
+#define PF_WRITE (1UL << 1)
+
+/* cycles for exception entry and for the return, Cortex-M4 without FPU context */
+#define SIM_EXCEPTION_CYCLES 12
+
+#define SIM_MAX_MODELS 32
+#define SIM_MAX_IRQ_LOOPS 100000
+
+uintptr_t sim_periph_base;
+uintptr_t sim_core_base;
+uint64_t sim_now;
+
+static const sim_model_t *models[SIM_MAX_MODELS];
+static int model_count;
+
+static int open_depth;
+static struct {
+    int active;
+    int is_write;
+    uint32_t phys;
+    uint32_t old;
+    const sim_model_t *m;
+} pending;
+
+/* last status read, used to fast-forward busy-wait loops */
+static struct {
+    int valid;
+    uint32_t phys;
+    uint32_t val;
+    uint32_t repeats;   /* reads of the same value after the first */
+} spin;
+
+static uint32_t nvic_enable[SIM_NUM_IRQ / 32];
+static uint32_t nvic_pend[SIM_NUM_IRQ / 32];
+static uint32_t irq_level[SIM_NUM_IRQ / 32];
+static int systick_pend;
+static sim_isr_t vectors[SIM_NUM_IRQ + 16];
+/* vector table of the image, VTOR at reset: no entries, the handlers come from sim_set_vector() */
+static uint32_t image_vectors[SIM_NUM_IRQ + 16];
+static uint32_t primask;
+static int in_isr;
+static uint32_t ipsr;
+
+/*********************************************************************
+ * Memory helpers
+ *********************************************************************/
+volatile uint32_t *sim_reg(uint32_t phys)
+{
+	if (phys >= SIM_CORE_PHYS) {
+		return (volatile uint32_t *)(sim_core_base + (phys - SIM_CORE_PHYS));
+	}
+	return (volatile uint32_t *)(sim_periph_base + (phys - SIM_PERIPH_PHYS));
+}
+
+static int sim_to_phys(uintptr_t a, uint32_t *pPhys)
+{
+	if (a >= sim_periph_base && a < sim_periph_base + SIM_PERIPH_SIZE) {
+		*pPhys = (uint32_t)(SIM_PERIPH_PHYS + (a - sim_periph_base));
+		return 1;
+	}
+	if (a >= sim_core_base && a < sim_core_base + SIM_CORE_SIZE) {
+		*pPhys = (uint32_t)(SIM_CORE_PHYS + (a - sim_core_base));
+		return 1;
+	}
+	return 0;
+}
+
+uint32_t sim_phys(const volatile void *p)
+{
+	uint32_t phys = 0;
+
+	if (!sim_to_phys((uintptr_t)p, &phys)) {
+		fprintf(stderr, "sim: %p is not a simulated register\n", (const void *)p);
+		abort();
+	}
+	return phys;
+}
+
+uint32_t sim_bus_addr(uint32_t phys)
+{
+	return (uint32_t)(uintptr_t)sim_reg(phys);
+}
+
+void sim_open(void)
+{
+	if (open_depth++ == 0) {
+		mprotect((void *)sim_periph_base, SIM_PERIPH_SIZE, PROT_READ | PROT_WRITE);
+		mprotect((void *)sim_core_base, SIM_CORE_SIZE, PROT_READ | PROT_WRITE);
+	}
+}
+
+void sim_close(void)
+{
+	if (--open_depth == 0) {
+		mprotect((void *)sim_periph_base, SIM_PERIPH_SIZE, PROT_NONE);
+		mprotect((void *)sim_core_base, SIM_CORE_SIZE, PROT_NONE);
+	}
+}
+
+static const sim_model_t *sim_find(uint32_t phys)
+{
+	for (int i = 0; i < model_count; i++) {
+		if (phys >= models[i]->phys && phys < models[i]->phys + models[i]->size) {
+			return models[i];
+		}
+	}
+	return NULL;
+}
+
+static void sim_update_all(void)
+{
+	for (int i = 0; i < model_count; i++) {
+		if (models[i]->update) {
+			models[i]->update(models[i]->ctx);
+		}
+	}
+}
+
+static uint64_t sim_next_event(void)
+{
+	uint64_t next = SIM_NEVER;
+
+	for (int i = 0; i < model_count; i++) {
+		if (models[i]->next_event) {
+			uint64_t t = models[i]->next_event(models[i]->ctx);
+			if (t < next) {
+				next = t;
+			}
+		}
+	}
+	return next;
+}
+
+void sim_model_reset(uint32_t phys)
+{
+	const sim_model_t *m = sim_find(phys);
+
+	if (m) {
+		memset((void *)sim_reg(m->phys), 0, m->size);
+		m->reset(m->ctx);
+	}
+}
+
+/*********************************************************************
+ * NVIC model (ISER/ICER/ISPR/ICPR, IPR kept as plain memory)
+ *********************************************************************/
+#define NVIC_ISER_OFF 0x000
+#define NVIC_ICER_OFF 0x080
+#define NVIC_ISPR_OFF 0x100
+#define NVIC_ICPR_OFF 0x180
+#define NVIC_IPR_OFF 0x300
+
+static void nvic_mirror(void)
+{
+	for (int n = 0; n < SIM_NUM_IRQ / 32; n++) {
+		SIM_REG(0xE000E100 + NVIC_ISER_OFF + 4 * n) = nvic_enable[n];
+		SIM_REG(0xE000E100 + NVIC_ICER_OFF + 4 * n) = nvic_enable[n];
+		SIM_REG(0xE000E100 + NVIC_ISPR_OFF + 4 * n) = nvic_pend[n] | irq_level[n];
+		SIM_REG(0xE000E100 + NVIC_ICPR_OFF + 4 * n) = nvic_pend[n] | irq_level[n];
+	}
+}
+
+static void nvic_reset(void *ctx)
+{
+	(void)ctx;
+	memset(nvic_enable, 0, sizeof(nvic_enable));
+	memset(nvic_pend, 0, sizeof(nvic_pend));
+	memset(irq_level, 0, sizeof(irq_level));
+	systick_pend = 0;
+	nvic_mirror();
+}
+
+static void nvic_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	uint32_t n = (off & 0x7F) / 4;
+
+	(void)ctx;
+	(void)old;
+	if (off >= NVIC_IPR_OFF || n >= SIM_NUM_IRQ / 32) {
+		return;
+	}
+	switch (off & ~0x7FU) {
+	case NVIC_ISER_OFF: nvic_enable[n] |= val; break;
+	case NVIC_ICER_OFF: nvic_enable[n] &= ~val; break;
+	case NVIC_ISPR_OFF: nvic_pend[n] |= val; break;
+	case NVIC_ICPR_OFF: nvic_pend[n] &= ~val; break;
+	default: break;
+	}
+	nvic_mirror();
+}
+
+static void nvic_read(void *ctx, uint32_t off)
+{
+	(void)ctx;
+	(void)off;
+	nvic_mirror();
+}
+
+static const sim_model_t nvic_model = {
+	"NVIC", 0xE000E100, 0x3F0, NULL, nvic_reset, nvic_read, NULL, nvic_write, NULL, NULL
+};
+
+void sim_irq_line(int irqn, int level)
+{
+	if (irqn < 0 || irqn >= SIM_NUM_IRQ) {
+		return;
+	}
+	if (level) {
+		irq_level[irqn / 32] |= (1U << (irqn % 32));
+	} else {
+		irq_level[irqn / 32] &= ~(1U << (irqn % 32));
+	}
+}
+
+void sim_irq_pend(int irqn)
+{
+	if (irqn == SIM_IRQ_SYSTICK) {
+		systick_pend = 1;
+	} else if (irqn >= 0 && irqn < SIM_NUM_IRQ) {
+		nvic_pend[irqn / 32] |= (1U << (irqn % 32));
+	}
+}
+
+/* highest priority pending interrupt, SysTick first, then lowest IPR value, then lowest number */
+static int nvic_select(void)
+{
+	const volatile uint8_t *ipr = (const volatile uint8_t *)sim_reg(0xE000E100 + NVIC_IPR_OFF);
+	int best = -2;
+	unsigned best_prio = 0x100;
+
+	if (systick_pend) {
+		return SIM_IRQ_SYSTICK;
+	}
+	for (int irq = 0; irq < SIM_NUM_IRQ; irq++) {
+		uint32_t bit = 1U << (irq % 32);
+		if ((nvic_enable[irq / 32] & bit) && ((nvic_pend[irq / 32] | irq_level[irq / 32]) & bit)) {
+			if (ipr[irq] < best_prio) {
+				best_prio = ipr[irq];
+				best = irq;
+			}
+		}
+	}
+	return best;
+}
+
+uint32_t sim_irq_save(void)
+{
+	uint32_t state = primask;
+
+	primask = 1;
+	return state;
+}
+
+void sim_irq_restore(uint32_t state)
+{
+	primask = state;
+}
+
+uint32_t sim_ipsr(void)
+{
+	return ipsr;
+}
+
+/*
+ * handler of an exception: the table VTOR points at (words, host code lives below 4GB in a
+ * -no-pie binary) when it has an entry, otherwise the vector set with sim_set_vector()
+ */
+static sim_isr_t sim_vector(int irqn)
+{
+	uint32_t entry = ((volatile uint32_t *)(uintptr_t)SIM_REG(0xE000ED08))[irqn + 16];
+
+	if (entry != 0U) {
+		return (sim_isr_t)(uintptr_t)entry;
+	}
+	return vectors[irqn + 16];
+}
+
+/*********************************************************************
+ * Access trapping
+ *********************************************************************/
+static void sim_access_begin(uint32_t phys, int is_write)
+{
+	const sim_model_t *m = sim_find(phys);
+	volatile uint32_t *r = sim_reg(phys);
+
+	sim_now += SIM_ACCESS_CYCLES;
+	sim_update_all();
+
+	pending.active = 1;
+	pending.is_write = is_write;
+	pending.phys = phys;
+	pending.m = m;
+	if (is_write) {
+		pending.old = *r;
+		return;
+	}
+
+	/* same status read again and again with nothing changed: the CPU spins until the next event.
+	 * A few re-reads are not a loop, e.g. a handler testing the flags of one register one by one. */
+	if (spin.valid && spin.phys == phys && *r == spin.val && spin.repeats >= SIM_SPIN_READS - 2) {
+		uint64_t t = sim_next_event();
+		if (t != SIM_NEVER && t > sim_now) {
+			sim_now = t;
+			sim_update_all();
+		}
+	}
+	if (m && m->read) {
+		m->read(m->ctx, phys - m->phys);
+	}
+}
+
+static void sim_access_end(void)
+{
+	const sim_model_t *m = pending.m;
+	volatile uint32_t *r = sim_reg(pending.phys);
+
+	if (pending.is_write) {
+		spin.valid = 0;
+		if (m && m->write) {
+			m->write(m->ctx, pending.phys - m->phys, pending.old, *r);
+		}
+		sim_update_all();
+	} else {
+		if (spin.valid && spin.phys == pending.phys && spin.val == *r) {
+			spin.repeats++;
+		} else {
+			spin.repeats = 0;
+		}
+		spin.valid = 1;
+		spin.phys = pending.phys;
+		spin.val = *r;
+		if (m && m->read_done) {
+			m->read_done(m->ctx, pending.phys - m->phys);
+		}
+	}
+	pending.active = 0;
+}
+
+static void sim_segv_handler(int sig, siginfo_t *si, void *pContext)
+{
+	ucontext_t *uc = pContext;
+	uint32_t phys;
+
+	(void)sig;
+	if (pending.active || !sim_to_phys((uintptr_t)si->si_addr, &phys)) {
+		/* a real crash: let it fault again with the default action */
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+	sim_open();
+	sim_access_begin(phys & ~3U, (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0);
+	uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void sim_trap_handler(int sig, siginfo_t *si, void *pContext)
+{
+	ucontext_t *uc = pContext;
+
+	(void)sig;
+	(void)si;
+	if (!pending.active) {
+		signal(SIGTRAP, SIG_DFL);
+		return;
+	}
+	uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+	sim_access_end();
+	sim_close();
+}
+
+/*********************************************************************
+ * Public API
+ *********************************************************************/
+static void sim_add(const sim_model_t *m)
+{
+	if (model_count < SIM_MAX_MODELS) {
+		models[model_count++] = m;
+	}
+}
+
+void sim_init(void)
+{
+	struct sigaction sa;
+	void *p;
+
+	if (sim_periph_base) {
+		sim_reset();
+		return;
+	}
+
+	p = mmap(NULL, SIM_PERIPH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("sim: mmap");
+		abort();
+	}
+	sim_periph_base = (uintptr_t)p;
+	p = mmap(NULL, SIM_CORE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("sim: mmap");
+		abort();
+	}
+	sim_core_base = (uintptr_t)p;
+
+	sim_add(&nvic_model);
+	for (int i = 0; i < sim_system_model_count; i++) {
+		sim_add(&sim_system_models[i]);
+	}
+	for (int i = 0; i < sim_usart_model_count; i++) {
+		sim_add(&sim_usart_models[i]);
+	}
+	for (int i = 0; i < sim_spi_model_count; i++) {
+		sim_add(&sim_spi_models[i]);
+	}
+	for (int i = 0; i < sim_i2c_model_count; i++) {
+		sim_add(&sim_i2c_models[i]);
+	}
+	for (int i = 0; i < sim_dma_model_count; i++) {
+		sim_add(&sim_dma_models[i]);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sa.sa_sigaction = sim_segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = sim_trap_handler;
+	sigaction(SIGTRAP, &sa, NULL);
+
+	open_depth = 1;
+	sim_reset();
+	sim_close();
+}
+
+void sim_reset(void)
+{
+	sim_open();
+	memset((void *)sim_periph_base, 0, SIM_PERIPH_SIZE);
+	memset((void *)sim_core_base, 0, SIM_CORE_SIZE);
+	sim_now = 0;
+	spin.valid = 0;
+	primask = 0;
+	in_isr = 0;
+	ipsr = 0;
+	memset(vectors, 0, sizeof(vectors));
+	for (int i = 0; i < model_count; i++) {
+		models[i]->reset(models[i]->ctx);
+	}
+	SIM_REG(0xE000ED08) = (uint32_t)(uintptr_t)image_vectors;
+	sim_close();
+}
+
+uint64_t sim_cycles(void)
+{
+	return sim_now;
+}
+
+void sim_set_vector(int irqn, sim_isr_t isr)
+{
+	if (irqn >= -16 && irqn < SIM_NUM_IRQ) {
+		vectors[irqn + 16] = isr;
+	}
+}
+
+void sim_dispatch_irqs(void)
+{
+	int irq = 0;
+	sim_isr_t isr;
+
+	if (primask || in_isr) {
+		return;
+	}
+	for (int n = 0; n < SIM_MAX_IRQ_LOOPS; n++) {
+		sim_open();
+		sim_update_all();
+		irq = nvic_select();
+		if (irq == SIM_IRQ_SYSTICK) {
+			systick_pend = 0;
+		} else if (irq >= 0) {
+			nvic_pend[irq / 32] &= ~(1U << (irq % 32));
+			nvic_mirror();
+		}
+		if (irq < SIM_IRQ_SYSTICK) {
+			sim_close();
+			return;
+		}
+		isr = sim_vector(irq);
+		sim_close();
+		if (!isr) {
+			fprintf(stderr, "sim: IRQ %d pending without a vector\n", irq);
+			abort();
+		}
+		sim_now += SIM_EXCEPTION_CYCLES;
+		in_isr = 1;
+		ipsr = (uint32_t)(irq + 16);
+		isr();
+		ipsr = 0;
+		in_isr = 0;
+		sim_now += SIM_EXCEPTION_CYCLES;
+		spin.valid = 0;
+	}
+	fprintf(stderr, "sim: IRQ %d never cleared by its handler\n", irq);
+	abort();
+}
+
+void sim_run(uint64_t cycles)
+{
+	uint64_t end = sim_now + cycles;
+
+	sim_dispatch_irqs();
+	while (sim_now < end) {
+		uint64_t t;
+
+		sim_open();
+		t = sim_next_event();
+		if (t > end) {
+			t = end;
+		}
+		sim_now = (t > sim_now) ? t : sim_now + 1;
+		sim_update_all();
+		sim_close();
+		sim_dispatch_irqs();
+	}
+}
+
+int sim_run_until(volatile int *pFlag, uint64_t timeout_cycles)
+{
+	uint64_t end = sim_now + timeout_cycles;
+
+	sim_dispatch_irqs();
+	while (!*pFlag) {
+		uint64_t t;
+
+		if (sim_now >= end) {
+			return 0;
+		}
+		sim_open();
+		t = sim_next_event();
+		if (t > end) {
+			t = end;
+		}
+		sim_now = (t > sim_now) ? t : sim_now + 1;
+		sim_update_all();
+		sim_close();
+		sim_dispatch_irqs();
+	}
+	return 1;
+}
@@ -0,0 +1,91 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+/*
+ * Host register-model simulator for the BareMetalDriver drivers (x86_64 Linux).
+ *
+ * Build the drivers with -DHOST_SIM -ISim -no-pie together with the Sim sources and a test main(),
+ * as make sim does for the tests in Sim/tests.
+ * Register blocks are kept PROT_NONE; every driver access faults into the simulator, which runs
+ * the peripheral model around the access (reads see fresh status, writes trigger side effects)
+ * and charges SIM_ACCESS_CYCLES to the cycle clock.
+ *
+ * Time model: sim_cycles() counts core clock cycles (HCLK). Only bus accesses and peripheral
+ * activity consume time; when a driver spins on an unchanged status register (SIM_SPIN_READS
+ * identical reads in a row) the clock jumps straight to the next peripheral event, which is what
+ * the busy-wait costs on silicon.
+ *
+ * Interrupts are level lines from the models into the NVIC model. They are delivered only by
+ * sim_run() / sim_dispatch_irqs(), never in the middle of a driver function.
+ * The handler is taken from the vector table SCB->VTOR points at (IRQ_Init, irq.h) when it has an
+ * entry for the interrupt, otherwise from sim_set_vector(). At reset VTOR points at an empty table
+ * standing in for the one of the image, so IRQ_Init copies it like on target. IPSR is modelled
+ * for GET_IPSR.
+ *
+ * DMA buffers must live below 4GB (static or heap data in a -no-pie binary), since the driver
+ * stores their address in 32-bit registers.
+ */
+
+/* cycles charged for one peripheral register access */
+#define SIM_ACCESS_CYCLES 2
+/* identical status reads in a row before they count as a busy-wait loop */
+#define SIM_SPIN_READS 8
+
+#define SIM_NEVER UINT64_MAX
+
+/* IRQ number of the SysTick exception for sim_set_vector() */
+#define SIM_IRQ_SYSTICK (-1)
+
+typedef void (*sim_isr_t)(void);
+
+/*
+ * Engine
+ */
+void sim_init(void);
+void sim_reset(void);
+uint64_t sim_cycles(void);
+uint32_t sim_hclk_hz(void);
+void sim_run(uint64_t cycles);
+int sim_run_until(volatile int *pFlag, uint64_t timeout_cycles);
+void sim_set_vector(int irqn, sim_isr_t isr);
+void sim_dispatch_irqs(void);
+
+/*
+ * USART model: bytes shifted out are captured in a log, receive bytes are injected by the test.
+ */
+void sim_usart_inject(void *pUSARTx, const uint8_t *pData, uint32_t len);
+uint32_t sim_usart_tx_log(void *pUSARTx, uint8_t *pBuffer, uint32_t max);
+void sim_usart_tx_log_clear(void *pUSARTx);
+
+/*
+ * SPI model: as master MISO = MOSI unless a responder is installed.
+ */
+typedef uint16_t (*sim_spi_responder_t)(uint16_t mosi);
+void sim_spi_set_responder(void *pSPIx, sim_spi_responder_t responder);
+
+/*
+ * SPI slave: an external master clocks len bytes of pMosi at sck_hz, what the slave sends goes to
+ * pMiso (may be NULL). NSS rises on EXTI line nss_exti_line (-1: none) once the frame is done.
+ */
+void sim_spi_master_frame(void *pSPIx, const uint8_t *pMosi, uint8_t *pMiso, uint32_t len, uint32_t sck_hz,
+		int nss_exti_line);
+
+/*
+ * EXTI: edge on a line, pending (and its IRQ raised) when RTSR/FTSR and IMR select it
+ */
+void sim_exti_edge(int line, int rising);
+
+/*
+ * I2C model (master): slave stubs with a register file. The first byte written after the
+ * address selects the register, further bytes are written/read from an auto-incremented pointer.
+ */
+void sim_i2c_add_slave(void *pI2Cx, uint8_t addr7, uint8_t *pRegs, uint32_t size);
+
+/*
+ * a slave stretching SCL for ever: START and STOP requests stay pending while held
+ */
+void sim_i2c_hold_scl(void *pI2Cx, int held);
+
+#endif /* SIM_H_ */
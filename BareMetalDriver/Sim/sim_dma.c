@@ -0,0 +1,285 @@
+/*
+ * sim_dma.c
+ *
+ * DMA1/DMA2 model: streams are served on request from the peripheral models (matched on PAR),
+ * memory-to-memory streams run on their own at SIM_DMA_M2M_CYCLES per item. NDTR, circular
+ * reload, double-buffer CT toggling, HT/TC flags and per-stream interrupt lines are modelled.
+ */
+#include <string.h>
+
+#include "sim_internal.h"
+
+#define SIM_DMA_M2M_CYCLES 4U
+
+#define DMA_LISR 0x00
+#define DMA_HISR 0x04
+#define DMA_LIFCR 0x08
+#define DMA_HIFCR 0x0C
+#define DMA_STREAM_OFF(n) (0x10U + 0x18U * (n))
+#define SxCR 0x00
+#define SxNDTR 0x04
+#define SxPAR 0x08
+#define SxM0AR 0x0C
+#define SxM1AR 0x10
+#define SxFCR 0x14
+
+#define CR_EN (1U << 0)
+#define CR_DMEIE (1U << 1)
+#define CR_TEIE (1U << 2)
+#define CR_HTIE (1U << 3)
+#define CR_TCIE (1U << 4)
+#define CR_CIRC (1U << 8)
+#define CR_PINC (1U << 9)
+#define CR_MINC (1U << 10)
+#define CR_DBM (1U << 18)
+#define CR_CT (1U << 19)
+
+#define FLAG_FE (1U << 0)
+#define FLAG_DME (1U << 2)
+#define FLAG_TE (1U << 3)
+#define FLAG_HT (1U << 4)
+#define FLAG_TC (1U << 5)
+
+struct sim_dma_stream {
+	struct dma_ctrl *pCtrl;
+	uint32_t n;
+	uint32_t total;
+	uint32_t done;
+	uint64_t m2m_end;
+};
+
+typedef struct dma_ctrl {
+	uint32_t phys;
+	int irq[8];
+	struct sim_dma_stream st[8];
+}dma_t;
+
+static dma_t dma1 = { .phys = 0x40026000, .irq = { 11, 12, 13, 14, 15, 16, 17, 47 } };
+static dma_t dma2 = { .phys = 0x40026400, .irq = { 56, 57, 58, 59, 60, 68, 69, 70 } };
+
+static const uint8_t flag_shift[4] = { 0, 6, 16, 22 };
+
+#define SREG(s, off) SIM_REG((s)->pCtrl->phys + DMA_STREAM_OFF((s)->n) + (off))
+
+static volatile uint32_t *dma_isr(struct sim_dma_stream *s)
+{
+	return sim_reg(s->pCtrl->phys + ((s->n < 4U) ? DMA_LISR : DMA_HISR));
+}
+
+static void dma_set_flag(struct sim_dma_stream *s, uint32_t flag)
+{
+	*dma_isr(s) |= flag << flag_shift[s->n & 3U];
+}
+
+static void dma_irq(struct sim_dma_stream *s)
+{
+	uint32_t flags = (*dma_isr(s) >> flag_shift[s->n & 3U]) & 0x3DU;
+	uint32_t cr = SREG(s, SxCR);
+	int level = 0;
+
+	level |= (flags & FLAG_TC) && (cr & CR_TCIE);
+	level |= (flags & FLAG_HT) && (cr & CR_HTIE);
+	level |= (flags & FLAG_TE) && (cr & CR_TEIE);
+	level |= (flags & FLAG_DME) && (cr & CR_DMEIE);
+	level |= (flags & FLAG_FE) && (SREG(s, SxFCR) & (1U << 7));
+	sim_irq_line(s->pCtrl->irq[s->n], level);
+}
+
+static uint32_t dma_size(uint32_t cr, int shift)
+{
+	return 1U << ((cr >> shift) & 3U);
+}
+
+/* host address of the current memory item */
+static uintptr_t dma_mem(struct sim_dma_stream *s)
+{
+	uint32_t cr = SREG(s, SxCR);
+	uint32_t base = ((cr & CR_DBM) && (cr & CR_CT)) ? SREG(s, SxM1AR) : SREG(s, SxM0AR);
+
+	return (uintptr_t)base + ((cr & CR_MINC) ? s->done * dma_size(cr, 13) : 0U);
+}
+
+static uint32_t dma_load(uintptr_t a, uint32_t size)
+{
+	if (size == 1U) {
+		return *(volatile uint8_t *)a;
+	}
+	if (size == 2U) {
+		return *(volatile uint16_t *)a;
+	}
+	return *(volatile uint32_t *)a;
+}
+
+static void dma_store(uintptr_t a, uint32_t size, uint32_t val)
+{
+	if (size == 1U) {
+		*(volatile uint8_t *)a = (uint8_t)val;
+	} else if (size == 2U) {
+		*(volatile uint16_t *)a = (uint16_t)val;
+	} else {
+		*(volatile uint32_t *)a = val;
+	}
+}
+
+static void dma_advance(struct sim_dma_stream *s)
+{
+	uint32_t cr = SREG(s, SxCR);
+	uint32_t ndtr = SREG(s, SxNDTR) - 1U;
+
+	s->done++;
+	SREG(s, SxNDTR) = ndtr;
+	if (s->done == s->total / 2U) {
+		dma_set_flag(s, FLAG_HT);
+	}
+	if (ndtr == 0U) {
+		dma_set_flag(s, FLAG_TC);
+		if (cr & (CR_CIRC | CR_DBM)) {
+			SREG(s, SxNDTR) = s->total;
+			s->done = 0;
+			if (cr & CR_DBM) {
+				SREG(s, SxCR) = cr ^ CR_CT;
+			}
+		} else {
+			SREG(s, SxCR) = cr & ~CR_EN;
+		}
+	}
+	dma_irq(s);
+}
+
+sim_dma_stream_t *sim_dma_request(uint32_t par, int to_periph)
+{
+	dma_t *ctrl[2] = { &dma1, &dma2 };
+
+	for (int c = 0; c < 2; c++) {
+		for (uint32_t n = 0; n < 8U; n++) {
+			struct sim_dma_stream *s = &ctrl[c]->st[n];
+			uint32_t cr = SREG(s, SxCR);
+			uint32_t dir = (cr >> 6) & 3U;
+
+			if ((cr & CR_EN) && SREG(s, SxPAR) == par && SREG(s, SxNDTR) != 0U &&
+			    dir == (to_periph ? 1U : 0U)) {
+				return s;
+			}
+		}
+	}
+	return NULL;
+}
+
+uint32_t sim_dma_fetch(sim_dma_stream_t *pStream)
+{
+	uint32_t val = dma_load(dma_mem(pStream), dma_size(SREG(pStream, SxCR), 13));
+
+	dma_advance(pStream);
+	return val;
+}
+
+void sim_dma_store(sim_dma_stream_t *pStream, uint32_t val)
+{
+	dma_store(dma_mem(pStream), dma_size(SREG(pStream, SxCR), 13), val);
+	dma_advance(pStream);
+}
+
+uint32_t sim_dma_remaining(sim_dma_stream_t *pStream)
+{
+	return SREG(pStream, SxNDTR);
+}
+
+/* memory-to-memory: data is moved at enable, EN/TC follow after the transfer time */
+static void dma_m2m(struct sim_dma_stream *s)
+{
+	uint32_t cr = SREG(s, SxCR);
+	uint32_t psize = dma_size(cr, 11);
+	uint32_t msize = dma_size(cr, 13);
+	uintptr_t src = SREG(s, SxPAR);
+	uintptr_t dst = SREG(s, SxM0AR);
+
+	for (uint32_t i = 0; i < s->total; i++) {
+		uint32_t v = dma_load(src + ((cr & CR_PINC) ? i * psize : 0U), psize);
+		dma_store(dst + ((cr & CR_MINC) ? i * msize : 0U), msize, v);
+	}
+	s->m2m_end = sim_now + (uint64_t)s->total * SIM_DMA_M2M_CYCLES;
+}
+
+static void dma_update(void *ctx)
+{
+	dma_t *d = ctx;
+
+	for (uint32_t n = 0; n < 8U; n++) {
+		struct sim_dma_stream *s = &d->st[n];
+		if (s->m2m_end <= sim_now) {
+			s->m2m_end = SIM_NEVER;
+			SREG(s, SxNDTR) = 0;
+			SREG(s, SxCR) &= ~CR_EN;
+			s->done = s->total;
+			dma_set_flag(s, FLAG_HT);
+			dma_set_flag(s, FLAG_TC);
+			dma_irq(s);
+		}
+	}
+}
+
+static uint64_t dma_next_event(void *ctx)
+{
+	dma_t *d = ctx;
+	uint64_t t = SIM_NEVER;
+
+	for (uint32_t n = 0; n < 8U; n++) {
+		if (d->st[n].m2m_end < t) {
+			t = d->st[n].m2m_end;
+		}
+	}
+	return t;
+}
+
+static void dma_reset(void *ctx)
+{
+	dma_t *d = ctx;
+
+	for (uint32_t n = 0; n < 8U; n++) {
+		d->st[n].pCtrl = d;
+		d->st[n].n = n;
+		d->st[n].total = 0;
+		d->st[n].done = 0;
+		d->st[n].m2m_end = SIM_NEVER;
+		SREG(&d->st[n], SxFCR) = 0x21;
+		sim_irq_line(d->irq[n], 0);
+	}
+}
+
+static void dma_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	dma_t *d = ctx;
+
+	if (off == DMA_LISR || off == DMA_HISR) {
+		SIM_REG(d->phys + off) = old;
+	} else if (off == DMA_LIFCR || off == DMA_HIFCR) {
+		SIM_REG(d->phys + off - 8U) &= ~val;
+		SIM_REG(d->phys + off) = 0;
+		for (uint32_t n = 0; n < 8U; n++) {
+			dma_irq(&d->st[n]);
+		}
+	} else if (off >= DMA_STREAM_OFF(0) && off < DMA_STREAM_OFF(8)) {
+		struct sim_dma_stream *s = &d->st[(off - DMA_STREAM_OFF(0)) / 0x18U];
+		uint32_t reg = (off - DMA_STREAM_OFF(0)) % 0x18U;
+
+		if (reg == SxCR) {
+			if ((val & CR_EN) && !(old & CR_EN)) {
+				s->total = SREG(s, SxNDTR);
+				s->done = 0;
+				if (((val >> 6) & 3U) == 2U && s->total != 0U) {
+					dma_m2m(s);
+				}
+			} else if (!(val & CR_EN) && (old & CR_EN)) {
+				/* software disable: transfer stops, EN reads back 0 */
+				s->m2m_end = SIM_NEVER;
+			}
+		}
+		dma_irq(s);
+	}
+}
+
+const sim_model_t sim_dma_models[] = {
+	{ "DMA1", 0x40026000, 0x400, &dma1, dma_reset, NULL, NULL, dma_write, dma_update, dma_next_event },
+	{ "DMA2", 0x40026400, 0x400, &dma2, dma_reset, NULL, NULL, dma_write, dma_update, dma_next_event },
+};
+const int sim_dma_model_count = sizeof(sim_dma_models) / sizeof(sim_dma_models[0]);
@@ -0,0 +1,461 @@
+/*
+ * sim_i2c.c
+ *
+ * I2C master model with slave stubs: START/SB, address phase with ADDR or AF, ADDR cleared by
+ * SR1 then SR2 read, TXE/BTF on transmit, RXNE/BTF with clock stretching on receive, ACK/POS
+ * handling for the 1/2/N byte sequences, STOP, DMAEN/LAST requests.
+ * Byte time is 9 SCL periods derived from CCR (standard, fast 2:1, fast 16:9).
+ */
+#include "sim_internal.h"
+
+#define I2C_CR1 0x00
+#define I2C_CR2 0x04
+#define I2C_DR 0x10
+#define I2C_SR1 0x14
+#define I2C_SR2 0x18
+#define I2C_CCR 0x1C
+
+#define CR1_PE (1U << 0)
+#define CR1_START (1U << 8)
+#define CR1_STOP (1U << 9)
+#define CR1_ACK (1U << 10)
+#define CR1_POS (1U << 11)
+#define CR1_SWRST (1U << 15)
+
+#define CR2_ITERREN (1U << 8)
+#define CR2_ITEVTEN (1U << 9)
+#define CR2_ITBUFEN (1U << 10)
+#define CR2_DMAEN (1U << 11)
+#define CR2_LAST (1U << 12)
+
+#define SR1_SB (1U << 0)
+#define SR1_ADDR (1U << 1)
+#define SR1_BTF (1U << 2)
+#define SR1_STOPF (1U << 4)
+#define SR1_RXNE (1U << 6)
+#define SR1_TXE (1U << 7)
+#define SR1_AF (1U << 10)
+#define SR1_ERRORS (0xDF00U)
+
+#define SR2_MSL (1U << 0)
+#define SR2_BUSY (1U << 1)
+#define SR2_TRA (1U << 2)
+
+#define I2C_MAX_SLAVES 4
+
+enum { PH_IDLE, PH_START, PH_ADDR, PH_TX, PH_RX, PH_NACKED };
+
+typedef struct {
+	uint8_t addr;
+	uint8_t *regs;
+	uint32_t size;
+	uint32_t ptr;
+	int first;
+}i2c_slave_t;
+
+typedef struct {
+	uint32_t phys;
+	int irq_ev;
+	int irq_er;
+	i2c_slave_t slaves[I2C_MAX_SLAVES];
+	int nslaves;
+	int slave;
+	int phase;
+	uint64_t start_at;
+	int shifting;
+	int shift_addr;
+	uint64_t shift_end;
+	uint8_t shift_data;
+	int holding;
+	uint8_t hold_data;
+	uint8_t rdr;
+	int rx_wait;
+	int nacked;
+	int ack_latch;
+	int sr1_read;
+	int scl_held;               /* a slave holds SCL low: no START/STOP goes out */
+}i2c_t;
+
+static i2c_t i2c1 = { .phys = 0x40005400, .irq_ev = 31, .irq_er = 32 };
+static i2c_t i2c2 = { .phys = 0x40005800, .irq_ev = 33, .irq_er = 34 };
+static i2c_t i2c3 = { .phys = 0x40005C00, .irq_ev = 72, .irq_er = 73 };
+
+#define REG(c, off) SIM_REG((c)->phys + (off))
+
+/* HCLK cycles of one SCL period */
+static uint64_t i2c_scl(i2c_t *c)
+{
+	uint32_t ccr = REG(c, I2C_CCR);
+	uint32_t n = ccr & 0xFFFU;
+	uint32_t pclk;
+
+	if (n == 0U) {
+		n = 80U;
+	}
+	if (ccr & (1U << 15)) {
+		pclk = (ccr & (1U << 14)) ? 25U * n : 3U * n;
+	} else {
+		pclk = 2U * n;
+	}
+	return (uint64_t)pclk * sim_apb_div(1);
+}
+
+static void i2c_irq(i2c_t *c)
+{
+	uint32_t sr1 = REG(c, I2C_SR1);
+	uint32_t cr2 = REG(c, I2C_CR2);
+	int ev = 0;
+
+	ev |= (cr2 & CR2_ITEVTEN) && (sr1 & (SR1_SB | SR1_ADDR | SR1_BTF | SR1_STOPF));
+	ev |= (cr2 & CR2_ITEVTEN) && (cr2 & CR2_ITBUFEN) && (sr1 & (SR1_TXE | SR1_RXNE));
+	sim_irq_line(c->irq_ev, ev);
+	sim_irq_line(c->irq_er, (cr2 & CR2_ITERREN) && (sr1 & SR1_ERRORS));
+}
+
+static i2c_slave_t *i2c_cur(i2c_t *c)
+{
+	return (c->slave >= 0) ? &c->slaves[c->slave] : NULL;
+}
+
+static void i2c_shift(i2c_t *c, uint8_t data, uint64_t t)
+{
+	c->shifting = 1;
+	c->shift_data = data;
+	c->shift_end = t + 9U * i2c_scl(c);
+}
+
+static void i2c_tx_push(i2c_t *c, uint8_t data, uint64_t t)
+{
+	REG(c, I2C_SR1) &= ~SR1_BTF;
+	if (!c->shifting) {
+		i2c_shift(c, data, t);
+		REG(c, I2C_SR1) |= SR1_TXE;
+	} else {
+		c->holding = 1;
+		c->hold_data = data;
+		REG(c, I2C_SR1) &= ~SR1_TXE;
+	}
+}
+
+static int i2c_rx_more(i2c_t *c)
+{
+	return !c->nacked && !c->rx_wait && !(REG(c, I2C_CR1) & (CR1_STOP | CR1_START));
+}
+
+static void i2c_dma_service(i2c_t *c, uint64_t t);
+
+/* byte received into DR (or kept in the shift register when DR is still full) */
+static void i2c_rx_done(i2c_t *c, uint64_t t)
+{
+	i2c_slave_t *s = i2c_cur(c);
+	uint32_t cr1 = REG(c, I2C_CR1);
+	uint8_t data = s->regs[s->ptr];
+	int ack;
+
+	s->ptr = (s->ptr + 1U) % s->size;
+	c->shifting = 0;
+
+	ack = (cr1 & CR1_POS) ? c->ack_latch : ((cr1 & CR1_ACK) != 0);
+	c->ack_latch = (cr1 & CR1_ACK) != 0;
+	if (REG(c, I2C_CR2) & CR2_DMAEN) {
+		sim_dma_stream_t *st = sim_dma_request(sim_bus_addr(c->phys + I2C_DR), 0);
+		if (st && (REG(c, I2C_CR2) & CR2_LAST) && sim_dma_remaining(st) == 1U) {
+			ack = 0;
+		}
+	}
+	if (!ack) {
+		c->nacked = 1;
+	}
+
+	if (REG(c, I2C_SR1) & SR1_RXNE) {
+		c->rx_wait = 1;
+		c->shift_data = data;
+		REG(c, I2C_SR1) |= SR1_BTF;
+	} else {
+		c->rdr = data;
+		REG(c, I2C_SR1) |= SR1_RXNE;
+		i2c_dma_service(c, t);
+		if (i2c_rx_more(c)) {
+			i2c_shift(c, 0, t);
+		}
+	}
+}
+
+static void i2c_tx_done(i2c_t *c, uint64_t t)
+{
+	i2c_slave_t *s = i2c_cur(c);
+
+	c->shifting = 0;
+	if (s->first) {
+		s->ptr = c->shift_data % s->size;
+		s->first = 0;
+	} else {
+		s->regs[s->ptr] = c->shift_data;
+		s->ptr = (s->ptr + 1U) % s->size;
+	}
+	if (c->holding) {
+		c->holding = 0;
+		i2c_shift(c, c->hold_data, t);
+		REG(c, I2C_SR1) |= SR1_TXE;
+	} else {
+		REG(c, I2C_SR1) |= SR1_BTF;
+	}
+	i2c_dma_service(c, t);
+}
+
+static void i2c_addr_done(i2c_t *c)
+{
+	uint8_t addr = c->shift_data >> 1;
+	int read = c->shift_data & 1U;
+
+	c->shifting = 0;
+	c->shift_addr = 0;
+	c->slave = -1;
+	for (int i = 0; i < c->nslaves; i++) {
+		if (c->slaves[i].addr == addr) {
+			c->slave = i;
+		}
+	}
+	if (c->slave < 0) {
+		REG(c, I2C_SR1) |= SR1_AF;
+		c->phase = PH_NACKED;
+		return;
+	}
+	c->slaves[c->slave].first = !read;
+	c->ack_latch = (REG(c, I2C_CR1) & CR1_ACK) != 0;
+	c->phase = read ? PH_RX : PH_TX;
+	REG(c, I2C_SR1) |= SR1_ADDR;
+	if (!read) {
+		REG(c, I2C_SR2) |= SR2_TRA;
+	} else {
+		REG(c, I2C_SR2) &= ~SR2_TRA;
+	}
+}
+
+static void i2c_dma_service(i2c_t *c, uint64_t t)
+{
+	sim_dma_stream_t *st;
+
+	if (!(REG(c, I2C_CR2) & CR2_DMAEN) || (REG(c, I2C_SR1) & SR1_ADDR)) {
+		return;
+	}
+	if (c->phase == PH_TX) {
+		while ((REG(c, I2C_SR1) & SR1_TXE) && !c->holding) {
+			st = sim_dma_request(sim_bus_addr(c->phys + I2C_DR), 1);
+			if (!st) {
+				break;
+			}
+			i2c_tx_push(c, (uint8_t)sim_dma_fetch(st), t);
+		}
+	} else if (c->phase == PH_RX && (REG(c, I2C_SR1) & SR1_RXNE)) {
+		st = sim_dma_request(sim_bus_addr(c->phys + I2C_DR), 0);
+		if (st) {
+			sim_dma_store(st, c->rdr);
+			REG(c, I2C_SR1) &= ~SR1_RXNE;
+			if (c->rx_wait) {
+				c->rx_wait = 0;
+				c->rdr = c->shift_data;
+				REG(c, I2C_SR1) &= ~SR1_BTF;
+				REG(c, I2C_SR1) |= SR1_RXNE;
+				i2c_dma_service(c, t);
+			}
+			if (i2c_rx_more(c) && !c->shifting) {
+				i2c_shift(c, 0, t);
+			}
+		}
+	}
+}
+
+static void i2c_stop(i2c_t *c)
+{
+	REG(c, I2C_CR1) &= ~CR1_STOP;
+	REG(c, I2C_SR2) &= ~(SR2_MSL | SR2_BUSY | SR2_TRA);
+	REG(c, I2C_SR1) &= ~(SR1_BTF | SR1_TXE);
+	c->phase = PH_IDLE;
+	c->holding = 0;
+	c->slave = -1;
+}
+
+static void i2c_update(void *ctx)
+{
+	i2c_t *c = ctx;
+
+	for (;;) {
+		uint64_t t = SIM_NEVER;
+		int what = 0;
+
+		if (c->start_at < t) {
+			t = c->start_at;
+			what = 1;
+		}
+		if (c->shifting && c->shift_end < t) {
+			t = c->shift_end;
+			what = 2;
+		}
+		if (t > sim_now) {
+			break;
+		}
+		if (what == 1) {
+			c->start_at = SIM_NEVER;
+			REG(c, I2C_CR1) &= ~CR1_START;
+			REG(c, I2C_SR1) &= ~(SR1_BTF | SR1_TXE | SR1_RXNE);
+			REG(c, I2C_SR1) |= SR1_SB;
+			REG(c, I2C_SR2) |= SR2_MSL | SR2_BUSY;
+			c->phase = PH_START;
+			c->holding = 0;
+			c->rx_wait = 0;
+			c->nacked = 0;
+		} else if (c->shift_addr) {
+			i2c_addr_done(c);
+		} else if (c->phase == PH_RX) {
+			i2c_rx_done(c, t);
+		} else {
+			i2c_tx_done(c, t);
+		}
+	}
+
+	/* START/STOP requests wait for the byte on the wire */
+	if (c->scl_held) {
+		/* nothing */
+	} else if ((REG(c, I2C_CR1) & CR1_START) && c->start_at == SIM_NEVER && !c->shifting) {
+		c->start_at = sim_now + i2c_scl(c);
+	}
+	if ((REG(c, I2C_CR1) & CR1_STOP) && !c->shifting && c->start_at == SIM_NEVER && !c->scl_held) {
+		i2c_stop(c);
+	}
+	i2c_dma_service(c, sim_now);
+	i2c_irq(c);
+}
+
+static uint64_t i2c_next_event(void *ctx)
+{
+	i2c_t *c = ctx;
+	uint64_t t = c->start_at;
+
+	if (c->shifting && c->shift_end < t) {
+		t = c->shift_end;
+	}
+	return t;
+}
+
+static void i2c_reset(void *ctx)
+{
+	i2c_t *c = ctx;
+
+	c->slave = -1;
+	c->phase = PH_IDLE;
+	c->start_at = SIM_NEVER;
+	c->shifting = 0;
+	c->shift_addr = 0;
+	c->holding = 0;
+	c->rx_wait = 0;
+	c->nacked = 0;
+	c->sr1_read = 0;
+	sim_irq_line(c->irq_ev, 0);
+	sim_irq_line(c->irq_er, 0);
+}
+
+static void i2c_read(void *ctx, uint32_t off)
+{
+	i2c_t *c = ctx;
+
+	if (off == I2C_SR1) {
+		c->sr1_read = 1;
+	} else if (off == I2C_SR2) {
+		if (c->sr1_read && (REG(c, I2C_SR1) & SR1_ADDR)) {
+			REG(c, I2C_SR1) &= ~SR1_ADDR;
+			if (c->phase == PH_TX) {
+				REG(c, I2C_SR1) |= SR1_TXE;
+			} else if (c->phase == PH_RX && i2c_rx_more(c)) {
+				i2c_shift(c, 0, sim_now);
+			}
+			i2c_dma_service(c, sim_now);
+		}
+		c->sr1_read = 0;
+	} else if (off == I2C_DR) {
+		REG(c, I2C_DR) = c->rdr;
+		REG(c, I2C_SR1) &= ~SR1_RXNE;
+		if (c->rx_wait) {
+			c->rx_wait = 0;
+			c->rdr = c->shift_data;
+			REG(c, I2C_SR1) &= ~SR1_BTF;
+			REG(c, I2C_SR1) |= SR1_RXNE;
+		}
+		if (c->phase == PH_RX && i2c_rx_more(c) && !c->shifting) {
+			i2c_shift(c, 0, sim_now);
+		}
+	}
+	i2c_irq(c);
+}
+
+static void i2c_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	i2c_t *c = ctx;
+
+	if (off == I2C_SR1) {
+		REG(c, I2C_SR1) = old & (val | ~SR1_ERRORS);
+	} else if (off == I2C_SR2) {
+		REG(c, I2C_SR2) = old;
+	} else if (off == I2C_CR1) {
+		if (val & CR1_SWRST) {
+			i2c_reset(c);
+			REG(c, I2C_SR1) = 0;
+			REG(c, I2C_SR2) = 0;
+		} else if (!(val & CR1_PE)) {
+			c->phase = PH_IDLE;
+			c->shifting = 0;
+			REG(c, I2C_CR1) = val & ~(CR1_START | CR1_STOP);
+			REG(c, I2C_SR1) = 0;
+			REG(c, I2C_SR2) = 0;
+		}
+	} else if (off == I2C_DR) {
+		if (c->phase == PH_START && (REG(c, I2C_SR1) & SR1_SB) && c->sr1_read) {
+			REG(c, I2C_SR1) &= ~SR1_SB;
+			c->phase = PH_ADDR;
+			c->shift_addr = 1;
+			i2c_shift(c, (uint8_t)val, sim_now);
+		} else if (c->phase == PH_TX && !(REG(c, I2C_SR1) & SR1_ADDR)) {
+			i2c_tx_push(c, (uint8_t)val, sim_now);
+		}
+		c->sr1_read = 0;
+	}
+	i2c_irq(c);
+}
+
+static i2c_t *i2c_from_regs(void *pI2Cx)
+{
+	uint32_t phys = sim_phys(pI2Cx);
+
+	if (phys == i2c2.phys) {
+		return &i2c2;
+	}
+	if (phys == i2c3.phys) {
+		return &i2c3;
+	}
+	return &i2c1;
+}
+
+void sim_i2c_add_slave(void *pI2Cx, uint8_t addr7, uint8_t *pRegs, uint32_t size)
+{
+	i2c_t *c = i2c_from_regs(pI2Cx);
+
+	if (c->nslaves < I2C_MAX_SLAVES && size > 0U) {
+		c->slaves[c->nslaves].addr = addr7;
+		c->slaves[c->nslaves].regs = pRegs;
+		c->slaves[c->nslaves].size = size;
+		c->slaves[c->nslaves].ptr = 0;
+		c->nslaves++;
+	}
+}
+
+void sim_i2c_hold_scl(void *pI2Cx, int held)
+{
+	i2c_from_regs(pI2Cx)->scl_held = held;
+}
+
+const sim_model_t sim_i2c_models[] = {
+	{ "I2C1", 0x40005400, 0x400, &i2c1, i2c_reset, i2c_read, NULL, i2c_write, i2c_update, i2c_next_event },
+	{ "I2C2", 0x40005800, 0x400, &i2c2, i2c_reset, i2c_read, NULL, i2c_write, i2c_update, i2c_next_event },
+	{ "I2C3", 0x40005C00, 0x400, &i2c3, i2c_reset, i2c_read, NULL, i2c_write, i2c_update, i2c_next_event },
+};
+const int sim_i2c_model_count = sizeof(sim_i2c_models) / sizeof(sim_i2c_models[0]);
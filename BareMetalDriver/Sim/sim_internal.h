@@ -0,0 +1,74 @@
+#ifndef SIM_INTERNAL_H_
+#define SIM_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sim.h"
+
+/*
+ * Interface between the access engine (sim.c) and the peripheral models.
+ * Models keep their visible registers directly in the simulated memory and private state in
+ * their own context; all callbacks run with the register blocks unprotected.
+ */
+#define SIM_PERIPH_PHYS 0x40000000UL
+#define SIM_PERIPH_SIZE 0x30000UL
+#define SIM_CORE_PHYS 0xE0000000UL
+#define SIM_CORE_SIZE 0x10000UL
+
+#define SIM_NUM_IRQ 96
+
+typedef struct {
+    const char *name;
+    uint32_t phys;                                  /* real base address on the STM32F411 */
+    uint32_t size;
+    void *ctx;
+    void (*reset)(void *ctx);
+    void (*read)(void *ctx, uint32_t off);          /* before the CPU reads register at off */
+    void (*read_done)(void *ctx, uint32_t off);     /* after the CPU read (clear-on-read bits) */
+    void (*write)(void *ctx, uint32_t off, uint32_t old, uint32_t val);  /* after the CPU wrote */
+    void (*update)(void *ctx);                      /* bring the model up to sim_now */
+    uint64_t (*next_event)(void *ctx);              /* SIM_NEVER if idle */
+}sim_model_t;
+
+extern uint64_t sim_now;
+
+/* open/close the register blocks for direct access by the models (nests) */
+void sim_open(void);
+void sim_close(void);
+
+volatile uint32_t *sim_reg(uint32_t phys);
+uint32_t sim_phys(const volatile void *p);
+uint32_t sim_bus_addr(uint32_t phys);
+void sim_irq_line(int irqn, int level);
+void sim_irq_pend(int irqn);
+uint32_t sim_apb_div(int bus);
+
+#define SIM_REG(phys) (*sim_reg(phys))
+
+/*
+ * DMA request interface used by USART/SPI/I2C models. The stream is found from its PAR value
+ * (the bus address of the data register), the channel selection is not modelled.
+ */
+typedef struct sim_dma_stream sim_dma_stream_t;
+sim_dma_stream_t *sim_dma_request(uint32_t par, int to_periph);
+uint32_t sim_dma_fetch(sim_dma_stream_t *pStream);
+void sim_dma_store(sim_dma_stream_t *pStream, uint32_t val);
+uint32_t sim_dma_remaining(sim_dma_stream_t *pStream);
+
+/*
+ * Model tables (one entry per instance)
+ */
+extern const sim_model_t sim_system_models[];
+extern const int sim_system_model_count;
+extern const sim_model_t sim_usart_models[];
+extern const int sim_usart_model_count;
+extern const sim_model_t sim_spi_models[];
+extern const int sim_spi_model_count;
+extern const sim_model_t sim_i2c_models[];
+extern const int sim_i2c_model_count;
+extern const sim_model_t sim_dma_models[];
+extern const int sim_dma_model_count;
+
+void sim_model_reset(uint32_t phys);
+
+#endif /* SIM_INTERNAL_H_ */
@@ -0,0 +1,86 @@
+#ifndef SIM_PERIPH_H_
+#define SIM_PERIPH_H_
+
+#include <stdint.h>
+
+/*
+ * Host simulator memory map (only included by stm32f411xx.h when HOST_SIM is defined).
+ *
+ * The simulator maps two blocks below 4GB so that the 32-bit addresses the drivers program into
+ * peripheral registers (DMA PAR/M0AR ...) still point at host memory:
+ *  - sim_periph_base : image of 0x40000000 - 0x4002FFFF (APB1, APB2, AHB1)
+ *  - sim_core_base   : image of 0xE0000000 - 0xE000FFFF (DWT, SysTick, NVIC, SCB)
+ * Every *_RegDef_t pointer is rebased onto these blocks, the offsets are kept from the real map.
+ */
+extern uintptr_t sim_periph_base;
+extern uintptr_t sim_core_base;
+
+#define SIM_PERIPH_ADDR(addr) (sim_periph_base + ((addr) - 0x40000000UL))
+#define SIM_CORE_ADDR(addr) (sim_core_base + ((addr) - 0xE0000000UL))
+
+#define SPI1_BASE_ADDRESS SIM_PERIPH_ADDR(0x40013000)
+#define SPI2_BASE_ADDRESS SIM_PERIPH_ADDR(0x40003800)
+#define SPI3_BASE_ADDRESS SIM_PERIPH_ADDR(0x40003C00)
+
+#define I2C1_BASE_ADDRESS SIM_PERIPH_ADDR(0x40005400)
+#define I2C2_BASE_ADDRESS SIM_PERIPH_ADDR(0x40005800)
+#define I2C3_BASE_ADDRESS SIM_PERIPH_ADDR(0x40005C00)
+
+#define USART1_BASE_ADDRESS SIM_PERIPH_ADDR(0x40011000)
+#define USART2_BASE_ADDRESS SIM_PERIPH_ADDR(0x40004400)
+#define USART6_BASE_ADDRESS SIM_PERIPH_ADDR(0x40011400)
+
+#define GPIOA_BASE_ADDRESS SIM_PERIPH_ADDR(0x40020000)
+#define GPIOB_BASE_ADDRESS SIM_PERIPH_ADDR(0x40020400)
+#define GPIOC_BASE_ADDRESS SIM_PERIPH_ADDR(0x40020800)
+#define GPIOD_BASE_ADDRESS SIM_PERIPH_ADDR(0x40020C00)
+#define GPIOE_BASE_ADDRESS SIM_PERIPH_ADDR(0x40021000)
+#define GPIOF_BASE_ADDRESS SIM_PERIPH_ADDR(0x40021400)
+#define GPIOG_BASE_ADDRESS SIM_PERIPH_ADDR(0x40021800)
+#define GPIOH_BASE_ADDRESS SIM_PERIPH_ADDR(0x40021C00)
+
+#define EXTI_BASE_ADDRESS SIM_PERIPH_ADDR(0x40013C00)
+#define SYSCFG_BASE_ADDRESS SIM_PERIPH_ADDR(0x40013800)
+
+#define RCC_BASE_ADDRESS SIM_PERIPH_ADDR(0x40023800)
+#define FLASH_R_BASE_ADDRESS SIM_PERIPH_ADDR(0x40023C00)
+#define PWR_BASE_ADDRESS SIM_PERIPH_ADDR(0x40007000)
+
+#define DMA1_BASE_ADDRESS SIM_PERIPH_ADDR(0x40026000)
+#define DMA2_BASE_ADDRESS SIM_PERIPH_ADDR(0x40026400)
+
+#define NO_PR_BITS_IMPLEMENTED 4
+
+#define NVIC_ISER0 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E100)
+#define NVIC_ISER1 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E104)
+#define NVIC_ISER2 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E108)
+#define NVIC_ISER3 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E10C)
+
+#define NVIC_ICER0 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E180)
+#define NVIC_ICER1 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E184)
+#define NVIC_ICER2 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E188)
+#define NVIC_ICER3 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E18C)
+
+#define NVIC_PR_BASE_ADDRESS (volatile uint32_t*)SIM_CORE_ADDR(0xE000E400)
+
+#define NVIC_IPR0 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E400)
+#define NVIC_IPR1 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E404)
+#define NVIC_IPR2 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E408)
+#define NVIC_IPR3 (volatile uint32_t*)SIM_CORE_ADDR(0xE000E40C)
+
+#define DWT_BASE_ADDRESS SIM_CORE_ADDR(0xE0001000)
+#define COREDEBUG_DEMCR (volatile uint32_t*)SIM_CORE_ADDR(0xE000EDFC)
+
+#define SCB_BASE_ADDRESS SIM_CORE_ADDR(0xE000ED00)
+
+/*
+ * PRIMASK model used by ENTER_CRITICAL/EXIT_CRITICAL: interrupts are only dispatched by sim_run()
+ * and sim_dispatch_irqs(), which do nothing while the mask is set.
+ */
+uint32_t sim_irq_save(void);
+void sim_irq_restore(uint32_t state);
+
+/* IPSR model for GET_IPSR: exception number of the handler being run, 0 in thread mode */
+uint32_t sim_ipsr(void);
+
+#endif /* SIM_PERIPH_H_ */
@@ -0,0 +1,319 @@
+/*
+ * sim_spi.c
+ *
+ * SPI master model: TX buffer + shift register clocked at fPCLK/2^(BR+1), MISO looped back to
+ * MOSI unless the test installs a responder, OVR on unread data, TXDMAEN/RXDMAEN requests.
+ * Slave: an external master started by sim_spi_master_frame() clocks items at its own rate, the
+ * shift register is loaded from the TX buffer at the start of every item (the previous item is
+ * sent again when it is empty) and NSS rises on an EXTI line at the end of the frame.
+ */
+#include "sim_internal.h"
+
+#define SPI_CR1 0x00
+#define SPI_CR2 0x04
+#define SPI_SR 0x08
+#define SPI_DR 0x0C
+
+#define CR1_MSTR (1U << 2)
+#define CR1_SPE (1U << 6)
+#define CR1_DFF (1U << 11)
+
+#define CR2_RXDMAEN (1U << 0)
+#define CR2_TXDMAEN (1U << 1)
+#define CR2_ERRIE (1U << 5)
+#define CR2_RXNEIE (1U << 6)
+#define CR2_TXEIE (1U << 7)
+
+#define SR_RXNE (1U << 0)
+#define SR_TXE (1U << 1)
+#define SR_MODF (1U << 5)
+#define SR_OVR (1U << 6)
+#define SR_BSY (1U << 7)
+
+typedef struct {
+	uint32_t phys;
+	int irq;
+	int bus;
+	int shifting;
+	uint64_t shift_end;
+	uint16_t shift_data;
+	int holding;
+	uint16_t hold_data;
+	uint16_t rdr;
+	int dr_read;
+	sim_spi_responder_t responder;
+	uint16_t slave_tx;          /* item in the slave shift register */
+	/* external master, not part of the peripheral: kept across its reset */
+	const uint8_t *ext_mosi;
+	uint8_t *ext_miso;
+	uint32_t ext_items;
+	uint32_t ext_pos;
+	uint64_t ext_period;
+	uint64_t ext_next;          /* end of the current item, SIM_NEVER when no frame runs */
+	int ext_nss_line;
+}spi_t;
+
+static spi_t spi1 = { .phys = 0x40013000, .irq = 35, .bus = 2, .ext_next = SIM_NEVER };
+static spi_t spi2 = { .phys = 0x40003800, .irq = 36, .bus = 1, .ext_next = SIM_NEVER };
+static spi_t spi3 = { .phys = 0x40003C00, .irq = 51, .bus = 1, .ext_next = SIM_NEVER };
+
+#define REG(s, off) SIM_REG((s)->phys + (off))
+
+static uint64_t spi_frame(spi_t *s)
+{
+	uint32_t cr1 = REG(s, SPI_CR1);
+	uint32_t bits = (cr1 & CR1_DFF) ? 16U : 8U;
+
+	return (uint64_t)bits * (2U << ((cr1 >> 3) & 7U)) * sim_apb_div(s->bus);
+}
+
+static int spi_enabled(spi_t *s)
+{
+	return (REG(s, SPI_CR1) & (CR1_SPE | CR1_MSTR)) == (CR1_SPE | CR1_MSTR);
+}
+
+static void spi_irq(spi_t *s)
+{
+	uint32_t sr = REG(s, SPI_SR);
+	uint32_t cr2 = REG(s, SPI_CR2);
+	int level = 0;
+
+	level |= (cr2 & CR2_TXEIE) && (sr & SR_TXE);
+	level |= (cr2 & CR2_RXNEIE) && (sr & SR_RXNE);
+	level |= (cr2 & CR2_ERRIE) && (sr & (SR_OVR | SR_MODF));
+	sim_irq_line(s->irq, level);
+}
+
+static void spi_start(spi_t *s, uint16_t data, uint64_t t)
+{
+	s->shifting = 1;
+	s->shift_data = data;
+	s->shift_end = t + spi_frame(s);
+	REG(s, SPI_SR) |= SR_TXE | SR_BSY;
+}
+
+static void spi_push(spi_t *s, uint16_t data, uint64_t t)
+{
+	if (!s->shifting && spi_enabled(s)) {
+		spi_start(s, data, t);
+	} else {
+		s->holding = 1;
+		s->hold_data = data;
+		REG(s, SPI_SR) &= ~SR_TXE;
+	}
+}
+
+static void spi_dma_service(spi_t *s, uint64_t t)
+{
+	sim_dma_stream_t *st;
+
+	if ((REG(s, SPI_CR2) & CR2_RXDMAEN) && (REG(s, SPI_SR) & SR_RXNE)) {
+		st = sim_dma_request(sim_bus_addr(s->phys + SPI_DR), 0);
+		if (st) {
+			sim_dma_store(st, s->rdr);
+			REG(s, SPI_SR) &= ~SR_RXNE;
+		}
+	}
+	while ((REG(s, SPI_CR2) & CR2_TXDMAEN) && (REG(s, SPI_SR) & SR_TXE) && (REG(s, SPI_CR1) & CR1_SPE)) {
+		st = sim_dma_request(sim_bus_addr(s->phys + SPI_DR), 1);
+		if (!st) {
+			break;
+		}
+		spi_push(s, (uint16_t)sim_dma_fetch(st), t);
+	}
+}
+
+static void spi_done(spi_t *s, uint64_t t)
+{
+	uint16_t miso = s->responder ? s->responder(s->shift_data) : s->shift_data;
+
+	if (REG(s, SPI_SR) & SR_RXNE) {
+		REG(s, SPI_SR) |= SR_OVR;
+	} else {
+		s->rdr = miso;
+		REG(s, SPI_SR) |= SR_RXNE;
+	}
+	s->shifting = 0;
+	if (s->holding) {
+		s->holding = 0;
+		spi_start(s, s->hold_data, t);
+	} else {
+		REG(s, SPI_SR) &= ~SR_BSY;
+	}
+	spi_dma_service(s, t);
+}
+
+static int spi_slave(spi_t *s)
+{
+	return (REG(s, SPI_CR1) & (CR1_SPE | CR1_MSTR)) == CR1_SPE;
+}
+
+/* start of a slave item: the TX buffer goes to the shift register if it holds data */
+static void spi_slave_load(spi_t *s)
+{
+	if (s->holding) {
+		s->holding = 0;
+		s->slave_tx = s->hold_data;
+		REG(s, SPI_SR) |= SR_TXE;
+	}
+}
+
+static void spi_slave_item(spi_t *s, uint64_t t)
+{
+	int wide = (REG(s, SPI_CR1) & CR1_DFF) != 0;
+	uint32_t i = s->ext_pos;
+	uint16_t mosi = wide ? (uint16_t)(s->ext_mosi[2 * i] | (s->ext_mosi[2 * i + 1] << 8)) : s->ext_mosi[i];
+
+	if (spi_slave(s)) {
+		if (s->ext_miso) {
+			if (wide) {
+				s->ext_miso[2 * i] = (uint8_t)s->slave_tx;
+				s->ext_miso[2 * i + 1] = (uint8_t)(s->slave_tx >> 8);
+			} else {
+				s->ext_miso[i] = (uint8_t)s->slave_tx;
+			}
+		}
+		if (REG(s, SPI_SR) & SR_RXNE) {
+			REG(s, SPI_SR) |= SR_OVR;
+		} else {
+			s->rdr = mosi;
+			REG(s, SPI_SR) |= SR_RXNE;
+		}
+	}
+	spi_dma_service(s, t);
+	if (++s->ext_pos < s->ext_items) {
+		spi_slave_load(s);
+		spi_dma_service(s, t);
+		s->ext_next = t + s->ext_period;
+	} else {
+		s->ext_next = SIM_NEVER;
+		if (s->ext_nss_line >= 0) {
+			sim_exti_edge(s->ext_nss_line, 1);
+		}
+	}
+}
+
+static void spi_update(void *ctx)
+{
+	spi_t *s = ctx;
+
+	spi_dma_service(s, sim_now);
+	while (s->shifting && s->shift_end <= sim_now) {
+		spi_done(s, s->shift_end);
+	}
+	while (s->ext_next <= sim_now) {
+		spi_slave_item(s, s->ext_next);
+	}
+	spi_irq(s);
+}
+
+static uint64_t spi_next_event(void *ctx)
+{
+	spi_t *s = ctx;
+	uint64_t next = s->shifting ? s->shift_end : SIM_NEVER;
+
+	return (s->ext_next < next) ? s->ext_next : next;
+}
+
+static void spi_reset(void *ctx)
+{
+	spi_t *s = ctx;
+
+	s->shifting = 0;
+	s->holding = 0;
+	s->rdr = 0;
+	s->dr_read = 0;
+	s->slave_tx = 0;
+	REG(s, SPI_SR) = SR_TXE;
+	REG(s, 0x10) = 0x0007;      /* CRCPR */
+	sim_irq_line(s->irq, 0);
+}
+
+static void spi_read(void *ctx, uint32_t off)
+{
+	spi_t *s = ctx;
+
+	if (off == SPI_DR) {
+		REG(s, SPI_DR) = s->rdr;
+		REG(s, SPI_SR) &= ~SR_RXNE;
+		s->dr_read = 1;
+		spi_irq(s);
+	}
+}
+
+/* OVR is cleared by a DR read followed by an SR read */
+static void spi_read_done(void *ctx, uint32_t off)
+{
+	spi_t *s = ctx;
+
+	if (off == SPI_SR && s->dr_read) {
+		REG(s, SPI_SR) &= ~SR_OVR;
+		s->dr_read = 0;
+		spi_irq(s);
+	}
+}
+
+static void spi_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	spi_t *s = ctx;
+
+	if (off == SPI_SR) {
+		/* only CRCERR is writable (rc_w0) */
+		REG(s, SPI_SR) = old & (val | ~(1U << 4));
+	} else if (off == SPI_DR) {
+		spi_push(s, (uint16_t)((REG(s, SPI_CR1) & CR1_DFF) ? val : (val & 0xFFU)), sim_now);
+	} else if (off == SPI_CR1) {
+		if (s->holding && !s->shifting && spi_enabled(s)) {
+			s->holding = 0;
+			spi_start(s, s->hold_data, sim_now);
+		}
+	}
+	spi_irq(s);
+}
+
+static spi_t *spi_from_regs(void *pSPIx)
+{
+	uint32_t phys = sim_phys(pSPIx);
+
+	if (phys == spi2.phys) {
+		return &spi2;
+	}
+	if (phys == spi3.phys) {
+		return &spi3;
+	}
+	return &spi1;
+}
+
+void sim_spi_set_responder(void *pSPIx, sim_spi_responder_t responder)
+{
+	spi_from_regs(pSPIx)->responder = responder;
+}
+
+void sim_spi_master_frame(void *pSPIx, const uint8_t *pMosi, uint8_t *pMiso, uint32_t len, uint32_t sck_hz,
+		int nss_exti_line)
+{
+	spi_t *s = spi_from_regs(pSPIx);
+	uint32_t bits;
+
+	sim_open();
+	bits = (REG(s, SPI_CR1) & CR1_DFF) ? 16U : 8U;
+	s->ext_mosi = pMosi;
+	s->ext_miso = pMiso;
+	s->ext_items = len / (bits / 8U);
+	s->ext_pos = 0;
+	s->ext_period = ((uint64_t)sim_hclk_hz() * bits + sck_hz - 1U) / sck_hz;
+	s->ext_nss_line = nss_exti_line;
+	if (s->ext_items) {
+		spi_slave_load(s);
+		spi_dma_service(s, sim_now);
+		s->ext_next = sim_now + s->ext_period;
+	}
+	sim_close();
+}
+
+const sim_model_t sim_spi_models[] = {
+	{ "SPI1", 0x40013000, 0x400, &spi1, spi_reset, spi_read, spi_read_done, spi_write, spi_update, spi_next_event },
+	{ "SPI2", 0x40003800, 0x400, &spi2, spi_reset, spi_read, spi_read_done, spi_write, spi_update, spi_next_event },
+	{ "SPI3", 0x40003C00, 0x400, &spi3, spi_reset, spi_read, spi_read_done, spi_write, spi_update, spi_next_event },
+};
+const int sim_spi_model_count = sizeof(sim_spi_models) / sizeof(sim_spi_models[0]);
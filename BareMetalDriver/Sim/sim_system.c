@@ -0,0 +1,372 @@
+/*
+ * sim_system.c
+ *
+ * RCC (oscillator ready flags, clock switch status, peripheral resets, HCLK/APB dividers),
+ * SysTick, DWT cycle counter, GPIO (BSRR into ODR) and EXTI pending register models.
+ */
+#include <string.h>
+
+#include "sim_internal.h"
+
+#define SIM_HSI_HZ 16000000U
+#define SIM_HSE_HZ 8000000U
+
+/*********************************************************************
+ * RCC
+ *********************************************************************/
+#define RCC_PHYS 0x40023800U
+#define RCC_CR 0x00
+#define RCC_PLLCFGR 0x04
+#define RCC_CFGR 0x08
+#define RCC_AHB1RSTR 0x10
+#define RCC_APB1RSTR 0x20
+#define RCC_APB2RSTR 0x24
+
+typedef struct {
+	uint32_t off;
+	uint32_t bit;
+	uint32_t phys;
+}rcc_reset_map_t;
+
+static const rcc_reset_map_t rcc_resets[] = {
+	{ RCC_AHB1RSTR, 21, 0x40026000 },   /* DMA1 */
+	{ RCC_AHB1RSTR, 22, 0x40026400 },   /* DMA2 */
+	{ RCC_APB1RSTR, 14, 0x40003800 },   /* SPI2 */
+	{ RCC_APB1RSTR, 15, 0x40003C00 },   /* SPI3 */
+	{ RCC_APB1RSTR, 17, 0x40004400 },   /* USART2 */
+	{ RCC_APB1RSTR, 21, 0x40005400 },   /* I2C1 */
+	{ RCC_APB1RSTR, 22, 0x40005800 },   /* I2C2 */
+	{ RCC_APB1RSTR, 23, 0x40005C00 },   /* I2C3 */
+	{ RCC_APB2RSTR, 4, 0x40011000 },    /* USART1 */
+	{ RCC_APB2RSTR, 5, 0x40011400 },    /* USART6 */
+	{ RCC_APB2RSTR, 12, 0x40013000 },   /* SPI1 */
+};
+
+static void rcc_reset(void *ctx)
+{
+	(void)ctx;
+	SIM_REG(RCC_PHYS + RCC_CR) = 0x00000083;
+	SIM_REG(RCC_PHYS + RCC_PLLCFGR) = 0x24003010;
+}
+
+static void rcc_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	(void)ctx;
+	if (off == RCC_CR) {
+		/* oscillators and PLL lock immediately */
+		val &= ~((1U << 1) | (1U << 17) | (1U << 25));
+		val |= (val & (1U << 0)) << 1;
+		val |= (val & (1U << 16)) << 1;
+		val |= (val & (1U << 24)) << 1;
+		SIM_REG(RCC_PHYS + RCC_CR) = val;
+	} else if (off == RCC_CFGR) {
+		SIM_REG(RCC_PHYS + RCC_CFGR) = (val & ~(3U << 2)) | ((val & 3U) << 2);
+	} else {
+		uint32_t rising = val & ~old;
+		for (uint32_t i = 0; i < sizeof(rcc_resets) / sizeof(rcc_resets[0]); i++) {
+			if (rcc_resets[i].off == off && (rising & (1U << rcc_resets[i].bit))) {
+				sim_model_reset(rcc_resets[i].phys);
+			}
+		}
+	}
+}
+
+uint32_t sim_hclk_hz(void)
+{
+	static const uint16_t ahb_div[8] = { 2, 4, 8, 16, 64, 128, 256, 512 };
+	uint32_t cfgr, pllcfgr, sysclk;
+
+	sim_open();
+	cfgr = SIM_REG(RCC_PHYS + RCC_CFGR);
+	pllcfgr = SIM_REG(RCC_PHYS + RCC_PLLCFGR);
+	sim_close();
+
+	switch ((cfgr >> 2) & 3U) {
+	case 1:
+		sysclk = SIM_HSE_HZ;
+		break;
+	case 2: {
+		uint32_t src = (pllcfgr & (1U << 22)) ? SIM_HSE_HZ : SIM_HSI_HZ;
+		uint32_t m = pllcfgr & 0x3FU;
+		uint32_t n = (pllcfgr >> 6) & 0x1FFU;
+		uint32_t p = (((pllcfgr >> 16) & 3U) + 1U) * 2U;
+		sysclk = (m == 0U) ? 0U : (uint32_t)(((uint64_t)src / m) * n / p);
+		break;
+	}
+	default:
+		sysclk = SIM_HSI_HZ;
+		break;
+	}
+	if (cfgr & (1U << 7)) {
+		sysclk /= ahb_div[(cfgr >> 4) & 7U];
+	}
+	return sysclk;
+}
+
+/* HCLK cycles per APB clock cycle, bus 1 = APB1, bus 2 = APB2 */
+uint32_t sim_apb_div(int bus)
+{
+	uint32_t ppre = (SIM_REG(RCC_PHYS + RCC_CFGR) >> ((bus == 1) ? 10 : 13)) & 7U;
+
+	return (ppre < 4U) ? 1U : (1U << (ppre - 3U));
+}
+
+/*********************************************************************
+ * SysTick
+ *********************************************************************/
+#define SYST_PHYS 0xE000E010U
+#define SYST_CTRL 0x00
+#define SYST_LOAD 0x04
+#define SYST_VAL 0x08
+
+#define SYST_CTRL_ENABLE (1U << 0)
+#define SYST_CTRL_TICKINT (1U << 1)
+#define SYST_CTRL_CLKSOURCE (1U << 2)
+#define SYST_CTRL_COUNTFLAG (1U << 16)
+
+static struct {
+	uint64_t last;
+	uint32_t val;
+} systick;
+
+static uint32_t systick_div(void)
+{
+	return (SIM_REG(SYST_PHYS + SYST_CTRL) & SYST_CTRL_CLKSOURCE) ? 1U : 8U;
+}
+
+static void systick_reset(void *ctx)
+{
+	(void)ctx;
+	systick.last = sim_now;
+	systick.val = 0;
+}
+
+static void systick_update(void *ctx)
+{
+	uint32_t ctrl = SIM_REG(SYST_PHYS + SYST_CTRL);
+	uint32_t load = SIM_REG(SYST_PHYS + SYST_LOAD) & 0xFFFFFFU;
+	uint32_t div = systick_div();
+	uint64_t ticks;
+
+	(void)ctx;
+	if (!(ctrl & SYST_CTRL_ENABLE)) {
+		systick.last = sim_now;
+		return;
+	}
+	ticks = (sim_now - systick.last) / div;
+	systick.last += ticks * div;
+	while (ticks && load) {
+		uint64_t step;
+
+		if (systick.val == 0U) {
+			systick.val = load;
+			ticks--;
+			continue;
+		}
+		step = (ticks < systick.val) ? ticks : systick.val;
+		systick.val -= (uint32_t)step;
+		ticks -= step;
+		if (systick.val == 0U) {
+			ctrl |= SYST_CTRL_COUNTFLAG;
+			if (ctrl & SYST_CTRL_TICKINT) {
+				sim_irq_pend(SIM_IRQ_SYSTICK);
+			}
+		}
+	}
+	SIM_REG(SYST_PHYS + SYST_CTRL) = ctrl;
+	SIM_REG(SYST_PHYS + SYST_VAL) = systick.val;
+}
+
+static uint64_t systick_next_event(void *ctx)
+{
+	uint32_t load = SIM_REG(SYST_PHYS + SYST_LOAD) & 0xFFFFFFU;
+	uint64_t n;
+
+	(void)ctx;
+	if (!(SIM_REG(SYST_PHYS + SYST_CTRL) & SYST_CTRL_ENABLE) || load == 0U) {
+		return SIM_NEVER;
+	}
+	n = (systick.val == 0U) ? (uint64_t)load + 1U : systick.val;
+	return systick.last + n * systick_div();
+}
+
+static void systick_read_done(void *ctx, uint32_t off)
+{
+	(void)ctx;
+	if (off == SYST_CTRL) {
+		SIM_REG(SYST_PHYS + SYST_CTRL) &= ~SYST_CTRL_COUNTFLAG;
+	}
+}
+
+static void systick_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	(void)ctx;
+	if (off == SYST_CTRL) {
+		if ((val & SYST_CTRL_ENABLE) && !(old & SYST_CTRL_ENABLE)) {
+			systick.last = sim_now;
+		}
+		SIM_REG(SYST_PHYS + SYST_CTRL) = (val & ~SYST_CTRL_COUNTFLAG) | (old & SYST_CTRL_COUNTFLAG);
+	} else if (off == SYST_VAL) {
+		/* any write clears the counter and COUNTFLAG */
+		systick.val = 0;
+		SIM_REG(SYST_PHYS + SYST_VAL) = 0;
+		SIM_REG(SYST_PHYS + SYST_CTRL) &= ~SYST_CTRL_COUNTFLAG;
+	}
+}
+
+/*********************************************************************
+ * DWT (CTRL.CYCCNTENA and CYCCNT only)
+ *********************************************************************/
+#define DWT_PHYS 0xE0001000U
+#define DWT_CTRL 0x00
+#define DWT_CYCCNT 0x04
+
+static struct {
+	uint64_t t0;
+	uint32_t base;
+} dwt;
+
+static uint32_t dwt_count(void)
+{
+	if (SIM_REG(DWT_PHYS + DWT_CTRL) & 1U) {
+		return dwt.base + (uint32_t)(sim_now - dwt.t0);
+	}
+	return dwt.base;
+}
+
+static void dwt_reset(void *ctx)
+{
+	(void)ctx;
+	dwt.t0 = sim_now;
+	dwt.base = 0;
+	SIM_REG(DWT_PHYS + DWT_CTRL) = 0x40000000;
+}
+
+static void dwt_read(void *ctx, uint32_t off)
+{
+	(void)ctx;
+	if (off == DWT_CYCCNT) {
+		SIM_REG(DWT_PHYS + DWT_CYCCNT) = dwt_count();
+	}
+}
+
+static void dwt_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	(void)ctx;
+	if (off == DWT_CYCCNT) {
+		dwt.base = val;
+		dwt.t0 = sim_now;
+	} else if (off == DWT_CTRL && ((old ^ val) & 1U)) {
+		/* freeze or restart the count at the current value */
+		dwt.base = (old & 1U) ? dwt.base + (uint32_t)(sim_now - dwt.t0) : dwt.base;
+		dwt.t0 = sim_now;
+	}
+}
+
+/*********************************************************************
+ * GPIO: only the atomic set/reset register needs a model, the rest is plain memory
+ *********************************************************************/
+#define GPIO_PHYS(n) (0x40020000U + 0x400U * (n))
+#define GPIO_ODR 0x14
+#define GPIO_BSRR 0x18
+
+static void gpio_reset(void *ctx)
+{
+	(void)ctx;
+}
+
+static void gpio_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	uint32_t phys = (uint32_t)(uintptr_t)ctx;
+
+	(void)old;
+	if (off == GPIO_BSRR) {
+		/* set wins over reset for the same pin, BSRR reads as 0 */
+		SIM_REG(phys + GPIO_ODR) = (SIM_REG(phys + GPIO_ODR) & ~(val >> 16)) | (val & 0xFFFFU);
+		SIM_REG(phys + GPIO_BSRR) = 0;
+	}
+}
+
+/*********************************************************************
+ * EXTI: edges come from the other models (sim_exti_edge), PR is write-1-to-clear
+ *********************************************************************/
+#define EXTI_PHYS 0x40013C00U
+#define EXTI_IMR 0x00
+#define EXTI_RTSR 0x08
+#define EXTI_FTSR 0x0C
+#define EXTI_SWIER 0x10
+#define EXTI_PR 0x14
+
+/* EXTI0..4 have their own IRQ, 5..9 and 10..15 share one */
+static int exti_irq(int line)
+{
+	static const int irq_0_4[5] = { 6, 7, 8, 9, 10 };
+
+	return (line < 5) ? irq_0_4[line] : (line < 10) ? 23 : 40;
+}
+
+static void exti_lines(void)
+{
+	uint32_t pending = SIM_REG(EXTI_PHYS + EXTI_PR) & SIM_REG(EXTI_PHYS + EXTI_IMR);
+
+	for (int line = 0; line < 16; line++) {
+		int irq = exti_irq(line);
+		int first = (line < 5) ? line : (line < 10) ? 5 : 10;
+		int last = (line < 5) ? line : (line < 10) ? 9 : 15;
+		int level = 0;
+
+		for (int l = first; l <= last; l++) {
+			level |= (pending >> l) & 1U;
+		}
+		sim_irq_line(irq, level);
+	}
+}
+
+static void exti_reset(void *ctx)
+{
+	(void)ctx;
+	exti_lines();
+}
+
+static void exti_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	(void)ctx;
+	if (off == EXTI_PR) {
+		SIM_REG(EXTI_PHYS + EXTI_PR) = old & ~val;
+	} else if (off == EXTI_SWIER) {
+		SIM_REG(EXTI_PHYS + EXTI_PR) |= val & SIM_REG(EXTI_PHYS + EXTI_IMR);
+	}
+	exti_lines();
+}
+
+void sim_exti_edge(int line, int rising)
+{
+	uint32_t bit = 1U << line;
+
+	sim_open();
+	if (SIM_REG(EXTI_PHYS + (rising ? EXTI_RTSR : EXTI_FTSR)) & bit) {
+		SIM_REG(EXTI_PHYS + EXTI_PR) |= bit;
+		exti_lines();
+	}
+	sim_close();
+}
+
+#define GPIO_MODEL(n, name) \
+	{ name, GPIO_PHYS(n), 0x400, (void *)(uintptr_t)GPIO_PHYS(n), gpio_reset, NULL, NULL, gpio_write, NULL, NULL }
+
+const sim_model_t sim_system_models[] = {
+	{ "RCC", RCC_PHYS, 0x400, NULL, rcc_reset, NULL, NULL, rcc_write, NULL, NULL },
+	{ "SysTick", SYST_PHYS, 0x10, NULL, systick_reset, NULL, systick_read_done, systick_write,
+	  systick_update, systick_next_event },
+	{ "DWT", DWT_PHYS, 0x1000, NULL, dwt_reset, dwt_read, NULL, dwt_write, NULL, NULL },
+	{ "EXTI", EXTI_PHYS, 0x400, NULL, exti_reset, NULL, NULL, exti_write, NULL, NULL },
+	GPIO_MODEL(0, "GPIOA"),
+	GPIO_MODEL(1, "GPIOB"),
+	GPIO_MODEL(2, "GPIOC"),
+	GPIO_MODEL(3, "GPIOD"),
+	GPIO_MODEL(4, "GPIOE"),
+	GPIO_MODEL(5, "GPIOF"),
+	GPIO_MODEL(6, "GPIOG"),
+	GPIO_MODEL(7, "GPIOH"),
+};
+const int sim_system_model_count = sizeof(sim_system_models) / sizeof(sim_system_models[0]);
@@ -0,0 +1,327 @@
+/*
+ * sim_usart.c
+ *
+ * USART model: TDR + shift register with frame timing from BRR, receive queue fed by the test,
+ * IDLE detection one frame after the last received byte, DMAT/DMAR requests.
+ */
+#include <string.h>
+
+#include "sim_internal.h"
+
+#define USART_SR 0x00
+#define USART_DR 0x04
+#define USART_BRR 0x08
+#define USART_CR1 0x0C
+#define USART_CR2 0x10
+#define USART_CR3 0x14
+
+#define SR_ORE (1U << 3)
+#define SR_IDLE (1U << 4)
+#define SR_RXNE (1U << 5)
+#define SR_TC (1U << 6)
+#define SR_TXE (1U << 7)
+#define SR_ERRORS (0xFU)
+#define SR_RC_W0 ((1U << 5) | (1U << 6) | (1U << 8) | (1U << 9))
+
+#define CR1_RE (1U << 2)
+#define CR1_TE (1U << 3)
+#define CR1_IDLEIE (1U << 4)
+#define CR1_RXNEIE (1U << 5)
+#define CR1_TCIE (1U << 6)
+#define CR1_TXEIE (1U << 7)
+#define CR1_M (1U << 12)
+#define CR1_UE (1U << 13)
+#define CR1_OVER8 (1U << 15)
+
+#define CR3_EIE (1U << 0)
+#define CR3_DMAR (1U << 6)
+#define CR3_DMAT (1U << 7)
+
+#define USART_RXQ_SIZE 4096U
+#define USART_LOG_SIZE 65536U
+
+typedef struct {
+	uint32_t phys;
+	int irq;
+	int bus;
+	int shifting;
+	uint64_t shift_end;
+	uint16_t shift_data;
+	int holding;
+	uint16_t hold_data;
+	uint16_t rdr;
+	int sr_read;
+	uint8_t rxq[USART_RXQ_SIZE];
+	uint32_t rx_head;
+	uint32_t rx_tail;
+	uint64_t rx_next;
+	uint64_t idle_at;
+	uint8_t log[USART_LOG_SIZE];
+	uint32_t log_len;
+}usart_t;
+
+static usart_t usart1 = { .phys = 0x40011000, .irq = 37, .bus = 2 };
+static usart_t usart2 = { .phys = 0x40004400, .irq = 38, .bus = 1 };
+static usart_t usart6 = { .phys = 0x40011400, .irq = 71, .bus = 2 };
+
+#define REG(u, off) SIM_REG((u)->phys + (off))
+
+/* HCLK cycles of one frame: start + data (+parity) + stop bits at the BRR bit time */
+static uint64_t usart_frame(usart_t *u)
+{
+	uint32_t brr = REG(u, USART_BRR) & 0xFFFFU;
+	uint32_t bit = (REG(u, USART_CR1) & CR1_OVER8) ? ((brr >> 4) * 8U + (brr & 7U)) : brr;
+	uint32_t bits = 1U + ((REG(u, USART_CR1) & CR1_M) ? 9U : 8U) + (((REG(u, USART_CR2) >> 12) & 3U) == 2U ? 2U : 1U);
+
+	if (bit == 0U) {
+		bit = 16U;
+	}
+	return (uint64_t)bits * bit * sim_apb_div(u->bus);
+}
+
+static int usart_tx_enabled(usart_t *u)
+{
+	return (REG(u, USART_CR1) & (CR1_UE | CR1_TE)) == (CR1_UE | CR1_TE);
+}
+
+static void usart_irq(usart_t *u)
+{
+	uint32_t sr = REG(u, USART_SR);
+	uint32_t cr1 = REG(u, USART_CR1);
+	int level = 0;
+
+	level |= (cr1 & CR1_TXEIE) && (sr & SR_TXE);
+	level |= (cr1 & CR1_TCIE) && (sr & SR_TC);
+	level |= (cr1 & CR1_RXNEIE) && (sr & (SR_RXNE | SR_ORE));
+	level |= (cr1 & CR1_IDLEIE) && (sr & SR_IDLE);
+	level |= (REG(u, USART_CR3) & CR3_EIE) && (sr & (SR_ORE | 0x6U));
+	sim_irq_line(u->irq, level);
+}
+
+static void usart_tx_start(usart_t *u, uint16_t data, uint64_t t)
+{
+	u->shifting = 1;
+	u->shift_data = data;
+	u->shift_end = t + usart_frame(u);
+}
+
+/* data written into TDR (by the CPU or the DMA) at time t */
+static void usart_tx_push(usart_t *u, uint16_t data, uint64_t t)
+{
+	REG(u, USART_SR) &= ~SR_TC;
+	if (!u->shifting && usart_tx_enabled(u)) {
+		usart_tx_start(u, data, t);
+		REG(u, USART_SR) |= SR_TXE;
+	} else {
+		u->holding = 1;
+		u->hold_data = data;
+		REG(u, USART_SR) &= ~SR_TXE;
+	}
+}
+
+static void usart_dma_service(usart_t *u, uint64_t t)
+{
+	sim_dma_stream_t *st;
+
+	while ((REG(u, USART_CR3) & CR3_DMAT) && (REG(u, USART_SR) & SR_TXE) && usart_tx_enabled(u)) {
+		st = sim_dma_request(sim_bus_addr(u->phys + USART_DR), 1);
+		if (!st) {
+			break;
+		}
+		usart_tx_push(u, (uint16_t)sim_dma_fetch(st), t);
+	}
+	if ((REG(u, USART_CR3) & CR3_DMAR) && (REG(u, USART_SR) & SR_RXNE)) {
+		st = sim_dma_request(sim_bus_addr(u->phys + USART_DR), 0);
+		if (st) {
+			sim_dma_store(st, u->rdr);
+			REG(u, USART_SR) &= ~SR_RXNE;
+		}
+	}
+}
+
+static void usart_tx_done(usart_t *u, uint64_t t)
+{
+	if (u->log_len < USART_LOG_SIZE) {
+		u->log[u->log_len++] = (uint8_t)u->shift_data;
+	}
+	u->shifting = 0;
+	if (u->holding) {
+		u->holding = 0;
+		usart_tx_start(u, u->hold_data, t);
+		REG(u, USART_SR) |= SR_TXE;
+	} else {
+		REG(u, USART_SR) |= SR_TC;
+	}
+	usart_dma_service(u, t);
+}
+
+static void usart_rx_arrive(usart_t *u, uint64_t t)
+{
+	uint8_t data = u->rxq[u->rx_tail++ % USART_RXQ_SIZE];
+	int enabled = (REG(u, USART_CR1) & (CR1_UE | CR1_RE)) == (CR1_UE | CR1_RE);
+	uint64_t frame = usart_frame(u);
+
+	if (enabled) {
+		if (REG(u, USART_SR) & SR_RXNE) {
+			REG(u, USART_SR) |= SR_ORE;
+		} else {
+			u->rdr = data;
+			REG(u, USART_SR) |= SR_RXNE;
+		}
+		usart_dma_service(u, t);
+	}
+	if (u->rx_tail != u->rx_head) {
+		u->rx_next = t + frame;
+	} else if (enabled) {
+		u->idle_at = t + frame;
+	}
+}
+
+static void usart_update(void *ctx)
+{
+	usart_t *u = ctx;
+
+	usart_dma_service(u, sim_now);
+	for (;;) {
+		uint64_t t = SIM_NEVER;
+		int what = 0;
+
+		if (u->shifting && u->shift_end < t) {
+			t = u->shift_end;
+			what = 1;
+		}
+		if (u->rx_tail != u->rx_head && u->rx_next < t) {
+			t = u->rx_next;
+			what = 2;
+		}
+		if (u->idle_at < t) {
+			t = u->idle_at;
+			what = 3;
+		}
+		if (t > sim_now) {
+			break;
+		}
+		if (what == 1) {
+			usart_tx_done(u, t);
+		} else if (what == 2) {
+			usart_rx_arrive(u, t);
+		} else {
+			u->idle_at = SIM_NEVER;
+			REG(u, USART_SR) |= SR_IDLE;
+		}
+	}
+	usart_irq(u);
+}
+
+static uint64_t usart_next_event(void *ctx)
+{
+	usart_t *u = ctx;
+	uint64_t t = u->idle_at;
+
+	if (u->shifting && u->shift_end < t) {
+		t = u->shift_end;
+	}
+	if (u->rx_tail != u->rx_head && u->rx_next < t) {
+		t = u->rx_next;
+	}
+	return t;
+}
+
+static void usart_reset(void *ctx)
+{
+	usart_t *u = ctx;
+
+	u->shifting = 0;
+	u->holding = 0;
+	u->rdr = 0;
+	u->sr_read = 0;
+	u->rx_head = u->rx_tail = 0;
+	u->rx_next = SIM_NEVER;
+	u->idle_at = SIM_NEVER;
+	u->log_len = 0;
+	REG(u, USART_SR) = SR_TXE | SR_TC;
+	sim_irq_line(u->irq, 0);
+}
+
+static void usart_read(void *ctx, uint32_t off)
+{
+	usart_t *u = ctx;
+
+	if (off == USART_SR) {
+		u->sr_read = 1;
+	} else if (off == USART_DR) {
+		REG(u, USART_DR) = u->rdr;
+		REG(u, USART_SR) &= ~SR_RXNE;
+		if (u->sr_read) {
+			REG(u, USART_SR) &= ~(SR_IDLE | SR_ERRORS);
+		}
+		u->sr_read = 0;
+		usart_irq(u);
+	}
+}
+
+static void usart_write(void *ctx, uint32_t off, uint32_t old, uint32_t val)
+{
+	usart_t *u = ctx;
+
+	if (off == USART_SR) {
+		REG(u, USART_SR) = old & (val | ~SR_RC_W0);
+	} else if (off == USART_DR) {
+		usart_tx_push(u, (uint16_t)(val & 0x1FFU), sim_now);
+	} else if (off == USART_CR1) {
+		if (u->holding && !u->shifting && usart_tx_enabled(u)) {
+			u->holding = 0;
+			usart_tx_push(u, u->hold_data, sim_now);
+		}
+	}
+	usart_irq(u);
+}
+
+static usart_t *usart_from_regs(void *pUSARTx)
+{
+	uint32_t phys = sim_phys(pUSARTx);
+
+	if (phys == usart1.phys) {
+		return &usart1;
+	}
+	if (phys == usart6.phys) {
+		return &usart6;
+	}
+	return &usart2;
+}
+
+void sim_usart_inject(void *pUSARTx, const uint8_t *pData, uint32_t len)
+{
+	usart_t *u = usart_from_regs(pUSARTx);
+
+	sim_open();
+	if (u->rx_tail == u->rx_head) {
+		u->rx_next = sim_now + usart_frame(u);
+	}
+	u->idle_at = SIM_NEVER;
+	for (uint32_t i = 0; i < len && (u->rx_head - u->rx_tail) < USART_RXQ_SIZE; i++) {
+		u->rxq[u->rx_head++ % USART_RXQ_SIZE] = pData[i];
+	}
+	sim_close();
+}
+
+uint32_t sim_usart_tx_log(void *pUSARTx, uint8_t *pBuffer, uint32_t max)
+{
+	usart_t *u = usart_from_regs(pUSARTx);
+	uint32_t n = (u->log_len < max) ? u->log_len : max;
+
+	memcpy(pBuffer, u->log, n);
+	return u->log_len;
+}
+
+void sim_usart_tx_log_clear(void *pUSARTx)
+{
+	usart_from_regs(pUSARTx)->log_len = 0;
+}
+
+const sim_model_t sim_usart_models[] = {
+	{ "USART1", 0x40011000, 0x400, &usart1, usart_reset, usart_read, NULL, usart_write, usart_update, usart_next_event },
+	{ "USART2", 0x40004400, 0x400, &usart2, usart_reset, usart_read, NULL, usart_write, usart_update, usart_next_event },
+	{ "USART6", 0x40011400, 0x400, &usart6, usart_reset, usart_read, NULL, usart_write, usart_update, usart_next_event },
+};
+const int sim_usart_model_count = sizeof(sim_usart_models) / sizeof(sim_usart_models[0]);
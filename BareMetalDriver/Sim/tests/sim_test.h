@@ -0,0 +1,36 @@
+#ifndef SIM_TEST_H_
+#define SIM_TEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Checks shared by the sim tests (make -C BareMetalDriver sim).
+ *
+ * CHECK prints the failed condition and counts it, the test goes on so one run shows every
+ * failure. CHECK_CYCLES prints a cycle figure measured with sim_cycles() and fails it when it
+ * is over budget: the budgets are the figures of the current drivers plus some slack, a run
+ * over them is a throughput regression. SIM_TEST_END prints PASS/FAIL and gives the exit code.
+ */
+static int sim_test_fails;
+
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			sim_test_fails++; \
+		} \
+	} while (0)
+
+#define CHECK_CYCLES(what, cycles, budget) do { \
+		uint64_t c_ = (cycles), b_ = (budget); \
+		printf("%-40s %8llu cycles (budget %llu)\n", what, (unsigned long long)c_, \
+		       (unsigned long long)b_); \
+		if (c_ > b_) { \
+			printf("FAIL %s:%d: %s over budget\n", __FILE__, __LINE__, what); \
+			sim_test_fails++; \
+		} \
+	} while (0)
+
+#define SIM_TEST_END() (puts(sim_test_fails ? "FAIL" : "PASS"), sim_test_fails != 0)
+
+#endif /* SIM_TEST_H_ */
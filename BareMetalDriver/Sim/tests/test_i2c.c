@@ -0,0 +1,242 @@
+/*
+ * I2C master at 400 kHz: blocking, interrupt and DMA transfers of every length the 1/2/N read
+ * sequences tell apart, register access with a repeated start, and recovery from an absent
+ * slave. The interrupt and ISR cycle counts are the cost the CPU pays per transfer.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "i2c.h"
+#include "dma.h"
+#include "sim.h"
+#include "sim_test.h"
+
+#define EEPROM 0x50
+
+static I2C_Handle_t h;
+static DMA_Handle_t tx, rx;
+static volatile int done, ev, irqs;
+static uint64_t isr_cycles;
+static uint8_t eeprom[64];
+static uint8_t b[16];
+
+void I2C_ApplicationEventCallback(I2C_Handle_t *pI2CHandle, uint8_t AppEv)
+{
+	(void)pI2CHandle;
+	ev = AppEv;
+	done = 1;
+}
+
+static void complete(I2C_Handle_t *pI2CHandle, uint8_t AppEv)
+{
+	(void)pI2CHandle;
+	ev = AppEv;
+	done = 1;
+}
+
+#define TIMED_ISR(name, call) \
+	static void name(void) \
+	{ \
+		uint64_t t = sim_cycles(); \
+		irqs++; \
+		call; \
+		isr_cycles += sim_cycles() - t; \
+	}
+
+TIMED_ISR(i2c1_ev_isr, I2C_EV_IRQHandling(&h))
+TIMED_ISR(i2c1_er_isr, I2C_ER_IRQHandling(&h))
+TIMED_ISR(dma_rx_isr, DMA_IRQHandling(&rx))
+TIMED_ISR(dma_tx_isr, DMA_IRQHandling(&tx))
+
+static void start(void)
+{
+	done = 0;
+	irqs = 0;
+	isr_cycles = 0;
+}
+
+/* completion of the transfer started, then the STOP on the bus */
+static int finish(void)
+{
+	int ok = sim_run_until(&done, 2000000);
+
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {
+		sim_run(100);
+	}
+	return ok;
+}
+
+static void set_pointer(uint8_t reg)
+{
+	static uint8_t r;
+
+	r = reg;
+	start();
+	I2C_MasterSendDataIT(&h, &r, 1, EEPROM, I2C_DISABLE_SR);
+	CHECK(finish() && ev == I2C_EVENT_TX_CMPLT);
+}
+
+static void test_blocking(void)
+{
+	static uint8_t p = 5;
+
+	for (uint32_t len = 1; len <= 5; len++) {
+		memset(b, 0, sizeof(b));
+		I2C_MasterSendData(&h, &p, 1, EEPROM);
+		while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+		I2C_MasterReceiveData(&h, b, len, EEPROM);
+		while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+		CHECK(memcmp(b, eeprom + 5, len) == 0);
+	}
+}
+
+static void test_it(void)
+{
+	for (uint32_t len = 1; len <= 7; len++) {
+		set_pointer(5);
+		memset(b, 0, sizeof(b));
+		start();
+		I2C_MasterReceiveDataIT(&h, b, len, EEPROM, I2C_DISABLE_SR);
+		CHECK(finish() && ev == I2C_EVENT_RX_CMPLT);
+		CHECK(memcmp(b, eeprom + 5, len) == 0);
+		CHECK(!(I2C1->CR1 & (1 << I2C_CR1_POS)));
+		/* SB, ADDR and a byte interrupt per byte past the second */
+		CHECK(irqs == (int)((len < 3) ? 3 : len + 1));
+	}
+}
+
+static void test_dma(void)
+{
+	static uint8_t w[9] = {0x20, 1, 2, 3, 4, 5, 6, 7, 8};
+	char what[48];
+
+	h.pRxDMA = &rx;
+	h.pTxDMA = &tx;
+	h.Callback = complete;
+	start();
+	I2C_MasterSendDataIT(&h, w, sizeof(w), EEPROM, I2C_DISABLE_SR);
+	CHECK(finish() && ev == I2C_EVENT_TX_CMPLT);
+	CHECK(memcmp(eeprom + 0x20, w + 1, 8) == 0);
+	CHECK(irqs == 3);
+	CHECK_CYCLES("I2C DMA write 8 B, ISR time", isr_cycles, 70);
+
+	for (uint32_t len = 3; len <= 16; len += 13) {
+		uint64_t t0;
+
+		set_pointer(0x20);
+		memset(b, 0, sizeof(b));
+		start();
+		t0 = sim_cycles();
+		I2C_MasterReceiveDataIT(&h, b, len, EEPROM, I2C_DISABLE_SR);
+		CHECK(sim_run_until(&done, 2000000) && ev == I2C_EVENT_RX_CMPLT);
+		snprintf(what, sizeof(what), "I2C DMA read %u B, bus time", (unsigned)len);
+		CHECK_CYCLES(what, sim_cycles() - t0, (len == 3) ? 1700 : 6400);
+		CHECK(finish());
+		CHECK(memcmp(b, eeprom + 0x20, len) == 0);
+		CHECK(!(I2C1->CR2 & ((1 << I2C_CR2_DMAEN) | (1 << I2C_CR2_LAST))));
+		CHECK(irqs == 3);
+		snprintf(what, sizeof(what), "I2C DMA read %u B, ISR time", (unsigned)len);
+		CHECK_CYCLES(what, isr_cycles, 80);
+	}
+}
+
+/* a register read in one transaction is never slower than pointer write + read */
+static void test_mem(int use_dma)
+{
+	static uint8_t wd[6];
+
+	h.pRxDMA = use_dma ? &rx : NULL;
+	h.pTxDMA = use_dma ? &tx : NULL;
+	for (uint32_t len = 1; len <= 7; len++) {
+		uint64_t t0, combined, separate;
+
+		memset(b, 0, sizeof(b));
+		start();
+		t0 = sim_cycles();
+		I2C_MemReadIT(&h, EEPROM, 9, I2C_MEMADD_SIZE_8BIT, b, len);
+		CHECK(sim_run_until(&done, 2000000) && ev == I2C_EVENT_RX_CMPLT);
+		combined = sim_cycles() - t0;
+		CHECK(finish());
+		CHECK(memcmp(b, eeprom + 9, len) == 0 && h.TxRxState == I2C_READY);
+
+		t0 = sim_cycles();
+		set_pointer(9);
+		start();
+		I2C_MasterReceiveDataIT(&h, b, len, EEPROM, I2C_DISABLE_SR);
+		CHECK(sim_run_until(&done, 2000000));
+		separate = sim_cycles() - t0;
+		CHECK(finish());
+		CHECK(combined <= separate);
+	}
+	for (int i = 0; i < 6; i++) {
+		wd[i] = (uint8_t)(0x90 + use_dma * 8 + i);
+	}
+	for (uint32_t len = 1; len <= 6; len += 5) {
+		start();
+		I2C_MemWriteIT(&h, EEPROM, 0x30, I2C_MEMADD_SIZE_8BIT, wd, len);
+		CHECK(finish() && ev == I2C_EVENT_TX_CMPLT);
+		CHECK(memcmp(eeprom + 0x30, wd, len) == 0 && h.TxRxState == I2C_READY);
+	}
+}
+
+static void test_mem_blocking(void)
+{
+	static const uint8_t wb[3] = {0xA1, 0xA2, 0xA3};
+
+	for (uint32_t len = 1; len <= 5; len++) {
+		memset(b, 0, sizeof(b));
+		I2C_MemRead(&h, EEPROM, 0x30, I2C_MEMADD_SIZE_8BIT, b, len);
+		while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+		CHECK(memcmp(b, eeprom + 0x30, len) == 0);
+	}
+	I2C_MemWrite(&h, EEPROM, 0x38, I2C_MEMADD_SIZE_8BIT, wb, 3);
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+	CHECK(memcmp(eeprom + 0x38, wb, 3) == 0);
+}
+
+/* NACK on the address: I2C_ERROR_AF, the handle and the bus usable again */
+static void test_absent(void)
+{
+	start();
+	I2C_MasterReceiveDataIT(&h, b, 4, 0x33, I2C_DISABLE_SR);
+	CHECK(finish() && ev == I2C_ERROR_AF && h.TxRxState == I2C_READY);
+	start();
+	I2C_MasterReceiveDataIT(&h, b, 4, EEPROM, I2C_DISABLE_SR);
+	CHECK(finish() && ev == I2C_EVENT_RX_CMPLT);
+}
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	for (int i = 0; i < (int)sizeof(eeprom); i++) {
+		eeprom[i] = (uint8_t)(0x40 + i);
+	}
+	sim_i2c_add_slave(I2C1, EEPROM, eeprom, sizeof(eeprom));
+	h.pI2Cx = I2C1;
+	h.I2C_Config.I2C_SckSpeed = I2C_SCL_SPEED_FM4K;
+	h.I2C_Config.I2C_AckControl = I2C_SCK_ACK_ENABLE;
+	I2C_Init(&h);
+	rx.pDMAx = DMA1;
+	rx.pStream = DMA1_Stream0;
+	rx.StreamNumber = 0;
+	rx.DMA_Config.DMA_Channel = 1;
+	tx.pDMAx = DMA1;
+	tx.pStream = DMA1_Stream6;
+	tx.StreamNumber = 6;
+	tx.DMA_Config.DMA_Channel = 1;
+	sim_set_vector(IRQ_NO_I2C1_EV, i2c1_ev_isr);
+	sim_set_vector(IRQ_NO_I2C1_ER, i2c1_er_isr);
+	sim_set_vector(IRQ_NO_DMA1_STREAM0, dma_rx_isr);
+	sim_set_vector(IRQ_NO_DMA1_STREAM6, dma_tx_isr);
+	*NVIC_ISER0 = (1U << IRQ_NO_I2C1_EV) | (1U << IRQ_NO_DMA1_STREAM0) | (1U << IRQ_NO_DMA1_STREAM6);
+	*NVIC_ISER1 = 1U << (IRQ_NO_I2C1_ER - 32);
+
+	test_blocking();
+	test_it();
+	test_dma();
+	test_mem(0);
+	test_mem(1);
+	test_mem_blocking();
+	test_absent();
+	return SIM_TEST_END();
+}
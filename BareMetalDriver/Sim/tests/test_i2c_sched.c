@@ -0,0 +1,126 @@
+/*
+ * I2C scheduler: four jobs with periods of 1, 2, 5 and 10 ms on one bus at 400 kHz, one of
+ * them on an absent device, for 200 SysTick periods. Every job keeps its rate, the absent one
+ * only counts errors, and a reader polling I2C_SchedGet never sees a torn or older result.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "i2c.h"
+#include "i2c_sched.h"
+#include "dma.h"
+#include "sim.h"
+#include "sim_test.h"
+
+#define TICKS 200
+
+static I2C_Handle_t h;
+static DMA_Handle_t rx;
+static I2C_Sched_t sched;
+static uint8_t imu[128], baro[128], adc[128];
+static uint8_t imu_result[2 * 6], baro_result[2 * 2], adc_result[2 * 1], absent_result[2 * 2];
+static I2C_Job_t jobs[4] = {
+	{ .DevAddress = 0x68, .MemAddress = 0x3B, .MemAddSize = I2C_MEMADD_SIZE_8BIT, .Len = 6, .Period = 1,
+	  .pBuffer = imu_result },
+	{ .DevAddress = 0x76, .MemAddress = 0x10, .MemAddSize = I2C_MEMADD_SIZE_8BIT, .Len = 2, .Period = 2,
+	  .pBuffer = baro_result },
+	{ .DevAddress = 0x40, .MemAddress = 0x02, .MemAddSize = I2C_MEMADD_SIZE_8BIT, .Len = 1, .Period = 5,
+	  .pBuffer = adc_result },
+	{ .DevAddress = 0x23, .MemAddress = 0x00, .MemAddSize = I2C_MEMADD_SIZE_8BIT, .Len = 2, .Period = 10,
+	  .pBuffer = absent_result },
+};
+static uint32_t ticks;
+static uint8_t sample;
+
+/* the devices take a new sample every tick, all bytes of a sample equal */
+static void systick_isr(void)
+{
+	ticks++;
+	sample++;
+	memset(imu + 0x3B, sample, 6);
+	memset(baro + 0x10, sample, 2);
+	I2C_SchedTick(&sched);
+}
+
+static void i2c1_ev_isr(void)
+{
+	I2C_EV_IRQHandling(&h);
+}
+
+static void i2c1_er_isr(void)
+{
+	I2C_ER_IRQHandling(&h);
+}
+
+static void dma_rx_isr(void)
+{
+	DMA_IRQHandling(&rx);
+}
+
+int main(void)
+{
+	uint32_t gets = 0, torn = 0, older = 0, last = 0;
+	uint8_t adc_value;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	sim_i2c_add_slave(I2C1, 0x68, imu, sizeof(imu));
+	sim_i2c_add_slave(I2C1, 0x76, baro, sizeof(baro));
+	sim_i2c_add_slave(I2C1, 0x40, adc, sizeof(adc));
+	adc[0x02] = 0x5A;
+	h.pI2Cx = I2C1;
+	h.I2C_Config.I2C_SckSpeed = I2C_SCL_SPEED_FM4K;
+	h.I2C_Config.I2C_AckControl = I2C_SCK_ACK_ENABLE;
+	I2C_Init(&h);
+	rx.pDMAx = DMA1;
+	rx.pStream = DMA1_Stream0;
+	rx.StreamNumber = 0;
+	rx.DMA_Config.DMA_Channel = 1;
+	h.pRxDMA = &rx;
+	sim_set_vector(IRQ_NO_I2C1_EV, i2c1_ev_isr);
+	sim_set_vector(IRQ_NO_I2C1_ER, i2c1_er_isr);
+	sim_set_vector(IRQ_NO_DMA1_STREAM0, dma_rx_isr);
+	sim_set_vector(SIM_IRQ_SYSTICK, systick_isr);
+	*NVIC_ISER0 = (1U << IRQ_NO_I2C1_EV) | (1U << IRQ_NO_DMA1_STREAM0);
+	*NVIC_ISER1 = 1U << (IRQ_NO_I2C1_ER - 32);
+
+	/* a job with period 0 is refused and the handle left alone */
+	jobs[2].Period = 0;
+	CHECK(I2C_SchedInit(&sched, &h, jobs, 4) == I2C_SCHED_ERROR_PARAM);
+	CHECK(h.Callback == NULL);
+	jobs[2].Period = 5;
+	CHECK(I2C_SchedInit(&sched, &h, jobs, 4) == I2C_SCHED_OK);
+
+	/* SysTick at 1 kHz */
+	*(volatile uint32_t *)SIM_CORE_ADDR(0xE000E014) = sim_hclk_hz() / 1000 - 1;
+	*(volatile uint32_t *)SIM_CORE_ADDR(0xE000E010) = 7;
+	while (ticks < TICKS) {
+		uint8_t d[6];
+		uint32_t seq = I2C_SchedGet(&jobs[0], d);
+		volatile int never = 0;
+
+		if (seq != 0) {
+			gets++;
+			for (int i = 1; i < 6; i++) {
+				torn += d[i] != d[0];
+			}
+			older += seq < last;
+			last = seq;
+		}
+		sim_run_until(&never, 37);
+	}
+	for (int i = 0; i < 4; i++) {
+		printf("job %d: seq %u errors %u overruns %u\n", i, (unsigned)jobs[i].Seq, (unsigned)jobs[i].Errors,
+		       (unsigned)jobs[i].Overruns);
+	}
+	printf("I2C_SchedGet: %u results read, %u torn, %u older than the one before\n", (unsigned)gets,
+	       (unsigned)torn, (unsigned)older);
+
+	CHECK(gets > 0 && torn == 0 && older == 0);
+	CHECK(I2C_SchedGet(&jobs[2], &adc_value) != 0 && adc_value == 0x5A);
+	/* at most the read of the last period still running */
+	CHECK(jobs[0].Seq >= TICKS / 1 - 1 && jobs[0].Overruns == 0);
+	CHECK(jobs[1].Seq >= TICKS / 2 - 1 && jobs[1].Overruns == 0);
+	CHECK(jobs[2].Seq >= TICKS / 5 - 1 && jobs[2].Overruns == 0);
+	CHECK(jobs[3].Seq == 0 && jobs[3].Errors >= TICKS / 10 - 1);
+	return SIM_TEST_END();
+}
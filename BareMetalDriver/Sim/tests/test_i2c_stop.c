@@ -0,0 +1,67 @@
+/*
+ * A STOP that cannot go out (a slave holding SCL low) before a new transfer: the START is not
+ * requested, the transfer ends at once with I2C_ERROR_TIMEOUT and the handle is ready. Once SCL
+ * is released the STOP goes out and the next transfer runs.
+ */
+#include "stm32f411xx.h"
+#include "i2c.h"
+#include "sim.h"
+#include "sim_test.h"
+
+static I2C_Handle_t h;
+static volatile int ev = -1, events;
+
+static void complete(I2C_Handle_t *pI2CHandle, uint8_t AppEv)
+{
+	(void)pI2CHandle;
+	ev = AppEv;
+	events++;
+}
+
+static void i2c1_ev_isr(void)
+{
+	I2C_EV_IRQHandling(&h);
+}
+
+static void i2c1_er_isr(void)
+{
+	I2C_ER_IRQHandling(&h);
+}
+
+int main(void)
+{
+	static uint8_t data[4];
+	static uint8_t regs[8];
+	uint64_t t0;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	h.pI2Cx = I2C1;
+	h.I2C_Config.I2C_SckSpeed = I2C_SCL_SPEED_SM;
+	h.I2C_Config.I2C_AckControl = I2C_SCK_ACK_ENABLE;
+	I2C_Init(&h);
+	h.Callback = complete;
+	sim_set_vector(IRQ_NO_I2C1_EV, i2c1_ev_isr);
+	sim_set_vector(IRQ_NO_I2C1_ER, i2c1_er_isr);
+	*NVIC_ISER0 = 1U << IRQ_NO_I2C1_EV;
+	*NVIC_ISER1 = 1U << (IRQ_NO_I2C1_ER - 32);
+
+	sim_i2c_hold_scl(I2C1, 1);
+	I2C1->CR1 |= (1 << I2C_CR1_STOP);
+	t0 = sim_cycles();
+	CHECK(I2C_MasterSendDataIT(&h, data, 4, 0x50, I2C_DISABLE_SR) == I2C_READY);
+	/* I2C_STOP_WAIT_LOOPS reads of CR1, then the error */
+	CHECK_CYCLES("I2C start refused behind a held STOP", sim_cycles() - t0, 4500);
+	CHECK(ev == I2C_ERROR_TIMEOUT && events == 1);
+	CHECK(h.TxRxState == I2C_READY);
+	CHECK(!(I2C1->CR1 & (1 << I2C_CR1_START)));
+
+	sim_i2c_hold_scl(I2C1, 0);
+	sim_i2c_add_slave(I2C1, 0x50, regs, sizeof(regs));
+	events = 0;
+	ev = -1;
+	CHECK(I2C_MasterSendDataIT(&h, data, 4, 0x50, I2C_DISABLE_SR) == I2C_READY);
+	CHECK(sim_run_until(&events, 10000000));
+	CHECK(ev == I2C_EVENT_TX_CMPLT);
+	return SIM_TEST_END();
+}
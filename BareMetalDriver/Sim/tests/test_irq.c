@@ -0,0 +1,89 @@
+/*
+ * RAM vector table: IRQ_Init moves VTOR into SRAM, two USARTs registered on IRQ_Dispatch each
+ * reach their own handle. The sim charges exception entry and bus accesses only, so a
+ * registered and a linked vector cost the same cycles here (the estimate is in irq.h).
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "uart.h"
+#include "irq.h"
+#include "sim.h"
+#include "sim_test.h"
+
+static volatile int done[2];
+static USART_Handle_t u1, u2;
+
+void USART_ApplicationEventCallback(USART_Handle_t *pUSARTHandle, uint8_t AppEv)
+{
+	if (AppEv == USART_EVENT_TX_CMPLT) {
+		done[pUSARTHandle == &u2]++;
+	}
+}
+
+static void usart_setup(USART_Handle_t *pHandle, USART_RegDef_t *pUSARTx)
+{
+	memset(pHandle, 0, sizeof(*pHandle));
+	pHandle->pUSARTx = pUSARTx;
+	pHandle->USART_Config.USART_Mode = USART_TX_RX;
+	pHandle->USART_Config.USART_Baud = USART_BAUD_115200;
+	pHandle->USART_Config.USART_WorlLenght = USART_DATA_8;
+	USART_Init(pHandle);
+	USART_SetBaudRate(pUSARTx, USART_BAUD_115200);
+	USART_PeripheralControl(pUSARTx, ENABLE);
+}
+
+static void usart2_isr(void)
+{
+	USART_IRQHandling(&u2);
+}
+
+/* cycles of a 6-byte interrupt transfer on USART2 */
+static uint64_t usart2_send(void)
+{
+	uint64_t t0 = sim_cycles();
+
+	done[1] = 0;
+	USART_SendDataIT(&u2, (uint8_t *)"twotwo", 6);
+	CHECK(sim_run_until(&done[1], 10000000));
+	return sim_cycles() - t0;
+}
+
+int main(void)
+{
+	uint64_t linked, registered;
+	uint32_t vtor_reset;
+	uint8_t log[16];
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	usart_setup(&u1, USART1);
+	usart_setup(&u2, USART2);
+	USART_IRQInterruptConfig(IRQ_NO_USART1, ENABLE);
+	USART_IRQInterruptConfig(IRQ_NO_USART2, ENABLE);
+
+	/* vector linked into the image */
+	sim_set_vector(IRQ_NO_USART2, usart2_isr);
+	linked = usart2_send();
+
+	vtor_reset = SCB->VTOR;
+	IRQ_Init();
+	CHECK(SCB->VTOR != vtor_reset && (SCB->VTOR & (IRQ_VECTOR_ALIGN - 1)) == 0);
+	USART_IRQRegister(&u1, IRQ_NO_USART1);
+	USART_IRQRegister(&u2, IRQ_NO_USART2);
+	registered = usart2_send();
+	printf("USART2 6 bytes by interrupt: linked vector %llu cycles, IRQ_Dispatch %llu\n",
+	       (unsigned long long)linked, (unsigned long long)registered);
+	CHECK(registered == linked);
+
+	/* both instances at once on the one dispatcher */
+	done[0] = done[1] = 0;
+	sim_usart_tx_log_clear(USART1);
+	sim_usart_tx_log_clear(USART2);
+	USART_SendDataIT(&u1, (uint8_t *)"one", 3);
+	USART_SendDataIT(&u2, (uint8_t *)"twotwo", 6);
+	CHECK(sim_run_until(&done[1], 10000000) && sim_run_until(&done[0], 10000000));
+	CHECK(done[0] == 1 && done[1] == 1);
+	CHECK(sim_usart_tx_log(USART1, log, sizeof(log)) == 3 && memcmp(log, "one", 3) == 0);
+	CHECK(sim_usart_tx_log(USART2, log, sizeof(log)) == 6 && memcmp(log, "twotwo", 6) == 0);
+	return SIM_TEST_END();
+}
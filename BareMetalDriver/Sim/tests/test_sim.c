@@ -0,0 +1,140 @@
+/*
+ * The models behind the blocking driver calls: USART frames and RX injection, SPI loopback,
+ * I2C write/read of a slave stub, the DMA debug UART and SysTick.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "uart.h"
+#include "spi.h"
+#include "i2c.h"
+#include "sim.h"
+#include "sim_test.h"
+
+void DMA1_Stream6_IRQHandler(void);
+
+static volatile int ticks;
+static uint8_t eeprom[256];
+
+static void systick_isr(void)
+{
+	ticks++;
+}
+
+static void test_usart(void)
+{
+	USART_Handle_t u = {0};
+	uint8_t log[64];
+	uint8_t rx[4] = {0};
+	uint64_t t0;
+
+	u.pUSARTx = USART2;
+	u.USART_Config.USART_Mode = USART_TX_RX;
+	u.USART_Config.USART_Baud = USART_BAUD_115200;
+	u.USART_Config.USART_NoOfStopBits = USART_STOPBITS_1;
+	u.USART_Config.USART_WorlLenght = USART_DATA_8;
+	u.USART_Config.USART_ParityControl = USART_NO_PARITY;
+	u.USART_Config.USART_HardwareFlowControl = USART_HWCONTROL_NONE;
+	USART_Init(&u);
+	USART_SetBaudRate(USART2, USART_BAUD_115200);
+	USART_PeripheralControl(USART2, ENABLE);
+
+	/* 115200 baud at 16 MHz: 139 cycles per bit, 1390 per frame, the call waits for the line */
+	t0 = sim_cycles();
+	USART_SendData(&u, (uint8_t *)"hello sim", 9);
+	CHECK_CYCLES("USART_SendData 9 bytes", sim_cycles() - t0, 9 * 1390 + 100);
+	sim_run(2000);
+	CHECK(sim_usart_tx_log(USART2, log, sizeof(log)) == 9 && memcmp(log, "hello sim", 9) == 0);
+
+	sim_usart_inject(USART2, (const uint8_t *)"abcd", 4);
+	USART_ReceiveData(&u, rx, 4);
+	CHECK(memcmp(rx, "abcd", 4) == 0);
+}
+
+static void test_spi(void)
+{
+	SPI_Handle_t s = {0};
+	uint8_t b = 0;
+	uint64_t t0;
+
+	s.pSPIx = SPI1;
+	s.SPI_Config.SPI_DeviceMode = SPI_MODE_MASTER;
+	s.SPI_Config.SPI_BusConfig = SPI_BUS_CONFIG_FD;
+	s.SPI_Config.SPI_SclkSpeed = SPI_SCLK_SPEED_DIV8;
+	s.SPI_Config.SPI_DFF = SPI_DFF_8BIT;
+	s.SPI_Config.SPI_SSM = SPI_SSM_ENABLE;
+	SPI_Init(&s);
+	SPI1->CR1 |= (1 << SPI_CR1_SPE);
+
+	/* no responder: MISO is MOSI */
+	t0 = sim_cycles();
+	SPI_SendData(SPI1, (uint8_t *)"h", 1);
+	SPI_ReceiveData(SPI1, &b, 1);
+	CHECK_CYCLES("SPI 1 byte tx+rx, PCLK/8", sim_cycles() - t0, 100);
+	CHECK(b == 'h');
+	SPI1->CR1 &= ~(1 << SPI_CR1_SPE);
+}
+
+static void test_i2c(void)
+{
+	I2C_Handle_t h = {0};
+	uint8_t wr[4] = {0x10, 1, 2, 3};
+	uint8_t rd[3] = {0};
+	uint64_t t0;
+
+	sim_i2c_add_slave(I2C1, 0x50, eeprom, sizeof(eeprom));
+	h.pI2Cx = I2C1;
+	h.I2C_Config.I2C_SckSpeed = I2C_SCL_SPEED_SM;
+	h.I2C_Config.I2C_AckControl = I2C_SCK_ACK_ENABLE;
+	I2C_Init(&h);
+
+	/* 100 kHz at 16 MHz: 160 cycles per bit, address and 4 bytes are 45 bits */
+	t0 = sim_cycles();
+	I2C_MasterSendData(&h, wr, 4, 0x50);
+	CHECK_CYCLES("I2C_MasterSendData 4 bytes, 100 kHz", sim_cycles() - t0, 7600);
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+	CHECK(eeprom[0x10] == 1 && eeprom[0x12] == 3);
+
+	I2C_MasterSendData(&h, wr, 1, 0x50);
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+	I2C_MasterReceiveData(&h, rd, 3, 0x50);
+	while (I2C1->SR2 & (1 << I2C_SR2_BUSY)) {}
+	CHECK(rd[0] == 1 && rd[1] == 2 && rd[2] == 3);
+}
+
+static void test_dma_uart(void)
+{
+	uint8_t log[64];
+
+	sim_set_vector(IRQ_NO_DMA1_STREAM6, DMA1_Stream6_IRQHandler);
+	system_uart_dma_init(USART_TX_OVERFLOW_DROP);
+	sim_usart_tx_log_clear(USART2);
+	uart_dma_write((const uint8_t *)"dma path\n", 9);
+	sim_run(200000);
+	CHECK(sim_usart_tx_log(USART2, log, sizeof(log)) == 9 && memcmp(log, "dma path\n", 9) == 0);
+}
+
+static void test_systick(void)
+{
+	volatile uint32_t *syst = (volatile uint32_t *)SIM_CORE_ADDR(0xE000E010);
+
+	/* 1 ms at 16 MHz, 10 ms of simulated time */
+	sim_set_vector(SIM_IRQ_SYSTICK, systick_isr);
+	syst[1] = 15999;
+	syst[2] = 0;
+	syst[0] = 7;
+	sim_run(16000 * 10);
+	CHECK(ticks == 10);
+	CHECK(sim_hclk_hz() == 16000000U);
+}
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	test_usart();
+	test_spi();
+	test_i2c();
+	test_dma_uart();
+	test_systick();
+	return SIM_TEST_END();
+}
@@ -0,0 +1,131 @@
+/*
+ * SPI bus: three devices with their own configuration and chip select, seven queued
+ * transactions run back to back by DMA. Chip select follows the device of each transaction
+ * (KeepCS holds it), CR1 is only rewritten when the device changes, a pending transaction is
+ * not queued twice.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "spi_bus.h"
+#include "gpio.h"
+#include "sim.h"
+#include "sim_test.h"
+
+#define CS_PIN 4    /* flash PA4, lcd PA5, adc PA6 */
+#define CS_MASK (7U << CS_PIN)
+#define NTRANS 7
+
+static SPI_Handle_t s;
+static DMA_Handle_t tx, rx;
+static SPI_Bus_t bus;
+static SPI_Device_t flash, lcd, adc;
+static char selected[64];
+static int nselected;
+static volatile int ndone;
+static uint64_t t_done[NTRANS];
+
+static void dma_rx_isr(void)
+{
+	DMA_IRQHandling(&rx);
+}
+
+static void dma_tx_isr(void)
+{
+	DMA_IRQHandling(&tx);
+}
+
+/* the device selected while an item is clocked, '!' when more than one is */
+static uint16_t responder(uint16_t mosi)
+{
+	uint32_t cs = ~GPIOA->ODR & CS_MASK;
+	char c = (cs == (1U << CS_PIN)) ? 'F' : (cs == (2U << CS_PIN)) ? 'L' :
+	         (cs == (4U << CS_PIN)) ? 'A' : (cs == 0) ? '-' : '!';
+
+	if (nselected < (int)sizeof(selected) - 1 && (nselected == 0 || selected[nselected - 1] != c)) {
+		selected[nselected++] = c;
+	}
+	return (uint16_t)(mosi + 1);
+}
+
+static void complete(SPI_Transaction_t *pTrans)
+{
+	t_done[(intptr_t)pTrans->pContext] = sim_cycles();
+	ndone++;
+}
+
+int main(void)
+{
+	static uint8_t cmd[4] = {3, 0, 0, 0};
+	static uint8_t data[64], px[64], sample[2];
+	SPI_Transaction_t t[NTRANS] = {
+		{ .pDevice = &flash, .pTxBuffer = cmd, .Len = 4, .KeepCS = 1 },
+		{ .pDevice = &flash, .pRxBuffer = data, .Len = 64 },
+		{ .pDevice = &flash, .pTxBuffer = cmd, .Len = 4 },
+		{ .pDevice = &lcd, .pTxBuffer = px, .Len = 64 },
+		{ .pDevice = &lcd, .pTxBuffer = px, .Len = 64 },
+		{ .pDevice = &adc, .pTxBuffer = sample, .pRxBuffer = sample, .Len = 2 },
+		{ .pDevice = &flash, .pTxBuffer = cmd, .Len = 4 },
+	};
+	SPI_Device_t *devices[3] = {&flash, &lcd, &adc};
+	uint64_t t0;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	s.pSPIx = SPI1;
+	s.SPI_Config.SPI_DeviceMode = SPI_MODE_MASTER;
+	s.SPI_Config.SPI_SSM = SPI_SSM_ENABLE;
+	SPI_Init(&s);
+	rx.pDMAx = DMA2;
+	rx.pStream = DMA2_Stream0;
+	rx.StreamNumber = 0;
+	rx.DMA_Config.DMA_Channel = 3;
+	tx.pDMAx = DMA2;
+	tx.pStream = DMA2_Stream3;
+	tx.StreamNumber = 3;
+	tx.DMA_Config.DMA_Channel = 3;
+	s.pRxDMA = &rx;
+	s.pTxDMA = &tx;
+	sim_set_vector(IRQ_NO_DMA2_STREAM0, dma_rx_isr);
+	sim_set_vector(IRQ_NO_DMA2_STREAM3, dma_tx_isr);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM0, ENABLE);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM3, ENABLE);
+	sim_spi_set_responder(SPI1, responder);
+
+	SPI_BusInit(&bus, &s);
+	for (int i = 0; i < 3; i++) {
+		devices[i]->SPI_Config = s.SPI_Config;
+		devices[i]->pCSPort = GPIOA;
+		devices[i]->CSPin = CS_PIN + i;
+		SPI_DeviceInit(devices[i]);
+	}
+	lcd.SPI_Config.SPI_CPOL = SPI_CPOL_HIGH;
+	lcd.SPI_Config.SPI_CPHA = SPI_CPHA_HIGH;
+	adc.SPI_Config.SPI_SclkSpeed = SPI_SCLK_SPEED_DIV8;
+	/* chip selects are outputs, released */
+	CHECK((GPIOA->ODR & CS_MASK) == CS_MASK);
+
+	t0 = sim_cycles();
+	for (int i = 0; i < NTRANS; i++) {
+		t[i].Callback = complete;
+		t[i].pContext = (void *)(intptr_t)i;
+		CHECK(SPI_BusSubmit(&bus, &t[i]) == SPI_TRANS_DONE);
+	}
+	CHECK(SPI_BusSubmit(&bus, &t[NTRANS - 1]) == SPI_TRANS_PENDING);
+	while (ndone < NTRANS && sim_cycles() - t0 < 10000000) {
+		sim_run(100);
+	}
+	selected[nselected] = '\0';
+	printf("chip selects while clocking: %s, CR1 rewrites %u\n", selected, (unsigned)bus.Reconfigs);
+
+	CHECK(ndone == NTRANS);
+	for (int i = 0; i < NTRANS; i++) {
+		CHECK(t[i].Status == SPI_TRANS_DONE);
+	}
+	CHECK(strcmp(selected, "FLAF") == 0);
+	CHECK(bus.Reconfigs == 3);
+	CHECK((GPIOA->ODR & CS_MASK) == CS_MASK);
+	/* lcd pixels at PCLK/2: 1024 line cycles, the rest is the setup in the completion interrupt */
+	CHECK_CYCLES("SPI bus 64 B transaction after another", t_done[3] - t_done[2], 1024 + 200);
+	CHECK_CYCLES("SPI bus 7 transactions", sim_cycles() - t0, 4600);
+	return SIM_TEST_END();
+}
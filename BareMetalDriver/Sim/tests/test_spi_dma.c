@@ -0,0 +1,152 @@
+/*
+ * SPI_TransferDMA: full duplex, transmit only, receive only with the fill item, the lengths it
+ * refuses and the busy return, against SPI_SendDataIT for the same length.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "spi.h"
+#include "dma.h"
+#include "sim.h"
+#include "sim_test.h"
+
+#define LEN 1024
+
+static SPI_Handle_t s;
+static DMA_Handle_t tx, rx;
+static volatile int done, ev, irqs, app_events;
+static uint8_t a[LEN], b[LEN];
+
+void SPI_ApplicationEventCallback(SPI_Handle_t *pSPIHandle, uint8_t AppEv)
+{
+	(void)pSPIHandle;
+	app_events++;
+	ev = AppEv;
+	done = 1;
+}
+
+static void complete(SPI_Handle_t *pSPIHandle, uint8_t AppEv)
+{
+	(void)pSPIHandle;
+	ev = AppEv;
+	done = 1;
+}
+
+static void dma_rx_isr(void)
+{
+	irqs++;
+	DMA_IRQHandling(&rx);
+}
+
+static void dma_tx_isr(void)
+{
+	irqs++;
+	DMA_IRQHandling(&tx);
+}
+
+static void spi1_isr(void)
+{
+	irqs++;
+	SPI_IRQHandle(&s);
+}
+
+static uint16_t responder(uint16_t mosi)
+{
+	return (uint16_t)(mosi ^ 0x5A);
+}
+
+static void start(void)
+{
+	done = 0;
+	irqs = 0;
+}
+
+int main(void)
+{
+	uint64_t t0;
+	int ok;
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	s.pSPIx = SPI1;
+	s.SPI_Config.SPI_DeviceMode = SPI_MODE_MASTER;
+	s.SPI_Config.SPI_BusConfig = SPI_BUS_CONFIG_FD;
+	s.SPI_Config.SPI_SclkSpeed = SPI_SCLK_SPEED_DIV2;
+	s.SPI_Config.SPI_DFF = SPI_DFF_8BIT;
+	s.SPI_Config.SPI_SSM = SPI_SSM_ENABLE;
+	SPI_Init(&s);
+	rx.pDMAx = DMA2;
+	rx.pStream = DMA2_Stream0;
+	rx.StreamNumber = 0;
+	rx.DMA_Config.DMA_Channel = 3;
+	tx.pDMAx = DMA2;
+	tx.pStream = DMA2_Stream3;
+	tx.StreamNumber = 3;
+	tx.DMA_Config.DMA_Channel = 3;
+	s.pRxDMA = &rx;
+	s.pTxDMA = &tx;
+	sim_set_vector(IRQ_NO_DMA2_STREAM0, dma_rx_isr);
+	sim_set_vector(IRQ_NO_DMA2_STREAM3, dma_tx_isr);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM0, ENABLE);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM3, ENABLE);
+	sim_spi_set_responder(SPI1, responder);
+	for (int i = 0; i < LEN; i++) {
+		a[i] = (uint8_t)(i * 7);
+	}
+
+	/* 0, more than NDTR holds, and half frames of 16-bit items are refused */
+	CHECK(SPI_TransferDMA(&s, a, b, 0, complete) == SPI_ERROR_PARAM);
+	CHECK(SPI_TransferDMA(&s, a, b, 65536, complete) == SPI_ERROR_PARAM);
+	SPI1->CR1 |= (1 << SPI_CR1_DFF);
+	CHECK(SPI_TransferDMA(&s, a, b, 3, complete) == SPI_ERROR_PARAM);
+	CHECK(SPI_TransferDMA(&s, a, b, 1, complete) == SPI_ERROR_PARAM);
+	SPI1->CR1 &= ~(1 << SPI_CR1_DFF);
+	CHECK(s.TxState == SPI_READY);
+
+	/* full duplex at PCLK/2: 16 cycles per byte on the line, one interrupt at the end */
+	start();
+	t0 = sim_cycles();
+	CHECK(SPI_TransferDMA(&s, a, b, LEN, complete) == SPI_READY);
+	CHECK(SPI_TransferDMA(&s, a, b, LEN, complete) == SPI_BUSY_IN_TXRX_DMA);
+	CHECK(sim_run_until(&done, 100000000));
+	CHECK_CYCLES("SPI_TransferDMA 1024 B duplex", sim_cycles() - t0, LEN * 16 + 600);
+	ok = 1;
+	for (int i = 0; i < LEN; i++) {
+		ok &= b[i] == (uint8_t)(a[i] ^ 0x5A);
+	}
+	CHECK(ok);
+	CHECK(ev == SPI_EVENT_TXRX_CMPLT && irqs == 1);
+
+	/* transmit only: the received items go to RxDiscard */
+	start();
+	SPI_TransferDMA(&s, a, NULL, 512, complete);
+	CHECK(sim_run_until(&done, 100000000));
+	CHECK(ev == SPI_EVENT_TXRX_CMPLT && irqs == 1);
+	CHECK(s.RxDiscard == (uint8_t)(a[511] ^ 0x5A));
+
+	/* receive only, TxFill clocked out; no callback: SPI_ApplicationEventCallback */
+	start();
+	s.TxFill = 0xFF;
+	SPI_TransferDMA(&s, NULL, b, 256, NULL);
+	CHECK(sim_run_until(&done, 100000000));
+	ok = 1;
+	for (int i = 0; i < 256; i++) {
+		ok &= b[i] == (0xFF ^ 0x5A);
+	}
+	CHECK(ok && app_events == 1 && irqs == 1);
+
+	/* SPI_ReceiveDataIT interrupts on RXNE, not on TXE */
+	sim_set_vector(IRQ_NO_SPI1, spi1_isr);
+	*NVIC_ISER1 = 1 << (IRQ_NO_SPI1 % 32);
+	SPI_ReceiveDataIT(&s, b, 4);
+	CHECK((SPI1->CR2 & (1 << SPI_CR2_RXNEIE)) && !(SPI1->CR2 & (1 << SPI_CR2_TXEIE)));
+	SPI_CloseReception(&s);
+
+	/* the same length by interrupts, for comparison: one interrupt per byte */
+	start();
+	t0 = sim_cycles();
+	SPI_SendDataIT(&s, a, LEN);
+	CHECK(sim_run_until(&done, 100000000));
+	CHECK_CYCLES("SPI_SendDataIT 1024 B", sim_cycles() - t0, 42000);
+	CHECK(irqs == LEN);
+	return SIM_TEST_END();
+}
@@ -0,0 +1,174 @@
+/*
+ * SPI slave by DMA at 100 MHz: an external master clocks frames of varying length, NSS on PA4
+ * (EXTI4) ends each one. Every received byte reaches the frame callback, in order, also for a
+ * frame longer than the ring; MISO carries the reply set before the frame, its last item
+ * repeated, or TxFill without a reply. Ring and reply lengths the streams cannot run are refused.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "spi.h"
+#include "dma.h"
+#include "gpio.h"
+#include "rcc_driver.h"
+#include "sim.h"
+#include "sim_test.h"
+
+#define NSS_PIN 4
+#define SCK_HZ 12500000U
+
+static SPI_Handle_t s;
+static DMA_Handle_t tx, rx;
+static volatile int frames, parts, errors;
+static uint8_t ring[32];
+static const uint8_t reply1[8] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7};
+static const uint8_t reply2[4] = {0xB0, 0xB1, 0xB2, 0xB3};
+static uint8_t got[64];
+static uint32_t ngot;
+static uint32_t frame_end[8];
+
+void SPI_ApplicationEventCallback(SPI_Handle_t *pSPIHandle, uint8_t AppEv)
+{
+	(void)pSPIHandle;
+	(void)AppEv;
+	errors++;
+}
+
+void SPI_ApplicationFrameCallback(SPI_Handle_t *pSPIHandle, uint8_t *pData, uint32_t len, uint8_t AppEv)
+{
+	if (ngot + len <= sizeof(got)) {
+		memcpy(got + ngot, pData, len);
+	}
+	ngot += len;
+	if (AppEv != SPI_EVENT_FRAME) {
+		parts++;
+		return;
+	}
+	if (frames < 8) {
+		frame_end[frames] = ngot;
+	}
+	frames++;
+	/* from the third frame on the master reads the other reply */
+	if (frames == 2) {
+		SPI_SlaveSetReply(pSPIHandle, reply2, sizeof(reply2));
+	}
+}
+
+static void dma_rx_isr(void)
+{
+	DMA_IRQHandling(&rx);
+}
+
+static void dma_tx_isr(void)
+{
+	DMA_IRQHandling(&tx);
+}
+
+static void nss_isr(void)
+{
+	GPIO_IRQHandling(NSS_PIN);
+	SPI_SlaveNSSHandling(&s);
+}
+
+/* one frame from the master, 0 when the frame callback did not follow within 1M cycles */
+static int master_frame(const uint8_t *pMosi, uint8_t *pMiso, uint32_t len)
+{
+	int want = frames + 1;
+	uint64_t t0 = sim_cycles();
+
+	memset(pMiso, 0, len);
+	sim_spi_master_frame(SPI1, pMosi, pMiso, len, SCK_HZ, NSS_PIN);
+	while (frames < want && sim_cycles() - t0 < 1000000) {
+		sim_run(1000);
+	}
+	return frames == want;
+}
+
+int main(void)
+{
+	static const uint32_t lens[4] = {12, 5, 20, 3};
+	uint8_t mosi[20], miso[20], expect[64];
+	uint32_t nexpect = 0;
+	GPIO_Handle_t nss = {0};
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	CHECK(RCC_ConfigSystemClock100MHz(RCC_PLL_SRC_HSI) == RCC_OK);
+	nss.pGPIOx = GPIOA;
+	nss.GPIO_PinConfig.GPIO_PinNumber = NSS_PIN;
+	nss.GPIO_PinConfig.GPIO_PinMode = GPIO_MODE_ITRT;
+	GPIO_PeriClockControl(GPIOA, ENABLE);
+	GPIO_Init(&nss);
+	s.pSPIx = SPI1;
+	s.SPI_Config.SPI_DeviceMode = SPI_MODE_SLAVE;
+	s.SPI_Config.SPI_SSM = SPI_SSM_ENABLE;
+	SPI_Init(&s);
+	rx.pDMAx = DMA2;
+	rx.pStream = DMA2_Stream0;
+	rx.StreamNumber = 0;
+	rx.DMA_Config.DMA_Channel = 3;
+	tx.pDMAx = DMA2;
+	tx.pStream = DMA2_Stream3;
+	tx.StreamNumber = 3;
+	tx.DMA_Config.DMA_Channel = 3;
+	s.pRxDMA = &rx;
+	s.pTxDMA = &tx;
+	sim_set_vector(IRQ_NO_DMA2_STREAM0, dma_rx_isr);
+	sim_set_vector(IRQ_NO_DMA2_STREAM3, dma_tx_isr);
+	sim_set_vector(IRQ_NO_EXTI4, nss_isr);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM0, ENABLE);
+	DMA_IRQInterruptConfig(IRQ_NO_DMA2_STREAM3, ENABLE);
+	*NVIC_ISER0 = 1 << IRQ_NO_EXTI4;
+
+	/* lengths the streams cannot run: refused, nothing started */
+	CHECK(SPI_SlaveStartDMA(&s, ring, 0, reply1, sizeof(reply1)) == SPI_ERROR_PARAM);
+	CHECK(SPI_SlaveStartDMA(&s, ring, 0x10000, reply1, sizeof(reply1)) == SPI_ERROR_PARAM);
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring), reply1, 0) == SPI_ERROR_PARAM);
+	SPI1->CR1 |= (1 << SPI_CR1_DFF);
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring) - 1, NULL, 0) == SPI_ERROR_PARAM);
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring), reply1, 3) == SPI_ERROR_PARAM);
+	SPI1->CR1 &= ~(1 << SPI_CR1_DFF);
+	CHECK(s.RxState == SPI_READY && !(SPI1->CR2 & (1 << SPI_CR2_RXDMAEN)) && !(DMA2_Stream0->CR & 1U));
+
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring), reply1, sizeof(reply1)) == SPI_READY);
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring), reply1, sizeof(reply1)) == SPI_BUSY_IN_SLAVE_DMA);
+	CHECK(SPI_SlaveSetReply(&s, reply2, 0) == SPI_ERROR_PARAM && s.pTxBuffer == reply1);
+	for (int f = 0; f < 4; f++) {
+		const uint8_t *pReply = (f < 2) ? reply1 : reply2;
+		uint32_t reply_len = (f < 2) ? sizeof(reply1) : sizeof(reply2);
+		int ok = 1;
+
+		for (uint32_t i = 0; i < lens[f]; i++) {
+			mosi[i] = expect[nexpect++] = (uint8_t)(f * 40 + i);
+		}
+		CHECK(master_frame(mosi, miso, lens[f]));
+		CHECK(frame_end[f] - (f ? frame_end[f - 1] : 0) == lens[f]);
+		for (uint32_t i = 0; i < lens[f]; i++) {
+			ok &= miso[i] == pReply[(i < reply_len) ? i : reply_len - 1];
+		}
+		CHECK(ok);
+	}
+	/* the 20-byte frame wrapped the 32-byte ring and came in parts */
+	CHECK(parts > 0);
+	CHECK(ngot == nexpect && memcmp(got, expect, nexpect) == 0);
+	SPI_SlaveStop(&s);
+	CHECK(s.RxState == SPI_READY);
+
+	/* no reply: every item of every frame is TxFill */
+	SPI_DeInit(&s);
+	SPI_Init(&s);
+	s.TxFill = 0x5A;
+	CHECK(SPI_SlaveStartDMA(&s, ring, sizeof(ring), NULL, 0) == SPI_READY);
+	for (int f = 0; f < 3; f++) {
+		int ok = 1;
+
+		CHECK(master_frame(mosi, miso, 6));
+		for (int i = 0; i < 6; i++) {
+			ok &= miso[i] == 0x5A;
+		}
+		CHECK(ok);
+	}
+	SPI_SlaveStop(&s);
+	CHECK(s.RxState == SPI_READY);
+	CHECK(errors == 0);
+	return SIM_TEST_END();
+}
@@ -0,0 +1,100 @@
+/*
+ * .bss zeroed by DMA2 Stream0 in the startup file (STARTUP_BSS_DMA_MIN): the register sequence
+ * of the startup code, run on the DMA model while the CPU copy of .data is charged alongside.
+ * The DMA column is measured; the sim cannot run Thumb code, so the two CPU loops are the
+ * Cortex-M4 TRM timings at 0 wait states, printed for comparison only. Once .bss is done the
+ * stream must be idle and the DMA2 clock as it was, also when AHB1ENR read 0 at entry.
+ */
+#include <string.h>
+#include "stm32f411xx.h"
+#include "sim.h"
+#include "sim_test.h"
+
+/* cycles per word: ldr/str loop, str loop, ldm/stm of 4 words, stm of 4 words */
+#define OLD_COPY_W 8.0
+#define OLD_ZERO_W 5.0
+#define NEW_COPY_W (13.0 / 4)
+#define NEW_ZERO_W (8.0 / 4)
+
+#define DMA_S0CR_ZERO 0x00005481U   /* memory to memory, word sizes, memory increment, EN */
+#define DMA_S0FCR_FIFO 0x07U        /* DMDIS, FTH full */
+#define DMA_LISR_S0_DONE 0x28U
+#define DMA_LIFCR_S0_ALL 0x3DU
+
+static uint32_t bss[65536 / 4];
+static const uint32_t zero;
+
+/*
+ * Reset_Handler from the .bss DMA start to BssDone, register for register: saved is r8, started
+ * r9. AHB1ENR reads 0 after reset and after boot_handoff, so the saved value cannot tell whether
+ * the stream was started. Returns the cycles from the start to the end of zeroing, the CPU busy
+ * with .data meanwhile
+ */
+static uint64_t startup_bss(uint32_t words, uint64_t cpu_busy)
+{
+	DMA_Stream_RegDef_t *s = DMA2_Stream0;
+	uint64_t t0 = sim_cycles();
+	uint32_t saved, started = 0, lisr;
+
+	saved = RCC->AHB1ENR;
+	RCC->AHB1ENR = saved | (1U << 22);
+	(void)RCC->AHB1ENR;
+	s->CR = 0;
+	while (s->CR & 1U) {}
+	DMA2->LIFCR = DMA_LIFCR_S0_ALL;
+	s->NDTR = words;
+	s->PAR = (uint32_t)(uintptr_t)&zero;
+	s->M0AR = (uint32_t)(uintptr_t)bss;
+	s->FCR = DMA_S0FCR_FIFO;
+	s->CR = DMA_S0CR_ZERO;
+	started = 1;
+
+	sim_run(cpu_busy);
+	if (!started) {
+		memset(bss, 0, words * 4);
+		return sim_cycles() - t0;
+	}
+	while (!((lisr = DMA2->LISR) & DMA_LISR_S0_DONE)) {}
+	DMA2->LIFCR = DMA_LIFCR_S0_ALL;
+	RCC->AHB1ENR = saved;
+	CHECK(!(lisr & (1U << 3)));
+	return sim_cycles() - t0;
+}
+
+int main(void)
+{
+	/* .data bytes, .bss bytes, DMA budget, AHB1ENR at entry */
+	static const uint32_t cases[][4] = {
+		{256, 4096, 4300, 0}, {1024, 4096, 4300, 0}, {4096, 4096, 4300, 0}, {8192, 2048, 6900, 0},
+		{1024, 16384, 16800, 0}, {1024, 4096, 4300, 0x1U},
+	};
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	sim_init();
+	printf("%7s %7s %8s | %8s %8s %8s\n", "data B", "bss B", "AHB1ENR", "ldr/str", "ldm/stm", "+dma");
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		double data_w = cases[i][0] / 4.0, bss_w = cases[i][1] / 4.0;
+		double old = data_w * OLD_COPY_W + bss_w * OLD_ZERO_W;
+		double ldm = data_w * NEW_COPY_W + bss_w * NEW_ZERO_W;
+		uint64_t dma;
+		int zeroed = 1;
+
+		memset(bss, 0xAA, sizeof(bss));
+		RCC->AHB1ENR = cases[i][3];
+		dma = startup_bss((uint32_t)bss_w, (uint64_t)(data_w * NEW_COPY_W));
+		printf("%7u %7u %8X | %8.0f %8.0f %8llu\n", (unsigned)cases[i][0], (unsigned)cases[i][1],
+		       (unsigned)cases[i][3], old, ldm, (unsigned long long)dma);
+		CHECK(dma <= cases[i][2]);
+
+		/* at BssDone: the stream is idle, DMA2 clocked as before, nothing written into .bss later */
+		CHECK(!(DMA2_Stream0->CR & 1U) && DMA2_Stream0->NDTR == 0 && DMA2->LISR == 0);
+		CHECK(RCC->AHB1ENR == cases[i][3]);
+		bss[0] = 0x55555555U;
+		sim_run(1000);
+		for (uint32_t k = 1; k < (uint32_t)bss_w; k++) {
+			zeroed &= bss[k] == 0;
+		}
+		CHECK(zeroed && bss[0] == 0x55555555U && bss[(uint32_t)bss_w] == 0xAAAAAAAAU);
+	}
+	return SIM_TEST_END();
+}
@@ -0,0 +1,309 @@
+#include "dma.h"
+#include "prof.h"
+#include "irq.h"
+#include <stddef.h>
+
+/*
+ * bit offset of the 6-bit flag group of stream 0..3 inside LISR (4..7 use the same offsets in HISR)
+ */
+static const uint8_t dma_flag_offset[4] = {0, 6, 16, 22};
+
+/*******************************************************************
+ * @fn          DMA_PeriClockControl
+ * @brief       Enable or disable the DMA controller clock
+ * @param[in]   pDMAx: DMA1 or DMA2
+ * @param[in]   EnorDi: ENABLE or DISABLE
+ * @return      None
+ * @note        None
+ */
+void DMA_PeriClockControl(DMA_RegDef_t *pDMAx, uint8_t EnorDi){
+    if(EnorDi == ENABLE){
+        if(pDMAx == DMA1){
+            DMA1_CLK_ENABLE();
+        } else if(pDMAx == DMA2){
+            DMA2_CLK_ENABLE();
+        }
+    } else {
+        if(pDMAx == DMA1){
+            DMA1_CLK_DISABLE();
+        } else if(pDMAx == DMA2){
+            DMA2_CLK_DISABLE();
+        }
+    }
+}
+
+/*******************************************************************
+ * @fn          DMA_Init
+ * @brief       Program the stream control register from the handle configuration
+ * @param[in]   pDMAHandle: handle of the stream
+ * @return      None
+ * @note        The stream is left disabled, transfers are started with DMA_Start/DMA_StartIT.
+ *              Direct mode is used (FIFO disabled), so peripheral and memory sizes should match
+ *              except for memory-to-memory transfers.
+ */
+void DMA_Init(DMA_Handle_t *pDMAHandle){
+    uint32_t tempreg = 0;
+
+    DMA_PeriClockControl(pDMAHandle->pDMAx, ENABLE);
+
+    //1. stream must be disabled before its configuration can be changed
+    DMA_Stop(pDMAHandle);
+
+    //2. channel selection
+    tempreg |= (pDMAHandle->DMA_Config.DMA_Channel & 0x7) << DMA_SxCR_CHSEL;
+    //3. direction
+    tempreg |= (pDMAHandle->DMA_Config.DMA_Direction & 0x3) << DMA_SxCR_DIR;
+    //4. address increment
+    if(pDMAHandle->DMA_Config.DMA_PeriphInc == ENABLE){
+        tempreg |= (1 << DMA_SxCR_PINC);
+    }
+    if(pDMAHandle->DMA_Config.DMA_MemInc == ENABLE){
+        tempreg |= (1 << DMA_SxCR_MINC);
+    }
+    //5. data size
+    tempreg |= (pDMAHandle->DMA_Config.DMA_PeriphDataSize & 0x3) << DMA_SxCR_PSIZE;
+    tempreg |= (pDMAHandle->DMA_Config.DMA_MemDataSize & 0x3) << DMA_SxCR_MSIZE;
+    //6. circular mode
+    if(pDMAHandle->DMA_Config.DMA_Mode == DMA_MODE_CIRCULAR){
+        tempreg |= (1 << DMA_SxCR_CIRC);
+    }
+    //7. priority
+    tempreg |= (pDMAHandle->DMA_Config.DMA_Priority & 0x3) << DMA_SxCR_PL;
+
+    pDMAHandle->pStream->CR = tempreg;
+
+    //8. direct mode (memory-to-memory requires the FIFO)
+    if(pDMAHandle->DMA_Config.DMA_Direction == DMA_DIR_MEM_TO_MEM){
+        pDMAHandle->pStream->FCR = (1 << DMA_SxFCR_DMDIS) | (0x3 << DMA_SxFCR_FTH);
+    } else {
+        pDMAHandle->pStream->FCR = 0;
+    }
+
+    DMA_ClearFlag(pDMAHandle, DMA_FLAG_ALL);
+}
+
+/*******************************************************************
+ * @fn          DMA_DeInit
+ * @brief       Disable the stream and put its registers back to reset values
+ * @param[in]   pDMAHandle: handle of the stream
+ * @return      None
+ * @note        The controller clock is kept, other streams may still be in use
+ */
+void DMA_DeInit(DMA_Handle_t *pDMAHandle){
+    DMA_Stop(pDMAHandle);
+    pDMAHandle->pStream->CR = 0;
+    pDMAHandle->pStream->NDTR = 0;
+    pDMAHandle->pStream->PAR = 0;
+    pDMAHandle->pStream->M0AR = 0;
+    pDMAHandle->pStream->M1AR = 0;
+    pDMAHandle->pStream->FCR = 0x21;
+    DMA_ClearFlag(pDMAHandle, DMA_FLAG_ALL);
+}
+
+/*******************************************************************
+ * @fn          DMA_Start
+ * @brief       Start a transfer without enabling stream interrupts (polling use)
+ * @param[in]   pDMAHandle: handle of the stream
+ * @param[in]   PeriphAddr: peripheral address (source for mem-to-mem)
+ * @param[in]   MemAddr: memory address
+ * @param[in]   len: number of data items (in units of the peripheral data size)
+ * @return      None
+ */
+void DMA_Start(DMA_Handle_t *pDMAHandle, uint32_t PeriphAddr, uint32_t MemAddr, uint32_t len){
+    DMA_Stream_RegDef_t *pStream = pDMAHandle->pStream;
+
+    pStream->CR &= ~(1 << DMA_SxCR_EN);
+    while(pStream->CR & (1 << DMA_SxCR_EN));
+
+    //flags of the previous transfer must be cleared before the stream can be enabled again
+    DMA_ClearFlag(pDMAHandle, DMA_FLAG_ALL);
+
+    pStream->PAR = PeriphAddr;
+    pStream->M0AR = MemAddr;
+    pStream->NDTR = len & 0xFFFF;
+
+    pStream->CR |= (1 << DMA_SxCR_EN);
+}
+
+/*******************************************************************
+ * @fn          DMA_StartIT
+ * @brief       Start a transfer with transfer-complete and error interrupts enabled
+ * @param[in]   pDMAHandle: handle of the stream
+ * @param[in]   PeriphAddr: peripheral address (source for mem-to-mem)
+ * @param[in]   MemAddr: memory address
+ * @param[in]   len: number of data items
+ * @return      None
+ * @note        In circular mode the half-transfer interrupt is enabled too
+ */
+void DMA_StartIT(DMA_Handle_t *pDMAHandle, uint32_t PeriphAddr, uint32_t MemAddr, uint32_t len){
+    DMA_Stream_RegDef_t *pStream = pDMAHandle->pStream;
+
+    pStream->CR &= ~(1 << DMA_SxCR_EN);
+    while(pStream->CR & (1 << DMA_SxCR_EN));
+
+    DMA_ClearFlag(pDMAHandle, DMA_FLAG_ALL);
+
+    pStream->PAR = PeriphAddr;
+    pStream->M0AR = MemAddr;
+    pStream->NDTR = len & 0xFFFF;
+
+    pStream->CR |= (1 << DMA_SxCR_TCIE) | (1 << DMA_SxCR_TEIE) | (1 << DMA_SxCR_DMEIE);
+    if(pStream->CR & (1 << DMA_SxCR_CIRC)){
+        pStream->CR |= (1 << DMA_SxCR_HTIE);
+    }
+
+    pStream->CR |= (1 << DMA_SxCR_EN);
+}
+
+/*******************************************************************
+ * @fn          DMA_Stop
+ * @brief       Disable the stream and wait until the hardware has released it
+ * @param[in]   pDMAHandle: handle of the stream
+ * @return      None
+ */
+void DMA_Stop(DMA_Handle_t *pDMAHandle){
+    pDMAHandle->pStream->CR &= ~((1 << DMA_SxCR_EN) | (1 << DMA_SxCR_TCIE) | (1 << DMA_SxCR_HTIE)
+                                | (1 << DMA_SxCR_TEIE) | (1 << DMA_SxCR_DMEIE));
+    //EN reads back as 1 until the current single transfer is finished
+    while(pDMAHandle->pStream->CR & (1 << DMA_SxCR_EN));
+}
+
+/*******************************************************************
+ * @fn          DMA_GetRemaining
+ * @brief       Number of data items left to transfer (NDTR)
+ * @param[in]   pDMAHandle: handle of the stream
+ * @return      remaining items
+ */
+uint32_t DMA_GetRemaining(DMA_Handle_t *pDMAHandle){
+    return pDMAHandle->pStream->NDTR & 0xFFFF;
+}
+
+/*******************************************************************
+ * @fn          DMA_GetFlagStatus
+ * @brief       Check one of the stream flags
+ * @param[in]   pDMAHandle: handle of the stream
+ * @param[in]   FlagName: DMA_FLAG_TC, DMA_FLAG_HT, DMA_FLAG_TE, ...
+ * @return      FLAG_SET or FLAG_RESET
+ */
+uint8_t DMA_GetFlagStatus(DMA_Handle_t *pDMAHandle, uint32_t FlagName){
+    uint32_t isr;
+    uint8_t stream = pDMAHandle->StreamNumber & 0x7;
+
+    isr = (stream < 4) ? pDMAHandle->pDMAx->LISR : pDMAHandle->pDMAx->HISR;
+    if(isr & (FlagName << dma_flag_offset[stream & 0x3])){
+        return FLAG_SET;
+    }
+    return FLAG_RESET;
+}
+
+/*******************************************************************
+ * @fn          DMA_ClearFlag
+ * @brief       Clear stream flags through LIFCR/HIFCR
+ * @param[in]   pDMAHandle: handle of the stream
+ * @param[in]   FlagName: one or more DMA_FLAG_x or'ed together
+ * @return      None
+ */
+void DMA_ClearFlag(DMA_Handle_t *pDMAHandle, uint32_t FlagName){
+    uint8_t stream = pDMAHandle->StreamNumber & 0x7;
+
+    if(stream < 4){
+        pDMAHandle->pDMAx->LIFCR = (FlagName << dma_flag_offset[stream]);
+    } else {
+        pDMAHandle->pDMAx->HIFCR = (FlagName << dma_flag_offset[stream - 4]);
+    }
+}
+
+/*
+ * IRQ Configuration and ISR handling
+ */
+void DMA_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi){
+    if(EnorDi == ENABLE){
+        if(IRQNumber <= 31){
+            *NVIC_ISER0 = (1 << IRQNumber);
+        } else if(IRQNumber < 64){
+            *NVIC_ISER1 = (1 << (IRQNumber % 32));
+        } else if(IRQNumber < 96){
+            *NVIC_ISER2 = (1 << (IRQNumber % 64));
+        }
+    } else {
+        if(IRQNumber <= 31){
+            *NVIC_ICER0 = (1 << IRQNumber);
+        } else if(IRQNumber < 64){
+            *NVIC_ICER1 = (1 << (IRQNumber % 32));
+        } else if(IRQNumber < 96){
+            *NVIC_ICER2 = (1 << (IRQNumber % 64));
+        }
+    }
+}
+
+void DMA_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority){
+    uint8_t iprx = IRQNumber / 4;
+    uint8_t iprx_section = IRQNumber % 4;
+    uint8_t shift_amount = (8 * iprx_section) + (8 - NO_PR_BITS_IMPLEMENTED);
+
+    *(NVIC_PR_BASE_ADDRESS + iprx) &= ~(0xFF << (8 * iprx_section));
+    *(NVIC_PR_BASE_ADDRESS + iprx) |= (IRQPriority << shift_amount);
+}
+
+/*******************************************************************
+ * @fn          DMA_IRQHandling
+ * @brief       Stream interrupt handling, call from DMAx_Streamy_IRQHandler
+ * @param[in]   pDMAHandle: handle of the stream
+ * @return      None
+ * @note        Flags are cleared before the callback so the callback may restart the stream
+ */
+void DMA_IRQHandling(DMA_Handle_t *pDMAHandle){
+    PROF_ENTER();
+    uint32_t cr = pDMAHandle->pStream->CR;
+
+    if((cr & (1 << DMA_SxCR_TEIE)) && DMA_GetFlagStatus(pDMAHandle, DMA_FLAG_TE)){
+        DMA_ClearFlag(pDMAHandle, DMA_FLAG_TE);
+        if(pDMAHandle->Callback != NULL){
+            pDMAHandle->Callback(pDMAHandle, DMA_EVENT_ERROR);
+        }
+    }
+
+    if((cr & (1 << DMA_SxCR_DMEIE)) && DMA_GetFlagStatus(pDMAHandle, DMA_FLAG_DME)){
+        DMA_ClearFlag(pDMAHandle, DMA_FLAG_DME);
+        //not fatal: EN stays set and TC still comes, owners must not treat it as the end
+        if(pDMAHandle->Callback != NULL){
+            pDMAHandle->Callback(pDMAHandle, DMA_EVENT_DIRECT_MODE_ERROR);
+        }
+    }
+
+    if((cr & (1 << DMA_SxCR_HTIE)) && DMA_GetFlagStatus(pDMAHandle, DMA_FLAG_HT)){
+        DMA_ClearFlag(pDMAHandle, DMA_FLAG_HT);
+        if(pDMAHandle->Callback != NULL){
+            pDMAHandle->Callback(pDMAHandle, DMA_EVENT_HALF_CMPLT);
+        }
+    }
+
+    if((cr & (1 << DMA_SxCR_TCIE)) && DMA_GetFlagStatus(pDMAHandle, DMA_FLAG_TC)){
+        DMA_ClearFlag(pDMAHandle, DMA_FLAG_TC);
+        if(!(cr & (1 << DMA_SxCR_CIRC))){
+            //normal mode: the stream disabled itself, stop further interrupts
+            pDMAHandle->pStream->CR &= ~((1 << DMA_SxCR_TCIE) | (1 << DMA_SxCR_HTIE));
+        }
+        if(pDMAHandle->Callback != NULL){
+            pDMAHandle->Callback(pDMAHandle, DMA_EVENT_CMPLT);
+        }
+    }
+    PROF_EXIT(PROF_ID_DMA_IRQ);
+}
+
+/* IRQ_Dispatch passes the handle registered with the IRQ (irq.h) */
+static void dma_irq_entry(void *pContext){
+    DMA_IRQHandling((DMA_Handle_t *)pContext);
+}
+
+/*******************************************************************
+ * @fn          DMA_IRQRegister
+ * @brief       Route the stream IRQ straight to DMA_IRQHandling of this handle
+ * @param[in]   pDMAHandle: handle of the stream
+ * @param[in]   IRQNumber: IRQ_NO_DMAx_STREAMy
+ * @return      None
+ * @note        IRQ_Init must have moved the vector table to SRAM
+ */
+void DMA_IRQRegister(DMA_Handle_t *pDMAHandle, uint8_t IRQNumber){
+    IRQ_Register(IRQNumber, dma_irq_entry, pDMAHandle);
+}
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include "gpio.h"
+#include "prof.h"
 #include <string.h>
 
 void GPIO_PeriClockControl(GPIO_RegDef_t *pGPIOx, uint8_t EnOrDi){
@@ -44,7 +45,7 @@ void GPIO_PeriClockControl(GPIO_RegDef_t *pGPIOx, uint8_t EnOrDi){
 void GPIO_Init(GPIO_Handle_t *pGPIOHandle){
     uint32_t temp;
     //1.config mode
-    if(pGPIOHandle->GPIO_PinConfig.GPIO_PinMode == GPIO_MODE_ANALOG){
+    if(pGPIOHandle->GPIO_PinConfig.GPIO_PinMode <= GPIO_MODE_ANALOG){
         //non interupt mode
         temp = (pGPIOHandle->GPIO_PinConfig.GPIO_PinMode << (2 * pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber));
         pGPIOHandle->pGPIOx->MODER &= ~(0x3 << (2 * pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber)); //clearing
@@ -87,8 +88,8 @@ void GPIO_Init(GPIO_Handle_t *pGPIOHandle){
 
     temp = 0;
     //3.config output type
-    temp = (pGPIOHandle->GPIO_PinConfig.GPIO_PinOutputType<< (2 * pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber));
-    pGPIOHandle->pGPIOx->OTYPER &= ~(0x3 << (2 * pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber)); //clearing
+    temp = (pGPIOHandle->GPIO_PinConfig.GPIO_PinOutputType << pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber);
+    pGPIOHandle->pGPIOx->OTYPER &= ~(0x1 << pGPIOHandle->GPIO_PinConfig.GPIO_PinNumber); //clearing, one bit per pin
     pGPIOHandle->pGPIOx->OTYPER |= temp;
 
     temp = 0;
@@ -194,9 +195,12 @@ void GPIO_IRQInterruptConfiguration(uint8_t IRQPriority, uint8_t PinNumber){
 
 }
 void GPIO_IRQHandling(uint8_t PinNumber){
-    //clear exti pr register corresponding to pin number
+    PROF_ENTER();
+    //clear exti pr register corresponding to pin number, write 1 to clear: |= would also clear
+    //every other pending line
     if(EXTI->PR & (1 << PinNumber)){
-        EXTI->PR |= (1 << PinNumber);
+        EXTI->PR = (1 << PinNumber);
     }
+    PROF_EXIT(PROF_ID_GPIO_IRQ);
 }
 
@@ -1,7 +1,13 @@
 #include "i2c.h"
+#include "prof.h"
+#include "irq.h"
 #include <stddef.h>
 
 static void I2C_ManageAcking(I2C_RegDef_t* pI2Cx, uint8_t EnorDi);
+static void i2c_notify(I2C_Handle_t *pI2CHandle, uint8_t AppEv);
+static void i2c_error(I2C_Handle_t *pI2CHandle, uint8_t AppEv);
+static void i2c_dma_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+static void i2c_dma_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
  /*
  */
 void I2C_PeriClockControl(I2C_RegDef_t *pI2Cx, uint8_t EnorDi){
@@ -39,45 +45,56 @@ void I2C_Init(I2C_Handle_t *pI2CHandle){
     I2C_PeriClockControl(pI2CHandle->pI2Cx, ENABLE);
     //1.config mode (standard or fast)
     //2. config the speed of i2c_scl: using CR2 and CCR for config clock setting and other time like hold time and setup time
-    tempreg = 0;
-    tempreg |= RCC_GetPCLK1Value()/ 1000000U;
-    pI2CHandle->pI2Cx->CR2 |= tempreg&0x3F;
+    //FREQ field = PCLK1 in MHz, it is rewritten so a changed system clock is picked up
+    uint32_t pclk1 = RCC_GetPCLK1Value();
+    tempreg = pI2CHandle->pI2Cx->CR2 & ~0x3F;
+    tempreg |= (pclk1 / 1000000U) & 0x3F;
+    pI2CHandle->pI2Cx->CR2 = tempreg;
 
     uint16_t ccr = 0;
     tempreg = 0;
 
-    if(pI2CHandle->I2C_Config.I2C_SckSpeed < I2C_SCL_SPEED_SM){
-        //mode is standard mode
-        ccr = RCC_GetPCLK1Value()/(2*pI2CHandle->I2C_Config.I2C_SckSpeed);
+    if(pI2CHandle->I2C_Config.I2C_SckSpeed <= I2C_SCL_SPEED_SM){
+        //mode is standard mode: Thigh = Tlow = CCR * Tpclk1
+        ccr = pclk1/(2*pI2CHandle->I2C_Config.I2C_SckSpeed);
+        if(ccr < 4){
+            ccr = 4;//minimum allowed in standard mode
+        }
         tempreg |= ccr&0xfff;
     } else {
         //mode is Fast mode
         tempreg |= (1<<15);//fast mode enable
         tempreg |= (pI2CHandle->I2C_Config.I2C_FMDutyCycle<<14);//duty cycle
         if(pI2CHandle->I2C_Config.I2C_FMDutyCycle == I2C_FM_DUTY_2){
-            ccr = RCC_GetPCLK1Value()/(3*pI2CHandle->I2C_Config.I2C_SckSpeed);
+            //Tlow/Thigh = 2, period = 3 * CCR * Tpclk1
+            ccr = pclk1/(3*pI2CHandle->I2C_Config.I2C_SckSpeed);
         } else {
-            ccr = RCC_GetPCLK1Value()/(2*pI2CHandle->I2C_Config.I2C_SckSpeed);
+            //Tlow/Thigh = 16/9, period = 25 * CCR * Tpclk1
+            ccr = pclk1/(25*pI2CHandle->I2C_Config.I2C_SckSpeed);
+        }
+        if(ccr < 1){
+            ccr = 1;
         }
         tempreg |= (ccr&0xFFF);
-        pI2CHandle->pI2Cx->CCR = tempreg;
     }
+    pI2CHandle->pI2Cx->CCR = tempreg;
     //3. config the device address
     tempreg = (pI2CHandle->I2C_Config.I2C_DeviceAddress<<1);
-    //4. enable Acking
-    tempreg = (pI2CHandle->I2C_Config.I2C_AckControl << 10);
     tempreg |= (1<<14);//requied in I2C_OAR1 register
-    pI2CHandle->pI2Cx->CR1 |= tempreg;
-    //5. config rise time
-    if(pI2CHandle->I2C_Config.I2C_SckSpeed < I2C_SCL_SPEED_SM){
-        //mode is standard mode
-        trise = RCC_GetPCLK1Value()/1000000U  + 1;
+    pI2CHandle->pI2Cx->OAR1 = tempreg;
+    //4. config rise time
+    if(pI2CHandle->I2C_Config.I2C_SckSpeed <= I2C_SCL_SPEED_SM){
+        //mode is standard mode, max rise time 1000 ns
+        trise = pclk1/1000000U  + 1;
 
     } else {
-        //mode is Fast mode
-        trise = RCC_GetPCLK1Value()*300/100000000U  + 1;//refer I2C manual for these specification
+        //mode is Fast mode, max rise time 300 ns
+        trise = (pclk1/1000000U)*300/1000U  + 1;//refer I2C manual for these specification
     }
     pI2CHandle->pI2Cx->TRISE = trise & 0x3F;
+    //5. enable the peripheral, then Acking: ACK is held at 0 while PE is 0
+    pI2CHandle->pI2Cx->CR1 |= (1<<I2C_CR1_PE);
+    I2C_ManageAcking(pI2CHandle->pI2Cx, pI2CHandle->I2C_Config.I2C_AckControl);
 }
 void I2C_DeInit(I2C_Handle_t *pI2CHandle){
     if (pI2CHandle->pI2Cx == I2C1)
@@ -109,77 +126,172 @@ uint8_t getFlagStatus(I2C_RegDef_t *pI2Cx, uint32_t FlagName){
 
     return FLAG_RESET;
 }
-void I2C_GenerateStartCondition(I2C_RegDef_t *pI2Cx){
+void I2C_GenerateStopCondition(I2C_RegDef_t *pI2Cx);
+
+/*
+ * wait for a pending STOP, each loop reads CR1 over APB1: at least 80 us at PCLK1 50 MHz,
+ * 8 SCL periods in standard mode
+ */
+#define I2C_STOP_WAIT_LOOPS 2000U
+
+/*
+ * returns FLAG_RESET when the STOP of the previous transfer did not go out (SCL held low), no START then
+ */
+RAMFUNC uint8_t I2C_GenerateStartCondition(I2C_RegDef_t *pI2Cx){
+    //a transfer chained from the completion of the previous one: its STOP goes out first (a few us),
+    //START set while STOP is pending is not generated reliably. Bounded: this runs in the event
+    //interrupt when the transfer is chained from a callback
+    for(uint32_t n = I2C_STOP_WAIT_LOOPS; pI2Cx->CR1 & (1<<I2C_CR1_STOP); n--){
+        if(n == 0){
+            return FLAG_RESET;
+        }
+    }
     pI2Cx->CR1 |= (1<<I2C_CR1_START);//generate start condition
+    return FLAG_SET;
 }
 
 void I2C_ExecuteAddressPhase(I2C_RegDef_t *pI2Cx, uint8_t SlaveAddress, uint8_t Direction){
     SlaveAddress = SlaveAddress << 1;
-    SlaveAddress &= Direction;//redudancy ^-^  transfer data = 7bit address + 1bit r/nw
+    SlaveAddress |= Direction;//transfer data = 7bit address + 1bit r/nw
     pI2Cx->DR = SlaveAddress;//send slave address
 }
 
 void I2C_ClearADDRFlag(I2C_Handle_t *pI2CHandle){
-    //check device mode
-    if(pI2CHandle->pI2Cx->CR2 & (1<<I2C_SR2_MSL)){
-        //master mode
-        if(pI2CHandle->TxRxState == I2C_BUSY_IN_RX){
-            if(pI2CHandle->RxSize == 1){
-                //fist disable ACK
-                I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
-                //clear ADDR flag
-                //cleared by: read SR1 and then read SR2
-                uint8_t dummy_read = pI2CHandle->pI2Cx->SR1;
-                dummy_read = pI2CHandle->pI2Cx->SR2;//read sr1 and sr2 to clear ADDR flag
-                (void)dummy_read;
-            }
-        }
-        else {
-                uint8_t dummy_read = pI2CHandle->pI2Cx->SR1;
-                dummy_read = pI2CHandle->pI2Cx->SR2;//read sr1 and sr2 to clear ADDR flag
-                (void)dummy_read;
+    uint32_t dummy_read;
+    //the mode is taken from the handle: reading SR2 for MSL would already clear ADDR
+    uint8_t rx = (pI2CHandle->TxRxState == I2C_BUSY_IN_RX);
+
+    if(rx && pI2CHandle->RxSize == 1){
+        //the only byte is clocked in as soon as ADDR is cleared, its NACK must be armed before
+        I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
+    }
+    //cleared by: read SR1 and then read SR2
+    dummy_read = pI2CHandle->pI2Cx->SR1;
+    dummy_read = pI2CHandle->pI2Cx->SR2;
+    (void)dummy_read;
+
+    if(rx && pI2CHandle->RxSize == 1){
+        //STOP right after ADDR, it goes out after the NACKed byte (RM)
+        if(pI2CHandle->sr == I2C_DISABLE_SR){
+            I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
         }
-    }else {
-        //slave mode
-        uint8_t dummy_read = pI2CHandle->pI2Cx->SR1;
-        dummy_read = pI2CHandle->pI2Cx->SR2;//read sr1 and sr2 to clear ADDR flag
-        (void)dummy_read;
+    } else if(rx && pI2CHandle->RxSize == 2){
+        //POS is set: clearing ACK now NACKs the second byte, not the first
+        I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
     }
 }
 
 void I2C_GenerateStopCondition(I2C_RegDef_t *pI2Cx){
     pI2Cx->CR1 |= (1<<I2C_CR1_STOP);//generate stop condition
 }
-void I2C_MasterSendData(I2C_Handle_t *pI2CHandle, uint8_t *pTxBuffer, uint32_t len, uint8_t SlaveAddress){
+/*
+ * START and address with write direction, returns with ADDR cleared and the bus held
+ */
+static void i2c_master_start_write(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress){
     //1. generate start condition
     I2C_GenerateStartCondition(pI2CHandle->pI2Cx);
     //2. confirm that start condition is generated successfully by checking the SB flag in the SB1 register
     //Note: until SB(start bit) is cleared by software(clear default value from 0 to 1), SCL will be stretch to low
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_SB));
+    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_FLAG_SB));
     //3. send slave address with write direction bit (total 8 bits)
     I2C_ExecuteAddressPhase(pI2CHandle->pI2Cx, SlaveAddress, I2C_WRITE);
     //4. confirm that address phase is completed by checking the ADDR flag in the SR1 register
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_ADDR));
+    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_FLAG_ADDR));
     //5. clear ADDR flag according to its software sequence
     //Note: Until ADDR is cleared by software(clear default value from 0 to 1), SCL will be stretch to low
     I2C_ClearADDRFlag(pI2CHandle);
+}
+
+static void i2c_master_write_bytes(I2C_RegDef_t *pI2Cx, const uint8_t *pTxBuffer, uint32_t len){
     //6. send data until len become 0
     while(len>0){
-        while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_TXE));//wait till txe is set
-        pI2CHandle->pI2Cx->DR = (*pTxBuffer & 0xFF);
+        while(!getFlagStatus(pI2Cx, I2C_FLAG_TXE));//wait till txe is set
+        pI2Cx->DR = (*pTxBuffer & 0xFF);
         len--;
         pTxBuffer++;
     }
+}
+
+static void i2c_master_wait_btf(I2C_RegDef_t *pI2Cx){
     //7. when len become 0, wait for TXE = 0 and BTF = 1(Byte transfer finished) before generating stop condition
     //Note: TXE = 1, BTF = 1 means that both DR and SR are empty and next transmission is possible
     //When BTF = 1 then SCL pulled to LOW
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_TXE));
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_BTF));
+    while(!getFlagStatus(pI2Cx, I2C_FLAG_TXE));
+    while(!getFlagStatus(pI2Cx, I2C_FLAG_BTF));
+}
+
+/*
+ * register address of a memory access, most significant byte first
+ */
+static uint8_t i2c_mem_address(uint8_t *pBuffer, uint16_t MemAddress, uint8_t MemAddSize){
+    if(MemAddSize == I2C_MEMADD_SIZE_16BIT){
+        pBuffer[0] = (uint8_t)(MemAddress >> 8);
+        pBuffer[1] = (uint8_t)MemAddress;
+        return 2;
+    }
+    pBuffer[0] = (uint8_t)MemAddress;
+    return 1;
+}
+
+void I2C_MasterSendData(I2C_Handle_t *pI2CHandle, uint8_t *pTxBuffer, uint32_t len, uint8_t SlaveAddress){
+    PROF_ENTER();
+    i2c_master_start_write(pI2CHandle, SlaveAddress);
+    i2c_master_write_bytes(pI2CHandle->pI2Cx, pTxBuffer, len);
+    i2c_master_wait_btf(pI2CHandle->pI2Cx);
     //8. generate stop condition and master have to wait for completion of stop condition
     //Note: generation stop condition, automatically clears BTF flag
     I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
+    PROF_EXIT(PROF_ID_I2C_MASTER_SEND);
+}
+
+/*******************************************************************
+ * @fn          I2C_MemWrite
+ * @brief       Write registers of a device: address, register address and data in one transfer
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   MemAddress: first register
+ * @param[in]   MemAddSize: @I2C_MemAddSize
+ * @param[in]   pData: data to write
+ * @param[in]   len: number of bytes
+ * @return      None
+ * @note        Blocking, the data follows the register address without a copy into one buffer
+ */
+void I2C_MemWrite(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                  const uint8_t *pData, uint32_t len){
+    uint8_t mem[2];
+    uint8_t memlen = i2c_mem_address(mem, MemAddress, MemAddSize);
+
+    i2c_master_start_write(pI2CHandle, SlaveAddress);
+    i2c_master_write_bytes(pI2CHandle->pI2Cx, mem, memlen);
+    i2c_master_write_bytes(pI2CHandle->pI2Cx, pData, len);
+    i2c_master_wait_btf(pI2CHandle->pI2Cx);
+    I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
 }
 
+/*******************************************************************
+ * @fn          I2C_MemRead
+ * @brief       Read registers of a device: register address written, then read after a repeated start
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   MemAddress: first register
+ * @param[in]   MemAddSize: @I2C_MemAddSize
+ * @param[out]  pData: received data
+ * @param[in]   len: number of bytes
+ * @return      None
+ * @note        Blocking, one bus transaction: no STOP/START pair between the two phases, the
+ *              bus cannot be taken by another master in between
+ */
+void I2C_MemRead(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                 uint8_t *pData, uint32_t len){
+    uint8_t mem[2];
+    uint8_t memlen = i2c_mem_address(mem, MemAddress, MemAddSize);
+
+    i2c_master_start_write(pI2CHandle, SlaveAddress);
+    i2c_master_write_bytes(pI2CHandle->pI2Cx, mem, memlen);
+    i2c_master_wait_btf(pI2CHandle->pI2Cx);
+    //the START of the read is the repeated start, SCL is held low by BTF until then
+    I2C_MasterReceiveData(pI2CHandle, pData, len, SlaveAddress);
+}
 
 void I2C_ManageAcking(I2C_RegDef_t* pI2Cx, uint8_t EnorDi){
     if(EnorDi == I2C_SCK_ACK_ENABLE){
@@ -189,60 +301,61 @@ void I2C_ManageAcking(I2C_RegDef_t* pI2Cx, uint8_t EnorDi){
     }
 }
 void I2C_MasterReceiveData(I2C_Handle_t *pI2CHandle, uint8_t *pRxBuffer, uint32_t len, uint8_t SlaveAddress){
+    I2C_RegDef_t *pI2Cx = pI2CHandle->pI2Cx;
+    PROF_ENTER();
+    //ACK/NACK is decided while a byte is received: the sequence depends on the length (RM 1/2/N bytes)
+    if(len == 2){
+        //POS: the ACK bit applies to the next byte, so the NACK lands on the second one
+        pI2Cx->CR1 |= (1<<I2C_CR1_POS);
+    }
+    I2C_ManageAcking(pI2Cx, I2C_SCK_ACK_ENABLE);
     //1. generate start condition
-    I2C_GenerateStartCondition(pI2CHandle->pI2Cx);
-    //2. confirm that stop condition is generated successfully by checking the SB flag in the SB1 register
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_SB));
-    //3. send slave address with write direction bit (total 8 bits)
-    I2C_ExecuteAddressPhase(pI2CHandle->pI2Cx, SlaveAddress, I2C_WRITE);
+    I2C_GenerateStartCondition(pI2Cx);
+    //2. confirm that start condition is generated successfully by checking the SB flag in the SB1 register
+    while(!getFlagStatus(pI2Cx, I2C_FLAG_SB));
+    //3. send slave address with read direction bit (total 8 bits)
+    I2C_ExecuteAddressPhase(pI2Cx, SlaveAddress, I2C_READ);
     //4. confirm that address phase is completed by checking the ADDR flag in the SR1 register
-    while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_ADDR));
+    while(!getFlagStatus(pI2Cx, I2C_FLAG_ADDR));
 
-    //5. read only 1 byte from slave
-    if(len==1){
-        //disable Acking
-        I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
-        //clear the addr flag
+    if(len == 1){
+        //5. read only 1 byte from slave: NACK armed before ADDR is cleared, STOP right after
+        I2C_ManageAcking(pI2Cx, I2C_SCK_ACK_DISABLE);
         I2C_ClearADDRFlag(pI2CHandle);
+        I2C_GenerateStopCondition(pI2Cx);
         //wait until RXNE become 1
-        //automatically set when a byte data completely received into DR (Data Register) from slave.
-        while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_RXNE));
-        //generate end condition
-        I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
-
-        //read data into buffer
-        *pRxBuffer = pI2CHandle->pI2Cx->DR;
-        return;
-    }
-
-    //5. read when read many bytes from slave
-    if(len>1){
-        //clear ADDr Flag
-        //read data until len = 0;
-        for(int i=0; i<len; i++){
-            //wait until RXNE becomes 1
-            while(!getFlagStatus(pI2CHandle->pI2Cx, I2C_SR1_RXNE));
-            //Note: không ACK byte cuối, byte cuối được NACK
-            //ack: finish reading a byte, nack: finish reading transmission(many bytes)
-            //Note: now finish receive The data  before the last one so the next setting is applied for the last
-            //but if you want using i==len-1 then you have to reverse the order of the loop with wating RXNE setting statement(NOT ASSURE TO WORK)
-            if(i==len-2){//if last 2 bytes remain
-                //clear ack bit
-                I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
-                //generate stop condition
-                I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
-            }
-            //read data from DR reg into buffer
-            *pRxBuffer = pI2CHandle->pI2Cx->DR;
-            //increment buffer address
-            pRxBuffer++;
+        while(!getFlagStatus(pI2Cx, I2C_FLAG_RXNE));
+        *pRxBuffer = pI2Cx->DR;
+    } else if(len == 2){
+        //5. 2 bytes: both are read once BTF says DR and the shift register are full
+        I2C_ClearADDRFlag(pI2CHandle);
+        I2C_ManageAcking(pI2Cx, I2C_SCK_ACK_DISABLE);
+        while(!getFlagStatus(pI2Cx, I2C_FLAG_BTF));
+        I2C_GenerateStopCondition(pI2Cx);
+        pRxBuffer[0] = pI2Cx->DR;
+        pRxBuffer[1] = pI2Cx->DR;
+        pI2Cx->CR1 &= ~(1<<I2C_CR1_POS);
+    } else if(len > 2){
+        //5. N bytes: byte by byte until 3 are left, then the last three with BTF
+        I2C_ClearADDRFlag(pI2CHandle);
+        while(len > 3){
+            while(!getFlagStatus(pI2Cx, I2C_FLAG_RXNE));
+            *pRxBuffer++ = pI2Cx->DR;
+            len--;
         }
+        //data N-2 in DR, N-1 in the shift register, SCL stretched: N is the byte to NACK
+        while(!getFlagStatus(pI2Cx, I2C_FLAG_BTF));
+        I2C_ManageAcking(pI2Cx, I2C_SCK_ACK_DISABLE);
+        *pRxBuffer++ = pI2Cx->DR;
+        //data N-1 in DR, N in the shift register
+        while(!getFlagStatus(pI2Cx, I2C_FLAG_BTF));
+        I2C_GenerateStopCondition(pI2Cx);
+        *pRxBuffer++ = pI2Cx->DR;
+        *pRxBuffer = pI2Cx->DR;
     }
     //re-enable Acking
-    if(pI2CHandle->I2C_Config.I2C_AckControl == I2C_SCK_ACK_ENABLE){
-            I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_ENABLE);
-    }
-
+    I2C_ManageAcking(pI2Cx, pI2CHandle->I2C_Config.I2C_AckControl);
+    PROF_EXIT(PROF_ID_I2C_MASTER_RECEIVE);
 }
 void I2C_EnableITBUFEN(I2C_RegDef_t* pI2Cx){
     pI2Cx->CR2 |= (1<<I2C_CR2_ITBUFEN);
@@ -265,7 +378,96 @@ void I2C_DisableITERREN(I2C_RegDef_t* pI2Cx){
 }
 
 
+/*
+ * stream of one direction of a master transfer, bytes to or from DR
+ */
+static void i2c_dma_setup(I2C_Handle_t *pI2CHandle, DMA_Handle_t *pDMAHandle, uint32_t Direction,
+                          DMA_Callback_t Callback){
+    pDMAHandle->DMA_Config.DMA_Direction = Direction;
+    pDMAHandle->DMA_Config.DMA_PeriphInc = DISABLE;
+    pDMAHandle->DMA_Config.DMA_MemInc = ENABLE;
+    pDMAHandle->DMA_Config.DMA_PeriphDataSize = DMA_SIZE_BYTE;
+    pDMAHandle->DMA_Config.DMA_MemDataSize = DMA_SIZE_BYTE;
+    pDMAHandle->DMA_Config.DMA_Mode = DMA_MODE_NORMAL;
+    //one byte per 9 SCL periods: any priority keeps up
+    pDMAHandle->DMA_Config.DMA_Priority = DMA_PRIORITY_MEDIUM;
+    pDMAHandle->Callback = Callback;
+    pDMAHandle->pParent = pI2CHandle;
+    DMA_Init(pDMAHandle);
+}
+
+/*
+ * data of a master write: DMA for more than 2 bytes when the handle has a stream, TXE interrupts otherwise
+ */
+static void i2c_master_tx_arm(I2C_Handle_t *pI2CHandle){
+    if(pI2CHandle->pTxDMA != NULL && pI2CHandle->TxLen > 2){
+        //DMA feeds DR once ADDR is cleared, the end is the BTF of the last byte
+        i2c_dma_setup(pI2CHandle, pI2CHandle->pTxDMA, DMA_DIR_MEM_TO_PERIPH, i2c_dma_tx_callback);
+        pI2CHandle->pTxDMA->pStream->CR |= (1 << DMA_SxCR_TEIE);
+        DMA_Start(pI2CHandle->pTxDMA, (uint32_t)(uintptr_t)&pI2CHandle->pI2Cx->DR, (uint32_t)(uintptr_t)pI2CHandle->pTxBuffer,
+                  pI2CHandle->TxLen);
+        pI2CHandle->TxLen = 0;
+        pI2CHandle->pI2Cx->CR2 |= (1<<I2C_CR2_DMAEN);
+    } else {
+        //enable ITBUFEN contorl bit
+        I2C_EnableITBUFEN(pI2CHandle->pI2Cx);
+    }
+}
+
+static void i2c_master_tx_start(I2C_Handle_t *pI2CHandle){
+    i2c_master_tx_arm(pI2CHandle);
+    //enable ITEVTEN control bit
+    I2C_EnableITEVTEN(pI2CHandle->pI2Cx);
+    //enable ITERREN control bit
+    I2C_EnableITERREN(pI2CHandle->pI2Cx);
+    //start condition last, everything is ready for its SB interrupt
+    if(I2C_GenerateStartCondition(pI2CHandle->pI2Cx) == FLAG_RESET){
+        i2c_error(pI2CHandle, I2C_ERROR_TIMEOUT);
+    }
+}
+
+/*
+ * master read from its START on, also the repeated START of I2C_MemReadIT. RXNE interrupts
+ * (ITBUFEN) are only turned on at SB, a write before it may still have TXE set.
+ */
+static void i2c_master_rx_start(I2C_Handle_t *pI2CHandle){
+    //every byte but the last is ACKed, whatever I2C_AckControl says
+    I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_ENABLE);
+    if(pI2CHandle->RxLen == 2){
+        //POS: the ACK bit applies to the next byte, so the NACK lands on the second one
+        pI2CHandle->pI2Cx->CR1 |= (1<<I2C_CR1_POS);
+    } else if(pI2CHandle->pRxDMA != NULL && pI2CHandle->RxLen > 2){
+        i2c_dma_setup(pI2CHandle, pI2CHandle->pRxDMA, DMA_DIR_PERIPH_TO_MEM, i2c_dma_rx_callback);
+        DMA_StartIT(pI2CHandle->pRxDMA, (uint32_t)(uintptr_t)&pI2CHandle->pI2Cx->DR, (uint32_t)(uintptr_t)pI2CHandle->pRxBuffer,
+                    pI2CHandle->RxLen);
+        pI2CHandle->pI2Cx->CR2 |= (1<<I2C_CR2_DMAEN) | (1<<I2C_CR2_LAST);
+    }
+    //enable ITEVTEN control bit
+    I2C_EnableITEVTEN(pI2CHandle->pI2Cx);
+    //enable ITERREN control bit
+    I2C_EnableITERREN(pI2CHandle->pI2Cx);
+    //start condition last, everything is ready for its SB interrupt
+    if(I2C_GenerateStartCondition(pI2CHandle->pI2Cx) == FLAG_RESET){
+        i2c_error(pI2CHandle, I2C_ERROR_TIMEOUT);
+    }
+}
+
+/*******************************************************************
+ * @fn          I2C_MasterSendDataIT
+ * @brief       Start a master write, driven by the event interrupt
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   pTxBuffer: data to send, valid until completion
+ * @param[in]   len: number of bytes
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   Sr: I2C_ENABLE_SR keeps the bus (no STOP) for a repeated start by the next transfer
+ * @return      previous state, the transfer is only started when it was I2C_READY
+ * @note        With pTxDMA set and more than 2 bytes the data goes by DMA: interrupts are SB, ADDR
+ *              and BTF only. Completion (I2C_EVENT_TX_CMPLT) and errors go to Callback, or to
+ *              I2C_ApplicationEventCallback when it is NULL. A STOP of the previous transfer
+ *              which does not go out ends this one with I2C_ERROR_TIMEOUT before returning.
+ */
 uint8_t I2C_MasterSendDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pTxBuffer, uint32_t len, uint8_t SlaveAddress, uint8_t Sr){
+    PROF_ENTER();
     uint8_t busyState = pI2CHandle->TxRxState;
     if(busyState == I2C_READY){
         pI2CHandle->pTxBuffer = pTxBuffer;
@@ -273,19 +475,33 @@ uint8_t I2C_MasterSendDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pTxBuffer, uint3
         pI2CHandle->DevAddress = SlaveAddress;
         pI2CHandle->TxRxState = I2C_BUSY_IN_TX;
         pI2CHandle->sr = Sr;
-        //start condition
-        I2C_GenerateStartCondition(pI2CHandle->pI2Cx);
-        //enable ITBUFEN contorl bit
-        I2C_EnableITBUFEN(pI2CHandle->pI2Cx);
-        //enable ITEVTEN control bit
-        I2C_EnableITEVTEN(pI2CHandle->pI2Cx);
-        //enable ITERREN control bit
-        I2C_EnableITERREN(pI2CHandle->pI2Cx);
+        pI2CHandle->pMemData = NULL;
+        i2c_master_tx_start(pI2CHandle);
     }
+    PROF_EXIT(PROF_ID_I2C_MASTER_SEND_IT);
     return busyState;
 
 }
+
+/*******************************************************************
+ * @fn          I2C_MasterReceiveDataIT
+ * @brief       Start a master read, driven by the event interrupt
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   pRxBuffer: received data, valid until completion
+ * @param[in]   len: number of bytes
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   Sr: I2C_ENABLE_SR keeps the bus (no STOP) for a repeated start by the next transfer
+ * @return      previous state, the transfer is only started when it was I2C_READY
+ * @note        Follows the 1, 2 and N byte sequences of the RM so the NACK and STOP land on the
+ *              last byte. With pRxDMA set and more than 2 bytes the data goes by DMA (LAST makes
+ *              it NACK the last byte): interrupts are SB, ADDR and the DMA transfer complete.
+ *              Otherwise 1 and N > 3 bytes take one RXNE interrupt per byte, the last two or
+ *              three bytes are read at BTF. Completion (I2C_EVENT_RX_CMPLT) and errors go to
+ *              Callback, or to I2C_ApplicationEventCallback when it is NULL. A STOP of the previous
+ *              transfer which does not go out ends this one with I2C_ERROR_TIMEOUT before returning.
+ */
 uint8_t I2C_MasterReceiveDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pRxBuffer, uint32_t len, uint8_t SlaveAddress, uint8_t Sr){
+    PROF_ENTER();
     uint8_t busyState = pI2CHandle->TxRxState;
     if(busyState == I2C_READY){
         pI2CHandle->pRxBuffer = pRxBuffer;
@@ -294,18 +510,74 @@ uint8_t I2C_MasterReceiveDataIT(I2C_Handle_t *pI2CHandle, uint8_t *pRxBuffer, ui
         pI2CHandle->TxRxState = I2C_BUSY_IN_RX;
         pI2CHandle->RxSize = len;//RxSize is used in ISR code to manage the data reception
         pI2CHandle->sr = Sr;
-        //start condition
-        I2C_GenerateStartCondition(pI2CHandle->pI2Cx);
-        //enable ITBUFEN contorl bit
-        I2C_EnableITBUFEN(pI2CHandle->pI2Cx);
-        //enable ITEVTEN control bit
-        I2C_EnableITEVTEN(pI2CHandle->pI2Cx);
-        //enable ITERREN control bit
-        I2C_EnableITERREN(pI2CHandle->pI2Cx);
+        pI2CHandle->pMemData = NULL;
+        i2c_master_rx_start(pI2CHandle);
     }
+    PROF_EXIT(PROF_ID_I2C_MASTER_RECEIVE_IT);
     return busyState;
 }
 
+/*
+ * register access of I2C_MemReadIT/I2C_MemWriteIT: the register address goes first as a write,
+ * the data phase is queued behind it and started from the interrupt
+ */
+static uint8_t i2c_mem_start(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress,
+                             uint8_t MemAddSize, uint8_t *pData, uint32_t len, uint8_t Direction){
+    uint8_t busyState = pI2CHandle->TxRxState;
+
+    if(busyState == I2C_READY){
+        pI2CHandle->pTxBuffer = pI2CHandle->MemAddr;
+        pI2CHandle->TxLen = i2c_mem_address(pI2CHandle->MemAddr, MemAddress, MemAddSize);
+        pI2CHandle->DevAddress = SlaveAddress;
+        pI2CHandle->TxRxState = I2C_BUSY_IN_TX;
+        pI2CHandle->sr = I2C_DISABLE_SR;
+        pI2CHandle->pMemData = pData;
+        pI2CHandle->MemLen = len;
+        pI2CHandle->MemDir = Direction;
+        i2c_master_tx_start(pI2CHandle);
+    }
+    return busyState;
+}
+
+/*******************************************************************
+ * @fn          I2C_MemWriteIT
+ * @brief       Start a register write: register address and data in one transaction
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   MemAddress: first register
+ * @param[in]   MemAddSize: @I2C_MemAddSize
+ * @param[in]   pData: data to write, valid until completion
+ * @param[in]   len: number of bytes
+ * @return      previous state, the transfer is only started when it was I2C_READY
+ * @note        The data phase follows the register address byte without a gap, by DMA when the
+ *              handle has pTxDMA and more than 2 bytes. Reports I2C_EVENT_TX_CMPLT like
+ *              I2C_MasterSendDataIT.
+ */
+uint8_t I2C_MemWriteIT(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                       uint8_t *pData, uint32_t len){
+    return i2c_mem_start(pI2CHandle, SlaveAddress, MemAddress, MemAddSize, pData, len, I2C_WRITE);
+}
+
+/*******************************************************************
+ * @fn          I2C_MemReadIT
+ * @brief       Start a register read: register address written, data read after a repeated start
+ * @param[in]   pI2CHandle: I2C handle
+ * @param[in]   SlaveAddress: 7-bit address
+ * @param[in]   MemAddress: first register
+ * @param[in]   MemAddSize: @I2C_MemAddSize
+ * @param[out]  pData: received data, valid until completion
+ * @param[in]   len: number of bytes
+ * @return      previous state, the transfer is only started when it was I2C_READY
+ * @note        One bus transaction: the repeated START is programmed at the BTF of the register
+ *              address, the read then runs as in I2C_MasterReceiveDataIT (DMA with pRxDMA and more
+ *              than 2 bytes). That BTF re-enters the event handler until the START goes out, one SCL
+ *              period at most. Reports I2C_EVENT_RX_CMPLT.
+ */
+uint8_t I2C_MemReadIT(I2C_Handle_t *pI2CHandle, uint8_t SlaveAddress, uint16_t MemAddress, uint8_t MemAddSize,
+                      uint8_t *pData, uint32_t len){
+    return i2c_mem_start(pI2CHandle, SlaveAddress, MemAddress, MemAddSize, pData, len, I2C_READ);
+}
+
 void I2C_SlaveSendData(I2C_RegDef_t *pI2Cx, uint32_t data){
     pI2Cx->DR = data;
 }
@@ -320,34 +592,99 @@ void I2C_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
 void I2C_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
 
 void I2C_CloseSendData(I2C_Handle_t *pI2CHandle){
+        if(pI2CHandle->pI2Cx->CR2 & (1<<I2C_CR2_DMAEN)){
+            pI2CHandle->pI2Cx->CR2 &= ~(1<<I2C_CR2_DMAEN);
+            DMA_Stop(pI2CHandle->pTxDMA);
+        }
         pI2CHandle->pTxBuffer = NULL;
         pI2CHandle->TxRxState = I2C_READY;
         pI2CHandle->TxLen = 0;
+        pI2CHandle->pMemData = NULL;
 
-                //enable ITBUFEN contorl bit
+        //disable ITBUFEN contorl bit
         I2C_DisableITBUFEN(pI2CHandle->pI2Cx);
-        //enable ITEVTEN control bit
+        //disable ITEVTEN control bit
         I2C_DisableITEVTEN(pI2CHandle->pI2Cx);
 
 }
 
 void I2C_CloseReceiveData(I2C_Handle_t *pI2CHandle){
+        if(pI2CHandle->pI2Cx->CR2 & (1<<I2C_CR2_DMAEN)){
+            pI2CHandle->pI2Cx->CR2 &= ~((1<<I2C_CR2_DMAEN) | (1<<I2C_CR2_LAST));
+            DMA_Stop(pI2CHandle->pRxDMA);
+        }
+        pI2CHandle->pI2Cx->CR1 &= ~(1<<I2C_CR1_POS);
         pI2CHandle->pRxBuffer = NULL;
         pI2CHandle->RxLen = 0;
         pI2CHandle->TxRxState = I2C_READY;
         pI2CHandle->RxSize = 0;//RxSize is used in ISR code to manage the data reception
+        pI2CHandle->pMemData = NULL;
 
-        if(pI2CHandle->I2C_Config.I2C_AckControl == I2C_SCK_ACK_ENABLE){
-            I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_ENABLE);
-        }
+        I2C_ManageAcking(pI2CHandle->pI2Cx, pI2CHandle->I2C_Config.I2C_AckControl);
 
-        //enable ITBUFEN contorl bit
+        //disable ITBUFEN contorl bit
         I2C_DisableITBUFEN(pI2CHandle->pI2Cx);
-        //enable ITEVTEN control bit
+        //disable ITEVTEN control bit
         I2C_DisableITEVTEN(pI2CHandle->pI2Cx);
 
 }
-void I2C_MasterHandleTXEInterupt(I2C_Handle_t *pI2CHandle){
+
+/*
+ * end of a master transfer: the handle is ready again before the callback, which may start the next one
+ */
+static void i2c_notify(I2C_Handle_t *pI2CHandle, uint8_t AppEv){
+    if(pI2CHandle->Callback != NULL){
+        pI2CHandle->Callback(pI2CHandle, AppEv);
+    } else {
+        I2C_ApplicationEventCallback(pI2CHandle, AppEv);
+    }
+}
+
+/*
+ * error during a master transfer ends it, in slave mode it is only reported
+ */
+static void i2c_error(I2C_Handle_t *pI2CHandle, uint8_t AppEv){
+    if(pI2CHandle->TxRxState == I2C_READY){
+        I2C_ApplicationEventCallback(pI2CHandle, AppEv);
+        return;
+    }
+    //after a NACK the master still owns the bus and has to release it (RM)
+    if(AppEv == I2C_ERROR_AF || AppEv == I2C_ERROR_DMA){
+        I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
+    }
+    if(pI2CHandle->TxRxState == I2C_BUSY_IN_TX){
+        I2C_CloseSendData(pI2CHandle);
+    } else {
+        I2C_CloseReceiveData(pI2CHandle);
+    }
+    i2c_notify(pI2CHandle, AppEv);
+}
+
+static void i2c_master_tx_done(I2C_Handle_t *pI2CHandle){
+    if(pI2CHandle->pMemData != NULL && pI2CHandle->MemDir == I2C_READ){
+        //register address is out: repeated START into the read, SCL is held by BTF until then
+        pI2CHandle->pRxBuffer = pI2CHandle->pMemData;
+        pI2CHandle->RxLen = pI2CHandle->MemLen;
+        pI2CHandle->RxSize = pI2CHandle->MemLen;
+        pI2CHandle->pMemData = NULL;
+        pI2CHandle->pTxBuffer = NULL;
+        pI2CHandle->TxRxState = I2C_BUSY_IN_RX;
+        i2c_master_rx_start(pI2CHandle);
+        return;
+    }
+    if(pI2CHandle->sr == I2C_DISABLE_SR){
+        I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
+    }
+    I2C_CloseSendData(pI2CHandle);
+    i2c_notify(pI2CHandle, I2C_EVENT_TX_CMPLT);
+}
+
+static void i2c_master_rx_done(I2C_Handle_t *pI2CHandle){
+    I2C_CloseReceiveData(pI2CHandle);
+    i2c_notify(pI2CHandle, I2C_EVENT_RX_CMPLT);
+}
+
+RAMFUNC void I2C_MasterHandleTXEInterupt(I2C_Handle_t *pI2CHandle){
         if(pI2CHandle->TxLen > 0){
             //1. load data in DR
             pI2CHandle->pI2Cx->DR = *(pI2CHandle->pTxBuffer);
@@ -356,51 +693,92 @@ void I2C_MasterHandleTXEInterupt(I2C_Handle_t *pI2CHandle){
             //3.Increment pTxBuffer
             pI2CHandle->pTxBuffer++;
         }
-}
-void I2C_MasterHandleRXNEInterupt(I2C_Handle_t *pI2CHandle){
-            //data reception
-        if(pI2CHandle->RxSize  == 1){
-            //1. read data from DR
-            *(pI2CHandle->pRxBuffer) = pI2CHandle->pI2Cx->DR;
-            //2. dereament in RxLen
-            pI2CHandle->RxLen--;
-            //3. Increment pRxBuffer
-            pI2CHandle->pRxBuffer++;
-        } else if(pI2CHandle->RxSize  > 1){
-            if(pI2CHandle->RxLen == 2){
-                //clear ACK
-                I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
+        if(pI2CHandle->TxLen == 0){
+            //TXE stays set from here on, the end is the BTF of the last byte
+            I2C_DisableITBUFEN(pI2CHandle->pI2Cx);
+            if(pI2CHandle->pMemData != NULL && pI2CHandle->MemDir == I2C_WRITE){
+                //register address written: the data follows in the same transfer
+                pI2CHandle->pTxBuffer = pI2CHandle->pMemData;
+                pI2CHandle->TxLen = pI2CHandle->MemLen;
+                pI2CHandle->pMemData = NULL;
+                i2c_master_tx_arm(pI2CHandle);
             }
-            //read DR
-            *(pI2CHandle->pRxBuffer) = pI2CHandle->pI2Cx->DR;
-            //2. dereament in RxLen
-            pI2CHandle->RxLen--;
-            //3. Increment pRxBuffer
-            pI2CHandle->pRxBuffer++;
         }
-        if(pI2CHandle->RxLen  == 0){
-            //close reception and notify application
-            //1. generate close condition
+}
+RAMFUNC void I2C_MasterHandleRXNEInterupt(I2C_Handle_t *pI2CHandle){
+        //1. read data from DR
+        *(pI2CHandle->pRxBuffer) = pI2CHandle->pI2Cx->DR;
+        //2. dereament in RxLen
+        pI2CHandle->RxLen--;
+        //3. Increment pRxBuffer
+        pI2CHandle->pRxBuffer++;
+        if(pI2CHandle->RxSize == 1){
+            //STOP was programmed at ADDR
+            i2c_master_rx_done(pI2CHandle);
+        } else if(pI2CHandle->RxLen == 3){
+            //the last three bytes are read at BTF, with the shift register full
+            I2C_DisableITBUFEN(pI2CHandle->pI2Cx);
+        }
+}
+
+/*
+ * BTF while receiving: DR and the shift register are full and SCL is stretched
+ */
+RAMFUNC static void i2c_master_handle_rx_btf(I2C_Handle_t *pI2CHandle){
+        if(pI2CHandle->RxLen > 3){
+            //RXNE interrupt was late, just go on
+            I2C_MasterHandleRXNEInterupt(pI2CHandle);
+        } else if(pI2CHandle->RxLen == 3){
+            //data N-2 in DR, N-1 shifted in: NACK goes to N, which is clocked in by this read
+            I2C_ManageAcking(pI2CHandle->pI2Cx, I2C_SCK_ACK_DISABLE);
+            *(pI2CHandle->pRxBuffer++) = pI2CHandle->pI2Cx->DR;
+            pI2CHandle->RxLen--;
+        } else if(pI2CHandle->RxLen == 2){
+            //data N-1 in DR, N shifted in: STOP before the reads, nothing more is clocked
             if(pI2CHandle->sr == I2C_DISABLE_SR){
                 I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
             }
-            //2.close I2C reception
-            I2C_CloseReceiveData(pI2CHandle);
-
-            //3. notify application that reception is completed
-            I2C_ApplicationEventCallback(pI2CHandle, I2C_EVENT_RX_CMPLT);
+            *(pI2CHandle->pRxBuffer++) = pI2CHandle->pI2Cx->DR;
+            *(pI2CHandle->pRxBuffer++) = pI2CHandle->pI2Cx->DR;
+            pI2CHandle->RxLen = 0;
+            i2c_master_rx_done(pI2CHandle);
         }
+}
 
+static void i2c_dma_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    //completion is the BTF of the last byte, only errors come from here
+    if(Event == DMA_EVENT_ERROR){
+        i2c_error((I2C_Handle_t *)pDMAHandle->pParent, I2C_ERROR_DMA);
+    }
+}
+
+static void i2c_dma_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    I2C_Handle_t *pI2CHandle = (I2C_Handle_t *)pDMAHandle->pParent;
+
+    if(Event == DMA_EVENT_CMPLT){
+        //last byte (NACKed through LAST) is in memory, program STOP (RM)
+        if(pI2CHandle->sr == I2C_DISABLE_SR){
+            I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
+        }
+        pI2CHandle->RxLen = 0;
+        i2c_master_rx_done(pI2CHandle);
+    } else if(Event == DMA_EVENT_ERROR){
+        i2c_error(pI2CHandle, I2C_ERROR_DMA);
+    }
 }
-void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
-    uint8_t temp1, temp2, temp3;
-    temp1 = pI2CHandle->pI2Cx->CR2 & (1<<I2C_CR2_ITEVTEN);
-    temp2 = pI2CHandle->pI2Cx->CR2 & (1<<I2C_CR2_ITERREN);
+
+RAMFUNC void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
+    PROF_ENTER();
+    uint32_t temp1, temp2, temp3;
+    uint32_t cr2 = pI2CHandle->pI2Cx->CR2;
+    //SR1 is read once, not once per flag: every read is a bus access inside the ISR
+    uint32_t sr1 = pI2CHandle->pI2Cx->SR1;
+    temp1 = cr2 & (1<<I2C_CR2_ITEVTEN);
 
     //Interupt handling for both master and slave mode
     //1. handle Interupt generated by SB event
     //note SB bit is only applied in master mode
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_SB);
+    temp3 = sr1 & (1<<I2C_SR1_SB);
     if(temp1 && temp3){
         //SB flag is set
         //this block will not be executed in master mode because SB bit is always 0
@@ -409,44 +787,46 @@ void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
             I2C_ExecuteAddressPhase(pI2CHandle->pI2Cx, pI2CHandle->DevAddress, I2C_WRITE);
         } else if(pI2CHandle->TxRxState == I2C_BUSY_IN_RX){
             I2C_ExecuteAddressPhase(pI2CHandle->pI2Cx, pI2CHandle->DevAddress, I2C_READ);
+            //RXNE interrupts for 1 and N > 3 bytes, 2 and 3 bytes are done with BTF alone
+            if(!(cr2 & (1<<I2C_CR2_DMAEN)) && (pI2CHandle->RxSize == 1 || pI2CHandle->RxSize > 3)){
+                I2C_EnableITBUFEN(pI2CHandle->pI2Cx);
+            }
         }
     }
 
     //2. handle Interrupt generated by ADDR event
     //Note: in master mode: Adddress is sent
     //        in slave modeL: Address matched with own address
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_ADDR);
+    temp3 = sr1 & (1<<I2C_SR1_ADDR);
     if(temp1 && temp3){
         I2C_ClearADDRFlag(pI2CHandle);
     }
 
     //3. handle interupt generated by BTF event
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_BTF);
+    temp3 = sr1 & (1<<I2C_SR1_BTF);
     if(temp1 && temp3){
         //BTF flag is set
         if(pI2CHandle->TxRxState == I2C_BUSY_IN_TX){
             //make sure that TXE is also set
-            if(pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_TXE)){
-                //Btx, TXE = 1
-                if(pI2CHandle->TxLen == 0){
-                    //1 generate Stop condition
-                    if(pI2CHandle->sr == I2C_DISABLE_SR){
-                        I2C_GenerateStopCondition(pI2CHandle->pI2Cx);
-                    }
-                    //2. reset all element of pI2CHandle structure
-                    I2C_CloseSendData(pI2CHandle);
-                    //3. notify application that transmission is completed
-                    I2C_ApplicationEventCallback(pI2CHandle, I2C_EVENT_TX_CMPLT);
+            if(sr1 & (1<<I2C_SR1_TXE)){
+                //Btx, TXE = 1: last byte out when nothing is left for the CPU or the DMA
+                if(pI2CHandle->TxLen == 0 && (!(pI2CHandle->pI2Cx->CR2 & (1<<I2C_CR2_DMAEN)) ||
+                                              DMA_GetRemaining(pI2CHandle->pTxDMA) == 0)){
+                    i2c_master_tx_done(pI2CHandle);
                 }
             }
         }else if(pI2CHandle->TxRxState == I2C_BUSY_IN_RX){
-            ;
+            //with DMA the stream takes DR, completion comes from its interrupt. BTF of the register
+            //address of I2C_MemReadIT stays until its repeated START goes out
+            if(!(cr2 & (1<<I2C_CR2_DMAEN)) && !(pI2CHandle->pI2Cx->CR1 & (1<<I2C_CR1_START))){
+                i2c_master_handle_rx_btf(pI2CHandle);
+            }
         }
     }
 
     //4. handle interrupt generated by STOPF event
     //Note: Stop detection flag is only applicable in slave mode, for master mode this flag will never be set
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_STOPF);
+    temp3 = sr1 & (1<<I2C_SR1_STOPF);
     if(temp1 && temp3){
         //STOPF flag is set
         //clear STOPF flag read SR1 then write to cr1
@@ -457,11 +837,19 @@ void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
         I2C_ApplicationEventCallback(pI2CHandle, I2C_EVENT_STOP);
     }
 
+    //ADDR and BTF handling move data and may end the transfer: take the flags again
+    if(sr1 & ((1<<I2C_SR1_ADDR) | (1<<I2C_SR1_BTF))){
+        sr1 = pI2CHandle->pI2Cx->SR1;
+        cr2 = pI2CHandle->pI2Cx->CR2;
+        temp1 = cr2 & (1<<I2C_CR2_ITEVTEN);
+    }
+    temp2 = cr2 & (1<<I2C_CR2_ITBUFEN);
+
     //5. handle interrupt generated by TXE event
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_TXE);
-    if(temp2 && temp2 && temp3){
-        //check for device mode
-        if(pI2CHandle->pI2Cx->SR2 & (1<<I2C_SR2_MSL)){
+    temp3 = sr1 & (1<<I2C_SR1_TXE);
+    if(temp1 && temp2 && temp3){
+        //check for device mode: a master transfer is running (MSL already drops with an early STOP)
+        if(pI2CHandle->TxRxState != I2C_READY){
             //TXE flag is set
             //data transmisson
             if(pI2CHandle->TxRxState == I2C_BUSY_IN_TX){
@@ -476,10 +864,10 @@ void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
         }
     }
     //6. handle interrupt generated by RXNE event
-    temp3 = pI2CHandle->pI2Cx->SR1 & (1<<I2C_SR1_RXNE);
-    if(temp2 && temp2 && temp3){
-        //check device mode
-        if(pI2CHandle->pI2Cx->SR2 & (1<<I2C_SR2_MSL)){
+    temp3 = sr1 & (1<<I2C_SR1_RXNE);
+    if(temp1 && temp2 && temp3){
+        //check device mode: the STOP of a 1 byte read is programmed before its RXNE, MSL is gone by then
+        if(pI2CHandle->TxRxState != I2C_READY){
             //deivce is master
             //RXNE flag is set
             if(pI2CHandle->TxRxState == I2C_BUSY_IN_RX){
@@ -493,76 +881,99 @@ void I2C_EV_IRQHandling(I2C_Handle_t *pI2CHandle){
             }
         }
     }
+    PROF_EXIT(PROF_ID_I2C_EV_IRQ);
 }
 void I2C_ER_IRQHandling(I2C_Handle_t *pI2CHandle){
-    uint32_t temp1,temp2;
+    PROF_ENTER();
+    uint32_t temp1,temp2,sr1;
 
     //Know the status of  ITERREN control bit in the CR2
 	temp2 = (pI2CHandle->pI2Cx->CR2) & ( 1 << I2C_CR2_ITERREN);
+	//one read for all the checks, an error handled below may already start the next transfer
+	sr1 = pI2CHandle->pI2Cx->SR1;
 
 
 /***********************Check for Bus error************************************/
-	temp1 = (pI2CHandle->pI2Cx->SR1) & ( 1<< I2C_SR1_BERR);
+	temp1 = sr1 & ( 1<< I2C_SR1_BERR);
 	if(temp1  && temp2 )
 	{
 		//This is Bus error
 
 		//Implement the code to clear the buss error flag
-		pI2CHandle->pI2Cx->SR1 &= ~( 1 << I2C_SR1_BERR);
+		//error flags are rc_w0: a plain write, a read-modify-write could clear a flag set meanwhile
+		pI2CHandle->pI2Cx->SR1 = ~( 1 << I2C_SR1_BERR);
 
 		//Implement the code to notify the application about the error
-	   I2C_ApplicationEventCallback(pI2CHandle,I2C_ERROR_BERR);
+	   i2c_error(pI2CHandle,I2C_ERROR_BERR);
 	}
 
 /***********************Check for arbitration lost error************************************/
-	temp1 = (pI2CHandle->pI2Cx->SR1) & ( 1 << I2C_SR1_ARLO );
+	temp1 = sr1 & ( 1 << I2C_SR1_ARLO );
 	if(temp1  && temp2)
 	{
 		//This is arbitration lost error
 
 		//Implement the code to clear the arbitration lost error flag
-		pI2CHandle->pI2Cx->SR1 &= ~( 1 << I2C_SR1_ARLO);
+		pI2CHandle->pI2Cx->SR1 = ~( 1 << I2C_SR1_ARLO);
 		//Implement the code to notify the application about the error
-	   I2C_ApplicationEventCallback(pI2CHandle,I2C_ERROR_ARLO);
+	   i2c_error(pI2CHandle,I2C_ERROR_ARLO);
 	}
 
 /***********************Check for ACK failure  error************************************/
 
-	temp1 = (pI2CHandle->pI2Cx->SR1) & ( 1 << I2C_SR1_AF);
+	temp1 = sr1 & ( 1 << I2C_SR1_AF);
 	if(temp1  && temp2)
 	{
 		//This is ACK failure error
 
 	    //Implement the code to clear the ACK failure error flag
-	    pI2CHandle->pI2Cx->SR1 &= ~( 1 << I2C_SR1_AF);
+	    pI2CHandle->pI2Cx->SR1 = ~( 1 << I2C_SR1_AF);
 		//Implement the code to notify the application about the error
-        I2C_ApplicationEventCallback(pI2CHandle,I2C_ERROR_AF);
+        i2c_error(pI2CHandle,I2C_ERROR_AF);
 	}
 
 /***********************Check for Overrun/underrun error************************************/
-	temp1 = (pI2CHandle->pI2Cx->SR1) & ( 1 << I2C_SR1_OVR);
+	temp1 = sr1 & ( 1 << I2C_SR1_OVR);
 	if(temp1  && temp2)
 	{
 		//This is Overrun/underrun
 
 	    //Implement the code to clear the Overrun/underrun error flag
-        pI2CHandle->pI2Cx->SR1 &= ~( 1 << I2C_SR1_OVR);
+        pI2CHandle->pI2Cx->SR1 = ~( 1 << I2C_SR1_OVR);
 		//Implement the code to notify the application about the error
-        I2C_ApplicationEventCallback(pI2CHandle,I2C_ERROR_OVR);
+        i2c_error(pI2CHandle,I2C_ERROR_OVR);
 	}
 
 /***********************Check for Time out error************************************/
-	temp1 = (pI2CHandle->pI2Cx->SR1) & ( 1 << I2C_SR1_TIMEOUT);
+	temp1 = sr1 & ( 1 << I2C_SR1_TIMEOUT);
 	if(temp1  && temp2)
 	{
 		//This is Time out error
 
 	    //Implement the code to clear the Time out error flag
-        pI2CHandle->pI2Cx->SR1 &= ~( 1 << I2C_SR1_TIMEOUT);
+        pI2CHandle->pI2Cx->SR1 = ~( 1 << I2C_SR1_TIMEOUT);
 
 		//Implement the code to notify the application about the error
-        I2C_ApplicationEventCallback(pI2CHandle,I2C_ERROR_TIMEOUT);
+        i2c_error(pI2CHandle,I2C_ERROR_TIMEOUT);
 	}
+    PROF_EXIT(PROF_ID_I2C_ER_IRQ);
+}
+
+/* IRQ_Dispatch passes the handle registered with the IRQ (irq.h) */
+RAMFUNC static void i2c_ev_irq_entry(void *pContext){
+    I2C_EV_IRQHandling((I2C_Handle_t *)pContext);
+}
+
+static void i2c_er_irq_entry(void *pContext){
+    I2C_ER_IRQHandling((I2C_Handle_t *)pContext);
+}
+
+/*
+ * route the event and error IRQs of this instance straight to the handlers, IRQ_Init must have run
+ */
+void I2C_IRQRegister(I2C_Handle_t *pI2CHandle, uint8_t EvIRQNumber, uint8_t ErIRQNumber){
+    IRQ_Register(EvIRQNumber, i2c_ev_irq_entry, pI2CHandle);
+    IRQ_Register(ErIRQNumber, i2c_er_irq_entry, pI2CHandle);
 }
 
 /*
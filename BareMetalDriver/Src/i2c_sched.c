@@ -0,0 +1,133 @@
+#include "i2c_sched.h"
+#include <stddef.h>
+
+static void i2c_sched_complete(I2C_Handle_t *pI2CHandle, uint8_t AppEv);
+
+/*******************************************************************
+ * @fn          I2C_SchedInit
+ * @brief       Put a job table on an I2C handle
+ * @param[in]   pSched: scheduler to initialize
+ * @param[in]   pI2CHandle: I2C handle, I2C_Init done
+ * @param[in]   pJobs: jobs, DevAddress/MemAddress/MemAddSize/Len/Period/pBuffer filled in
+ * @param[in]   NumJobs: number of jobs
+ * @return      I2C_SCHED_OK, I2C_SCHED_ERROR_PARAM when a job has Period or Len 0
+ * @note        The handle belongs to the scheduler from now on. Every job is due at the first tick.
+ */
+uint8_t I2C_SchedInit(I2C_Sched_t *pSched, I2C_Handle_t *pI2CHandle, I2C_Job_t *pJobs, uint32_t NumJobs){
+    //the tick divides by Period
+    for(uint32_t i = 0; i < NumJobs; i++){
+        if(pJobs[i].Period == 0 || pJobs[i].Len == 0){
+            return I2C_SCHED_ERROR_PARAM;
+        }
+    }
+    pSched->pI2CHandle = pI2CHandle;
+    pSched->pJobs = pJobs;
+    pSched->NumJobs = NumJobs;
+    pSched->Tick = 0;
+    pSched->pRunning = NULL;
+    for(uint32_t i = 0; i < NumJobs; i++){
+        pJobs[i].Seq = 0;
+        pJobs[i].Due = 1;
+        pJobs[i].Errors = 0;
+        pJobs[i].Overruns = 0;
+    }
+    pI2CHandle->pParent = pSched;
+    pI2CHandle->Callback = i2c_sched_complete;
+    return I2C_SCHED_OK;
+}
+
+/*
+ * start the most overdue job, interrupts masked by the caller and the bus idle
+ */
+static void i2c_sched_start(I2C_Sched_t *pSched){
+    I2C_Job_t *pJob = NULL;
+    uint32_t late = 0;
+    uint32_t now = pSched->Tick;
+
+    for(uint32_t i = 0; i < pSched->NumJobs; i++){
+        //wrap-safe: due when now is not before Due
+        uint32_t l = now - pSched->pJobs[i].Due;
+        if((int32_t)l >= 0 && (pJob == NULL || l > late)){
+            pJob = &pSched->pJobs[i];
+            late = l;
+        }
+    }
+    if(pJob == NULL){
+        return;
+    }
+    if(late >= pJob->Period){
+        //a whole period behind: drop the missed ones instead of reading back to back to catch up
+        pJob->Overruns += late / pJob->Period;
+        pJob->Due = now + pJob->Period;
+    } else {
+        pJob->Due += pJob->Period;
+    }
+    pSched->pRunning = pJob;
+    //into the copy readers are not using, the other one holds result Seq
+    (void)I2C_MemReadIT(pSched->pI2CHandle, pJob->DevAddress, pJob->MemAddress, pJob->MemAddSize,
+                        pJob->pBuffer + ((pJob->Seq + 1U) & 1U) * pJob->Len, pJob->Len);
+}
+
+/*******************************************************************
+ * @fn          I2C_SchedTick
+ * @brief       Advance the time of the scheduler, start a due job when the bus is idle
+ * @param[in]   pSched: scheduler
+ * @return      None
+ * @note        Call from SysTick_Handler, Period of the jobs counts these calls
+ */
+void I2C_SchedTick(I2C_Sched_t *pSched){
+    uint32_t state;
+
+    ENTER_CRITICAL(state);
+    pSched->Tick++;
+    if(pSched->pRunning == NULL){
+        i2c_sched_start(pSched);
+    }
+    EXIT_CRITICAL(state);
+}
+
+/*
+ * completion interrupt of I2C_MemReadIT: publish the result, then chain the next due job
+ */
+static void i2c_sched_complete(I2C_Handle_t *pI2CHandle, uint8_t AppEv){
+    I2C_Sched_t *pSched = (I2C_Sched_t *)pI2CHandle->pParent;
+    I2C_Job_t *pJob = pSched->pRunning;
+    uint32_t state;
+
+    if(AppEv == I2C_EVENT_RX_CMPLT){
+        pJob->Seq++;
+    } else {
+        pJob->Errors++;
+    }
+
+    ENTER_CRITICAL(state);
+    pSched->pRunning = NULL;
+    i2c_sched_start(pSched);
+    EXIT_CRITICAL(state);
+}
+
+/*******************************************************************
+ * @fn          I2C_SchedGet
+ * @brief       Copy the latest result of a job
+ * @param[in]   pJob: job
+ * @param[out]  pData: Len bytes
+ * @return      sequence number of the result, 0 when the job has no result yet
+ * @note        Callable from any context. Only the copy that is not being read into is copied; when
+ *              a new result lands meanwhile (a job faster than the copy) the copy is done again.
+ */
+uint32_t I2C_SchedGet(const I2C_Job_t *pJob, uint8_t *pData){
+    uint32_t seq;
+
+    do {
+        seq = pJob->Seq;
+        if(seq == 0){
+            return 0;
+        }
+        const volatile uint8_t *pSrc = pJob->pBuffer + (seq & 1U) * pJob->Len;
+        for(uint32_t i = 0; i < pJob->Len; i++){
+            pData[i] = pSrc[i];
+        }
+        //the copy was only written again after Seq moved on
+    } while(pJob->Seq != seq);
+    return seq;
+}
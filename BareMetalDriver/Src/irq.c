@@ -0,0 +1,84 @@
+#include "irq.h"
+#include <stddef.h>
+
+typedef struct {
+    IRQ_Handler_t Handler;
+    void *pContext;
+}IRQ_Slot_t;
+
+/* indexed by exception number (IRQ number + 16), like the table */
+static uint32_t irq_vectors[IRQ_VECTOR_COUNT] __attribute__((aligned(IRQ_VECTOR_ALIGN)));
+static IRQ_Slot_t irq_slots[IRQ_VECTOR_COUNT];
+
+/*******************************************************************
+ * @fn          IRQ_Init
+ * @brief       Copy the vector table in use into SRAM and switch VTOR to the copy
+ * @return      None
+ * @note        Call once, before the first IRQ_SetVector/IRQ_Register, with interrupts masked
+ *              or none enabled yet
+ */
+void IRQ_Init(void){
+    const volatile uint32_t *pFlash = (const volatile uint32_t *)(uintptr_t)SCB->VTOR;
+
+    for(uint32_t i = 0; i < IRQ_VECTOR_COUNT; i++){
+        irq_vectors[i] = pFlash[i];
+    }
+    DSB();
+    SCB->VTOR = (uint32_t)(uintptr_t)irq_vectors;
+    DSB();
+    ISB();
+}
+
+/*******************************************************************
+ * @fn          IRQ_SetVector
+ * @brief       Install a handler directly in the RAM vector table
+ * @param[in]   IRQNumber: IRQ_NO_x, or IRQ_NO_SYSTICK
+ * @param[in]   pVector: handler
+ * @return      None
+ * @note        Takes effect at the next exception entry, no barrier needed for a data write
+ *              the core sees in order
+ */
+void IRQ_SetVector(int16_t IRQNumber, IRQ_Vector_t pVector){
+    if(IRQNumber < -16 || IRQNumber >= IRQ_NO_COUNT){
+        return;
+    }
+    irq_vectors[IRQNumber + 16] = (uint32_t)(uintptr_t)pVector;
+    DMB();
+}
+
+/*******************************************************************
+ * @fn          IRQ_Register
+ * @brief       Dispatch an IRQ to Handler(pContext) through IRQ_Dispatch
+ * @param[in]   IRQNumber: IRQ_NO_x, or IRQ_NO_SYSTICK
+ * @param[in]   Handler: called from the interrupt with pContext
+ * @param[in]   pContext: e.g. the driver handle of the instance raising the IRQ
+ * @return      None
+ * @note        The slot is written before the vector so the dispatcher never sees half of it
+ */
+void IRQ_Register(int16_t IRQNumber, IRQ_Handler_t Handler, void *pContext){
+    uint32_t state;
+
+    if(IRQNumber < -16 || IRQNumber >= IRQ_NO_COUNT || Handler == NULL){
+        return;
+    }
+    ENTER_CRITICAL(state);
+    irq_slots[IRQNumber + 16].Handler = Handler;
+    irq_slots[IRQNumber + 16].pContext = pContext;
+    EXIT_CRITICAL(state);
+    IRQ_SetVector(IRQNumber, IRQ_Dispatch);
+}
+
+/*******************************************************************
+ * @fn          IRQ_Dispatch
+ * @brief       Common vector of the registered IRQs
+ * @return      None
+ * @note        IPSR holds the exception number of the handler being run
+ */
+RAMFUNC void IRQ_Dispatch(void){
+    uint32_t exception;
+    const IRQ_Slot_t *pSlot;
+
+    GET_IPSR(exception);
+    pSlot = &irq_slots[exception & 0x1FF];
+    pSlot->Handler(pSlot->pContext);
+}
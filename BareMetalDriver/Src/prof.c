@@ -0,0 +1,146 @@
+#include "prof.h"
+
+#if PROF_ENABLE
+
+#include <stdio.h>
+
+static PROF_Entry_t prof_table[PROF_ID_COUNT];
+static uint32_t prof_overhead;
+
+static const char *const prof_names[PROF_ID_COUNT] = {
+	"USART_SendData",
+	"USART_ReceiveData",
+	"USART_SendDataIT",
+	"USART_ReceiveDataIT",
+	"USART_IRQHandling",
+	"uart_dma_write",
+	"SPI_SendData",
+	"SPI_ReceiveData",
+	"SPI_SendDataIT",
+	"SPI_ReceiveDataIT",
+	"SPI_IRQHandle",
+	"I2C_MasterSendData",
+	"I2C_MasterReceiveData",
+	"I2C_MasterSendDataIT",
+	"I2C_MasterReceiveDataIT",
+	"I2C_EV_IRQHandling",
+	"I2C_ER_IRQHandling",
+	"DMA_IRQHandling",
+	"GPIO_IRQHandling",
+	"SPI_SendData16",
+	"SPI_ReceiveData16",
+};
+
+/*********************************************************************
+ * @fn          PROF_Init
+ * @brief       Start the DWT cycle counter, clear the table and measure the cost of two
+ *              back-to-back counter reads, which is subtracted from every sample
+ * @return      None
+ */
+void PROF_Init(void)
+{
+	uint32_t start;
+
+	*COREDEBUG_DEMCR |= (1 << COREDEBUG_DEMCR_TRCENA);
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= (1 << DWT_CTRL_CYCCNTENA);
+
+	prof_overhead = 0;
+	start = DWT->CYCCNT;
+	prof_overhead = DWT->CYCCNT - start;
+
+	PROF_Reset();
+}
+
+/*********************************************************************
+ * @fn          PROF_Reset
+ * @brief       Clear all slots
+ * @return      None
+ */
+void PROF_Reset(void)
+{
+	uint32_t state;
+
+	ENTER_CRITICAL(state);
+	for (uint32_t i = 0; i < PROF_ID_COUNT; i++) {
+		prof_table[i].Calls = 0;
+		prof_table[i].MinCycles = UINT32_MAX;
+		prof_table[i].MaxCycles = 0;
+		prof_table[i].TotalCycles = 0;
+	}
+	EXIT_CRITICAL(state);
+}
+
+/*********************************************************************
+ * @fn          PROF_Record
+ * @brief       Account one call of slot Id that started at StartCycles
+ * @param[in]   Id: refer @PROF_Id
+ * @param[in]   StartCycles: DWT->CYCCNT sampled by PROF_ENTER
+ * @return      None
+ * @note        Called from thread and interrupt context, the slot update is done with IRQs masked
+ */
+void PROF_Record(uint8_t Id, uint32_t StartCycles)
+{
+	uint32_t cycles = DWT->CYCCNT - StartCycles;
+	PROF_Entry_t *pEntry;
+	uint32_t state;
+
+	if (Id >= PROF_ID_COUNT) {
+		return;
+	}
+	cycles = (cycles > prof_overhead) ? (cycles - prof_overhead) : 0;
+	pEntry = &prof_table[Id];
+
+	ENTER_CRITICAL(state);
+	pEntry->Calls++;
+	pEntry->TotalCycles += cycles;
+	if (cycles < pEntry->MinCycles) {
+		pEntry->MinCycles = cycles;
+	}
+	if (cycles > pEntry->MaxCycles) {
+		pEntry->MaxCycles = cycles;
+	}
+	EXIT_CRITICAL(state);
+}
+
+/*********************************************************************
+ * @fn          PROF_GetEntry
+ * @brief       Read access to one slot
+ * @param[in]   Id: refer @PROF_Id
+ * @return      pointer to the slot, NULL for an unknown Id
+ */
+const PROF_Entry_t *PROF_GetEntry(uint8_t Id)
+{
+	if (Id >= PROF_ID_COUNT) {
+		return NULL;
+	}
+	return &prof_table[Id];
+}
+
+/*********************************************************************
+ * @fn          PROF_Dump
+ * @brief       Print every slot that was hit through printf (retargeted to the debug UART)
+ * @return      None
+ * @note        The table is copied with IRQs masked so one line is consistent, printing is not
+ */
+void PROF_Dump(void)
+{
+	PROF_Entry_t entry;
+	uint32_t state;
+
+	printf("%-24s %10s %10s %10s %10s\r\n", "entry", "calls", "min", "mean", "max");
+	for (uint32_t i = 0; i < PROF_ID_COUNT; i++) {
+		ENTER_CRITICAL(state);
+		entry = prof_table[i];
+		EXIT_CRITICAL(state);
+
+		if (entry.Calls == 0) {
+			continue;
+		}
+		printf("%-24s %10lu %10lu %10lu %10lu\r\n", prof_names[i],
+		       (unsigned long)entry.Calls, (unsigned long)entry.MinCycles,
+		       (unsigned long)(entry.TotalCycles / entry.Calls), (unsigned long)entry.MaxCycles);
+	}
+}
+
+#endif /* PROF_ENABLE */
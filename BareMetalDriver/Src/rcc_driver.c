@@ -1,89 +1,256 @@
 #include "rcc_driver.h"
 
-uint32_t RCC_GetPLLOutputClock(void){
-    return 8000000;
-}
-
 uint16_t AHB_Prescaler[8] = {2,4,8,16,64,128,256, 512};
 uint16_t APB1_Prescaler[4] = {2,4,8,16};
 
 uint16_t APB2_Prescaler[4] = {2,4,8,16};
 
-uint32_t RCC_GetPCLK1Value(void){
-    uint32_t pclk1, SystemClk;
-    uint8_t clksrc, temp, ahbp, apb1p;
+/*
+ * highest HCLK for 0, 1, 2 and 3 flash wait states at 2.7 - 3.6 V (refer flash access time in RM)
+ */
+static const uint32_t FlashLatencyMaxHCLK[4] = {30000000U, 64000000U, 90000000U, 100000000U};
 
-    //AHB
-    //determind clock source: HSI, HSE, PLL
-    clksrc = ((RCC->CFGR >> 2) & 0x3);
+static uint8_t rcc_wait(volatile uint32_t *pReg, uint32_t Mask, uint32_t Value){
+    uint32_t timeout = RCC_TIMEOUT;
 
-    if(clksrc == 0){//HSI
-        SystemClk = 16000000;
+    while((*pReg & Mask) != Value){
+        if(--timeout == 0){
+            return 0;
+        }
     }
-    else if(clksrc == 1){//HSE
-        SystemClk = 8000000;
+    return 1;
+}
+
+/*********************************************************************
+ * @fn          RCC_ConfigSystemClock
+ * @brief       Run SYSCLK from the main PLL with the given dividers
+ * @param[in]   pClkConfig: PLL source, PLL factors and bus prescalers
+ * @return      @RCC_Status, on error the system keeps running from HSI
+ * @note        Sequence: switch to HSI so the PLL can be reprogrammed, regulator to scale 1,
+ *              flash wait states and ART accelerator for the new HCLK, PLL lock, bus prescalers,
+ *              then switch to PLL.
+ *              Peripherals clocked from APB must be reinitialised afterwards (baud rate, I2C CCR).
+ */
+uint8_t RCC_ConfigSystemClock(RCC_ClkConfig_t *pClkConfig){
+    uint32_t src, vco_in, vco_out, sysclk, hclk, pclk1, tempreg;
+    uint8_t latency = 0;
+
+    //1. check the PLL factors against the datasheet limits
+    src = (pClkConfig->RCC_PLLSource == RCC_PLL_SRC_HSI) ? HSI_VALUE : HSE_VALUE;
+    if(pClkConfig->RCC_PLLM < 2 || pClkConfig->RCC_PLLM > 63 || pClkConfig->RCC_PLLN < 50 ||
+       pClkConfig->RCC_PLLN > 432 || (pClkConfig->RCC_PLLP & 1) || pClkConfig->RCC_PLLP < 2 ||
+       pClkConfig->RCC_PLLP > 8 || pClkConfig->RCC_PLLQ < 2 || pClkConfig->RCC_PLLQ > 15){
+        return RCC_ERROR_PARAM;
     }
-    else{//PLL
-        SystemClk = RCC_GetPLLOutputClock();
+    vco_in = src / pClkConfig->RCC_PLLM;
+    vco_out = vco_in * pClkConfig->RCC_PLLN;
+    sysclk = vco_out / pClkConfig->RCC_PLLP;
+    hclk = (pClkConfig->RCC_AHBPrescaler < 8) ? sysclk : sysclk / AHB_Prescaler[pClkConfig->RCC_AHBPrescaler - 8];
+    pclk1 = (pClkConfig->RCC_APB1Prescaler < 4) ? hclk : hclk / APB1_Prescaler[pClkConfig->RCC_APB1Prescaler - 4];
+    if(vco_in < 1000000U || vco_in > 2000000U || vco_out < 100000000U || vco_out > 432000000U ||
+       sysclk > RCC_SYSCLK_MAX || pclk1 > RCC_PCLK1_MAX){
+        return RCC_ERROR_PARAM;
+    }
+    while(latency < 3 && hclk > FlashLatencyMaxHCLK[latency]){
+        latency++;
     }
 
-    //AHB
-    temp = ((RCC->CFGR >> 4) & 0xF);
+    //2. run from HSI while the PLL is reprogrammed
+    RCC->CR |= (1 << RCC_CR_HSION);
+    if(!rcc_wait(&RCC->CR, (1 << RCC_CR_HSIRDY), (1 << RCC_CR_HSIRDY))){
+        return RCC_ERROR_SWITCH;
+    }
+    RCC->CFGR &= ~(0x3 << RCC_CFGR_SW);
+    if(!rcc_wait(&RCC->CFGR, (0x3 << RCC_CFGR_SWS), 0)){
+        return RCC_ERROR_SWITCH;
+    }
+    RCC->CR &= ~(1 << RCC_CR_PLLON);
+    if(!rcc_wait(&RCC->CR, (1 << RCC_CR_PLLRDY), 0)){
+        return RCC_ERROR_SWITCH;
+    }
 
-    if(temp<8){
-        ahbp = 1;
-    } else {
-        ahbp = AHB_Prescaler[temp-8];
+    //3. start HSE when it feeds the PLL
+    if(pClkConfig->RCC_PLLSource != RCC_PLL_SRC_HSI){
+        RCC->CR &= ~((1 << RCC_CR_HSEON) | (1 << RCC_CR_HSEBYP));
+        if(pClkConfig->RCC_PLLSource == RCC_PLL_SRC_HSE_BYPASS){
+            //HSEBYP can only be written while HSE is off
+            RCC->CR |= (1 << RCC_CR_HSEBYP);
+        }
+        RCC->CR |= (1 << RCC_CR_HSEON);
+        if(!rcc_wait(&RCC->CR, (1 << RCC_CR_HSERDY), (1 << RCC_CR_HSERDY))){
+            RCC->CR &= ~((1 << RCC_CR_HSEON) | (1 << RCC_CR_HSEBYP));
+            return RCC_ERROR_HSE;
+        }
     }
 
-    //APB1
-    temp = ((RCC->CFGR >> 10) & 0x7);
-    if(temp<4){
-        apb1p = 1;
-    } else {
-        apb1p = APB1_Prescaler[temp-4];
+    //4. regulator scale 1 is needed above 84 MHz
+    PWR_CLK_ENABLE();
+    PWR->CR |= (0x3 << PWR_CR_VOS);
+
+    //5. flash wait states, HSI (16 MHz) runs with any latency so this is safe before the switch
+    tempreg = FLASH->ACR;
+    tempreg &= ~(0xF << FLASH_ACR_LATENCY);
+    tempreg |= (latency << FLASH_ACR_LATENCY);
+    FLASH->ACR = tempreg;
+    if((FLASH->ACR & (0xF << FLASH_ACR_LATENCY)) != (latency << FLASH_ACR_LATENCY)){
+        return RCC_ERROR_SWITCH;
+    }
+    RCC_FlashARTEnable();
+
+    //6. program and lock the PLL, reserved bits keep their value
+    tempreg = RCC->PLLCFGR;
+    tempreg &= ~((0x3F << RCC_PLLCFGR_PLLM) | (0x1FF << RCC_PLLCFGR_PLLN) | (0x3 << RCC_PLLCFGR_PLLP) |
+                 (1 << RCC_PLLCFGR_PLLSRC) | (0xF << RCC_PLLCFGR_PLLQ));
+    tempreg |= (pClkConfig->RCC_PLLM << RCC_PLLCFGR_PLLM);
+    tempreg |= (pClkConfig->RCC_PLLN << RCC_PLLCFGR_PLLN);
+    tempreg |= (((pClkConfig->RCC_PLLP >> 1) - 1) << RCC_PLLCFGR_PLLP);
+    tempreg |= ((pClkConfig->RCC_PLLSource != RCC_PLL_SRC_HSI) << RCC_PLLCFGR_PLLSRC);
+    tempreg |= (pClkConfig->RCC_PLLQ << RCC_PLLCFGR_PLLQ);
+    RCC->PLLCFGR = tempreg;
+    RCC->CR |= (1 << RCC_CR_PLLON);
+    if(!rcc_wait(&RCC->CR, (1 << RCC_CR_PLLRDY), (1 << RCC_CR_PLLRDY))){
+        return RCC_ERROR_SWITCH;
     }
 
-    pclk1 = SystemClk / (apb1p*ahbp);
-    return pclk1;
+    //7. bus prescalers before the switch so APB1 never runs above its limit
+    tempreg = RCC->CFGR;
+    tempreg &= ~((0xF << RCC_CFGR_HPRE) | (0x7 << RCC_CFGR_PPRE1) | (0x7 << RCC_CFGR_PPRE2));
+    tempreg |= (pClkConfig->RCC_AHBPrescaler << RCC_CFGR_HPRE);
+    tempreg |= (pClkConfig->RCC_APB1Prescaler << RCC_CFGR_PPRE1);
+    tempreg |= (pClkConfig->RCC_APB2Prescaler << RCC_CFGR_PPRE2);
+    RCC->CFGR = tempreg;
+
+    //8. switch SYSCLK to the PLL
+    RCC->CFGR |= (0x2 << RCC_CFGR_SW);
+    if(!rcc_wait(&RCC->CFGR, (0x3 << RCC_CFGR_SWS), (0x2 << RCC_CFGR_SWS))){
+        return RCC_ERROR_SWITCH;
+    }
+    return RCC_OK;
 }
 
-uint32_t RCC_GetPCLK2Value(void){
-    uint32_t pclk2, SystemClk;
-    uint8_t clksrc, temp, ahbp, apb2p;
+/*********************************************************************
+ * @fn          RCC_FlashARTEnable
+ * @brief       ART accelerator: flush the flash caches, then enable prefetch, I-cache and D-cache
+ * @return      None
+ * @note        Hides the flash wait states for sequential code and literal pools
+ */
+void RCC_FlashARTEnable(void){
+    RCC_FlashARTReset();
+    FLASH->ACR |= (1 << FLASH_ACR_PRFTEN) | (1 << FLASH_ACR_ICEN) | (1 << FLASH_ACR_DCEN);
+}
+
+/*********************************************************************
+ * @fn          RCC_FlashARTReset
+ * @brief       Invalidate the flash instruction and data caches
+ * @return      None
+ * @note        Needed after flash programming or before running another image. The reset bits only
+ *              act with the caches disabled, the previous enable state is restored afterwards.
+ */
+void RCC_FlashARTReset(void){
+    uint32_t acr = FLASH->ACR;
+
+    FLASH->ACR = acr & ~((1 << FLASH_ACR_ICEN) | (1 << FLASH_ACR_DCEN));
+    FLASH->ACR |= (1 << FLASH_ACR_ICRST) | (1 << FLASH_ACR_DCRST);
+    FLASH->ACR &= ~((1 << FLASH_ACR_ICRST) | (1 << FLASH_ACR_DCRST));
+    FLASH->ACR = acr;
+}
+
+/*********************************************************************
+ * @fn          RCC_ConfigSystemClock100MHz
+ * @brief       SYSCLK = HCLK = PCLK2 = 100 MHz, PCLK1 = 50 MHz
+ * @param[in]   PLLSource: @RCC_PLLSource
+ * @return      @RCC_Status, an HSE that does not start falls back to HSI
+ * @note        VCO input 2 MHz, VCO output 400 MHz, PLLP = 4, PLLQ = 9 (44.4 MHz, USB unused)
+ */
+uint8_t RCC_ConfigSystemClock100MHz(uint8_t PLLSource){
+    RCC_ClkConfig_t clk;
+    uint8_t status;
+
+    clk.RCC_PLLSource = PLLSource;
+    clk.RCC_PLLM = ((PLLSource == RCC_PLL_SRC_HSI) ? HSI_VALUE : HSE_VALUE) / 2000000U;
+    clk.RCC_PLLN = 200;
+    clk.RCC_PLLP = 4;
+    clk.RCC_PLLQ = 9;
+    clk.RCC_AHBPrescaler = RCC_AHB_DIV1;
+    clk.RCC_APB1Prescaler = RCC_APB_DIV2;
+    clk.RCC_APB2Prescaler = RCC_APB_DIV1;
+
+    status = RCC_ConfigSystemClock(&clk);
+    if(status == RCC_ERROR_HSE){
+        clk.RCC_PLLSource = RCC_PLL_SRC_HSI;
+        clk.RCC_PLLM = HSI_VALUE / 2000000U;
+        status = RCC_ConfigSystemClock(&clk);
+    }
+    return status;
+}
+
+uint32_t RCC_GetPLLOutputClock(void){
+    uint32_t src, pllm, plln, pllp;
+
+    //PLL output = (source / PLLM) * PLLN / PLLP, refer RCC_PLLCFGR
+    src = (RCC->PLLCFGR & (1 << RCC_PLLCFGR_PLLSRC)) ? HSE_VALUE : HSI_VALUE;
+    pllm = (RCC->PLLCFGR >> RCC_PLLCFGR_PLLM) & 0x3F;
+    plln = (RCC->PLLCFGR >> RCC_PLLCFGR_PLLN) & 0x1FF;
+    pllp = (((RCC->PLLCFGR >> RCC_PLLCFGR_PLLP) & 0x3) + 1) * 2;
+    if(pllm == 0){
+        return 0;
+    }
+    return (src / pllm) * plln / pllp;
+}
+
+uint32_t RCC_GetSysClockValue(void){
+    uint8_t clksrc;
 
-    //AHB
     //determind clock source: HSI, HSE, PLL
-    clksrc = ((RCC->CFGR >> 2) & 0x3);
+    clksrc = ((RCC->CFGR >> RCC_CFGR_SWS) & 0x3);
 
     if(clksrc == 0){//HSI
-        SystemClk = 16000000;
+        return HSI_VALUE;
     }
     else if(clksrc == 1){//HSE
-        SystemClk = 8000000;
+        return HSE_VALUE;
     }
     else{//PLL
-        SystemClk = RCC_GetPLLOutputClock();
+        return RCC_GetPLLOutputClock();
     }
+}
+
+uint32_t RCC_GetHCLKValue(void){
+    uint8_t temp;
 
     //AHB
-    temp = ((RCC->CFGR >> 4) & 0xF);
+    temp = ((RCC->CFGR >> RCC_CFGR_HPRE) & 0xF);
 
     if(temp<8){
-        ahbp = 1;
+        return RCC_GetSysClockValue();
+    }
+    return RCC_GetSysClockValue() / AHB_Prescaler[temp-8];
+}
+
+uint32_t RCC_GetPCLK1Value(void){
+    uint8_t temp, apb1p;
+
+    //APB1
+    temp = ((RCC->CFGR >> RCC_CFGR_PPRE1) & 0x7);
+    if(temp<4){
+        apb1p = 1;
     } else {
-        ahbp = AHB_Prescaler[temp-8];
+        apb1p = APB1_Prescaler[temp-4];
     }
 
+    return RCC_GetHCLKValue() / apb1p;
+}
+
+uint32_t RCC_GetPCLK2Value(void){
+    uint8_t temp, apb2p;
+
     //APB2
-    temp = ((RCC->CFGR >> 13) & 0x7);
+    temp = ((RCC->CFGR >> RCC_CFGR_PPRE2) & 0x7);
     if(temp<4){
         apb2p = 1;
     } else {
         apb2p = APB2_Prescaler[temp-4];
     }
 
-    pclk2 = SystemClk / (apb2p*ahbp);
-    return pclk2;
+    return RCC_GetHCLKValue() / apb2p;
 }
-
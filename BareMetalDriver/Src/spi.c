@@ -1,10 +1,57 @@
 #include "spi.h"
+#include "prof.h"
+#include "irq.h"
 #include <stddef.h>
 
 
-static void spi_txe_interrupt_handle(SPI_Handle_t *pHandle);
-static void spi_rxne_interrupt_handle(SPI_Handle_t *pHandle);
+RAMFUNC static void spi_txe_interrupt_handle(SPI_Handle_t *pHandle);
+RAMFUNC static void spi_rxne_interrupt_handle(SPI_Handle_t *pHandle);
 static void spi_ovr_interrupt_handle(SPI_Handle_t *pHandle);
+static void spi_dma_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+static void spi_dma_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+static void spi_dma_close(SPI_Handle_t *pHandle, uint8_t AppEv);
+static void spi_slave_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+static void spi_slave_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+
+/*
+ * CR1 for a configuration, SPE left clear
+ */
+static uint32_t spi_cr1_value(const SPI_Config_t *pConfig){
+    uint32_t tempreg = 0;
+
+    //1.config device mode
+    if(pConfig->SPI_DeviceMode == SPI_MODE_MASTER){
+        tempreg |= (1<<SPI_CR1_MSTR);
+    }
+
+    //2.config bus config
+    if(pConfig->SPI_BusConfig == SPI_BUS_CONFIG_FD){
+        //bidi mode should be cleared
+        tempreg &= ~(1<<SPI_CR1_BIDIMODE);
+    }else if(pConfig->SPI_BusConfig == SPI_BUS_CONFIG_SIMPLEX_RXONLY){
+        //bidi mode should be cleared
+        tempreg &= ~(1<<SPI_CR1_BIDIMODE);
+        //RX_ONLY must be set
+        tempreg |= (1<<SPI_CR1_RXONLY);
+    }
+    //3.config sclk speed
+    tempreg |= (pConfig->SPI_SclkSpeed << SPI_CR1_BR);
+    //4.config frame format
+    tempreg |= pConfig->SPI_DFF << SPI_CR1_DFF;
+    //5.config sclk polarity
+    tempreg |= pConfig->SPI_CPOL << SPI_CR1_CPOL;
+    //6.config sclk phase
+    tempreg |= pConfig->SPI_CPHA << SPI_CR1_CPHA;
+    //7.config software slave management: a master keeps its internal NSS high (SSI), or it
+    //  would see a mode fault
+    if(pConfig->SPI_SSM == SPI_SSM_ENABLE){
+        tempreg |= (1<<SPI_CR1_SSM);
+        if(pConfig->SPI_DeviceMode == SPI_MODE_MASTER){
+            tempreg |= (1<<SPI_CR1_SSI);
+        }
+    }
+    return tempreg;
+}
 /*******************************************************************
  * @fn          SPI_PeripheralClockControl
  * @brief       Enable or disable the SPI peripheral clock
@@ -49,35 +96,55 @@ void SPI_PeriClockControl(SPI_RegDef_t* SPIx, uint8_t EnorDi){
   *
  */
 void SPI_Init(SPI_Handle_t *pSPIHandler){
-    // config CPI CR1
-    uint32_t tempreg = 0;
-
     //enable peripheral clock
     SPI_PeriClockControl(pSPIHandler->pSPIx, ENABLE);
 
-    //1.config device mode
-    tempreg |= pSPIHandler->SPI_Config.SPI_DeviceMode << SPI_CR1_MSTR;
+    pSPIHandler->pSPIx->CR1 = spi_cr1_value(&pSPIHandler->SPI_Config);
+}
 
-    //2.config bus config
-    if(pSPIHandler->SPI_Config.SPI_BusConfig == SPI_BUS_CONFIG_FD){
-        //bidi mode should be cleared
-        tempreg &= ~(1<<15);
-    }else if(pSPIHandler->SPI_Config.SPI_BusConfig == SPI_BUS_CONFIG_SIMPLEX_RXONLY){
-        //bidi mode should be cleared
-        tempreg &= ~(1<<15);
-        //RX_ONLY must be set
-        tempreg |= (1<<10);
+/*******************************************************************
+  * @fn          SPI_ApplyConfig
+  * @brief       Switch a running SPI to another configuration (device on a shared bus)
+  * @param[in]   pSPIHandle: SPI handle
+  * @param[in]   pConfig: configuration to apply
+  * @return      1 when CR1 was reprogrammed, 0 when it already matched
+  * @note        Waits for the bus to be idle. SPE is kept as it was.
+  * */
+uint8_t SPI_ApplyConfig(SPI_Handle_t *pSPIHandle, const SPI_Config_t *pConfig){
+    SPI_RegDef_t *pSPIx = pSPIHandle->pSPIx;
+    uint32_t cr1 = spi_cr1_value(pConfig);
+    uint32_t spe = pSPIx->CR1 & (1<<SPI_CR1_SPE);
+
+    if((pSPIx->CR1 & ~(1<<SPI_CR1_SPE)) == cr1){
+        return 0;
+    }
+    //mode, speed and frame may only change with the SPI disabled (RM)
+    while(pSPIx->SR & SPI_BUSY_FLAG);
+    pSPIx->CR1 = cr1;
+    pSPIx->CR1 = cr1 | spe;
+    pSPIHandle->SPI_Config = *pConfig;
+    return 1;
+}
+
+/*
+ * RCC reset of the peripheral: registers back to reset values, TX buffer and shift register emptied
+ */
+static void spi_peri_reset(SPI_RegDef_t *pSPIx){
+    if (pSPIx == SPI1)
+    {
+        RCC->APB2RSTR |= (1 << 12);  // SPI1 reset
+        RCC->APB2RSTR &= ~(1 << 12); // clear reset bit
+    }
+    else if (pSPIx == SPI2)
+    {
+        RCC->APB1RSTR |= (1 << 14);  // SPI2 reset
+        RCC->APB1RSTR &= ~(1 << 14);
+    }
+    else if (pSPIx == SPI3)
+    {
+        RCC->APB1RSTR |= (1 << 15);  // SPI3 reset
+        RCC->APB1RSTR &= ~(1 << 15);
     }
-    //3.config sclk speed
-    tempreg |= (pSPIHandler->SPI_Config.SPI_SclkSpeed << SPI_CR1_BR);
-    //4.config frame format
-    tempreg |= pSPIHandler->SPI_Config.SPI_DFF << SPI_CR1_DFF;
-    //5.config sclk polarity
-    tempreg |= pSPIHandler->SPI_Config.SPI_CPOL << SPI_CR1_CPOL;
-    //6.config sclk phase
-    tempreg |= pSPIHandler->SPI_Config.SPI_CPHA << SPI_CR1_CPHA;
-    //7.config software slave management
-    pSPIHandler->pSPIx->CR1 = tempreg;
 }
 
 /*******************************************************************
@@ -93,21 +160,7 @@ void SPI_Init(SPI_Handle_t *pSPIHandler){
   *
   * */
 void SPI_DeInit(SPI_Handle_t *pSPIHandle){
-    if (pSPIHandle->pSPIx == SPI1)
-    {
-        RCC->APB2RSTR |= (1 << 12);  // SPI1 reset
-        RCC->APB2RSTR &= ~(1 << 12); // clear reset bit
-    }
-    else if (pSPIHandle->pSPIx == SPI2)
-    {
-        RCC->APB1RSTR |= (1 << 14);  // SPI2 reset
-        RCC->APB1RSTR &= ~(1 << 14);
-    }
-    else if (pSPIHandle->pSPIx == SPI3)
-    {
-        RCC->APB1RSTR |= (1 << 15);  // SPI3 reset
-        RCC->APB1RSTR &= ~(1 << 15);
-    }
+    spi_peri_reset(pSPIHandle->pSPIx);
     SPI_PeriClockControl(pSPIHandle->pSPIx, DISABLE);
 }
 
@@ -149,6 +202,23 @@ void SPI_SSIConfig(SPI_RegDef_t *pSPIx, uint8_t EnorDi){
         pSPIx->CR1 &= ~(1<<SPI_CR1_SSI);
     }
 }
+/*
+ * halfword loops for DFF=16, the buffer is 2-byte aligned
+ */
+static void spi_send16(SPI_RegDef_t *pSPIx, const uint16_t *pTxBuffer, uint32_t count){
+    while(count--){
+        while(!(pSPIx->SR & SPI_TXE_FLAG));
+        pSPIx->DR = *pTxBuffer++;
+    }
+}
+
+static void spi_receive16(SPI_RegDef_t *pSPIx, uint16_t *pRxBuffer, uint32_t count){
+    while(count--){
+        while(!(pSPIx->SR & SPI_RXNE_FLAG));
+        *pRxBuffer++ = (uint16_t)pSPIx->DR;
+    }
+}
+
 /*******************************************************************
   * @fn          SPI_SendData
   * @brief       Send a Data through the SPI peripheral
@@ -156,31 +226,31 @@ void SPI_SSIConfig(SPI_RegDef_t *pSPIx, uint8_t EnorDi){
   *              This parameter can be one of the following values:
   *              SPI1, SPI2, SPI3
   * @param[in]   pTxBuffer: pointer to data buffer
-  * @param[in]   len: length of data buffer
+  * @param[in]   len: length of data buffer in bytes, even with SPI_DFF_16BIT
   * @return      None
-  * @note        None
+  * @note        16-bit frames are taken little endian from the buffer (first byte = low byte),
+  *              an aligned buffer is streamed as halfwords
   * */
 void SPI_SendData(SPI_RegDef_t *pSPIx, uint8_t *pTxBuffer, uint32_t len){
-    while(len>0){
-        //1. wait until TXE(Transmit buffer empty) is set
-        while(SPI_GetFlagStatus(pSPIx, SPI_TXE_FLAG) == FLAG_RESET);
-
-        //2. check DFF
-        if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
-            //16bit data
-            //1. load data into DR
-            pSPIx->DR = (*pTxBuffer & 0xFFFF);//&0xff to up 16bit
-            len--;
-            len--;
-            (uint16_t*)pTxBuffer++;
+    PROF_ENTER();
+    //frame format checked once, not for every item
+    if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
+        if(((uintptr_t)pTxBuffer & 1U) == 0U){
+            spi_send16(pSPIx, (const uint16_t *)pTxBuffer, len / 2);
         } else {
-            //8bit data
-            pSPIx->DR = (*pTxBuffer);
-            len--;
-            pTxBuffer++;
+            for(; len >= 2; len -= 2, pTxBuffer += 2){
+                while(!(pSPIx->SR & SPI_TXE_FLAG));
+                pSPIx->DR = (uint16_t)(pTxBuffer[0] | (pTxBuffer[1] << 8));
+            }
+        }
+    } else {
+        for(; len > 0; len--){
+            //wait until TXE(Transmit buffer empty) is set
+            while(!(pSPIx->SR & SPI_TXE_FLAG));
+            pSPIx->DR = *pTxBuffer++;
         }
-
     }
+    PROF_EXIT(PROF_ID_SPI_SEND);
 }
 
 /*******************************************************************
@@ -190,30 +260,79 @@ void SPI_SendData(SPI_RegDef_t *pSPIx, uint8_t *pTxBuffer, uint32_t len){
   *              This parameter can be one of the following values:
   *              SPI1, SPI2, SPI3
   * @param[in]   pRxBuffer: pointer to data buffer
+  * @param[in]   len: length of data buffer in bytes, even with SPI_DFF_16BIT
   * @return      None
-  * @note        None
+  * @note        16-bit frames are stored little endian, an aligned buffer is filled as halfwords
   * */
 void SPI_ReceiveData(SPI_RegDef_t *pSPIx, uint8_t *pRxBuffer, uint32_t len){
-    while(len>0){
-        //1. wait until TXE(Transmit buffer empty) is set
-        while(SPI_GetFlagStatus(pSPIx, SPI_RXNE_FLAG) == FLAG_RESET);
-
-        //2. check DFF
-        if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
-            //16bit data
-            //1. load data into DR
-            *((uint16_t*)pRxBuffer) = pSPIx->DR;//&0xff to up 16bit
-            len--;
-            len--;
-            (uint16_t*)pRxBuffer++;
+    PROF_ENTER();
+    if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
+        if(((uintptr_t)pRxBuffer & 1U) == 0U){
+            spi_receive16(pSPIx, (uint16_t *)pRxBuffer, len / 2);
         } else {
-            //8bit data
-            (*pRxBuffer) = pSPIx->DR;
-            len--;
-            pRxBuffer++;
+            for(; len >= 2; len -= 2, pRxBuffer += 2){
+                uint16_t item;
+                while(!(pSPIx->SR & SPI_RXNE_FLAG));
+                item = (uint16_t)pSPIx->DR;
+                pRxBuffer[0] = (uint8_t)item;
+                pRxBuffer[1] = (uint8_t)(item >> 8);
+            }
         }
+    } else {
+        for(; len > 0; len--){
+            //wait until RXNE(Receive buffer not empty) is set
+            while(!(pSPIx->SR & SPI_RXNE_FLAG));
+            *pRxBuffer++ = (uint8_t)pSPIx->DR;
+        }
+    }
+    PROF_EXIT(PROF_ID_SPI_RECEIVE);
+}
 
+/*******************************************************************
+  * @fn          SPI_SendData16
+  * @brief       Send 16-bit frames
+  * @param[in]   pSPIx: SPI1, SPI2, SPI3, configured with SPI_DFF_16BIT
+  * @param[in]   pTxBuffer: frames to send
+  * @param[in]   count: number of frames
+  * @return      None
+  * */
+void SPI_SendData16(SPI_RegDef_t *pSPIx, const uint16_t *pTxBuffer, uint32_t count){
+    PROF_ENTER();
+    spi_send16(pSPIx, pTxBuffer, count);
+    PROF_EXIT(PROF_ID_SPI_SEND16);
+}
+
+/*******************************************************************
+  * @fn          SPI_ReceiveData16
+  * @brief       Receive 16-bit frames
+  * @param[in]   pSPIx: SPI1, SPI2, SPI3, configured with SPI_DFF_16BIT
+  * @param[in]   pRxBuffer: received frames
+  * @param[in]   count: number of frames
+  * @return      None
+  * */
+void SPI_ReceiveData16(SPI_RegDef_t *pSPIx, uint16_t *pRxBuffer, uint32_t count){
+    PROF_ENTER();
+    spi_receive16(pSPIx, pRxBuffer, count);
+    PROF_EXIT(PROF_ID_SPI_RECEIVE16);
+}
+
+/*
+ * interrupt transfers move whole frames: the handlers never read or write past len
+ */
+static uint8_t spi_len_ok(SPI_RegDef_t *pSPIx, uint32_t len){
+    if(len == 0){
+        return 0;
     }
+    return !((pSPIx->CR1 & (1<<SPI_CR1_DFF)) && (len & 1U));
+}
+
+/*
+ * DMA transfers as well: NDTR is 16 bits, and a stream of 0 items never completes
+ */
+static uint8_t spi_dma_len_ok(SPI_RegDef_t *pSPIx, uint32_t len){
+    uint32_t items = (pSPIx->CR1 & (1<<SPI_CR1_DFF)) ? len / 2 : len;
+
+    return spi_len_ok(pSPIx, len) && items <= 0xFFFF;
 }
 
 /*******************************************************************
@@ -223,13 +342,16 @@ void SPI_ReceiveData(SPI_RegDef_t *pSPIx, uint8_t *pRxBuffer, uint32_t len){
  *              This parameter can be one of the following values:
  *              SPI1, SPI2, SPI3
  * @param[in]   pTxBuffer: pointer to data buffer
- * @param[in]   len: length of data buffer
- * @return      None
+ * @param[in]   len: length of data buffer in bytes, even with SPI_DFF_16BIT
+ * @return      previous state, SPI_ERROR_PARAM for a length of 0 or an odd one with 16-bit frames
  * @note        None
  * */
 uint8_t SPI_SendDataIT(SPI_Handle_t *pSPIHandler, uint8_t *pTxBuffer, uint32_t len){
+    PROF_ENTER();
     uint8_t state = pSPIHandler->TxState;
-    if(state!=SPI_BUSY_IN_TX){
+    if(state!=SPI_BUSY_IN_TX && !spi_len_ok(pSPIHandler->pSPIx, len)){
+        state = SPI_ERROR_PARAM;
+    } else if(state!=SPI_BUSY_IN_TX){
         //1. Save TX buffer address and length of data to be sent in global variable
         pSPIHandler->pTxBuffer = pTxBuffer;
         pSPIHandler->TxLen = len;
@@ -239,6 +361,7 @@ uint8_t SPI_SendDataIT(SPI_Handle_t *pSPIHandler, uint8_t *pTxBuffer, uint32_t l
         pSPIHandler->pSPIx->CR2 |= (1<<SPI_CR2_TXEIE);
         //4. Transmit data will be handled in ISR code
     }
+    PROF_EXIT(PROF_ID_SPI_SEND_IT);
     return state;
 }
 
@@ -249,25 +372,374 @@ uint8_t SPI_SendDataIT(SPI_Handle_t *pSPIHandler, uint8_t *pTxBuffer, uint32_t l
  *              This parameter can be one of the following values:
  *              SPI1, SPI2, SPI3
  * @param[in]   pRxBuffer: pointer to data buffer
- * @return      None
+ * @param[in]   len: length of data buffer in bytes, even with SPI_DFF_16BIT
+ * @return      previous state, SPI_ERROR_PARAM for a length of 0 or an odd one with 16-bit frames
  * @note        None
  * */
 
 uint8_t SPI_ReceiveDataIT(SPI_Handle_t *pSPIHandler, uint8_t *pRxBuffer, uint32_t len){
+    PROF_ENTER();
     uint8_t state = pSPIHandler->RxState;
-    if(state!=SPI_BUSY_IN_RX){
+    if(state!=SPI_BUSY_IN_RX && !spi_len_ok(pSPIHandler->pSPIx, len)){
+        state = SPI_ERROR_PARAM;
+    } else if(state!=SPI_BUSY_IN_RX){
         //1. Save RX buffer address and length of data to be sent in global variable
         pSPIHandler->pRxBuffer = pRxBuffer;
         pSPIHandler->RxLen = len;
         //2. mark spi state as busy in transmission so that no other code can take over the same SPI bus until transmission is complete
         pSPIHandler->RxState = SPI_BUSY_IN_RX;
-        //3. Enable RXEIE control bit in SPI_CR2 register to get interupt when RXE flag is set
-        pSPIHandler->pSPIx->CR2 |= (1<<SPI_CR2_TXEIE);
+        //3. Enable RXNEIE control bit in SPI_CR2 register to get interupt when RXNE flag is set
+        pSPIHandler->pSPIx->CR2 |= (1<<SPI_CR2_RXNEIE);
         //4. Transmit data will be handled in ISR code
     }
+    PROF_EXIT(PROF_ID_SPI_RECEIVE_IT);
     return state;
 }
 
+/*
+ * stream of one direction of a DMA transfer, the memory side only moves along a real buffer
+ */
+static void spi_dma_setup(SPI_Handle_t *pSPIHandle, DMA_Handle_t *pDMAHandle, uint32_t Direction,
+                          uint8_t MemInc, uint32_t DataSize, uint32_t Mode, DMA_Callback_t Callback){
+    pDMAHandle->DMA_Config.DMA_Direction = Direction;
+    pDMAHandle->DMA_Config.DMA_PeriphInc = DISABLE;
+    pDMAHandle->DMA_Config.DMA_MemInc = MemInc;
+    pDMAHandle->DMA_Config.DMA_PeriphDataSize = DataSize;
+    pDMAHandle->DMA_Config.DMA_MemDataSize = DataSize;
+    pDMAHandle->DMA_Config.DMA_Mode = Mode;
+    //RX drains DR before the next item lands in it, TX only has to keep up
+    pDMAHandle->DMA_Config.DMA_Priority = (Direction == DMA_DIR_PERIPH_TO_MEM) ? DMA_PRIORITY_VERY_HIGH
+                                                                              : DMA_PRIORITY_HIGH;
+    pDMAHandle->Callback = Callback;
+    pDMAHandle->pParent = pSPIHandle;
+    DMA_Init(pDMAHandle);
+}
+
+/*******************************************************************
+ * @fn          SPI_TransferDMA
+ * @brief       Full-duplex transfer with one DMA stream per direction, no CPU work per item
+ * @param[in]   pSPIHandle: SPI handle, pTxDMA and pRxDMA must point to the streams of this SPI
+ *              (@SPI_DMA_Streams)
+ * @param[in]   pTxBuffer: data to send, NULL sends TxFill for every item (receive only)
+ * @param[in]   pRxBuffer: received data, NULL drops it into RxDiscard (transmit only)
+ * @param[in]   len: number of bytes (two per item with SPI_DFF_16BIT, len even), 1 to 65535 items.
+ *              16-bit items are moved as halfwords: buffers must be 2-byte aligned
+ * @param[in]   Callback: called with SPI_EVENT_TXRX_CMPLT or SPI_EVENT_DMA_ERROR from the RX
+ *              stream interrupt, NULL reports to SPI_ApplicationEventCallback
+ * @return      previous state, the transfer is only started when it was SPI_READY.
+ *              SPI_ERROR_PARAM for a length out of range, nothing is started.
+ * @note        Only the RX stream raises an interrupt: the last item received means the last
+ *              one sent. Buffers must stay valid until the callback. The application routes both
+ *              stream IRQs to DMA_IRQHandling (DMA_IRQRegister). The SPI is enabled here.
+ */
+uint8_t SPI_TransferDMA(SPI_Handle_t *pSPIHandle, const uint8_t *pTxBuffer, uint8_t *pRxBuffer, uint32_t len,
+                        SPI_Callback_t Callback){
+    SPI_RegDef_t *pSPIx = pSPIHandle->pSPIx;
+    uint8_t state = (pSPIHandle->TxState != SPI_READY) ? pSPIHandle->TxState : pSPIHandle->RxState;
+    uint32_t size = DMA_SIZE_BYTE;
+    uint32_t items = len;
+
+    if(state != SPI_READY){
+        return state;
+    }
+    if(!spi_dma_len_ok(pSPIx, len)){
+        return SPI_ERROR_PARAM;
+    }
+    if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
+        size = DMA_SIZE_HALFWORD;
+        items = len / 2;
+    }
+
+    pSPIHandle->pTxBuffer = (uint8_t *)pTxBuffer;
+    pSPIHandle->pRxBuffer = pRxBuffer;
+    pSPIHandle->TxLen = len;
+    pSPIHandle->RxLen = len;
+    pSPIHandle->TxState = SPI_BUSY_IN_TXRX_DMA;
+    pSPIHandle->RxState = SPI_BUSY_IN_TXRX_DMA;
+    pSPIHandle->Callback = Callback;
+
+    spi_dma_setup(pSPIHandle, pSPIHandle->pRxDMA, DMA_DIR_PERIPH_TO_MEM, (pRxBuffer != NULL) ? ENABLE : DISABLE,
+                  size, DMA_MODE_NORMAL, spi_dma_rx_callback);
+    spi_dma_setup(pSPIHandle, pSPIHandle->pTxDMA, DMA_DIR_MEM_TO_PERIPH, (pTxBuffer != NULL) ? ENABLE : DISABLE,
+                  size, DMA_MODE_NORMAL, spi_dma_tx_callback);
+
+    //an item left in DR by an earlier transfer would be the first one received
+    SPI_ClearOVRFlag(pSPIx);
+
+    //RM order: RXDMAEN, streams, TXDMAEN, so nothing is received before the RX stream is ready
+    pSPIx->CR2 |= (1<<SPI_CR2_RXDMAEN);
+    DMA_StartIT(pSPIHandle->pRxDMA, (uint32_t)(uintptr_t)&pSPIx->DR,
+                (pRxBuffer != NULL) ? (uint32_t)(uintptr_t)pRxBuffer : (uint32_t)(uintptr_t)&pSPIHandle->RxDiscard,
+                items);
+    //TX completion is not waited for, only its errors interrupt
+    pSPIHandle->pTxDMA->pStream->CR |= (1 << DMA_SxCR_TEIE);
+    DMA_Start(pSPIHandle->pTxDMA, (uint32_t)(uintptr_t)&pSPIx->DR,
+              (pTxBuffer != NULL) ? (uint32_t)(uintptr_t)pTxBuffer : (uint32_t)(uintptr_t)&pSPIHandle->TxFill,
+              items);
+    pSPIx->CR2 |= (1<<SPI_CR2_TXDMAEN);
+    pSPIx->CR1 |= (1<<SPI_CR1_SPE);
+
+    return state;
+}
+
+static void spi_dma_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    if(Event == DMA_EVENT_ERROR){
+        spi_dma_close((SPI_Handle_t *)pDMAHandle->pParent, SPI_EVENT_DMA_ERROR);
+    }
+}
+
+static void spi_dma_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    if(Event == DMA_EVENT_CMPLT){
+        spi_dma_close((SPI_Handle_t *)pDMAHandle->pParent, SPI_EVENT_TXRX_CMPLT);
+    } else if(Event == DMA_EVENT_ERROR){
+        spi_dma_close((SPI_Handle_t *)pDMAHandle->pParent, SPI_EVENT_DMA_ERROR);
+    }
+}
+
+/*
+ * end of SPI_TransferDMA: streams and requests off, handle ready before the callback so it can
+ * start the next transfer
+ */
+static void spi_dma_close(SPI_Handle_t *pHandle, uint8_t AppEv){
+    SPI_Callback_t callback = pHandle->Callback;
+
+    if(pHandle->RxState != SPI_BUSY_IN_TXRX_DMA){
+        return;
+    }
+    //last item received: the bus goes idle within a clock, then chip select may be released
+    if(AppEv == SPI_EVENT_TXRX_CMPLT){
+        while(SPI_GetFlagStatus(pHandle->pSPIx, SPI_BUSY_FLAG) == FLAG_SET);
+    }
+    pHandle->pSPIx->CR2 &= ~((1<<SPI_CR2_TXDMAEN) | (1<<SPI_CR2_RXDMAEN));
+    DMA_Stop(pHandle->pTxDMA);
+    DMA_Stop(pHandle->pRxDMA);
+
+    pHandle->pTxBuffer = NULL;
+    pHandle->pRxBuffer = NULL;
+    pHandle->TxLen = 0;
+    pHandle->RxLen = 0;
+    pHandle->TxState = SPI_READY;
+    pHandle->RxState = SPI_READY;
+    pHandle->Callback = NULL;
+
+    if(callback != NULL){
+        callback(pHandle, AppEv);
+    } else {
+        SPI_ApplicationEventCallback(pHandle, AppEv);
+    }
+}
+
+/*
+ * slave reply: the TX stream runs once over the reply, the SPI repeats the last item after it.
+ * Without a reply the stream feeds TxFill for every item of every frame, an SPI with nothing
+ * written would send whatever its shift register holds.
+ */
+static void spi_slave_arm_tx(SPI_Handle_t *pHandle){
+    SPI_RegDef_t *pSPIx = pHandle->pSPIx;
+    uint32_t size = DMA_SIZE_BYTE;
+    uint32_t items = pHandle->TxLen;
+
+    if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
+        size = DMA_SIZE_HALFWORD;
+        items = pHandle->TxLen / 2;
+    }
+    if(pHandle->pTxBuffer == NULL){
+        spi_dma_setup(pHandle, pHandle->pTxDMA, DMA_DIR_MEM_TO_PERIPH, DISABLE, size, DMA_MODE_CIRCULAR,
+                      spi_slave_tx_callback);
+        pHandle->pTxDMA->pStream->CR |= (1 << DMA_SxCR_TEIE);
+        DMA_Start(pHandle->pTxDMA, (uint32_t)(uintptr_t)&pSPIx->DR, (uint32_t)(uintptr_t)&pHandle->TxFill, 1);
+    } else {
+        spi_dma_setup(pHandle, pHandle->pTxDMA, DMA_DIR_MEM_TO_PERIPH, ENABLE, size, DMA_MODE_NORMAL,
+                      spi_slave_tx_callback);
+        pHandle->pTxDMA->pStream->CR |= (1 << DMA_SxCR_TEIE);
+        DMA_Start(pHandle->pTxDMA, (uint32_t)(uintptr_t)&pSPIx->DR, (uint32_t)(uintptr_t)pHandle->pTxBuffer, items);
+    }
+    pSPIx->CR2 |= (1<<SPI_CR2_TXDMAEN);
+}
+
+/*
+ * hand out what the RX stream wrote since the last call, as at most two slices (buffer wrap)
+ */
+static void spi_slave_deliver(SPI_Handle_t *pHandle, uint8_t AppEv){
+    uint32_t itemsize = (pHandle->pSPIx->CR1 & (1<<SPI_CR1_DFF)) ? 2U : 1U;
+    uint32_t pos = pHandle->RxLen - DMA_GetRemaining(pHandle->pRxDMA) * itemsize;
+    uint32_t last = pHandle->RxDMAPos;
+
+    //NDTR is reloaded at the wrap, that is position 0
+    if(pos >= pHandle->RxLen){
+        pos = 0;
+    }
+    if(pos == last){
+        if(AppEv == SPI_EVENT_FRAME){
+            //frame boundary on a slice boundary still has to be reported
+            SPI_ApplicationFrameCallback(pHandle, &pHandle->pRxBuffer[last], 0, AppEv);
+        }
+        return;
+    }
+    if(pos > last){
+        SPI_ApplicationFrameCallback(pHandle, &pHandle->pRxBuffer[last], pos - last, AppEv);
+    } else {
+        //tail of the ring first, then the beginning
+        SPI_ApplicationFrameCallback(pHandle, &pHandle->pRxBuffer[last], pHandle->RxLen - last,
+                                     (pos == 0) ? AppEv : SPI_EVENT_FRAME_PART);
+        if(pos > 0){
+            SPI_ApplicationFrameCallback(pHandle, pHandle->pRxBuffer, pos, AppEv);
+        }
+    }
+    pHandle->RxDMAPos = pos;
+}
+
+/*******************************************************************
+ * @fn          SPI_SlaveStartDMA
+ * @brief       Run the SPI as a slave: circular DMA into a receive ring, optional DMA reply
+ * @param[in]   pSPIHandle: SPI handle, SPI_Init done with SPI_MODE_SLAVE, pTxDMA/pRxDMA set
+ *              (@SPI_DMA_Streams)
+ * @param[in]   pRxBuffer: receive ring owned by the DMA
+ * @param[in]   RxLen: size of the ring in bytes (even with SPI_DFF_16BIT, at most 65535 items)
+ * @param[in]   pTxBuffer: reply sent from the start of every frame, NULL sends TxFill for every item
+ * @param[in]   TxLen: size of the reply in bytes, the last item is repeated when the master
+ *              clocks more. Same limits as RxLen when pTxBuffer is set
+ * @return      previous state, the slave is only started when it was SPI_READY.
+ *              SPI_ERROR_PARAM for a length out of range, nothing is started.
+ * @note        Frames are delimited by the rising edge of NSS: the application configures that
+ *              pin as GPIO_MODE_ITRT and calls SPI_SlaveNSSHandling from its EXTI interrupt.
+ *              With SPI_SSM_ENABLE the SPI is always selected and NSS only needs the EXTI pin.
+ *              Data is reported through SPI_ApplicationFrameCallback as slices of pRxBuffer, no
+ *              copy is made: SPI_EVENT_FRAME at the end of a frame, SPI_EVENT_FRAME_PART when
+ *              half or all of the ring filled up within one. The CPU is not involved per item, so
+ *              SCK only has to stay below what the DMA sustains (fPCLK/2).
+ */
+uint8_t SPI_SlaveStartDMA(SPI_Handle_t *pSPIHandle, uint8_t *pRxBuffer, uint32_t RxLen,
+                          const uint8_t *pTxBuffer, uint32_t TxLen){
+    SPI_RegDef_t *pSPIx = pSPIHandle->pSPIx;
+    uint8_t state = (pSPIHandle->TxState != SPI_READY) ? pSPIHandle->TxState : pSPIHandle->RxState;
+    uint32_t size = DMA_SIZE_BYTE;
+    uint32_t items = RxLen;
+
+    if(state != SPI_READY){
+        return state;
+    }
+    if(!spi_dma_len_ok(pSPIx, RxLen) || (pTxBuffer != NULL && !spi_dma_len_ok(pSPIx, TxLen))){
+        return SPI_ERROR_PARAM;
+    }
+    if(pSPIx->CR1 & (1<<SPI_CR1_DFF)){
+        size = DMA_SIZE_HALFWORD;
+        items = RxLen / 2;
+    }
+
+    pSPIHandle->pRxBuffer = pRxBuffer;
+    pSPIHandle->RxLen = RxLen;
+    pSPIHandle->RxDMAPos = 0;
+    pSPIHandle->pTxBuffer = (uint8_t *)pTxBuffer;
+    pSPIHandle->TxLen = TxLen;
+    pSPIHandle->TxState = SPI_BUSY_IN_SLAVE_DMA;
+    pSPIHandle->RxState = SPI_BUSY_IN_SLAVE_DMA;
+
+    spi_dma_setup(pSPIHandle, pSPIHandle->pRxDMA, DMA_DIR_PERIPH_TO_MEM, ENABLE, size, DMA_MODE_CIRCULAR,
+                  spi_slave_rx_callback);
+
+    SPI_ClearOVRFlag(pSPIx);
+    pSPIx->CR2 |= (1<<SPI_CR2_RXDMAEN);
+    DMA_StartIT(pSPIHandle->pRxDMA, (uint32_t)(uintptr_t)&pSPIx->DR, (uint32_t)(uintptr_t)pRxBuffer, items);
+    spi_slave_arm_tx(pSPIHandle);
+    pSPIx->CR1 |= (1<<SPI_CR1_SPE);
+
+    return state;
+}
+
+/*******************************************************************
+ * @fn          SPI_SlaveSetReply
+ * @brief       Change the reply of SPI_SlaveStartDMA
+ * @param[in]   pSPIHandle: SPI handle running as slave
+ * @param[in]   pTxBuffer: new reply, NULL sends TxFill
+ * @param[in]   TxLen: size of the reply in bytes, same limits as in SPI_SlaveStartDMA
+ * @return      SPI_READY, or SPI_ERROR_PARAM for a length out of range: the reply is not changed
+ * @note        Armed at the next end of frame (SPI_SlaveNSSHandling): called from
+ *              SPI_ApplicationFrameCallback with SPI_EVENT_FRAME it is the reply of the next frame,
+ *              otherwise of the one after it. The old reply must stay valid until then.
+ */
+uint8_t SPI_SlaveSetReply(SPI_Handle_t *pSPIHandle, const uint8_t *pTxBuffer, uint32_t TxLen){
+    uint32_t state;
+
+    if(pTxBuffer != NULL && !spi_dma_len_ok(pSPIHandle->pSPIx, TxLen)){
+        return SPI_ERROR_PARAM;
+    }
+    ENTER_CRITICAL(state);
+    pSPIHandle->pTxBuffer = (uint8_t *)pTxBuffer;
+    pSPIHandle->TxLen = TxLen;
+    EXIT_CRITICAL(state);
+    return SPI_READY;
+}
+
+/*******************************************************************
+ * @fn          SPI_SlaveNSSHandling
+ * @brief       End of frame: deliver the frame and re-arm the reply for the next one
+ * @param[in]   pSPIHandle: SPI handle running as slave
+ * @return      None
+ * @note        Called from the EXTI interrupt of the NSS pin, after GPIO_IRQHandling.
+ *              Items of the reply still in the SPI (TX buffer and shift register) can only be
+ *              dropped by an RCC reset, so the SPI is reset and set up again here: the master
+ *              must leave NSS high for the latency of this interrupt before the next frame.
+ */
+void SPI_SlaveNSSHandling(SPI_Handle_t *pSPIHandle){
+    SPI_RegDef_t *pSPIx = pSPIHandle->pSPIx;
+
+    if(pSPIHandle->RxState != SPI_BUSY_IN_SLAVE_DMA){
+        return;
+    }
+    spi_slave_deliver(pSPIHandle, SPI_EVENT_FRAME);
+
+    //the RX stream keeps running, only its request is off during the reset
+    DMA_Stop(pSPIHandle->pTxDMA);
+    spi_peri_reset(pSPIx);
+    pSPIx->CR1 = spi_cr1_value(&pSPIHandle->SPI_Config);
+    pSPIx->CR2 |= (1<<SPI_CR2_RXDMAEN);
+    spi_slave_arm_tx(pSPIHandle);
+    pSPIx->CR1 |= (1<<SPI_CR1_SPE);
+}
+
+/*******************************************************************
+ * @fn          SPI_SlaveStop
+ * @brief       Stop a slave started with SPI_SlaveStartDMA
+ * @param[in]   pSPIHandle: SPI handle
+ * @return      None
+ * @note        Data received since the last slice is delivered as SPI_EVENT_FRAME_PART
+ */
+void SPI_SlaveStop(SPI_Handle_t *pSPIHandle){
+    if(pSPIHandle->RxState != SPI_BUSY_IN_SLAVE_DMA){
+        return;
+    }
+    pSPIHandle->pSPIx->CR1 &= ~(1<<SPI_CR1_SPE);
+    pSPIHandle->pSPIx->CR2 &= ~((1<<SPI_CR2_TXDMAEN) | (1<<SPI_CR2_RXDMAEN));
+    spi_slave_deliver(pSPIHandle, SPI_EVENT_FRAME_PART);
+    DMA_Stop(pSPIHandle->pTxDMA);
+    DMA_Stop(pSPIHandle->pRxDMA);
+
+    pSPIHandle->pTxBuffer = NULL;
+    pSPIHandle->pRxBuffer = NULL;
+    pSPIHandle->TxLen = 0;
+    pSPIHandle->RxLen = 0;
+    pSPIHandle->TxState = SPI_READY;
+    pSPIHandle->RxState = SPI_READY;
+}
+
+static void spi_slave_rx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    SPI_Handle_t *pHandle = (SPI_Handle_t *)pDMAHandle->pParent;
+
+    if(Event == DMA_EVENT_ERROR){
+        SPI_ApplicationEventCallback(pHandle, SPI_EVENT_DMA_ERROR);
+        return;
+    }
+    //half or full ring: pass the data on so a long frame does not get overwritten
+    spi_slave_deliver(pHandle, SPI_EVENT_FRAME_PART);
+}
+
+static void spi_slave_tx_callback(DMA_Handle_t *pDMAHandle, uint8_t Event){
+    if(Event == DMA_EVENT_ERROR){
+        SPI_ApplicationEventCallback((SPI_Handle_t *)pDMAHandle->pParent, SPI_EVENT_DMA_ERROR);
+    }
+}
+
 /*
  * IRQ Configuration and ISR handling
  */
@@ -277,7 +749,8 @@ void SPI_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi){
 void SPI_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority){
 
 }
-void SPI_IRQHandle(SPI_Handle_t *pHandle){
+RAMFUNC void SPI_IRQHandle(SPI_Handle_t *pHandle){
+    PROF_ENTER();
     uint8_t temp1, temp2;
     //first check if TXE  is set
     temp1 = pHandle->pSPIx->SR & (1<<SPI_SR_TXE);
@@ -303,18 +776,17 @@ void SPI_IRQHandle(SPI_Handle_t *pHandle){
         //hanlde ERR interrupt
         spi_ovr_interrupt_handle(pHandle);
     }
-
+    PROF_EXIT(PROF_ID_SPI_IRQ);
 }
 
-static void spi_txe_interrupt_handle(SPI_Handle_t *pHandle){
+RAMFUNC static void spi_txe_interrupt_handle(SPI_Handle_t *pHandle){
         //2. check DFF
         if(pHandle->pSPIx->CR1 & (1<<SPI_CR1_DFF)){
             //16bit data
             //1. load data into DR
-            pHandle->pSPIx->DR = *((uint16_t*)pHandle->pTxBuffer);//&0xff to up 16bit
-            pHandle->TxLen--;
-            pHandle->TxLen--;
-            (uint16_t*)pHandle->pTxBuffer++;
+            pHandle->pSPIx->DR = (uint16_t)(pHandle->pTxBuffer[0] | (pHandle->pTxBuffer[1] << 8));
+            pHandle->TxLen -= 2;//even, checked by SPI_SendDataIT
+            pHandle->pTxBuffer += 2;
         } else {
             //8bit data
             pHandle->pSPIx->DR = *(pHandle->pTxBuffer);//&0xff to up 16bit
@@ -328,15 +800,16 @@ static void spi_txe_interrupt_handle(SPI_Handle_t *pHandle){
             SPI_ApplicationEventCallback(pHandle, SPI_EVENT_TX_CMPLT);
         }
 }
-static void spi_rxne_interrupt_handle(SPI_Handle_t *pHandle){
+RAMFUNC static void spi_rxne_interrupt_handle(SPI_Handle_t *pHandle){
         //2. check DFF
         if(pHandle->pSPIx->CR1 & (1<<SPI_CR1_DFF)){
             //16bit data
             //1. load data into DR
-            *((uint16_t*)pHandle->pRxBuffer) = pHandle->pSPIx->DR;//&0xff to up 16bit
-            pHandle->RxLen--;
-            pHandle->RxLen--;
-            (uint16_t*)pHandle->pRxBuffer++;
+            uint16_t item = (uint16_t)pHandle->pSPIx->DR;
+            pHandle->pRxBuffer[0] = (uint8_t)item;
+            pHandle->pRxBuffer[1] = (uint8_t)(item >> 8);
+            pHandle->RxLen -= 2;//even, checked by SPI_ReceiveDataIT
+            pHandle->pRxBuffer += 2;
         } else {
             //8bit data
             *(pHandle->pRxBuffer) = pHandle->pSPIx->DR;//&0xff to up 16bit
@@ -381,4 +854,29 @@ void SPI_CloseReception(SPI_Handle_t *pSPIHandle){
             pSPIHandle->RxState = SPI_READY;
 }
 
+/*
+ * defaults of the application callbacks, the application overrides them
+ */
+__attribute((weak)) void SPI_ApplicationEventCallback(SPI_Handle_t *pHandle, uint8_t AppEv){
+    (void)pHandle;
+    (void)AppEv;
+}
 
+__attribute((weak)) void SPI_ApplicationFrameCallback(SPI_Handle_t *pHandle, uint8_t *pData, uint32_t len, uint8_t AppEv){
+    (void)pHandle;
+    (void)pData;
+    (void)len;
+    (void)AppEv;
+}
+
+/* IRQ_Dispatch passes the handle registered with the IRQ (irq.h) */
+RAMFUNC static void spi_irq_entry(void *pContext){
+    SPI_IRQHandle((SPI_Handle_t *)pContext);
+}
+
+/*
+ * route the IRQ of this instance straight to SPI_IRQHandle, IRQ_Init must have run
+ */
+void SPI_IRQRegister(SPI_Handle_t *pHandle, uint8_t IRQNumber){
+    IRQ_Register(IRQNumber, spi_irq_entry, pHandle);
+}
@@ -0,0 +1,154 @@
+#include "spi_bus.h"
+#include "gpio.h"
+#include <stddef.h>
+
+static void spi_bus_start(SPI_Bus_t *pBus, SPI_Transaction_t *pTrans);
+static void spi_bus_complete(SPI_Handle_t *pSPIHandle, uint8_t AppEv);
+
+/*
+ * chip select through BSRR: atomic against other users of the same port, active low
+ */
+static void spi_bus_cs(const SPI_Device_t *pDevice, uint8_t Assert){
+    if(pDevice != NULL && pDevice->pCSPort != NULL){
+        pDevice->pCSPort->BSRR = Assert ? (1U << (pDevice->CSPin + 16)) : (1U << pDevice->CSPin);
+    }
+}
+
+/*******************************************************************
+ * @fn          SPI_BusInit
+ * @brief       Put a queue on an SPI handle
+ * @param[in]   pBus: bus to initialize
+ * @param[in]   pSPIHandle: SPI handle, SPI_Init done and pTxDMA/pRxDMA set (SPI_TransferDMA)
+ * @return      None
+ * @note        The handle belongs to the bus from now on: its transfers are started by the queue
+ */
+void SPI_BusInit(SPI_Bus_t *pBus, SPI_Handle_t *pSPIHandle){
+    pBus->pSPIHandle = pSPIHandle;
+    pBus->pHead = NULL;
+    pBus->pTail = NULL;
+    pBus->pSelected = NULL;
+    pBus->Reconfigs = 0;
+    pSPIHandle->pParent = pBus;
+}
+
+/*******************************************************************
+ * @fn          SPI_DeviceInit
+ * @brief       Configure the chip select pin of a device as output, deasserted
+ * @param[in]   pDevice: device, pCSPort/CSPin filled in
+ * @return      None
+ * @note        The level is set before the pin becomes an output, no glitch on the line
+ */
+void SPI_DeviceInit(SPI_Device_t *pDevice){
+    GPIO_Handle_t cs;
+
+    if(pDevice->pCSPort == NULL){
+        return;
+    }
+    GPIO_PeriClockControl(pDevice->pCSPort, ENABLE);
+    spi_bus_cs(pDevice, 0);
+
+    cs.pGPIOx = pDevice->pCSPort;
+    cs.GPIO_PinConfig.GPIO_PinNumber = pDevice->CSPin;
+    cs.GPIO_PinConfig.GPIO_PinMode = GPIO_MODE_OUT;
+    cs.GPIO_PinConfig.GPIO_PinSpeed = GPIO_SPEED_HIGH;
+    cs.GPIO_PinConfig.GPIO_PinOutputType = GPIO_OT_PUSHPULL;
+    cs.GPIO_PinConfig.GPIO_PullUpPullDown = 0;
+    cs.GPIO_PinConfig.GPIO_AltFuncMode = 0;
+    GPIO_Init(&cs);
+}
+
+/*******************************************************************
+ * @fn          SPI_BusSubmit
+ * @brief       Queue a transaction, it is started right away when the bus is idle
+ * @param[in]   pBus: bus of the device
+ * @param[in]   pTrans: transaction, pDevice/buffers/Len/KeepCS/Callback filled in
+ * @return      previous Status, the transaction is only queued when it was not SPI_TRANS_PENDING
+ * @note        Callable from tasks and interrupts. The transaction and its buffers must stay valid
+ *              until Status leaves SPI_TRANS_PENDING (or Callback runs).
+ */
+uint8_t SPI_BusSubmit(SPI_Bus_t *pBus, SPI_Transaction_t *pTrans){
+    uint8_t status = pTrans->Status;
+    uint8_t idle;
+    uint32_t state;
+
+    if(status == SPI_TRANS_PENDING){
+        return status;
+    }
+    pTrans->Status = SPI_TRANS_PENDING;
+    pTrans->pNext = NULL;
+
+    ENTER_CRITICAL(state);
+    idle = (pBus->pHead == NULL);
+    if(idle){
+        pBus->pHead = pTrans;
+    } else {
+        pBus->pTail->pNext = pTrans;
+    }
+    pBus->pTail = pTrans;
+    EXIT_CRITICAL(state);
+
+    //a busy bus starts it from the completion of the transaction ahead
+    if(idle){
+        spi_bus_start(pBus, pTrans);
+    }
+    return status;
+}
+
+/*
+ * run pTrans, the head of the queue as taken by the caller inside its critical section:
+ * chip select of another device released, CR1 switched if needed
+ */
+static void spi_bus_start(SPI_Bus_t *pBus, SPI_Transaction_t *pTrans){
+    if(pBus->pSelected != pTrans->pDevice){
+        //a chip select kept by KeepCS cannot stay down while another device is addressed
+        spi_bus_cs(pBus->pSelected, 0);
+        pBus->pSelected = NULL;
+    }
+    if(SPI_ApplyConfig(pBus->pSPIHandle, &pTrans->pDevice->SPI_Config)){
+        pBus->Reconfigs++;
+    }
+    if(pBus->pSelected == NULL){
+        //after the mode switch, so the new clock polarity is on the line before CS falls
+        spi_bus_cs(pTrans->pDevice, 1);
+        pBus->pSelected = pTrans->pDevice;
+    }
+    if(SPI_TransferDMA(pBus->pSPIHandle, pTrans->pTxBuffer, pTrans->pRxBuffer, pTrans->Len,
+                       spi_bus_complete) == SPI_ERROR_PARAM){
+        //rejected length: it fails right away and the queue moves on
+        spi_bus_complete(pBus->pSPIHandle, SPI_EVENT_DMA_ERROR);
+    }
+}
+
+/*
+ * completion interrupt of SPI_TransferDMA: start the next transaction first, then report this one
+ */
+static void spi_bus_complete(SPI_Handle_t *pSPIHandle, uint8_t AppEv){
+    SPI_Bus_t *pBus = (SPI_Bus_t *)pSPIHandle->pParent;
+    SPI_Transaction_t *pTrans = pBus->pHead;
+    SPI_Transaction_t *pNext;
+    uint32_t state;
+
+    if(!pTrans->KeepCS || AppEv != SPI_EVENT_TXRX_CMPLT){
+        spi_bus_cs(pTrans->pDevice, 0);
+        pBus->pSelected = NULL;
+    }
+
+    //pHead is not read again once the section is left: an idle bus seen by an SPI_BusSubmit
+    //from a higher priority interrupt is started by that call alone
+    ENTER_CRITICAL(state);
+    pNext = pTrans->pNext;
+    pBus->pHead = pNext;
+    if(pNext == NULL){
+        pBus->pTail = NULL;
+    }
+    EXIT_CRITICAL(state);
+
+    if(pNext != NULL){
+        spi_bus_start(pBus, pNext);
+    }
+
+    pTrans->Status = (AppEv == SPI_EVENT_TXRX_CMPLT) ? SPI_TRANS_DONE : SPI_TRANS_ERROR;
+    if(pTrans->Callback != NULL){
+        pTrans->Callback(pTrans);
+    }
+}
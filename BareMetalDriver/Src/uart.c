@@ -1,4 +1,7 @@
 #include "uart.h"
+#include "dma.h"
+#include "prof.h"
+#include "irq.h"
 #include<stdint.h>
 #include <stddef.h>
 
@@ -6,21 +9,62 @@
 #define GPIOAEN (1U<<0)
 #define USART2EN (1U<<17)
 #define DBG_UART_BAUDRATE 115200//popular baudrate, refer online
-#define SYS_FREQ 16000000
-/*refer clocks and startup in datasheet
- = FREQ of HSI(FREQ of internal clock)*/
-#define APB1_CLK SYS_FREQ
 #define CR1_TE (1U<<3)
 #define CR1_UE (1U<<13)
+#define CR3_DMAT (1U<<7)
 #define SR_TXE (1U<<7)
+#define SR_TC (1U<<6)
+
+/*
+ * USART2_TX is served by DMA1 stream 6 channel 4 (refer DMA1 request mapping in RM)
+ */
+#define DBG_UART_TX_DMA_CHANNEL 4
+#define DBG_UART_TX_DMA_STREAM 6
 
 static void usart_set_baudrate(uint32_t periph_clk, uint32_t baudrate);
 static void uart_write(int ch);
+static void uart_tx_dma_kick(void);
+static void uart_tx_dma_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+static void usart_rx_dma_deliver(USART_Handle_t *pUSARTHandle, uint8_t AppEv);
+static void usart_rx_dma_callback(DMA_Handle_t *pDMAHandle, uint8_t Event);
+
+/*
+ * Transmit ring used by the DMA engine.
+ * head is only written by the producer (_write/__io_putchar), tail and inflight only by the
+ * DMA completion interrupt. Both are free running, the index in the buffer is (x % size).
+ */
+static uint8_t uart_tx_ring[UART_TX_RING_SIZE];
+static volatile uint32_t uart_tx_head;
+static volatile uint32_t uart_tx_tail;
+static volatile uint32_t uart_tx_inflight;
+static volatile uint32_t uart_tx_dropped;
+static uint8_t uart_tx_policy;
+static uint8_t uart_tx_dma_ready;
+static DMA_Handle_t uart_tx_dma;
+
 int __io_putchar(int ch) {
-	uart_write(ch);
+	uint8_t c = (uint8_t)ch;
+
+	if (uart_tx_dma_ready) {
+		uart_dma_write(&c, 1);
+	} else {
+		uart_write(ch);
+	}
 	return ch;
 }
 
+/*
+ * Called by _write in syscalls.c with the whole printf buffer
+ */
+int __io_write(char *ptr, int len) {
+	if (!uart_tx_dma_ready) {
+		for (int i = 0; i < len; i++) {
+			uart_write(ptr[i]);
+		}
+		return len;
+	}
+	return (int)uart_dma_write((const uint8_t *)ptr, (uint32_t)len);
+}
 void system_uart_init(void) {
 	/* Enable clock access to GPIOA */
 	RCC->AHB1ENR |= GPIOAEN;
@@ -36,8 +80,8 @@ void system_uart_init(void) {
 	GPIOA->AFRL &= ~(1U << 11);
 	/* Enable clock access to UsART2 */
 	RCC->APB1ENR |= USART2EN;
-	/* setting baudrate */
-	usart_set_baudrate(APB1_CLK, DBG_UART_BAUDRATE);
+	/* setting baudrate from the current APB1 clock (16 MHz HSI or 50 MHz with the PLL) */
+	usart_set_baudrate(RCC_GetPCLK1Value(), DBG_UART_BAUDRATE);
 	/* config transfer direction */
 	USART2->CR1 |= CR1_TE;
 	/* Enable Uart module */
@@ -49,8 +93,192 @@ static void uart_write(int ch) {
 	while (!(USART2->SR & SR_TXE)) {
 	}
 	/* write to transmit data register */
-	USART2->DR |= ch & 0xff;
+	USART2->DR = ch & 0xff;
+}
+
+/*********************************************************************
+ * @fn      		  - system_uart_dma_init
+ *
+ * @brief             - Bring up the debug UART with a DMA driven transmit path
+ *
+ * @param[in]         - OverflowPolicy: @USART_TxOverflowPolicy, what uart_dma_write does
+ *                      when the ring is full
+ *
+ * @return            -
+ *
+ * @Note              - USART2 TX is moved to DMA1 stream 6. The application must route
+ *                      DMA1_Stream6_IRQHandler here (already done below) and keep the
+ *                      interrupt enabled, otherwise the ring is only drained by uart_dma_flush.
+ */
+void system_uart_dma_init(uint8_t OverflowPolicy) {
+	system_uart_init();
+
+	uart_tx_head = 0;
+	uart_tx_tail = 0;
+	uart_tx_inflight = 0;
+	uart_tx_dropped = 0;
+	uart_tx_policy = OverflowPolicy;
+
+	uart_tx_dma.pDMAx = DMA1;
+	uart_tx_dma.pStream = DMA1_Stream6;
+	uart_tx_dma.StreamNumber = DBG_UART_TX_DMA_STREAM;
+	uart_tx_dma.DMA_Config.DMA_Channel = DBG_UART_TX_DMA_CHANNEL;
+	uart_tx_dma.DMA_Config.DMA_Direction = DMA_DIR_MEM_TO_PERIPH;
+	uart_tx_dma.DMA_Config.DMA_PeriphInc = DISABLE;
+	uart_tx_dma.DMA_Config.DMA_MemInc = ENABLE;
+	uart_tx_dma.DMA_Config.DMA_PeriphDataSize = DMA_SIZE_BYTE;
+	uart_tx_dma.DMA_Config.DMA_MemDataSize = DMA_SIZE_BYTE;
+	uart_tx_dma.DMA_Config.DMA_Mode = DMA_MODE_NORMAL;
+	uart_tx_dma.DMA_Config.DMA_Priority = DMA_PRIORITY_LOW;
+	uart_tx_dma.Callback = uart_tx_dma_callback;
+	uart_tx_dma.pParent = NULL;
+	DMA_Init(&uart_tx_dma);
+
+	/* let the USART raise DMA requests on TXE */
+	USART2->CR3 |= CR3_DMAT;
+
+	DMA_IRQInterruptConfig(IRQ_NO_DMA1_STREAM6, ENABLE);
+	uart_tx_dma_ready = 1;
+}
+
+/*********************************************************************
+ * @fn      		  - uart_dma_write
+ *
+ * @brief             - Copy data into the transmit ring and start DMA if it is idle
+ *
+ * @param[in]         - pData: data to send
+ * @param[in]         - len: number of bytes
+ *
+ * @return            - number of bytes accepted (less than len only with USART_TX_OVERFLOW_DROP)
+ *
+ * @Note              - With USART_TX_OVERFLOW_BLOCK the call waits for ring space. When it is
+ *                      called with interrupts masked the completion flag is polled instead.
+ */
+uint32_t uart_dma_write(const uint8_t *pData, uint32_t len) {
+	PROF_ENTER();
+	uint32_t copied = 0;
+
+	while (copied < len) {
+		uint32_t head = uart_tx_head;
+		uint32_t space = UART_TX_RING_SIZE - (head - uart_tx_tail);
+
+		if (space == 0) {
+			if (uart_tx_policy == USART_TX_OVERFLOW_DROP) {
+				uart_tx_dropped += len - copied;
+				break;
+			}
+			/* blocking: make sure the ring is draining, then wait for the completion */
+			uart_tx_dma_kick();
+			if (DMA_GetFlagStatus(&uart_tx_dma, DMA_FLAG_TC)) {
+				uint32_t state;
+				ENTER_CRITICAL(state);
+				DMA_IRQHandling(&uart_tx_dma);
+				EXIT_CRITICAL(state);
+			}
+			continue;
+		}
+
+		/* copy up to the end of the buffer, the next loop iteration handles the wrap */
+		uint32_t idx = head % UART_TX_RING_SIZE;
+		uint32_t chunk = UART_TX_RING_SIZE - idx;
+		if (chunk > space) {
+			chunk = space;
+		}
+		if (chunk > len - copied) {
+			chunk = len - copied;
+		}
+		for (uint32_t i = 0; i < chunk; i++) {
+			uart_tx_ring[idx + i] = pData[copied + i];
+		}
+		copied += chunk;
+
+		/* data must be visible before the new head is published */
+		DMB();
+		uart_tx_head = head + chunk;
+	}
+
+	uart_tx_dma_kick();
+	PROF_EXIT(PROF_ID_UART_DMA_WRITE);
+	return copied;
+}
+
+/*********************************************************************
+ * @fn      		  - uart_dma_flush
+ *
+ * @brief             - Wait until every queued byte has left the shift register
+ *
+ * @return            -
+ *
+ * @Note              - Call before a reset or before jumping to another image
+ */
+void uart_dma_flush(void) {
+	if (!uart_tx_dma_ready) {
+		while (!(USART2->SR & SR_TC)) {
+		}
+		return;
+	}
+
+	while (uart_tx_head != uart_tx_tail) {
+		uart_tx_dma_kick();
+		if (DMA_GetFlagStatus(&uart_tx_dma, DMA_FLAG_TC)) {
+			uint32_t state;
+			ENTER_CRITICAL(state);
+			DMA_IRQHandling(&uart_tx_dma);
+			EXIT_CRITICAL(state);
+		}
+	}
+	/* last byte written by DMA is still shifting out */
+	while (!(USART2->SR & SR_TC)) {
+	}
+}
+
+/*
+ * number of bytes discarded by USART_TX_OVERFLOW_DROP since system_uart_dma_init
+ */
+uint32_t uart_dma_dropped(void) {
+	return uart_tx_dropped;
+}
+
+/*
+ * start a DMA transfer of the contiguous part of the ring if nothing is in flight
+ */
+static void uart_tx_dma_kick(void) {
+	uint32_t state;
+
+	ENTER_CRITICAL(state);
+	if (uart_tx_inflight == 0 && uart_tx_head != uart_tx_tail) {
+		uint32_t tail = uart_tx_tail;
+		uint32_t idx = tail % UART_TX_RING_SIZE;
+		uint32_t len = uart_tx_head - tail;
+
+		/* DMA cannot wrap, send up to the end of the buffer and continue from the start next time */
+		if (len > UART_TX_RING_SIZE - idx) {
+			len = UART_TX_RING_SIZE - idx;
+		}
+		uart_tx_inflight = len;
+		/* TC must be cleared (read SR, write 0) before the new transfer, refer RM DMA section of USART */
+		USART2->SR &= ~SR_TC;
+		DMA_StartIT(&uart_tx_dma, (uint32_t)(uintptr_t)&USART2->DR, (uint32_t)(uintptr_t)&uart_tx_ring[idx], len);
+	}
+	EXIT_CRITICAL(state);
 }
+
+static void uart_tx_dma_callback(DMA_Handle_t *pDMAHandle, uint8_t Event) {
+	/* only TC and TE end a segment, and only once the stream let go of it: a restart while EN is
+	 * still set would be ignored and the segment released twice */
+	if ((Event == DMA_EVENT_CMPLT || Event == DMA_EVENT_ERROR) &&
+	    !(pDMAHandle->pStream->CR & (1 << DMA_SxCR_EN))) {
+		/* release the transferred segment (an errored one is dropped) and continue with the rest */
+		uart_tx_tail += uart_tx_inflight;
+		uart_tx_inflight = 0;
+		uart_tx_dma_kick();
+	}
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+	DMA_IRQHandling(&uart_tx_dma);
+}
+
 //Note: this code applied only when dont use Oversampling
 static uint16_t compute_usart_baudrate(uint32_t periph_clk, uint32_t baudrate) {
 	return ((periph_clk + (baudrate / 2U)) / baudrate);
@@ -117,8 +345,11 @@ void USART_Init(USART_Handle_t *pUSARTHandle){
 		tempreg |= ( ( 1 << USART_CR1_RE) | ( 1 << USART_CR1_TE) );
 	}
 
-    //Implement the code to configure the Word length configuration item
-	tempreg |= pUSARTHandle->USART_Config.USART_WorlLenght << USART_CR1_M; ;
+    //Implement the code to configure the Word length configuration item, M = 1 selects 9 data bits
+	if ( pUSARTHandle->USART_Config.USART_WorlLenght == USART_DATA_9)
+	{
+		tempreg |= ( 1 << USART_CR1_M);
+	}
 
 
     //Configuration of parity control bit fields
@@ -180,8 +411,8 @@ void USART_Init(USART_Handle_t *pUSARTHandle){
 
 /******************************** Configuration of BRR(Baudrate register)******************************************/
 
-	//Implement the code to configure the baud rate
-	//We will cover this in the lecture. No action required here
+	//Implement the code to configure the baud rate, BRR follows the APB clock the USART runs from
+	USART_SetBaudRate(pUSARTHandle->pUSARTx, pUSARTHandle->USART_Config.USART_Baud);
 
 }
 void USART_DeInit(USART_Handle_t *pUSARTHandle){
@@ -206,6 +437,7 @@ void USART_DeInit(USART_Handle_t *pUSARTHandle){
 */
 void USART_SendData(USART_Handle_t *pUSARTHandle, uint8_t *pTxBuffer, uint32_t Len)
 {
+	PROF_ENTER();
 
 	uint16_t *pdata;
    //Loop over until "Len" number of bytes are transferred
@@ -248,6 +480,7 @@ void USART_SendData(USART_Handle_t *pUSARTHandle, uint8_t *pTxBuffer, uint32_t L
 
 	//Implement the code to wait till TC flag is set in the SR
 	while( ! USART_GetFlagStatus(pUSARTHandle->pUSARTx,USART_FLAG_TC));
+	PROF_EXIT(PROF_ID_USART_SEND);
 }
 
 
@@ -268,6 +501,7 @@ void USART_SendData(USART_Handle_t *pUSARTHandle, uint8_t *pTxBuffer, uint32_t L
 
 void USART_ReceiveData(USART_Handle_t *pUSARTHandle, uint8_t *pRxBuffer, uint32_t Len)
 {
+	PROF_ENTER();
    //Loop over until "Len" number of bytes are transferred
 	for(uint32_t i = 0 ; i < Len; i++)
 	{
@@ -326,7 +560,7 @@ void USART_ReceiveData(USART_Handle_t *pUSARTHandle, uint8_t *pRxBuffer, uint32_
 			pRxBuffer++;
 		}
 	}
-
+	PROF_EXIT(PROF_ID_USART_RECEIVE);
 }
 
 /*********************************************************************
@@ -345,12 +579,13 @@ void USART_ReceiveData(USART_Handle_t *pUSARTHandle, uint8_t *pRxBuffer, uint32_
  */
 uint8_t USART_SendDataIT(USART_Handle_t *pUSARTHandle,uint8_t *pTxBuffer, uint32_t Len)
 {
+	PROF_ENTER();
 	uint8_t txstate = pUSARTHandle->TxState;
 
 	if(txstate != USART_BUSY_IN_TX)
 	{
 		pUSARTHandle->TxLen = Len;
-		*pUSARTHandle->pTxBuffer = *pTxBuffer;
+		pUSARTHandle->pTxBuffer = pTxBuffer;
 		pUSARTHandle->TxState = USART_BUSY_IN_TX;
 
 		//Implement the code to enable interrupt for TXE
@@ -361,6 +596,7 @@ uint8_t USART_SendDataIT(USART_Handle_t *pUSARTHandle,uint8_t *pTxBuffer, uint32
 		pUSARTHandle->pUSARTx->CR1 |= (1 << USART_CR1_TCIE);
 	}
 
+	PROF_EXIT(PROF_ID_USART_SEND_IT);
 	return txstate;
 
 }
@@ -382,12 +618,13 @@ uint8_t USART_SendDataIT(USART_Handle_t *pUSARTHandle,uint8_t *pTxBuffer, uint32
  */
 uint8_t USART_ReceiveDataIT(USART_Handle_t *pUSARTHandle,uint8_t *pRxBuffer, uint32_t Len)
 {
+	PROF_ENTER();
 	uint8_t rxstate = pUSARTHandle->RxState;
 
 	if(rxstate != USART_BUSY_IN_RX)
 	{
 		pUSARTHandle->RxLen = Len;
-		*pUSARTHandle->pRxBuffer = *pRxBuffer;
+		pUSARTHandle->pRxBuffer = pRxBuffer;
 		pUSARTHandle->RxState = USART_BUSY_IN_RX;
 
 		//Implement the code to enable interrupt for RXNE
@@ -396,15 +633,192 @@ uint8_t USART_ReceiveDataIT(USART_Handle_t *pUSARTHandle,uint8_t *pRxBuffer, uin
 
 	}
 
+	PROF_EXIT(PROF_ID_USART_RECEIVE_IT);
 	return rxstate;
 
 }
 
+/*********************************************************************
+ * @fn      		  - USART_ReceiveToIdleDMA
+ *
+ * @brief             - Receive continuously with DMA in circular mode, frames are delimited by
+ *                      the IDLE line condition and handed to the application in place
+ *
+ * @param[in]         - pUSARTHandle: USART handle, USART_Init must have been called
+ * @param[in]         - pDMAHandle: stream serving USARTx_RX, pDMAx/pStream/StreamNumber and
+ *                      DMA_Channel must be filled in, the rest is configured here
+ * @param[in]         - pRxBuffer: circular buffer owned by the DMA
+ * @param[in]         - Len: size of pRxBuffer (max 65535)
+ *
+ * @return            - previous RxState, reception is only started when it was USART_READY
+ *
+ * @Note              - Data is reported through USART_ApplicationRxDataCallback as (pointer, length)
+ *                      slices of pRxBuffer, no copy is made. A slice stays valid until the DMA has
+ *                      written Len more bytes, so the callback must consume it before that.
+ *                      The application routes the stream IRQ to DMA_IRQHandling and the USART IRQ to
+ *                      USART_IRQHandling.
+ */
+uint8_t USART_ReceiveToIdleDMA(USART_Handle_t *pUSARTHandle, DMA_Handle_t *pDMAHandle, uint8_t *pRxBuffer, uint32_t Len)
+{
+	uint8_t rxstate = pUSARTHandle->RxState;
+
+	if(rxstate == USART_READY)
+	{
+		pUSARTHandle->pRxBuffer = pRxBuffer;
+		pUSARTHandle->RxLen = Len;
+		pUSARTHandle->RxDMAPos = 0;
+		pUSARTHandle->pRxDMA = pDMAHandle;
+		pUSARTHandle->RxState = USART_BUSY_IN_RX_DMA;
+
+		pDMAHandle->DMA_Config.DMA_Direction = DMA_DIR_PERIPH_TO_MEM;
+		pDMAHandle->DMA_Config.DMA_PeriphInc = DISABLE;
+		pDMAHandle->DMA_Config.DMA_MemInc = ENABLE;
+		pDMAHandle->DMA_Config.DMA_PeriphDataSize = DMA_SIZE_BYTE;
+		pDMAHandle->DMA_Config.DMA_MemDataSize = DMA_SIZE_BYTE;
+		pDMAHandle->DMA_Config.DMA_Mode = DMA_MODE_CIRCULAR;
+		pDMAHandle->Callback = usart_rx_dma_callback;
+		pDMAHandle->pParent = pUSARTHandle;
+		DMA_Init(pDMAHandle);
+
+		//clear a stale IDLE flag (read SR then DR) so the first interrupt is a real frame end
+		(void)pUSARTHandle->pUSARTx->SR;
+		(void)pUSARTHandle->pUSARTx->DR;
+
+		DMA_StartIT(pDMAHandle, (uint32_t)(uintptr_t)&pUSARTHandle->pUSARTx->DR, (uint32_t)(uintptr_t)pRxBuffer, Len);
+
+		//byte reception is done by DMA, the CPU is only interrupted on IDLE and half/full buffer
+		pUSARTHandle->pUSARTx->CR1 &= ~( 1 << USART_CR1_RXNEIE);
+		pUSARTHandle->pUSARTx->CR3 |= ( 1 << USART_CR3_DMAR);
+		pUSARTHandle->pUSARTx->CR1 |= ( 1 << USART_CR1_IDLEIE);
+	}
+
+	return rxstate;
+}
+
+/*********************************************************************
+ * @fn      		  - USART_StopReceiveDMA
+ *
+ * @brief             - Stop a reception started with USART_ReceiveToIdleDMA
+ *
+ * @param[in]         - pUSARTHandle: USART handle
+ *
+ * @return            -
+ *
+ * @Note              - Bytes received since the last slice are delivered before stopping
+ */
+void USART_StopReceiveDMA(USART_Handle_t *pUSARTHandle)
+{
+	if(pUSARTHandle->RxState != USART_BUSY_IN_RX_DMA)
+	{
+		return;
+	}
+
+	pUSARTHandle->pUSARTx->CR1 &= ~( 1 << USART_CR1_IDLEIE);
+	pUSARTHandle->pUSARTx->CR3 &= ~( 1 << USART_CR3_DMAR);
+	usart_rx_dma_deliver(pUSARTHandle, USART_EVENT_IDLE);
+	DMA_Stop(pUSARTHandle->pRxDMA);
+
+	pUSARTHandle->RxState = USART_READY;
+	pUSARTHandle->pRxBuffer = NULL;
+	pUSARTHandle->RxLen = 0;
+	pUSARTHandle->pRxDMA = NULL;
+}
+
+/*
+ * hand out everything the DMA wrote since the last call, as at most two slices (buffer wrap)
+ */
+static void usart_rx_dma_deliver(USART_Handle_t *pUSARTHandle, uint8_t AppEv)
+{
+	uint32_t pos = pUSARTHandle->RxLen - DMA_GetRemaining(pUSARTHandle->pRxDMA);
+	uint32_t last = pUSARTHandle->RxDMAPos;
+
+	//NDTR is reloaded to RxLen at the wrap, that is position 0
+	if(pos >= pUSARTHandle->RxLen)
+	{
+		pos = 0;
+	}
+
+	if(pos == last)
+	{
+		return;
+	}
+
+	if(pos > last)
+	{
+		USART_ApplicationRxDataCallback(pUSARTHandle, &pUSARTHandle->pRxBuffer[last], pos - last, AppEv);
+	}
+	else
+	{
+		//DMA wrapped: tail of the buffer first, then the beginning
+		USART_ApplicationRxDataCallback(pUSARTHandle, &pUSARTHandle->pRxBuffer[last], pUSARTHandle->RxLen - last,
+				(pos == 0) ? AppEv : USART_EVENT_RX_CMPLT);
+		if(pos > 0)
+		{
+			USART_ApplicationRxDataCallback(pUSARTHandle, pUSARTHandle->pRxBuffer, pos, AppEv);
+		}
+	}
+	pUSARTHandle->RxDMAPos = pos;
+}
+
+static void usart_rx_dma_callback(DMA_Handle_t *pDMAHandle, uint8_t Event)
+{
+	USART_Handle_t *pUSARTHandle = (USART_Handle_t *)pDMAHandle->pParent;
+
+	if(Event == DMA_EVENT_ERROR)
+	{
+		USART_ApplicationEventCallback(pUSARTHandle, USART_ERREVENT_DMA);
+		return;
+	}
+	if(Event == DMA_EVENT_DIRECT_MODE_ERROR)
+	{
+		//a missed request is an overrun of the USART, reported by its ORE flag
+		return;
+	}
+	//half or full buffer: pass the data on so a long frame does not get overwritten
+	usart_rx_dma_deliver(pUSARTHandle, USART_EVENT_RX_CMPLT);
+}
+
 /*
  * IRQ Configuration and ISR handling
  */
-void USART_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi);
-void USART_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
+void USART_IRQInterruptConfig(uint8_t IRQNumber, uint8_t EnorDi)
+{
+	if(EnorDi == ENABLE)
+	{
+		if(IRQNumber <= 31)
+		{
+			*NVIC_ISER0 = ( 1 << IRQNumber );
+		}else if(IRQNumber < 64)
+		{
+			*NVIC_ISER1 = ( 1 << (IRQNumber % 32) );
+		}else if(IRQNumber < 96)
+		{
+			*NVIC_ISER2 = ( 1 << (IRQNumber % 64) );
+		}
+	}else
+	{
+		if(IRQNumber <= 31)
+		{
+			*NVIC_ICER0 = ( 1 << IRQNumber );
+		}else if(IRQNumber < 64)
+		{
+			*NVIC_ICER1 = ( 1 << (IRQNumber % 32) );
+		}else if(IRQNumber < 96)
+		{
+			*NVIC_ICER2 = ( 1 << (IRQNumber % 64) );
+		}
+	}
+}
+
+void USART_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority)
+{
+	uint8_t iprx = IRQNumber / 4;
+	uint8_t iprx_section = IRQNumber % 4;
+	uint8_t shift_amount = ( 8 * iprx_section ) + ( 8 - NO_PR_BITS_IMPLEMENTED );
+
+	*( NVIC_PR_BASE_ADDRESS + iprx ) &= ~( 0xFF << ( 8 * iprx_section ) );
+	*( NVIC_PR_BASE_ADDRESS + iprx ) |= ( IRQPriority << shift_amount );
+}
 
 /*********************************************************************
  * @fn      		  - USART_IRQHandler
@@ -420,8 +834,9 @@ void USART_IRQPriorityConfig(uint8_t IRQNumber, uint32_t IRQPriority);
  * @Note              - Resolve all the TODOs
 
  */
-void USART_IRQHandling(USART_Handle_t *pUSARTHandle)
+RAMFUNC void USART_IRQHandling(USART_Handle_t *pUSARTHandle)
 {
+	PROF_ENTER();
 
 	uint32_t temp1 , temp2, temp3;
 
@@ -651,24 +1066,32 @@ void USART_IRQHandling(USART_Handle_t *pUSARTHandle)
 	temp1 = pUSARTHandle->pUSARTx->SR & ( 1 << USART_SR_IDLE);
 
 	//Implement the code to check the state of IDLEIE bit in CR1
-	temp2 = pUSARTHandle->pUSARTx->CR3 & ( 1 << USART_CR3_CTSE);
+	temp2 = pUSARTHandle->pUSARTx->CR1 & ( 1 << USART_CR1_IDLEIE);
 
 
 	if(temp1 && temp2)
 	{
-		//Implement the code to clear the IDLE flag. Refer to the RM to understand the clear sequence
-		pUSARTHandle->pUSARTx->SR &= ~( 1 << USART_SR_IDLE);
+		//IDLE is cleared by a read of SR (done above) followed by a read of DR
+		(void)pUSARTHandle->pUSARTx->DR;
 		//this interrupt is because of idle
-		USART_ApplicationEventCallback(pUSARTHandle,USART_EVENT_IDLE);
+		if(pUSARTHandle->RxState == USART_BUSY_IN_RX_DMA)
+		{
+			//end of frame: hand the received bytes to the application without copying
+			usart_rx_dma_deliver(pUSARTHandle, USART_EVENT_IDLE);
+		}
+		else
+		{
+			USART_ApplicationEventCallback(pUSARTHandle,USART_EVENT_IDLE);
+		}
 	}
 
 /*************************Check for Overrun detection flag ********************************************/
 
 	//Implement the code to check the status of ORE flag  in the SR
-	temp1 = pUSARTHandle->pUSARTx->SR & USART_SR_ORE;
+	temp1 = pUSARTHandle->pUSARTx->SR & ( 1 << USART_SR_ORE);
 
 	//Implement the code to check the status of RXNEIE  bit in the CR1
-	temp2 = pUSARTHandle->pUSARTx->CR1 & USART_CR1_RXNEIE;
+	temp2 = pUSARTHandle->pUSARTx->CR1 & ( 1 << USART_CR1_RXNEIE);
 
 
 	if(temp1  && temp2 )
@@ -717,22 +1140,85 @@ void USART_IRQHandling(USART_Handle_t *pUSARTHandle)
 			USART_ApplicationEventCallback(pUSARTHandle,USART_ERREVENT_ORE);
 		}
 	}
+	PROF_EXIT(PROF_ID_USART_IRQ);
+}
 
+/*********************************************************************
+ * @fn      		  - USART_PeripheralControl
+ *
+ * @brief             - Enable or disable the USART (UE bit)
+ *
+ * @param[in]         - base address of the USART peripheral
+ * @param[in]         - ENABLE or DISABLE
+ *
+ * @return            - None
+ *
+ * @Note              - None
+
+ */
+void USART_PeripheralControl(USART_RegDef_t *pUSARTx, uint8_t EnOrDi)
+{
+	if(EnOrDi == ENABLE)
+	{
+		pUSARTx->CR1 |= (1 << USART_CR1_UE);
+	}else
+	{
+		pUSARTx->CR1 &= ~(1 << USART_CR1_UE);
+	}
+}
+
+/*********************************************************************
+ * @fn      		  - USART_GetFlagStatus
+ *
+ * @brief             - Read one status flag of the USART
+ *
+ * @param[in]         - base address of the USART peripheral
+ * @param[in]         - flag mask, refer @USART_FLAG
+ *
+ * @return            - FLAG_SET or FLAG_RESET
+ *
+ * @Note              - None
+
+ */
+uint8_t USART_GetFlagStatus(USART_RegDef_t *pUSARTx, uint32_t FlagName)
+{
+	if(pUSARTx->SR & FlagName)
+	{
+		return FLAG_SET;
+	}
+	return FLAG_RESET;
+}
+
+/*********************************************************************
+ * @fn      		  - USART_ClearFlag
+ *
+ * @brief             - Clear a status flag of the USART
+ *
+ * @param[in]         - base address of the USART peripheral
+ * @param[in]         - flag mask, refer @USART_FLAG
+ *
+ * @return            - None
+ *
+ * @Note              - only CTS, LBD, TC and RXNE are cleared by writing 0, the other flags
+ *                      need the SR then DR read sequence
 
+ */
+void USART_ClearFlag(USART_RegDef_t *pUSARTx, uint16_t StatusFlagName)
+{
+	pUSARTx->SR = ~((uint32_t)StatusFlagName);
 }
 
  /*********************************************************************
  * @fn      		  - USART_SetBaudRate
  *
- * @brief             -
+ * @brief             - Program BRR for BaudRate from the current APB clock of the USART
  *
- * @param[in]         -
- * @param[in]         -
- * @param[in]         -
+ * @param[in]         - pUSARTx: USART1, USART2 or USART6
+ * @param[in]         - BaudRate: @USART_Baud
  *
  * @return            -
  *
- * @Note              -  Resolve all the TODOs
+ * @Note              -  The APB clock is read back from RCC, call it again after RCC_ConfigSystemClock
 
  */
 void USART_SetBaudRate(USART_RegDef_t *pUSARTx, uint32_t BaudRate)
@@ -798,3 +1284,43 @@ void USART_SetBaudRate(USART_RegDef_t *pUSARTx, uint32_t BaudRate)
   pUSARTx->BRR = tempreg;
 }
 
+
+/*
+ * defaults of the application callbacks, the application overrides them
+ */
+__attribute((weak)) void USART_ApplicationEventCallback(USART_Handle_t *pHandle, uint8_t AppEv)
+{
+	(void)pHandle;
+	(void)AppEv;
+}
+
+__attribute((weak)) void USART_ApplicationRxDataCallback(USART_Handle_t *pHandle, uint8_t *pData, uint32_t len, uint8_t AppEv)
+{
+	(void)pHandle;
+	(void)pData;
+	(void)len;
+	(void)AppEv;
+}
+
+/* IRQ_Dispatch passes the handle registered with the IRQ (irq.h) */
+RAMFUNC static void usart_irq_entry(void *pContext)
+{
+	USART_IRQHandling((USART_Handle_t *)pContext);
+}
+
+/*********************************************************************
+ * @fn      		  - USART_IRQRegister
+ *
+ * @brief             - route the IRQ of this instance straight to USART_IRQHandling
+ *
+ * @param[in]         - handle of the instance
+ * @param[in]         - IRQ_NO_USARTx
+ *
+ * @return            - none
+ *
+ * @Note              - IRQ_Init must have moved the vector table to SRAM
+ */
+void USART_IRQRegister(USART_Handle_t *pUSARTHandle, uint8_t IRQNumber)
+{
+	IRQ_Register(IRQNumber, usart_irq_entry, pUSARTHandle);
+}
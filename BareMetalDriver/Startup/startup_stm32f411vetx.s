@@ -30,6 +30,13 @@
 .global g_pfnVectors
 .global Default_Handler
 
+/* start address for the initialization values of the .ramfunc section.
+defined in linker script */
+.word _siramfunc
+/* start address for the .ramfunc section. defined in linker script */
+.word _sramfunc
+/* end address for the .ramfunc section. defined in linker script */
+.word _eramfunc
 /* start address for the initialization values of the .data section.
 defined in linker script */
 .word _sidata
@@ -42,6 +49,24 @@ defined in linker script */
 /* end address for the .bss section. defined in linker script */
 .word _ebss
 
+/* .bss at least that large (bytes) is zeroed by DMA2 Stream0 while the CPU copies .ramfunc and
+.data; 0 (default) leaves the DMA code out. Set with -Wa,--defsym,STARTUP_BSS_DMA_MIN=<bytes>.
+The DMA is slower per word than the stm loop: it only pays when the copy of .data hides it,
+about .bss smaller than 1.5x .data. Estimated from the RM/TRM cycle counts, not measured */
+.ifndef STARTUP_BSS_DMA_MIN
+.equ STARTUP_BSS_DMA_MIN, 0
+.endif
+
+.equ RCC_AHB1ENR, 0x40023830
+.equ RCC_AHB1ENR_DMA2EN, (1 << 22)
+.equ DMA2_LISR, 0x40026400
+.equ DMA2_LIFCR, 0x40026408
+.equ DMA2_S0CR, 0x40026410    /* NDTR, PAR, M0AR, FCR follow at +4, +8, +12, +20 */
+.equ DMA_S0CR_ZERO, 0x00005481 /* memory to memory, word sizes, memory increment, EN */
+.equ DMA_S0FCR_FIFO, 0x07      /* DMDIS, FTH full: memory to memory needs the FIFO (RM) */
+.equ DMA_LISR_S0_DONE, 0x28   /* TCIF0 | TEIF0 */
+.equ DMA_LIFCR_S0_ALL, 0x3D
+
 /**
  * @brief  This is the code that gets called when the processor first
  *          starts execution following a reset event. Only the absolutely
@@ -60,37 +85,78 @@ Reset_Handler:
 /* Call the clock system initialization function.*/
   bl  SystemInit
 
+/* Start zeroing a large .bss by DMA, r9 = 1 once the stream runs, r8 = AHB1ENR to restore then */
+  movs r9, #0
+.if STARTUP_BSS_DMA_MIN
+  ldr r0, =_sbss
+  ldr r1, =_ebss
+  subs r2, r1, r0
+  ldr r3, =STARTUP_BSS_DMA_MIN
+  cmp r2, r3
+  bcc NoDmaZerobss
+  ldr r3, =RCC_AHB1ENR
+  ldr r8, [r3]
+  orr r4, r8, #RCC_AHB1ENR_DMA2EN
+  str r4, [r3]
+  ldr r4, [r3]           /* read back: the clock is on before DMA2 is accessed */
+  ldr r3, =DMA2_S0CR
+  movs r4, #0
+  str r4, [r3]           /* stream disabled, e.g. left running by the bootloader */
+WaitDmaDisabled:
+  ldr r4, [r3]
+  lsls r4, r4, #31
+  bne WaitDmaDisabled
+  ldr r4, =DMA2_LIFCR
+  movs r5, #DMA_LIFCR_S0_ALL
+  str r5, [r4]
+  lsrs r2, r2, #2        /* words */
+  str r2, [r3, #4]       /* NDTR */
+  ldr r4, =DmaZeroSource
+  str r4, [r3, #8]       /* PAR: peripheral port is the source, not incremented */
+  str r0, [r3, #12]      /* M0AR */
+  movs r4, #DMA_S0FCR_FIFO
+  str r4, [r3, #20]      /* FCR, reset value is direct mode */
+  ldr r4, =DMA_S0CR_ZERO
+  str r4, [r3]
+  movs r9, #1            /* not r8: AHB1ENR may well read 0 */
+NoDmaZerobss:
+.endif
+
+/* Copy the code executed from SRAM (.ramfunc) from flash */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  bl CopyWords
+
 /* Copy the data segment initializers from flash to SRAM */
   ldr r0, =_sdata
   ldr r1, =_edata
   ldr r2, =_sidata
-  movs r3, #0
-  b LoopCopyDataInit
-
-CopyDataInit:
-  ldr r4, [r2, r3]
-  str r4, [r0, r3]
-  adds r3, r3, #4
-
-LoopCopyDataInit:
-  adds r4, r0, r3
-  cmp r4, r1
-  bcc CopyDataInit
-
-/* Zero fill the bss segment. */
-  ldr r2, =_sbss
-  ldr r4, =_ebss
-  movs r3, #0
-  b LoopFillZerobss
-
-FillZerobss:
-  str  r3, [r2]
-  adds r2, r2, #4
-
-LoopFillZerobss:
-  cmp r2, r4
-  bcc FillZerobss
-
+  bl CopyWords
+
+/* Zero fill the bss segment, or wait for the DMA doing it */
+  ldr r0, =_sbss
+  ldr r1, =_ebss
+  cmp r9, #0
+  bne WaitDmaZerobss
+  bl ZeroWords
+  b BssDone
+
+WaitDmaZerobss:
+  ldr r2, =DMA2_LISR
+  ldr r3, [r2]
+  tst r3, #DMA_LISR_S0_DONE
+  beq WaitDmaZerobss
+  ldr r4, =DMA2_LIFCR
+  movs r5, #DMA_LIFCR_S0_ALL
+  str r5, [r4]
+  ldr r4, =RCC_AHB1ENR
+  str r8, [r4]           /* DMA2 clock back as it was */
+  tst r3, #(1 << 3)      /* TEIF0: zero it with the CPU */
+  it ne
+  blne ZeroWords
+
+BssDone:
 
 /* Call static constructors */
   bl __libc_init_array
@@ -103,6 +169,76 @@ LoopForever:
 
   .size Reset_Handler, .-Reset_Handler
 
+/* Copy words from r2 to r0 up to r1, 16 bytes per ldm/stm then the remaining words.
+   Clobbers r0-r6, r12 */
+  .section .text.CopyWords,"ax",%progbits
+  .type CopyWords, %function
+CopyWords:
+  subs r12, r1, r0
+  bic r12, r12, #15
+  add r12, r12, r0       /* end of the 16-byte blocks */
+  b LoopCopyBlock
+
+CopyBlock:
+  ldmia r2!, {r3-r6}
+  stmia r0!, {r3-r6}
+
+LoopCopyBlock:
+  cmp r0, r12
+  bcc CopyBlock
+  b LoopCopyWord
+
+CopyWord:
+  ldr r3, [r2], #4
+  str r3, [r0], #4
+
+LoopCopyWord:
+  cmp r0, r1
+  bcc CopyWord
+  bx lr
+
+  .size CopyWords, .-CopyWords
+
+/* Zero words from r0 up to r1, 16 bytes per stm then the remaining words.
+   Clobbers r0, r3-r6, r12 */
+  .section .text.ZeroWords,"ax",%progbits
+  .type ZeroWords, %function
+ZeroWords:
+  subs r12, r1, r0
+  bic r12, r12, #15
+  add r12, r12, r0
+  movs r3, #0
+  movs r4, #0
+  movs r5, #0
+  movs r6, #0
+  b LoopZeroBlock
+
+ZeroBlock:
+  stmia r0!, {r3-r6}
+
+LoopZeroBlock:
+  cmp r0, r12
+  bcc ZeroBlock
+  b LoopZeroWord
+
+ZeroWord:
+  str r3, [r0], #4
+
+LoopZeroWord:
+  cmp r0, r1
+  bcc ZeroWord
+  bx lr
+
+  .size ZeroWords, .-ZeroWords
+
+.if STARTUP_BSS_DMA_MIN
+/* source of the DMA zeroing, read from flash */
+  .section .rodata.ZeroWord,"a",%progbits
+  .align 2
+DmaZeroSource:
+  .word 0
+.endif
+
 /**
  * @brief  This is the code that gets called when the processor receives an
  *         unexpected interrupt.  This simply enters an infinite loop, preserving